@@ -0,0 +1,456 @@
+/*
+Benchmark driver for the storage engine. It is built from the same sources as main.c (all of them are
+included into one translation unit) but has no REPL: statements are filled in directly and run through
+execute_statement(), which dispatches to execute_insert() / execute_select() / execute_update() /
+execute_delete() and then ends the statement exactly like the REPL does (page release, WAL commit).
+
+    gcc -O2 -o bench bench.c -lm -pthread
+    ./bench [database file] [--rows N] [--ops N] [--workload a,b,...] [--read-pct P] [--zipf S] [--seed N]
+            [--readers N] [--reader-scans] [database options]
+
+The database file defaults to bench.db and is recreated, database options are the ones main.c takes
+(--frames, --mmap, --no-wal, --group-commit-ms, --checkpoint-kb, --fill, --scan-threads, --page-size,
+--no-page-checksums, --verify-pages, --no-packed-keys, --read-ahead, --writeback-ms, --direct-io,
+--hot-keys-kb).
+Workloads, all by default:
+    insert-seq   inserts ids 1..rows in order into an empty table
+    insert-rand  inserts ids 1..rows in random order into an empty table
+    lookup-rand  point selects on uniformly distributed ids
+    lookup-zipf  point selects on Zipf distributed ids (a few hot ids get most lookups)
+    scan         selects the whole table, one op is one full scan
+    count        select count(*) over the whole table, a parallel scan on --scan-threads threads
+    update-rand  updates on uniformly distributed ids
+    mixed        Zipf distributed ids, read-pct percent point selects and updates for the rest
+    delete-rand  deletes every id in random order, leaves the table empty
+Workloads that need rows load all of them first with random inserts, that load is not measured.
+With --readers N, N threads run point lookups on uniformly distributed ids through the reader cursor
+(reader_seek()) for as long as each workload runs, next to the workload on the main thread. With
+--reader-scans they run full table scans instead, each one reads a single snapshot of the table.
+
+One line is printed per workload: ops/sec, latency percentiles, pages read from and written to the
+database file while it ran and the tree height afterwards. Select output goes to /dev/null.
+*/
+#include "src/arena.c"
+#include "src/backup.c"
+#include "src/binary_protocol.c"
+#include "src/btree.c"
+#include "src/bulk_load.c"
+#include "src/constants.h"
+#include "src/crc32c.c"
+#include "src/cursor.c"
+#include "src/db.c"
+#include "src/header.c"
+#include "src/hot_keys.c"
+#include "src/index.c"
+#include "src/input.c"
+#include "src/internal_node.c"
+#include "src/leaf_node.c"
+#include "src/output.c"
+#include "src/pager.c"
+#include "src/parallel_scan.c"
+#include "src/prepared.c"
+#include "src/query_processing.c"
+#include "src/read_ahead.c"
+#include "src/server.c"
+#include "src/stats.c"
+#include "src/test.c"
+#include "src/transaction.c"
+#include "src/vacuum.c"
+#include "src/warm_cache.c"
+#include "src/wal.c"
+
+#include <math.h>
+
+#ifdef _WIN32
+#define BENCH_NULL_DEVICE "NUL"
+#else
+#define BENCH_NULL_DEVICE "/dev/null"
+#endif
+
+typedef struct
+{
+    const char *filename;
+    uint32_t rows;     // table size
+    uint32_t ops;      // operations per workload (scan: full scans = ops / rows, at least 1)
+    uint32_t read_pct; // mixed: share of selects
+    double zipf_s;     // Zipf exponent, 0.99 is the usual YCSB skew
+    uint64_t seed;
+    uint32_t readers;  // concurrent reader threads
+    bool reader_scans; // readers scan the whole table instead of looking up single ids
+} BenchOptions;
+
+typedef struct
+{
+    Table *table;
+    bool loaded;        // table holds ids 1..rows
+    uint64_t rng;       // xorshift64 state
+    uint32_t *shuffled; // random permutation of 1..rows
+    double *zipf_cdf;   // cumulative Zipf probabilities of ranks 0..rows-1
+    uint64_t *latency;  // nanoseconds per op of the running workload
+    FILE *report;       // the real stdout, stdout itself is sent to the null device
+    int readers_stop;   // set to end the reader threads of the running workload
+} Bench;
+
+typedef struct
+{
+    Bench *bench;
+    uint32_t rows;
+    bool scans;
+    uint64_t rng;
+    uint64_t ops;
+    pthread_t thread;
+} BenchReader;
+
+static uint64_t bench_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// xorshift64, the same sequence on every platform (rand() is only 15 bits on Windows)
+static uint64_t bench_random(Bench *bench)
+{
+    bench->rng ^= bench->rng << 13;
+    bench->rng ^= bench->rng >> 7;
+    bench->rng ^= bench->rng << 17;
+    return bench->rng;
+}
+
+// Uniformly distributed id in 1..rows
+static uint32_t bench_uniform_id(Bench *bench, BenchOptions *options)
+{
+    return (uint32_t)(bench_random(bench) % options->rows) + 1;
+}
+
+/*
+Zipf distributed id. A rank is drawn from the precomputed CDF, rank 0 being the most popular. Ranks are
+mapped through the shuffled ids so the hot ids are spread over the whole tree instead of sharing a leaf.
+*/
+static uint32_t bench_zipf_id(Bench *bench, BenchOptions *options)
+{
+    double u = (double)(bench_random(bench) >> 11) / (double)(1ull << 53);
+    uint32_t low = 0;
+    uint32_t high = options->rows - 1;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (bench->zipf_cdf[middle] < u)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return bench->shuffled[low];
+}
+
+static void *bench_reader(void *argument)
+{
+    BenchReader *reader = argument;
+    Table *table = reader->bench->table;
+    while (!__atomic_load_n(&reader->bench->readers_stop, __ATOMIC_RELAXED))
+    {
+        reader->rng ^= reader->rng << 13;
+        reader->rng ^= reader->rng >> 7;
+        reader->rng ^= reader->rng << 17;
+        uint32_t id = (uint32_t)(reader->rng % reader->rows) + 1;
+        Cursor *cursor = reader_seek(table, reader->scans ? 0 : id);
+        if (reader->scans)
+            reader_read_ahead(cursor, UINT32_MAX);
+        while (reader->scans && !cursor->end_of_table)
+            reader_advance(cursor);
+        reader_close(cursor);
+        reader->ops++;
+    }
+    return NULL;
+}
+
+static void bench_shuffle(Bench *bench, BenchOptions *options)
+{
+    for (uint32_t i = 0; i < options->rows; i++)
+        bench->shuffled[i] = i + 1;
+    for (uint32_t i = options->rows - 1; i > 0; i--)
+    {
+        uint32_t j = (uint32_t)(bench_random(bench) % (i + 1));
+        uint32_t tmp = bench->shuffled[i];
+        bench->shuffled[i] = bench->shuffled[j];
+        bench->shuffled[j] = tmp;
+    }
+}
+
+static void bench_statement(Statement *statement, StatementType type, uint32_t id)
+{
+    statement->type = type;
+    statement->row_to_insert.id = id;
+    snprintf(statement->row_to_insert.username, sizeof(statement->row_to_insert.username), "user%u", id);
+    snprintf(statement->row_to_insert.email, sizeof(statement->row_to_insert.email), "person%u@example.com", id);
+    statement->select_min_id = id;
+    statement->select_max_id = id;
+    statement->select_count = false;
+    statement->select_columns = SELECT_COLUMNS_ALL;
+    statement->select_like = false;
+    statement->column = INDEX_NONE;
+}
+
+// Runs one statement and records its latency
+static void bench_op(Bench *bench, Statement *statement, uint32_t op)
+{
+    uint64_t start = bench_now_ns();
+    execute_statement(statement, bench->table);
+    bench->latency[op] = bench_now_ns() - start;
+}
+
+// Closes the table (if open) and starts over with an empty database file
+static void bench_reset(Bench *bench, BenchOptions *options)
+{
+    if (bench->table != NULL)
+        db_close(bench->table);
+    char wal_filename[512];
+    snprintf(wal_filename, sizeof(wal_filename), "%s-wal", options->filename);
+    remove(options->filename);
+    remove(wal_filename);
+    bench->table = db_open(options->filename);
+    bench->loaded = false;
+}
+
+static void bench_ensure_loaded(Bench *bench, BenchOptions *options)
+{
+    if (bench->loaded)
+        return;
+    bench_reset(bench, options);
+    bench_shuffle(bench, options);
+    Statement statement;
+    for (uint32_t i = 0; i < options->rows; i++)
+    {
+        bench_statement(&statement, STATEMENT_INSERT, bench->shuffled[i]);
+        execute_statement(&statement, bench->table);
+    }
+    bench->loaded = true;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t latency_a = *(const uint64_t *)a;
+    uint64_t latency_b = *(const uint64_t *)b;
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+static double bench_percentile_us(uint64_t *sorted, uint32_t count, double percentile)
+{
+    uint32_t index = (uint32_t)(percentile / 100.0 * (count - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+// Runs one workload and prints its line of the report, returns false for an unknown name
+static bool bench_run(Bench *bench, BenchOptions *options, const char *name)
+{
+    bool insert_seq = strcmp(name, "insert-seq") == 0;
+    bool insert_rand = strcmp(name, "insert-rand") == 0;
+    bool scan = strcmp(name, "scan") == 0;
+    bool count = strcmp(name, "count") == 0;
+    bool delete_rand = strcmp(name, "delete-rand") == 0;
+    bool lookup_rand = strcmp(name, "lookup-rand") == 0;
+    bool lookup_zipf = strcmp(name, "lookup-zipf") == 0;
+    bool update_rand = strcmp(name, "update-rand") == 0;
+    bool mixed = strcmp(name, "mixed") == 0;
+    if (!(insert_seq || insert_rand || scan || count || delete_rand || lookup_rand || lookup_zipf || update_rand || mixed))
+        return false;
+
+    if (insert_seq || insert_rand)
+    {
+        bench_reset(bench, options);
+        bench_shuffle(bench, options);
+    }
+    else
+    {
+        bench_ensure_loaded(bench, options);
+        if (delete_rand)
+            bench_shuffle(bench, options);
+    }
+
+    uint32_t ops = options->ops;
+    if (insert_seq || insert_rand || delete_rand)
+        ops = options->rows;
+    else if (scan || count)
+        ops = options->ops / options->rows > 0 ? options->ops / options->rows : 1;
+
+    BenchReader *readers = calloc(options->readers + 1, sizeof(BenchReader));
+    bench->readers_stop = 0;
+    for (uint32_t i = 0; i < options->readers; i++)
+    {
+        readers[i].bench = bench;
+        readers[i].rows = options->rows;
+        readers[i].scans = options->reader_scans;
+        readers[i].rng = bench_random(bench) | 1;
+        if (pthread_create(&readers[i].thread, NULL, bench_reader, &readers[i]) != 0)
+        {
+            fprintf(bench->report, "Unable to start reader thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t pages_read = __atomic_load_n(&db_stats.pages_read, __ATOMIC_RELAXED);
+    uint64_t pages_written = __atomic_load_n(&db_stats.pages_written, __ATOMIC_RELAXED);
+    Statement statement;
+    uint64_t start = bench_now_ns();
+    for (uint32_t op = 0; op < ops; op++)
+    {
+        if (insert_seq)
+            bench_statement(&statement, STATEMENT_INSERT, op + 1);
+        else if (insert_rand)
+            bench_statement(&statement, STATEMENT_INSERT, bench->shuffled[op]);
+        else if (delete_rand)
+            bench_statement(&statement, STATEMENT_DELETE, bench->shuffled[op]);
+        else if (lookup_rand)
+            bench_statement(&statement, STATEMENT_SELECT, bench_uniform_id(bench, options));
+        else if (lookup_zipf)
+            bench_statement(&statement, STATEMENT_SELECT, bench_zipf_id(bench, options));
+        else if (update_rand)
+            bench_statement(&statement, STATEMENT_UPDATE, bench_uniform_id(bench, options));
+        else if (mixed)
+        {
+            bool read = bench_random(bench) % 100 < options->read_pct;
+            bench_statement(&statement, read ? STATEMENT_SELECT : STATEMENT_UPDATE, bench_zipf_id(bench, options));
+        }
+        else
+        {
+            bench_statement(&statement, STATEMENT_SELECT, 0);
+            statement.select_max_id = UINT32_MAX;
+            statement.select_count = count;
+        }
+        bench_op(bench, &statement, op);
+    }
+    double seconds = (bench_now_ns() - start) / 1e9;
+    __atomic_store_n(&bench->readers_stop, 1, __ATOMIC_RELAXED);
+    uint64_t reader_ops = 0;
+    for (uint32_t i = 0; i < options->readers; i++)
+    {
+        pthread_join(readers[i].thread, NULL);
+        reader_ops += readers[i].ops;
+    }
+    free(readers);
+    fflush(stdout);
+
+    if (insert_seq || insert_rand)
+        bench->loaded = true;
+    if (delete_rand)
+        bench->loaded = false;
+
+    qsort(bench->latency, ops, sizeof(uint64_t), compare_latency);
+    fprintf(bench->report, "%-12s %9u ops %12.0f ops/s  p50 %8.2f us  p99 %8.2f us  p999 %8.2f us  "
+                           "read %8llu  written %8llu  height %u",
+            name, ops, ops / seconds,
+            bench_percentile_us(bench->latency, ops, 50.0),
+            bench_percentile_us(bench->latency, ops, 99.0),
+            bench_percentile_us(bench->latency, ops, 99.9),
+            (unsigned long long)(__atomic_load_n(&db_stats.pages_read, __ATOMIC_RELAXED) - pages_read),
+            (unsigned long long)(__atomic_load_n(&db_stats.pages_written, __ATOMIC_RELAXED) - pages_written),
+            tree_height(bench->table));
+    if (options->readers > 0)
+        fprintf(bench->report, "  readers %u %12.0f %s/s", options->readers, reader_ops / seconds,
+                options->reader_scans ? "scans" : "lookups");
+    fprintf(bench->report, "\n");
+    fflush(bench->report);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options = {"bench.db", 100000, 100000, 90, 0.99, 1, 0, false};
+    const char *workloads = "insert-seq,insert-rand,lookup-rand,lookup-zipf,scan,count,update-rand,mixed,delete-rand";
+
+    for (int i = 1; i < argc;)
+    {
+        int consumed = parse_db_option(argc, argv, i);
+        if (consumed > 0)
+        {
+            i += consumed;
+            continue;
+        }
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--rows") == 0 && has_value)
+            options.rows = (uint32_t)atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--ops") == 0 && has_value)
+            options.ops = (uint32_t)atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--workload") == 0 && has_value)
+            workloads = argv[i + 1];
+        else if (strcmp(argv[i], "--read-pct") == 0 && has_value)
+            options.read_pct = (uint32_t)atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--zipf") == 0 && has_value)
+            options.zipf_s = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+            options.seed = (uint64_t)atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "--readers") == 0 && has_value)
+            options.readers = (uint32_t)atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--reader-scans") == 0)
+        {
+            options.reader_scans = true;
+            i++;
+            continue;
+        }
+        else if (i == 1 && argv[i][0] != '-')
+        {
+            options.filename = argv[i];
+            i++;
+            continue;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        i += 2;
+    }
+    if (options.rows == 0 || options.ops == 0)
+    {
+        printf("--rows and --ops must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Bench bench = {0};
+    bench.rng = options.seed * 2654435761u + 1; // xorshift must not start at 0
+    bench.shuffled = malloc(sizeof(uint32_t) * options.rows);
+    bench.zipf_cdf = malloc(sizeof(double) * options.rows);
+    uint32_t max_ops = options.ops > options.rows ? options.ops : options.rows;
+    bench.latency = malloc(sizeof(uint64_t) * max_ops);
+    bench_shuffle(&bench, &options);
+
+    double total = 0;
+    for (uint32_t i = 0; i < options.rows; i++)
+        total += 1.0 / pow(i + 1, options.zipf_s);
+    double sum = 0;
+    for (uint32_t i = 0; i < options.rows; i++)
+    {
+        sum += 1.0 / pow(i + 1, options.zipf_s);
+        bench.zipf_cdf[i] = sum / total;
+    }
+
+    // Selects print their rows, keep them out of the report
+    bench.report = fdopen(dup(fileno(stdout)), "w");
+    if (freopen(BENCH_NULL_DEVICE, "w", stdout) == NULL)
+    {
+        fprintf(bench.report, "Unable to open %s\n", BENCH_NULL_DEVICE);
+        exit(EXIT_FAILURE);
+    }
+    const char *io_mode = db_config.pager_mmap ? "mmap" : db_config.pager_direct ? "direct" : "read/write";
+    fprintf(bench.report, "rows %u, ops %u, frames %u, page size %u, %s, %s\n", options.rows, options.ops,
+            db_config.buffer_pool_frames, db_config.page_size, io_mode, db_config.wal_enabled ? "wal" : "no wal");
+
+    char *list = strdup(workloads);
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        if (!bench_run(&bench, &options, name))
+        {
+            fprintf(bench.report, "Unknown workload %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(list);
+
+    if (bench.table != NULL)
+        db_close(bench.table);
+    free(bench.shuffled);
+    free(bench.zipf_cdf);
+    free(bench.latency);
+    fclose(bench.report);
+    return 0;
+}
@@ -1,13 +1,31 @@
+#include "src/arena.c"
+#include "src/backup.c"
+#include "src/binary_protocol.c"
 #include "src/btree.c"
+#include "src/bulk_load.c"
 #include "src/constants.h"
+#include "src/crc32c.c"
 #include "src/cursor.c"
 #include "src/db.c"
+#include "src/header.c"
+#include "src/hot_keys.c"
+#include "src/index.c"
 #include "src/input.c"
 #include "src/internal_node.c" 
 #include "src/leaf_node.c" 
+#include "src/output.c"
 #include "src/pager.c" 
+#include "src/parallel_scan.c"
+#include "src/prepared.c"
 #include "src/query_processing.c" 
+#include "src/read_ahead.c"
+#include "src/server.c"
+#include "src/stats.c"
 #include "src/test.c"
+#include "src/transaction.c"
+#include "src/vacuum.c"
+#include "src/warm_cache.c"
+#include "src/wal.c"
 
 int main(int argc, char *argv[])
 {
@@ -18,6 +36,61 @@ int main(int argc, char *argv[])
     }
 
     char *filename = argv[1];
+    bool binary = false;
+    bool serve = false;
+    uint16_t serve_port = 0;
+    uint32_t serve_loops = 0; // one per online CPU
+    // Optional settings after the filename, e.g. program.exe test --frames 1000
+    for (int i = 2; i < argc;)
+    {
+        // --binary: read request frames from stdin instead of statements (see binary_protocol.c)
+        if (strcmp(argv[i], "--binary") == 0)
+        {
+            binary = true;
+            i++;
+            continue;
+        }
+        // --serve PORT: serve binary protocol clients over TCP instead (see server.c), --serve-loops N event loops
+        if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            serve = true;
+            serve_port = (uint16_t)atoi(argv[i + 1]);
+            i += 2;
+            continue;
+        }
+        if (strcmp(argv[i], "--serve-loops") == 0 && i + 1 < argc)
+        {
+            serve_loops = (uint32_t)atoi(argv[i + 1]);
+            i += 2;
+            continue;
+        }
+        int consumed = parse_db_option(argc, argv, i);
+        if (consumed == 0)
+        {
+            printf("Unknown option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        i += consumed;
+    }
+    if (binary)
+    {
+        // Responses own stdout, messages printed along the way (recovery, errors) go to stderr instead
+        int response_fd = dup(STDOUT_FILENO);
+        fflush(stdout);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        Table *table = db_open(filename);
+        serve_binary(table, STDIN_FILENO, response_fd);
+        db_close(table);
+        close(response_fd);
+        return 0;
+    }
+    if (serve)
+    {
+        Table *table = db_open(filename);
+        serve_network(table, serve_port, serve_loops);
+        db_close(table);
+        return 0;
+    }
     Table *table = db_open(filename);
 
     InputBuffer *input_buffer = new_input_buffer();
@@ -67,6 +140,18 @@ int main(int argc, char *argv[])
         case (EXECUTE_TABLE_FULL):
             printf("Error Table full.\n");
             break;
+        case (EXECUTE_NOT_FOUND):
+            printf("Row not found.\n");
+            break;
+        case (EXECUTE_TRANSACTION_OPEN):
+            printf("Error: A transaction is already open.\n");
+            break;
+        case (EXECUTE_NO_TRANSACTION):
+            printf("Error: No transaction is open.\n");
+            break;
+        case (EXECUTE_INDEX_EXISTS):
+            printf("Error: The column is already indexed.\n");
+            break;
         }
     }
     return 0;
@@ -0,0 +1,98 @@
+#include "constants.h"
+
+/*
+Scratch memory for the writer thread (Pager.scratch). A statement that splits a leaf copies the page, builds
+a cell list for it and may go on to split the parent, every one of those buffers lives only until the
+function that asked for it returns. They are bump allocated from a block and given back all at once:
+
+    ArenaMark mark = arena_mark(&pager->scratch);
+    void *copy = arena_alloc(&pager->scratch, PAGE_SIZE);
+    ...
+    arena_rewind(&pager->scratch, mark);
+
+Nested users (the parent split under the leaf split) rewind to their own, later mark first, so as long as
+every function rewinds before it returns the blocks are used like a stack. A request that does not fit the
+current block starts a new one, linked to the previous, rewinding past a block keeps it as the spare for
+the next one. Only the writer may use it, readers on other threads allocate on their own.
+*/
+
+// The first ARENA_ALIGNMENT aligned address after the block header.
+static char *arena_block_data(ArenaBlock *block)
+{
+    uintptr_t data = (uintptr_t)(block + 1);
+    return (char *)((data + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1));
+}
+
+// Makes a block with room for at least `size` bytes the current one.
+static void arena_push_block(Arena *arena, size_t size)
+{
+    ArenaBlock *block = arena->spare;
+    arena->spare = NULL;
+    if (block == NULL || block->capacity < size)
+    {
+        free(block);
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + ARENA_ALIGNMENT + capacity);
+        if (block == NULL)
+        {
+            printf("Out of memory for scratch space\n");
+            exit(EXIT_FAILURE);
+        }
+        block->capacity = capacity;
+    }
+    block->previous = arena->block;
+    arena->block = block;
+    arena->used = 0;
+}
+
+/**
+ * @brief Allocates `size` bytes of scratch memory, aligned to ARENA_ALIGNMENT.
+ *
+ * The memory stays valid until the arena is rewound to a mark taken before this call.
+ *
+ * @param arena The arena, Pager.scratch.
+ * @param size Number of bytes.
+ * @return Pointer to uninitialized memory, never NULL.
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (arena->block == NULL || arena->block->capacity - arena->used < size)
+        arena_push_block(arena, size);
+    void *memory = arena_block_data(arena->block) + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+// Remembers how much of the arena is in use, see arena_rewind().
+ArenaMark arena_mark(Arena *arena)
+{
+    ArenaMark mark = {arena->block, arena->used};
+    return mark;
+}
+
+// Gives back everything allocated since `mark` was taken.
+void arena_rewind(Arena *arena, ArenaMark mark)
+{
+    while (arena->block != mark.block)
+    {
+        ArenaBlock *block = arena->block;
+        arena->block = block->previous;
+        if (arena->spare == NULL || arena->spare->capacity < block->capacity)
+        {
+            free(arena->spare);
+            arena->spare = block;
+        }
+        else
+            free(block);
+    }
+    arena->used = mark.used;
+}
+
+// Frees every block, the arena is empty afterwards.
+void arena_free(Arena *arena)
+{
+    arena_rewind(arena, (ArenaMark){NULL, 0});
+    free(arena->spare);
+    arena->spare = NULL;
+}
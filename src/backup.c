@@ -0,0 +1,199 @@
+#include "constants.h"
+
+/*
+.backup PATH writes a copy of the database as it is right now to PATH, while the writer goes on.
+
+The command checkpoints first, so the database file holds every committed statement, and takes a snapshot
+right after (pager_open_shared_snapshot()), before the writer can change anything else. From then on the file
+only changes where the writer changes a page, and the first change to a page after the snapshot keeps its old
+contents as a version, the way it does for readers. A thread of its own then copies the file a run of
+BACKUP_RUN_PAGES pages at a time, in the kernel with copy_file_range() (sendfile() where that fails). After
+each run it asks the pager which pages of the run have changed since the snapshot and writes those again
+from the version the snapshot reads. A page copied before or while the writer changed it is patched that
+way, a page changed before it was copied is patched too, harmlessly. Platforms without either call read
+every page through the pager.
+
+The copy is a database file without a log, consistent as of the command. `.backup` without a path reports
+on the last one, db_close() waits for one still running.
+*/
+
+// Copies bytes [offset, offset + length) of the database file into the backup, returns how many it copied.
+static off_t backup_copy_range(Backup *backup, off_t offset, off_t length)
+{
+    off_t done = 0;
+#ifdef __linux__
+    int source = backup->pager->file_descriptor;
+    while (done < length)
+    {
+        loff_t in = offset + done, out = offset + done;
+        ssize_t copied = copy_file_range(source, &in, backup->file_descriptor, &out, length - done, 0);
+        if (copied == -1 && errno == EINTR)
+            continue;
+        if (copied <= 0)
+            break;
+        done += copied;
+    }
+    while (done < length)
+    {
+        // Older kernels do not copy between file systems, sendfile() does but writes at the file position
+        off_t in = offset + done;
+        if (lseek(backup->file_descriptor, offset + done, SEEK_SET) == -1)
+            break;
+        ssize_t copied = sendfile(backup->file_descriptor, source, &in, length - done);
+        if (copied == -1 && errno == EINTR)
+            continue;
+        if (copied <= 0)
+            break;
+        done += copied;
+    }
+#endif
+    return done;
+}
+
+static void backup_write_page(Backup *backup, uint32_t page_num, void *page)
+{
+    pager_copy_snapshot_page(backup->pager, page_num, &backup->snapshot, page);
+    if (pwrite(backup->file_descriptor, page, PAGE_SIZE, (off_t)page_num * PAGE_SIZE) != (ssize_t)PAGE_SIZE &&
+        backup->error == 0)
+        backup->error = errno != 0 ? errno : EIO;
+}
+
+static void *backup_main(void *argument)
+{
+    Backup *backup = argument;
+    Pager *pager = backup->pager;
+    uint64_t start_ns = stats_now_ns();
+    void *page = malloc(PAGE_SIZE);
+    for (uint32_t first = 0; first < backup->num_pages && backup->error == 0; first += BACKUP_RUN_PAGES)
+    {
+        uint32_t run = backup->num_pages - first < BACKUP_RUN_PAGES ? backup->num_pages - first : BACKUP_RUN_PAGES;
+        off_t copied = backup_copy_range(backup, (off_t)first * PAGE_SIZE, (off_t)run * PAGE_SIZE);
+        for (uint32_t i = 0; i < run; i++)
+        {
+            uint32_t page_num = first + i;
+            // Pages the kernel did not copy completely and pages the writer changed come from the pager
+            if ((off_t)(i + 1) * PAGE_SIZE > copied || pager_page_changed(pager, page_num, &backup->snapshot))
+            {
+                backup_write_page(backup, page_num, page);
+                backup->pages_patched++;
+            }
+        }
+        __atomic_store_n(&backup->pages_done, first + run, __ATOMIC_RELEASE);
+    }
+    free(page);
+    if (backup->error == 0 && fdatasync(backup->file_descriptor) == -1)
+        backup->error = errno;
+    close(backup->file_descriptor);
+    pager_close_snapshot(pager, &backup->snapshot);
+    backup->elapsed_ns = stats_now_ns() - start_ns;
+    __atomic_store_n(&backup->finished, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void backup_report(Backup *backup)
+{
+    if (!__atomic_load_n(&backup->finished, __ATOMIC_ACQUIRE))
+        printf("Backup to %s: %u of %u pages copied.\n", backup->path,
+               __atomic_load_n(&backup->pages_done, __ATOMIC_ACQUIRE), backup->num_pages);
+    else if (backup->error != 0)
+        printf("Backup to %s failed: %s\n", backup->path, strerror(backup->error));
+    else
+        printf("Backup to %s finished: %u pages in %.1f ms, %u from the pager.\n", backup->path, backup->num_pages,
+               backup->elapsed_ns / 1e6, backup->pages_patched);
+}
+
+// Waits for the last backup to finish and frees it, called by db_close() and before a new backup starts.
+void backup_wait(Table *table)
+{
+    Backup *backup = table->backup;
+    if (backup == NULL)
+        return;
+    pthread_join(backup->thread, NULL);
+    free(backup->path);
+    free(backup);
+    table->backup = NULL;
+}
+
+// Whether a backup is still copying. .vacuum refuses to run meanwhile, cutting the file back would take pages from under the copy.
+bool backup_running(Table *table)
+{
+    return table->backup != NULL && !__atomic_load_n(&table->backup->finished, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Implements the `.backup` meta command.
+ *
+ *     .backup          reports on the last backup
+ *     .backup PATH     starts copying the database to PATH and returns, see above
+ *
+ * @param table The table to back up.
+ * @param argument Text after ".backup ", empty for the plain command.
+ *
+ * @return META_COMMAND_SUCCESS, errors are reported on stdout.
+ */
+MetaCommandResult backup_command(Table *table, const char *argument)
+{
+    Pager *pager = table->pager;
+    if (strcmp(argument, "") == 0)
+    {
+        if (table->backup == NULL)
+            printf("No backup has run.\n");
+        else
+            backup_report(table->backup);
+        return META_COMMAND_SUCCESS;
+    }
+    if (backup_running(table))
+    {
+        printf("A backup is already running.\n");
+        return META_COMMAND_SUCCESS;
+    }
+    if (pager->in_transaction)
+    {
+        printf("Backup can not run inside a transaction.\n");
+        return META_COMMAND_SUCCESS;
+    }
+    int file_descriptor = open(argument, O_WRONLY | O_CREAT | O_BINARY, S_IWUSR | S_IRUSR);
+    if (file_descriptor == -1)
+    {
+        printf("Unable to open %s\n", argument);
+        return META_COMMAND_SUCCESS;
+    }
+    // Truncated only once it is known not to be the database itself
+    struct stat target, database;
+    if (fstat(file_descriptor, &target) == 0 && fstat(pager->file_descriptor, &database) == 0 &&
+        target.st_dev == database.st_dev && target.st_ino == database.st_ino)
+    {
+        close(file_descriptor);
+        printf("Can not back up to the database file itself.\n");
+        return META_COMMAND_SUCCESS;
+    }
+    if (ftruncate(file_descriptor, 0) == -1)
+    {
+        close(file_descriptor);
+        printf("Unable to open %s\n", argument);
+        return META_COMMAND_SUCCESS;
+    }
+    backup_wait(table);
+
+    if (pager->wal != NULL)
+    {
+        wal_commit(pager);
+        wal_checkpoint(pager);
+    }
+    else
+        pager_flush_dirty(pager);
+    Backup *backup = calloc(1, sizeof(Backup));
+    backup->pager = pager;
+    backup->file_descriptor = file_descriptor;
+    backup->path = strdup(argument);
+    backup->num_pages = pager->num_pages;
+    pager_open_shared_snapshot(pager, &backup->snapshot);
+    if (pthread_create(&backup->thread, NULL, backup_main, backup) != 0)
+    {
+        printf("Unable to start the backup thread\n");
+        exit(EXIT_FAILURE);
+    }
+    table->backup = backup;
+    printf("Backup of %u pages to %s started.\n", backup->num_pages, backup->path);
+    return META_COMMAND_SUCCESS;
+}
@@ -0,0 +1,251 @@
+#include "constants.h"
+
+/*
+The binary batch protocol, frame layout in constants.h. Rows arrive in their serialized form and are
+packed from the request buffer straight into the leaf cells, a select writes the cells straight back into
+the response in that form. Nothing is tokenized on the way.
+*/
+
+// Reads exactly size bytes, false when the input ends first (a clean end only before a frame).
+static bool binary_read_full(int fd, void *buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t bytes = read(fd, (char *)buffer + done, size - done);
+        if (bytes == 0)
+            return false;
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("Error reading binary request: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        done += bytes;
+    }
+    return true;
+}
+
+static void binary_write_full(int fd, const void *buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t bytes = write(fd, (const char *)buffer + done, size - done);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("Error writing binary response: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        done += bytes;
+    }
+}
+
+// Makes room for `extra` more bytes after response->size.
+void binary_response_reserve(BinaryResponse *response, uint32_t extra)
+{
+    if (response->size + extra <= response->capacity)
+        return;
+    while (response->size + extra > response->capacity)
+        response->capacity *= 2;
+    response->data = realloc(response->data, response->capacity);
+    if (response->data == NULL)
+    {
+        printf("Out of memory for binary response\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Fills in length and status of the response frame that starts at `start`, dropping its data on an error.
+static void binary_response_finish(BinaryResponse *response, uint32_t start, uint8_t status)
+{
+    if (status != BINARY_STATUS_OK)
+        response->size = start + sizeof(uint32_t) + sizeof(uint8_t);
+    uint32_t length = response->size - start - sizeof(uint32_t);
+    memcpy(response->data + start, &length, sizeof(uint32_t));
+    response->data[start + sizeof(uint32_t)] = status;
+}
+
+// Both strings of a serialized row must end inside their column, the leaf cell takes them up to the NUL
+static bool binary_row_is_valid(const char *row)
+{
+    return memchr(row + USERNAME_OFFSET, '\0', USERNAME_SIZE) != NULL &&
+           memchr(row + EMAIL_OFFSET, '\0', EMAIL_SIZE) != NULL;
+}
+
+static uint8_t binary_execute_rows(Table *table, uint8_t opcode, const char *payload, uint32_t size,
+                                   BinaryResponse *response)
+{
+    if (size % ROW_SIZE != 0)
+        return BINARY_STATUS_BAD_REQUEST;
+    uint32_t num_rows = size / ROW_SIZE;
+    for (uint32_t i = 0; i < num_rows; i++)
+        if (!binary_row_is_valid(payload + i * ROW_SIZE))
+            return BINARY_STATUS_BAD_REQUEST;
+
+    binary_response_reserve(response, num_rows);
+    for (uint32_t i = 0; i < num_rows; i++)
+    {
+        const char *row = payload + i * ROW_SIZE;
+        ExecuteResult result = opcode == BINARY_OP_INSERT ? execute_insert_row(table, row) : execute_update_row(table, row);
+        response->data[response->size++] = (uint8_t)result;
+        pager_release_pages(table->pager);
+    }
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t binary_execute_deletes(Table *table, const char *payload, uint32_t size, BinaryResponse *response)
+{
+    if (size % sizeof(uint32_t) != 0)
+        return BINARY_STATUS_BAD_REQUEST;
+    uint32_t num_ids = size / sizeof(uint32_t);
+    binary_response_reserve(response, num_ids);
+    for (uint32_t i = 0; i < num_ids; i++)
+    {
+        uint32_t id;
+        memcpy(&id, payload + i * sizeof(uint32_t), sizeof(uint32_t));
+        response->data[response->size++] = (uint8_t)execute_delete_key(table, id);
+        pager_release_pages(table->pager);
+    }
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t binary_execute_select(Table *table, const char *payload, uint32_t size, BinaryResponse *response)
+{
+    if (size != 2 * sizeof(uint32_t))
+        return BINARY_STATUS_BAD_REQUEST;
+    uint32_t min_id, max_id;
+    memcpy(&min_id, payload, sizeof(uint32_t));
+    memcpy(&max_id, payload + sizeof(uint32_t), sizeof(uint32_t));
+    if (min_id > max_id)
+        return BINARY_STATUS_OK;
+
+    pager_advise(table->pager, PAGER_ACCESS_SEQUENTIAL);
+    Cursor *cursor = reader_seek(table, min_id);
+    reader_read_ahead(cursor, max_id);
+    RowView row;
+    while (!(cursor->end_of_table))
+    {
+        if (reader_key(cursor) > max_id)
+            break;
+        binary_response_reserve(response, ROW_SIZE);
+        reader_row(cursor, &row);
+        serialize_row_view(&row, response->data + response->size);
+        response->size += ROW_SIZE;
+        reader_advance(cursor);
+    }
+    reader_close(cursor);
+    pager_advise(table->pager, PAGER_ACCESS_RANDOM);
+    return BINARY_STATUS_OK;
+}
+
+// Whether a request changes the table, those may only be executed on the writer thread.
+bool binary_request_writes(uint8_t opcode)
+{
+    return opcode == BINARY_OP_INSERT || opcode == BINARY_OP_UPDATE || opcode == BINARY_OP_DELETE;
+}
+
+/**
+ * @brief Executes one request frame and appends its response frame to `response`.
+ *
+ * A request that writes (binary_request_writes()) is one unit of durability: its records go through the
+ * same code as single statements but are committed to the write-ahead log once, after the last record, and
+ * it must run on the writer thread. Each row releases its pages like a statement, which keeps the latches
+ * and frames the request holds to one row's worth, so readers see the rows one at a time, not the frame at
+ * once. A select reads through a reader cursor and may run on any thread. The latency histograms count
+ * one statement per request.
+ *
+ * @param table The open table.
+ * @param request The frame without its length: opcode and payload.
+ * @param length Length of the frame, at least 1.
+ * @param response The response frame is appended after response->size.
+ */
+void binary_execute(Table *table, const char *request, uint32_t length, BinaryResponse *response)
+{
+    uint64_t start_ns = stats_now_ns();
+    uint8_t opcode = (uint8_t)request[0];
+    const char *payload = request + 1;
+    uint32_t payload_size = length - 1;
+    uint32_t start = response->size;
+    binary_response_reserve(response, sizeof(uint32_t) + sizeof(uint8_t));
+    response->size += sizeof(uint32_t) + sizeof(uint8_t);
+    uint8_t status = BINARY_STATUS_BAD_REQUEST;
+    StatementType type = STATEMENT_SELECT;
+    if (opcode == BINARY_OP_INSERT || opcode == BINARY_OP_UPDATE)
+    {
+        status = binary_execute_rows(table, opcode, payload, payload_size, response);
+        type = opcode == BINARY_OP_INSERT ? STATEMENT_INSERT : STATEMENT_UPDATE;
+    }
+    else if (opcode == BINARY_OP_DELETE)
+    {
+        status = binary_execute_deletes(table, payload, payload_size, response);
+        type = STATEMENT_DELETE;
+    }
+    else if (opcode == BINARY_OP_SELECT)
+        status = binary_execute_select(table, payload, payload_size, response);
+
+    if (binary_request_writes(opcode))
+    {
+        pager_release_pages(table->pager);
+        wal_commit(table->pager);
+    }
+    if (status == BINARY_STATUS_OK)
+        stats_record_latency(type, stats_now_ns() - start_ns);
+    binary_response_finish(response, start, status);
+}
+
+/**
+ * @brief Serves binary request frames until the input ends.
+ *
+ * Requests are executed one after the other with binary_execute(), on the writer thread.
+ *
+ * @param table The open table.
+ * @param in_fd Where requests are read from (stdin).
+ * @param out_fd Where responses are written to.
+ */
+void serve_binary(Table *table, int in_fd, int out_fd)
+{
+    uint32_t request_capacity = 64 * 1024;
+    char *request = malloc(request_capacity);
+    BinaryResponse response = {malloc(request_capacity), 0, request_capacity};
+    if (request == NULL || response.data == NULL)
+    {
+        printf("Out of memory for binary requests\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t length;
+    while (binary_read_full(in_fd, &length, sizeof(length)))
+    {
+        if (length == 0 || length > BINARY_MAX_FRAME)
+        {
+            printf("Binary request of %u bytes, at most %u allowed\n", length, BINARY_MAX_FRAME);
+            exit(EXIT_FAILURE);
+        }
+        if (length > request_capacity)
+        {
+            while (length > request_capacity)
+                request_capacity *= 2;
+            request = realloc(request, request_capacity);
+            if (request == NULL)
+            {
+                printf("Out of memory for binary requests\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (!binary_read_full(in_fd, request, length))
+        {
+            printf("Binary request cut short\n");
+            exit(EXIT_FAILURE);
+        }
+
+        response.size = 0;
+        binary_execute(table, request, length, &response);
+        binary_write_full(out_fd, response.data, response.size);
+    }
+    free(request);
+    free(response.data);
+}
@@ -15,6 +15,7 @@
 NodeType get_node_type(void *node)
 {
     uint8_t value = *((uint8_t *)node + NODE_TYPE_OFFSET); // this fetch 0-1 byte from metadata in leaf node(aka page).
+    value &= (uint8_t)~LEAF_NODE_PACKED_FLAG;              // the high bit marks a packed leaf, see leaf_node.c
     return (NodeType)value;                                // Cast the extracted value to the NodeType enumeration and return it
 }
 
@@ -123,7 +124,7 @@ uint32_t get_node_max_key(Pager *pager, void *node)
 {
     if (get_node_type(node) == LEAF_NODE)
     {
-        return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
+        return leaf_node_key(node, *leaf_node_num_cells(node) - 1);
     }
     void *right_child = get_page(pager, *internal_node_right_child(node));
     return get_node_max_key(pager, right_child);
@@ -160,6 +161,7 @@ Cursor *find_table(Table *table, uint32_t key)
 
 void create_new_root(Table *table, uint32_t right_child_page_num)
 {
+    db_stats.root_promotions++;
     void *root = get_page(table->pager, table->root_page_num);
     void *root_right_child = get_page(table->pager, right_child_page_num);
     uint32_t left_child_page_num = get_unused_page_num(table->pager);
@@ -171,12 +173,6 @@ void create_new_root(Table *table, uint32_t right_child_page_num)
         initialize_internal_node(left_child);
     }
 
-    // Ensure left_child's metadata is correctly set after memcpy
-    if (get_node_type(left_child) == LEAF_NODE)
-    {
-        *leaf_node_num_cells(left_child) = LEAF_NODE_LEFT_SPLIT_COUNT;
-    }
-
     // Left child has data copied from old root
     memcpy(left_child, root, PAGE_SIZE);
     set_node_root(left_child, false);
@@ -188,7 +184,11 @@ void create_new_root(Table *table, uint32_t right_child_page_num)
         {
             child = get_page(table->pager, *internal_node_child(left_child, i));
             *node_parent(child) = left_child_page_num;
+            pager_mark_dirty(table->pager, *internal_node_child(left_child, i));
         }
+        child = get_page(table->pager, *internal_node_right_child(left_child));
+        *node_parent(child) = left_child_page_num;
+        pager_mark_dirty(table->pager, *internal_node_right_child(left_child));
     }
 
     // Root node is a new internal node with one key and two children
@@ -201,4 +201,158 @@ void create_new_root(Table *table, uint32_t right_child_page_num)
     *internal_node_right_child(root) = right_child_page_num;
     *node_parent(left_child) = table->root_page_num;
     *node_parent(root_right_child) = table->root_page_num;
+    pager_mark_dirty(table->pager, table->root_page_num);
+    pager_mark_dirty(table->pager, left_child_page_num);
+    pager_mark_dirty(table->pager, right_child_page_num);
+}
+
+/**
+ * @brief Append fast path: positions a cursor after the last row without descending the tree.
+ *
+ * Most ids arrive in increasing order, so the insert position is usually the end
+ * of the right-most leaf. The table remembers that leaf (remember_rightmost_leaf()),
+ * and when the new key is larger than everything in it the root-to-leaf descent is
+ * skipped. The remembered page is validated before use: only the right-most leaf
+ * of the tree is a leaf with next_leaf == 0, so a page that was split or merged
+ * away since then is detected and the caller falls back to find_table(). A freed
+ * page can come back as a leaf of an index tree that passes the same checks, so
+ * the leaf is forgotten once the page epoch moves on (pager_new_page_epoch()).
+ *
+ * @param table A pointer to the table.
+ * @param key The key about to be inserted.
+ *
+ * @return A cursor one past the last cell of the right-most leaf, or NULL if the
+ *         fast path does not apply.
+ */
+Cursor *find_append_position(Table *table, uint32_t key)
+{
+    uint32_t page_num = table->rightmost_leaf_page_num;
+    if (page_num == 0 || key <= table->rightmost_max_key)
+        return NULL;
+    if (table->rightmost_epoch != table->pager->page_epoch)
+    {
+        table->rightmost_leaf_page_num = 0;
+        return NULL;
+    }
+
+    void *node = get_page(table->pager, page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (get_node_type(node) != LEAF_NODE || *leaf_node_next_leaf(node) != 0 || num_cells == 0 ||
+        leaf_node_key(node, num_cells - 1) >= key)
+    {
+        table->rightmost_leaf_page_num = 0;
+        return NULL;
+    }
+
+    Cursor *cursor = cursor_open(table, page_num);
+    cursor->cell_num = num_cells;
+    return cursor;
+}
+
+/**
+ * @brief Remembers the right-most leaf after an insert into `leaf_page_num`.
+ *
+ * Either the leaf itself is the right-most one, or it was the right-most one and
+ * has just been split, in which case its new next leaf is. Anything else leaves
+ * the remembered leaf as it is. Only called for keys above the remembered maximum,
+ * the only ones that can change it.
+ *
+ * @param table A pointer to the table.
+ * @param leaf_page_num The leaf an insert just went into.
+ */
+void remember_rightmost_leaf(Table *table, uint32_t leaf_page_num)
+{
+    void *node = get_page(table->pager, leaf_page_num);
+    if (get_node_type(node) != LEAF_NODE)
+        return; // a root leaf that split is an internal node now, the next insert finds the leaf
+    uint32_t next_page_num = *leaf_node_next_leaf(node);
+    if (next_page_num != 0)
+    {
+        void *next = get_page(table->pager, next_page_num);
+        if (*leaf_node_next_leaf(next) != 0)
+            return;
+        leaf_page_num = next_page_num;
+        node = next;
+    }
+    table->rightmost_leaf_page_num = leaf_page_num;
+    table->rightmost_max_key = leaf_node_key(node, *leaf_node_num_cells(node) - 1);
+    table->rightmost_epoch = table->pager->page_epoch;
+}
+
+/**
+ * @brief Counts the levels of the tree, a table whose root is a leaf has height 1.
+ *
+ * Every leaf is at the same depth, so following the first child down is enough.
+ *
+ * @param table A pointer to the table.
+ *
+ * @return Number of nodes on any path from the root to a leaf.
+ */
+uint32_t tree_height(Table *table)
+{
+    uint32_t height = 1;
+    void *node = get_page(table->pager, table->root_page_num);
+    while (get_node_type(node) == INTERNAL_NODE)
+    {
+        node = get_page(table->pager, *internal_node_child(node, 0));
+        height++;
+    }
+    pager_release_pages(table->pager);
+    return height;
+}
+
+/**
+ * @brief Shrinks the tree by one level when the root is left with a single child.
+ *
+ * The root keeps its page (table->root_page_num never changes), so its only child is
+ * copied into the root page, the child's children are pointed at the root and the
+ * child's page is freed. This is the reverse of create_new_root().
+ *
+ * @param table A pointer to the table whose root has no keys left.
+ */
+void collapse_root(Table *table)
+{
+    Pager *pager = table->pager;
+    void *root = get_page(pager, table->root_page_num);
+    uint32_t child_page_num = *internal_node_right_child(root);
+    void *child = get_page(pager, child_page_num);
+
+    memcpy(root, child, PAGE_SIZE);
+    set_node_root(root, true);
+    *node_parent(root) = 0;
+    if (get_node_type(root) == INTERNAL_NODE)
+    {
+        for (uint32_t i = 0; i <= *internal_node_num_keys(root); i++)
+        {
+            uint32_t grand_child_page_num = *internal_node_child(root, i);
+            void *grand_child = get_page(pager, grand_child_page_num);
+            *node_parent(grand_child) = table->root_page_num;
+            pager_mark_dirty(pager, grand_child_page_num);
+        }
+    }
+    pager_mark_dirty(pager, table->root_page_num);
+    free_page(pager, child_page_num);
+}
+
+/**
+ * @brief Checks an internal node after a merge below it removed one of its keys.
+ *
+ * A root without keys is collapsed, a non-root node below INTERNAL_NODE_MIN_CELL keys
+ * is rebalanced (which may remove a key from its own parent and come back here).
+ *
+ * @param table A pointer to the table containing the B-tree.
+ * @param page_num Page number of the internal node that lost a key.
+ */
+void node_after_remove(Table *table, uint32_t page_num)
+{
+    void *node = get_page(table->pager, page_num);
+    if (is_root_node(node))
+    {
+        if (*internal_node_num_keys(node) == 0)
+            collapse_root(table);
+    }
+    else if (*internal_node_num_keys(node) < INTERNAL_NODE_MIN_CELL)
+    {
+        internal_node_rebalance(table, page_num);
+    }
 }
@@ -0,0 +1,385 @@
+#include "constants.h"
+
+static int compare_rows_by_id(const void *a, const void *b)
+{
+    uint32_t id_a = ((const Row *)a)->id;
+    uint32_t id_b = ((const Row *)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/*
+Ends the operation after a node has been written. Every BULK_LOAD_COMMIT_PAGES pages the write-ahead log
+gets a commit so its buffer stays small. The root page is written last, so a crash in the middle of a load
+leaves the table as it was before (the pages written so far are simply unreachable).
+*/
+static void bulk_load_page_done(Pager *pager, uint32_t *pages_written)
+{
+    pager_release_pages(pager);
+    (*pages_written)++;
+    if (*pages_written % BULK_LOAD_COMMIT_PAGES == 0)
+        wal_commit(pager);
+}
+
+/*
+Adds the rows of a batch to the indexes of the table, before the rows themselves are loaded. A crash in
+between leaves entries for rows that do not exist, which lookups skip (they compare the rows), where the
+other order would leave rows an index lookup misses.
+*/
+static void bulk_load_index(Table *table, Row *rows, uint32_t num_rows)
+{
+    uint32_t rows_indexed = 0;
+    char serialized[sizeof(Row)];
+    RowView view;
+    for (uint32_t i = 0; i < num_rows; i++)
+    {
+        serialize_row(&rows[i], serialized);
+        deserialize_row_view(serialized, &view);
+        pager_latch_tree(table->pager);
+        index_add_row(table, &view);
+        bulk_load_page_done(table->pager, &rows_indexed);
+    }
+}
+
+/*
+Picks the pages for one level of the tree. A level with a single node is the top of the tree and goes to
+the root page, which never moves. Pages come from get_unused_page_num() so the freelist is used first.
+*/
+static void bulk_load_allocate(Table *table, uint32_t *pages, uint32_t num_nodes)
+{
+    for (uint32_t i = 0; i < num_nodes; i++)
+    {
+        if (num_nodes == 1)
+        {
+            pages[i] = table->root_page_num;
+            break;
+        }
+        pages[i] = get_unused_page_num(table->pager);
+        get_page(table->pager, pages[i]); // reserves the page, the next call must not return it again
+    }
+    pager_release_pages(table->pager);
+}
+
+/*
+Number of nodes needed for `items` entries when a node takes at most `capacity` of them. When the entries
+are spread evenly no node may end up with fewer than `minimum`, the fill the delete path maintains.
+*/
+static uint32_t bulk_load_node_count(uint64_t items, uint32_t capacity, uint32_t minimum)
+{
+    uint32_t num_nodes = (uint32_t)((items + capacity - 1) / capacity);
+    while (num_nodes > 1 && items / num_nodes < minimum)
+        num_nodes--;
+    return num_nodes;
+}
+
+// db_config.bulk_load_fill within [BULK_LOAD_MIN_FILL, 100].
+static uint32_t bulk_load_fill(void)
+{
+    uint32_t fill = db_config.bulk_load_fill;
+    if (fill < BULK_LOAD_MIN_FILL)
+        fill = BULK_LOAD_MIN_FILL;
+    if (fill > 100)
+        fill = 100;
+    return fill;
+}
+
+/**
+ * @brief Bytes of LEAF_NODE_SPACE_FOR_CELL a leaf is filled to, the fill percent of them.
+ *
+ * Shared by the bulk load and .vacuum (see vacuum.c). A leaf always takes at least one cell of
+ * the largest size.
+ */
+uint32_t bulk_load_leaf_capacity(void)
+{
+    uint32_t leaf_capacity = LEAF_NODE_SPACE_FOR_CELL * bulk_load_fill() / 100;
+    if (leaf_capacity < LEAF_NODE_MAX_CELL_SPACE)
+        leaf_capacity = LEAF_NODE_MAX_CELL_SPACE;
+    return leaf_capacity;
+}
+
+/*
+Builds the tree bottom-up into the (empty) table. Entries are spread evenly over the nodes of a level, so
+no node ends up much emptier than the others. `pages`/`max_keys` describe the level below while the next
+one is built.
+*/
+static void bulk_load_build(Table *table, Row *rows, uint32_t num_rows)
+{
+    Pager *pager = table->pager;
+    uint32_t pages_written = 0;
+
+    // Leaf level, planned by bytes since cells vary in size
+    uint32_t *payload_sizes = malloc(sizeof(uint32_t) * num_rows);
+    uint64_t total_payload = 0;
+    for (uint32_t row = 0; row < num_rows; row++)
+    {
+        payload_sizes[row] = 1 + strnlen(rows[row].username, COLUMN_USERNAME_SIZE) + strnlen(rows[row].email, COLUMN_EMAIL_SIZE);
+        total_payload += payload_sizes[row];
+    }
+    uint32_t leaf_capacity = bulk_load_leaf_capacity();
+    /*
+    The slots are counted packed when the ids are dense enough that a leaf's worth of them spans less than
+    the delta range, the actual layout of each leaf is checked below.
+    */
+    uint32_t slot_size = LEAF_NODE_SLOT_SIZE;
+    uint64_t rows_per_leaf = leaf_capacity / (LEAF_NODE_PACKED_SLOT_SIZE + total_payload / num_rows);
+    uint64_t id_span = rows[num_rows - 1].id - rows[0].id;
+    if (db_config.packed_keys && id_span / num_rows * rows_per_leaf <= LEAF_NODE_PACKED_MAX_DELTA)
+        slot_size = LEAF_NODE_PACKED_SLOT_SIZE;
+    uint64_t total_bytes = total_payload + (uint64_t)num_rows * slot_size;
+    uint32_t planned = bulk_load_node_count(total_bytes, leaf_capacity, LEAF_NODE_MIN_FILL);
+
+    /*
+    Each leaf takes the rows up to its share of the bytes. Rounding at the cell boundaries can leave the
+    last leaf with more than a page holds, then the rest goes to extra leaves.
+    */
+    uint32_t num_nodes = 0;
+    uint32_t *leaf_cells = malloc(sizeof(uint32_t) * num_rows);
+    uint64_t assigned = 0;
+    for (uint32_t row = 0; row < num_rows; num_nodes++)
+    {
+        uint64_t target = num_nodes + 1 < planned ? total_bytes * (num_nodes + 1) / planned : total_bytes;
+        uint32_t first = row;
+        uint32_t leaf_payload = 0;
+        uint32_t num_cells = 0;
+        while (row < num_rows &&
+               leaf_node_space_for(num_cells + 1, leaf_payload + payload_sizes[row], rows[first].id, rows[row].id) <=
+                   LEAF_NODE_SPACE_FOR_CELL &&
+               (num_cells == 0 || assigned + slot_size + payload_sizes[row] <= target))
+        {
+            leaf_payload += payload_sizes[row];
+            assigned += slot_size + payload_sizes[row++];
+            num_cells++;
+        }
+        leaf_cells[num_nodes] = num_cells;
+    }
+    free(payload_sizes);
+
+    uint32_t *pages = malloc(sizeof(uint32_t) * num_nodes);
+    uint32_t *max_keys = malloc(sizeof(uint32_t) * num_nodes);
+    bulk_load_allocate(table, pages, num_nodes);
+
+    uint32_t row = 0;
+    for (uint32_t i = 0; i < num_nodes; i++)
+    {
+        void *node = get_page(pager, pages[i]);
+        initialize_leaf_node(node);
+        leaf_node_fill_rows(pager, node, rows + row, leaf_cells[i]);
+        row += leaf_cells[i];
+        *leaf_node_next_leaf(node) = i + 1 < num_nodes ? pages[i + 1] : 0;
+        max_keys[i] = rows[row - 1].id;
+        pager_mark_dirty(pager, pages[i]);
+        bulk_load_page_done(pager, &pages_written);
+    }
+    free(leaf_cells);
+
+    // Internal levels, until a level fits in one node
+    uint32_t child_capacity = (INTERNAL_NODE_MAX_CELL + 1) * bulk_load_fill() / 100;
+    if (child_capacity < 2)
+        child_capacity = 2;
+    while (num_nodes > 1)
+    {
+        uint32_t num_children = num_nodes;
+        uint32_t *children = pages;
+        uint32_t *child_max_keys = max_keys;
+        num_nodes = bulk_load_node_count(num_children, child_capacity, INTERNAL_NODE_MIN_CELL + 1);
+        pages = malloc(sizeof(uint32_t) * num_nodes);
+        max_keys = malloc(sizeof(uint32_t) * num_nodes);
+        bulk_load_allocate(table, pages, num_nodes);
+
+        uint32_t child = 0;
+        for (uint32_t i = 0; i < num_nodes; i++)
+        {
+            uint32_t node_children = num_children / num_nodes + (i < num_children % num_nodes);
+            void *node = get_page(pager, pages[i]);
+            initialize_internal_node(node);
+            *internal_node_num_keys(node) = node_children - 1;
+            for (uint32_t j = 0; j + 1 < node_children; j++)
+            {
+                internal_node_children(node)[j] = children[child + j];
+                *internal_node_key(node, j) = child_max_keys[child + j];
+            }
+            *internal_node_right_child(node) = children[child + node_children - 1];
+            max_keys[i] = child_max_keys[child + node_children - 1];
+            pager_mark_dirty(pager, pages[i]);
+
+            for (uint32_t j = 0; j < node_children; j++)
+            {
+                void *child_node = get_page(pager, children[child + j]);
+                *node_parent(child_node) = pages[i];
+                pager_mark_dirty(pager, children[child + j]);
+            }
+            child += node_children;
+            bulk_load_page_done(pager, &pages_written);
+        }
+        free(children);
+        free(child_max_keys);
+    }
+
+    // The single node of the last level was written to the root page
+    void *root = get_page(pager, table->root_page_num);
+    set_node_root(root, true);
+    *node_parent(root) = 0;
+    pager_mark_dirty(pager, table->root_page_num);
+    free(pages);
+    free(max_keys);
+}
+
+/**
+ * @brief Loads a batch of rows into a table.
+ *
+ * The rows are sorted by id first (unless they already are). Into an empty table
+ * the B+tree is built bottom-up in a single pass: leaves are packed to
+ * db_config.bulk_load_fill percent, chained through their next_leaf pointers
+ * and every internal level is built from the one below. There are no descents
+ * from the root and no splits. A table that already holds rows gets the sorted
+ * batch through the regular insert path instead. Indexes get the entries of the
+ * batch first (bulk_load_index()).
+ *
+ * @param table The table to load into.
+ * @param rows The rows to load, the array is sorted in place.
+ * @param num_rows Number of rows.
+ *
+ * @return EXECUTE_SUCCESS, or EXECUTE_DUPLICATE_KEY (nothing is loaded) if an id
+ *         appears twice in the batch or already exists in the table.
+ */
+ExecuteResult bulk_load(Table *table, Row *rows, uint32_t num_rows)
+{
+    if (num_rows == 0)
+        return EXECUTE_SUCCESS;
+
+    bool sorted = true;
+    for (uint32_t i = 1; i < num_rows && sorted; i++)
+        sorted = rows[i - 1].id <= rows[i].id;
+    if (!sorted)
+        qsort(rows, num_rows, sizeof(Row), compare_rows_by_id);
+    for (uint32_t i = 1; i < num_rows; i++)
+    {
+        if (rows[i - 1].id == rows[i].id)
+            return EXECUTE_DUPLICATE_KEY;
+    }
+
+    Pager *pager = table->pager;
+    void *root = get_page(pager, table->root_page_num);
+    bool empty = get_node_type(root) == LEAF_NODE && *leaf_node_num_cells(root) == 0;
+    pager_release_pages(pager);
+
+    if (empty)
+    {
+        if (index_any(table))
+            bulk_load_index(table, rows, num_rows);
+        bulk_load_build(table, rows, num_rows);
+    }
+    else
+    {
+        // Check every id before changing anything, so a duplicate does not leave half a batch behind
+        for (uint32_t i = 0; i < num_rows; i++)
+        {
+            Cursor *cursor = find_table(table, rows[i].id);
+            void *node = get_page(pager, cursor->page_num);
+            bool exists = cursor->cell_num < *leaf_node_num_cells(node) &&
+                          leaf_node_key(node, cursor->cell_num) == rows[i].id;
+            cursor_close(cursor);
+            pager_release_pages(pager);
+            if (exists)
+                return EXECUTE_DUPLICATE_KEY;
+        }
+        if (index_any(table))
+            bulk_load_index(table, rows, num_rows);
+        uint32_t rows_written = 0;
+        char serialized[sizeof(Row)];
+        for (uint32_t i = 0; i < num_rows; i++)
+        {
+            Cursor *cursor = find_table(table, rows[i].id);
+            serialize_row(&rows[i], serialized);
+            leaf_node_insert(cursor, rows[i].id, serialized);
+            cursor_close(cursor);
+            bulk_load_page_done(pager, &rows_written);
+        }
+    }
+
+    pager_release_pages(pager);
+    wal_commit(pager);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+Parses one line of an import file into a row. Lines hold the same fields as an insert statement,
+"id username email", separated by spaces, tabs or commas.
+*/
+static bool parse_import_line(char *line, Row *row)
+{
+    const char *separators = " \t,\r\n";
+    char *id_string = strtok(line, separators);
+    char *username = strtok(NULL, separators);
+    char *email = strtok(NULL, separators);
+    if (id_string == NULL || username == NULL || email == NULL || strtok(NULL, separators) != NULL)
+        return false;
+
+    int id = atoi(id_string);
+    if (id < 0 || strlen(username) > COLUMN_USERNAME_SIZE || strlen(email) > COLUMN_EMAIL_SIZE)
+        return false;
+
+    row->id = id;
+    strcpy(row->username, username);
+    strcpy(row->email, email);
+    return true;
+}
+
+/**
+ * @brief Implements the `.import <file>` meta command.
+ *
+ * Reads every row of the file (see parse_import_line()) and hands them to
+ * bulk_load(). Empty lines are skipped, any malformed line aborts the import
+ * before the table is touched.
+ *
+ * @param table The table to load into.
+ * @param filename Path of the file to import.
+ *
+ * @return META_COMMAND_SUCCESS, errors are reported on stdout.
+ */
+MetaCommandResult import_file(Table *table, const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        printf("Unable to open %s\n", filename);
+        return META_COMMAND_SUCCESS;
+    }
+
+    uint32_t capacity = 1024;
+    uint32_t num_rows = 0;
+    Row *rows = malloc(sizeof(Row) * capacity);
+    char *line = NULL;
+    size_t line_length = 0;
+    uint32_t line_num = 0;
+    bool ok = true;
+    while (getline(&line, &line_length, file) > 0)
+    {
+        line_num++;
+        if (strspn(line, " \t,\r\n") == strlen(line))
+            continue;
+        if (num_rows == capacity)
+        {
+            capacity *= 2;
+            rows = realloc(rows, sizeof(Row) * capacity);
+        }
+        if (!parse_import_line(line, &rows[num_rows]))
+        {
+            printf("Syntax error on line %u of %s, nothing imported.\n", line_num, filename);
+            ok = false;
+            break;
+        }
+        num_rows++;
+    }
+    free(line);
+    fclose(file);
+
+    if (ok)
+    {
+        if (bulk_load(table, rows, num_rows) == EXECUTE_SUCCESS)
+            printf("Imported %u rows.\n", num_rows);
+        else
+            printf("Duplicate key found, nothing imported.\n");
+    }
+    free(rows);
+    return META_COMMAND_SUCCESS;
+}
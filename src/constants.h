@@ -1,6 +1,11 @@
 #ifndef MODULE1_H
 #define MODULE1_H
 
+// O_DIRECT (glibc only declares it for GNU sources)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
@@ -10,11 +15,113 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <pthread.h> // page latches, readers run on their own threads
+#include <sched.h>
+#ifndef _WIN32
+#include <sys/uio.h>  // pwritev
+#include <sys/mman.h> // mmap pager mode
+#endif
+#ifdef __linux__
+#include <signal.h>
+#include <sys/epoll.h>   // event loops of the network server
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h> // .backup, where copy_file_range() fails
+#endif
+
+// Vector instructions used by internal_node_find_child(), the scalar search is used without them
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// CRC32C instructions used by crc32c(), a table is used without them
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+
+// O_BINARY only exists on Windows, elsewhere files are always opened in binary mode
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// Windows has no fsync/fdatasync, _commit() flushes the file to disk
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h> // _aligned_malloc for the buffer pool slabs
+#define fsync(fd) _commit(fd)
+#define fdatasync(fd) _commit(fd)
+#endif
 
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
-#define TABLE_MAX_PAGES 100 // Maximum number of pages allowed for a table
+#define BUFFER_POOL_DEFAULT_FRAMES 100 // Number of pages the pager keeps resident unless overridden with --frames
+#define BUFFER_POOL_MIN_FRAMES 64      // A split touches several pages per tree level, so never go below this
+#define PAGER_MAX_IOVEC 64             // Most pages coalesced into a single pwritev(), well below IOV_MAX
+#define PAGER_MMAP_MIN_EXTENT (1 << 20)  // the mapped file grows by at least 1 MB at a time
+#define PAGER_MMAP_MAX_EXTENT (64 << 20) // and by at most 64 MB, below that it doubles
+#define PAGER_MMAP_MAX_RETIRED 32        // mappings replaced by a larger one, kept until close
+#define PAGER_MIN_LATCHED_FRAMES 16      // initial size of the list of pages the writer latched, grows as needed
+#define PAGER_MMAP_RESERVE ((off_t)sizeof(void *) << 27) // address space reserved up front, 1 GB on 64 bit
+#define PAGER_TS_PENDING UINT64_MAX // end_ts of a page version whose replacement has not committed yet
+#define PAGER_TS_LATEST UINT64_MAX  // snapshot of the writer thread, it sees its own changes
+#define PAGER_MAX_FREE_VERSIONS 64  // reclaimed page versions kept for reuse instead of freed
+#define PAGER_MAX_SLABS 32          // frame memory regions, one per batch of frames (the pool only ever doubles)
+#define PAGER_SLAB_ALIGNMENT 4096   // frame memory is aligned to this, and each frame is a multiple of it
+#define PAGER_HUGE_PAGE_SIZE (2 << 20) // slabs at least this large are aligned to it and may use huge pages
+#define PAGER_DEFAULT_WRITEBACK_MS 100 // background write-back interval unless overridden with --writeback-ms
+#define READ_AHEAD_DEFAULT_LEAVES 32   // leaves a scan reads ahead of itself unless overridden with --read-ahead
+#define HOT_KEYS_WAYS 4                // slots of a hot key bucket, 4 * 16 bytes fill one cache line
+#define HOT_KEYS_BUCKET_SIZE 64        // bytes of a bucket, buckets are aligned to it
+#define HOT_KEY_REFERENCED 0x80000000u // bit of HotKeySlot.epoch, the slot was hit since eviction last passed it
+#define HOT_KEYS_NO_EPOCH UINT32_MAX   // hot_keys_epoch() of a cursor that may not use the cache
 #define INVALID_PAGE_NUM UINT32_MAX
+#define DEFAULT_PAGE_SIZE 4096 // page size of new database files unless overridden with --page-size
+#define MIN_PAGE_SIZE 4096     // page sizes are powers of two in [MIN_PAGE_SIZE, MAX_PAGE_SIZE]
+#define MAX_PAGE_SIZE 65536    // leaf slots store payload offsets in 16 bits
+#define PAGE_TRAILER_SIZE 4    // CRC32C at the end of every page, in files created with page checksums
+
+#define WAL_DEFAULT_GROUP_COMMIT_MS 10          // commits inside this window share one fdatasync
+#define WAL_DEFAULT_CHECKPOINT_BYTES (4 << 20)  // checkpoint once the log grows past 4 MB
+#define WAL_RECORD_PAGE_RANGE 1                 // redo record: bytes [offset, offset + length) of a page
+#define WAL_RECORD_COMMIT 2                     // end of a statement, carries the checksum of its records
+#define WAL_CHECKSUM_SEED 2166136261u           // FNV-1a offset basis, see wal_checksum()
+
+#define BULK_LOAD_DEFAULT_FILL 90    // percent, leaves room for a few inserts per node before it splits
+#define BULK_LOAD_MIN_FILL 50        // below this the merge threshold would be hit right away
+#define BULK_LOAD_COMMIT_PAGES 256   // a bulk load commits its pages to the write-ahead log in batches this size
+
+#define VACUUM_COMMIT_PAGES 128    // .vacuum commits to the write-ahead log in batches of about this many changed pages
+#define VACUUM_NO_NODE UINT32_MAX  // Vacuum.owner of a page that holds no node
+
+#define BACKUP_RUN_PAGES 256          // .backup copies the file this many pages at a time, then patches what changed
+#define WARM_CACHE_MAGIC 0x4d524157u  // "WARM", first word of a warm list file, see warm_cache.c
+
+#define PARALLEL_SCAN_MAX_THREADS 64  // most parts one scan is cut into
+#define PARALLEL_SCAN_KEYS_PER_PART 8 // separator keys looked for per part, more keys balance the parts better
+
+#define ARENA_BLOCK_SIZE (1 << 20) // scratch memory of the writer comes in blocks of 1 MB (or one allocation, if larger)
+#define ARENA_ALIGNMENT 64         // every scratch allocation starts on a cache line
+#define INPUT_BUFFER_INITIAL_SIZE 1024 // statement lines shorter than this never grow the input buffer
+
+#define OUTPUT_CHUNK_SIZE (16 * 1024) // select output is formatted into chunks of this size
+#define OUTPUT_CHUNKS 8                // chunks written together by one writev()
+#define OUTPUT_MAX_ROW_SIZE 2048       // longest formatted row, json with every character escaped as \u00XX
+
+#define SERVER_MAX_EVENTS 64          // epoll events a loop handles per wakeup
+#define SERVER_READ_SIZE (64 * 1024)  // bytes a connection reads at once, a read can hold many pipelined requests
+#define SERVER_BACKLOG 128            // pending connections the listening socket queues
+
+#define STATS_LATENCY_BUCKETS 24  // bucket 0 counts statements under 1 us, bucket i those in [2^(i-1), 2^i) us
+#define STATS_STATEMENT_TYPES 8   // one latency histogram per StatementType
 
 /*
 Calculates the size of a specific attribute (field) within a given struct.
@@ -50,14 +157,41 @@ enum StatementType_t
     STATEMENT_INSERT,
     STATEMENT_SELECT,
     STATEMENT_UPDATE,
-    STATEMENT_DELETE
+    STATEMENT_DELETE,
+    STATEMENT_BEGIN,
+    STATEMENT_COMMIT,
+    STATEMENT_ROLLBACK,
+    STATEMENT_CREATE_INDEX
 };
 typedef enum StatementType_t StatementType;
 
+// Columns a secondary index can be created on, see index.c. Also the order of their roots in the file header.
+enum IndexColumn_t
+{
+    INDEX_USERNAME,
+    INDEX_EMAIL,
+    INDEX_NONE
+};
+typedef enum IndexColumn_t IndexColumn;
+
+// Columns a select prints ("select id, email"), bits of Statement.select_columns and RowFilter.columns
+#define SELECT_COLUMN_ID 1
+#define SELECT_COLUMN_USERNAME 2
+#define SELECT_COLUMN_EMAIL 4
+#define SELECT_COLUMNS_ALL (SELECT_COLUMN_ID | SELECT_COLUMN_USERNAME | SELECT_COLUMN_EMAIL)
+
 struct Statement_t
 {
     StatementType type;
     Row row_to_insert;
+    uint32_t select_min_id;  // select: inclusive id range, [0, UINT32_MAX] without a where clause
+    uint32_t select_max_id;  // min > max means the range is empty
+    bool select_count;       // select count(*): print the number of rows in range instead of the rows
+    uint32_t select_columns; // select: SELECT_COLUMN_* bits of the columns to print, SELECT_COLUMNS_ALL for *
+    IndexColumn column;      // select: column of a "where username = x" condition, INDEX_NONE without one
+                             // create index: the column to index
+    bool select_like;        // select: value is a "like" pattern rather than the exact value
+    char value[COLUMN_EMAIL_SIZE + 1]; // select: the value that column must have
 };
 typedef struct Statement_t Statement;
 
@@ -76,14 +210,18 @@ enum ExecuteResult_t
     EXECUTE_SUCCESS,
     EXECUTE_TABLE_FULL,
     EXECUTE_DUPLICATE_KEY,
-    EXECUTE_NOT_FOUND
+    EXECUTE_NOT_FOUND,
+    EXECUTE_TRANSACTION_OPEN, // begin while a transaction is already open
+    EXECUTE_NO_TRANSACTION,   // commit or rollback without begin
+    EXECUTE_INDEX_EXISTS      // create index on a column that already has one
 };
 typedef enum ExecuteResult_t ExecuteResult;
 
 typedef enum
 {
     INTERNAL_NODE,
-    LEAF_NODE
+    LEAF_NODE,
+    FREE_NODE // page on the freelist, see header.c
 } NodeType;
 
 enum MetaCommandResult_t
@@ -93,12 +231,386 @@ enum MetaCommandResult_t
 };
 typedef enum MetaCommandResult_t MetaCommandResult;
 
+// Access pattern hint for the pager, only the mmap mode acts on it (see pager_advise())
+typedef enum
+{
+    PAGER_ACCESS_RANDOM,
+    PAGER_ACCESS_SEQUENTIAL
+} PagerAccess;
+
+// Slot of a leaf cell, see the leaf node layout
+typedef struct
+{
+    uint32_t key;
+    uint16_t offset; // of the payload within the page
+    uint16_t size;   // of the payload
+} LeafSlot;
+
+// Slot of a cell in a packed leaf, the key is stored as its distance from the base key of the page
+typedef struct
+{
+    uint16_t delta;
+    uint16_t offset;
+    uint16_t size;
+} PackedLeafSlot;
+
+/*
+A row read in place from a leaf payload (leaf_node_row()). The strings are not NUL terminated and only
+valid for as long as the page they point into.
+*/
+typedef struct
+{
+    uint32_t id;
+    const char *username;
+    uint32_t username_length;
+    const char *email;
+    uint32_t email_length;
+} RowView;
+
+/*
+What a read cursor keeps of the rows it passes (reader_set_filter()). Cells that fail the condition are
+skipped on the leaf without leaving the cursor, the rows it stops on only have the projected columns
+filled in by reader_row(), the others are empty.
+*/
+typedef struct
+{
+    uint32_t columns;      // SELECT_COLUMN_* bits of the columns reader_row() fills in
+    IndexColumn column;    // column the condition is on, INDEX_NONE to keep every row
+    bool like;             // value is a pattern, % matches any run of characters and _ any one character
+    const char *value;     // not NUL terminated, the caller keeps it alive while the cursor is open
+    uint32_t value_length;
+    uint32_t max_key;      // skipping stops at the first row past it, the caller's scan ends there anyway
+} RowFilter;
+
+// When pages read from the file have their checksum verified (--verify-pages), see pager_verify_page()
+typedef enum
+{
+    PAGE_VERIFY_ONCE,   // the first time a page is read in a session, pages this session wrote count as verified
+    PAGE_VERIFY_ALWAYS, // every time a page is read from the file (or mapped in again)
+    PAGE_VERIFY_OFF
+} PageVerify;
+
+// How select prints its rows, see output.c
+typedef enum
+{
+    OUTPUT_TEXT,
+    OUTPUT_CSV,
+    OUTPUT_JSON,
+    OUTPUT_BINARY
+} OutputMode;
+
+// Buffered select output on one file descriptor, written with writev() a batch of chunks at a time
+struct OutputSink_t
+{
+    int fd;
+    OutputMode mode;
+    char *buffer;                 // OUTPUT_CHUNKS chunks of OUTPUT_CHUNK_SIZE bytes
+    uint32_t chunk;               // chunk rows are formatted into
+    uint32_t used[OUTPUT_CHUNKS]; // bytes filled in each chunk
+};
+typedef struct OutputSink_t OutputSink;
+
+/*
+Runtime options chosen on the command line (see main.c). db_open() and page_open() read them when the
+database is opened, so they must be set before that.
+*/
+struct DbConfig_t
+{
+    uint32_t buffer_pool_frames;   // how many pages may be resident in memory at once
+    bool pager_mmap;               // serve pages straight from a mapping of the file instead of read()
+    bool wal_enabled;              // keep a write-ahead log next to the database file
+    uint32_t wal_group_commit_ms;  // 0 syncs the log on every commit
+    uint32_t wal_checkpoint_bytes; // log size that triggers a checkpoint
+    uint32_t bulk_load_fill;       // percent of each node .import fills, the rest is left for later inserts
+    uint32_t scan_threads;         // threads of a parallel scan (select count(*)), 0 for one per online CPU
+    OutputMode output_mode;        // format of select output (.mode)
+    uint32_t page_size;            // page size of a new database file, an existing file keeps its own
+    bool page_checksums;           // a new database file gets a CRC32C trailer on every page
+    PageVerify page_verify;        // which page reads check the trailer
+    bool packed_keys;              // leaves whose keys are close together store them as 16 bit deltas
+    uint32_t read_ahead_leaves;    // leaves a scan announces to the OS ahead of itself, 0 turns read-ahead off
+    uint32_t writeback_ms;         // interval of the background write-back of dirty pages, 0 turns it off
+    bool pager_direct;             // read and write the database file with O_DIRECT, past the OS page cache
+    uint32_t hot_keys_kb;          // memory of the cache of leaves point lookups found their key in, 0 turns it off
+    bool warm_cache;               // keep a list of the resident pages at close and load them again at open
+};
+typedef struct DbConfig_t DbConfig;
+
+// Power of two latency histogram of one statement type, see STATS_LATENCY_BUCKETS
+struct LatencyHistogram_t
+{
+    uint64_t sequence; // odd while a statement is being added, see stats_record_latency()
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_LATENCY_BUCKETS];
+};
+typedef struct LatencyHistogram_t LatencyHistogram;
+
+/*
+Process wide counters, shown by `.stats`. They are increments on paths that already do far more work
+(a page lookup, a split, a write), so they are always on. Bytes are counted when the syscall returns. The
+counters reader threads and the write-back thread update too (the pager's, cursor advances, hot keys, log
+syncs) are relaxed atomic adds, `.stats` and bench.c read them with atomic loads.
+*/
+struct DbStats_t
+{
+    uint64_t page_hits;       // get_page() found the page in the buffer pool
+    uint64_t page_misses;     // get_page() had to pick a frame
+    uint64_t pages_read;      // misses on pages that exist in the file
+    uint64_t bytes_read;      // read from the database file
+    uint64_t pages_verified;  // page checksums checked, see pager_verify_page()
+    uint64_t pages_written;   // written back to the database file
+    uint64_t pages_written_back; // of those, by the background write-back thread
+    uint64_t pages_read_ahead; // announced to the OS ahead of a scan, see read_ahead.c
+    uint64_t pages_warmed;    // loaded from the warm list after open, see warm_cache.c
+    uint64_t bytes_written;
+    uint64_t flushes;         // write syscalls on the database file, a pwritev() run counts once
+    uint64_t leaf_splits;
+    uint64_t internal_splits;
+    uint64_t root_promotions; // create_new_root(), the tree grew by a level
+    uint64_t leaf_merges;
+    uint64_t internal_merges;
+    uint64_t cursor_advances;
+    uint64_t hot_key_hits;    // point lookups that went straight to their leaf, see hot_keys.c
+    uint64_t hot_key_misses;  // lookups that descended from the root with the cache on
+    uint64_t page_versions;   // page images kept for snapshots, see pager_preserve_page()
+    uint64_t wal_commits;     // commits that appended records to the log
+    uint64_t wal_bytes_written;
+    uint64_t wal_syncs;
+    uint64_t checkpoints;
+    LatencyHistogram latency[STATS_STATEMENT_TYPES]; // indexed by StatementType
+};
+typedef struct DbStats_t DbStats;
+
+/*
+Every record in the write-ahead log starts with this header.
+    WAL_RECORD_PAGE_RANGE : followed by `length` bytes that are copied to `offset` in page `page_num`.
+    WAL_RECORD_COMMIT     : no payload, `length` holds the checksum of all records since the previous commit.
+Records are physical after-images, so replaying one twice gives the same page and replay can always start
+from the beginning of the log.
+*/
+struct WalRecordHeader_t
+{
+    uint32_t type;
+    uint32_t page_num;
+    uint32_t offset;
+    uint32_t length;
+};
+typedef struct WalRecordHeader_t WalRecordHeader;
+
+/*
+Write-ahead log state. Records of the running statement collect in `buffer` and are appended to the log
+file by wal_commit(). The file is only fdatasync'ed once per group commit window, so a burst of commits
+shares one sync. Pages marked dirty without an explicit range are logged as full page images when the
+operation releases its pages (pending_pages).
+*/
+struct Wal_t
+{
+    int file_descriptor;
+    char *buffer;              // records not yet appended to the log file
+    uint32_t buffer_length;
+    uint32_t buffer_capacity;
+    uint32_t *pending_pages;   // pages that need a full image before the operation ends
+    uint32_t num_pending;
+    uint32_t pending_capacity;
+    uint32_t checksum;         // checksum of the records since the last commit
+    off_t file_length;         // bytes appended to the log file
+    off_t synced_length;       // prefix of the log file known to be on disk
+    long long last_sync_ms;    // time of the last fdatasync
+};
+typedef struct Wal_t Wal;
+
+/*
+Scratch memory of the writer thread (see arena.c). Splits, merges and compactions rebuild pages from copies
+of them and from temporary cell lists, those come from the arena instead of malloc(). Allocations are given
+back in reverse order by rewinding to a mark taken before them, blocks that empty are kept for the next
+statement, so once warm the write path allocates nothing.
+*/
+struct ArenaBlock_t
+{
+    struct ArenaBlock_t *previous; // block that was current before this one, NULL for the first
+    size_t capacity;               // bytes after the header
+};
+typedef struct ArenaBlock_t ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock *block; // block allocations come from, NULL before the first one
+    size_t used;       // bytes of it in use
+    ArenaBlock *spare; // the last block that emptied, reused before a new one is allocated
+} Arena;
+
+typedef struct
+{
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+/*
+A frame is one slot of the buffer pool. It holds a single page of the database file while that page is
+resident in memory.
+    pin_count  : number of cursors currently positioned on this page, a pinned frame is never evicted.
+    touched_op : id of the operation that last called get_page() on this frame. Callers keep raw page
+                 pointers for the whole statement, so a frame touched by the running operation is not
+                 evicted either (see pager_release_pages()).
+    referenced : CLOCK reference bit, set on every access and cleared when the clock hand passes by.
+*/
+struct Frame_t
+{
+    void *data;          // PAGE_SIZE bytes in one of the pager's slabs, or in the mapping in mmap mode
+    uint32_t page_num;   // page held by this frame or INVALID_PAGE_NUM if the frame is empty
+    uint32_t pin_count;  // pin/unpin reference count
+    uint32_t touched_op; // operation that last fetched this frame
+    bool dirty;          // page was modified and must be written back before the frame is reused
+    bool referenced;     // CLOCK reference bit
+    bool wal_pending;    // a full page image has to be logged before the operation ends
+    off_t wal_lsn;       // end of the last log record describing this page, the log must be synced up to it before write back
+    pthread_rwlock_t *latch; // shared for readers of the page, exclusive for the writer changing it
+    bool writer_latched;     // the running write operation holds latch exclusively
+};
+typedef struct Frame_t Frame;
+
+/*
+The contents a page had before the writer changed it, kept while a snapshot may still need them. Versions
+of a page form a chain from the oldest to the newest, end_ts is the commit timestamp of the statement
+that replaced the contents, so the version covers every snapshot taken before that.
+*/
+struct PageVersion_t
+{
+    uint32_t page_num;
+    uint32_t readers;                  // snapshots reading the version right now, it is not freed meanwhile
+    uint64_t end_ts;                   // PAGER_TS_PENDING until the replacing statement or transaction commits
+    struct PageVersion_t *older;       // chain of the page
+    struct PageVersion_t *newer;
+    struct PageVersion_t *next_created; // every version in creation order, the oldest are reclaimed first
+    char data[];                       // PAGE_SIZE bytes
+};
+typedef struct PageVersion_t PageVersion;
+
+// The point in time a read cursor sees the table at, registered with the pager while the cursor is open.
+struct Snapshot_t
+{
+    uint64_t ts; // commit timestamp of the last statement the snapshot sees
+    bool registered;
+    struct Snapshot_t *older;
+    struct Snapshot_t *newer;
+};
+typedef struct Snapshot_t Snapshot;
+
+/*
+Read-ahead of one scan, see read_ahead.c. The leaves ahead of the scan are taken from the internal node
+above them, as of the scan's snapshot, and announced to the OS up to db_config.read_ahead_leaves ahead.
+*/
+struct ReadAhead_t
+{
+    uint32_t *leaves;     // children of one internal node, in key order
+    uint32_t num_leaves;
+    uint32_t leaves_capacity;
+    uint32_t next_leaf;   // first of leaves not announced yet
+    uint32_t next_key;    // first key after the internal node, 0 when it is the last one
+    uint32_t max_key;     // the scan stops after this key, so does the read-ahead
+    uint32_t ahead;       // leaves announced that the scan did not enter yet
+};
+typedef struct ReadAhead_t ReadAhead;
+
+/*
+The leaf a key was last found in, see hot_keys.c. `sequence` is odd while a thread rewrites the slot, a
+reader that sees it odd or changed afterwards ignores what it read.
+*/
+typedef struct
+{
+    uint32_t sequence;
+    uint32_t key;
+    uint32_t page_num; // 0 for an empty slot (page 0 is the file header)
+    uint32_t epoch;    // Pager.page_epoch when the key was found there, plus HOT_KEY_REFERENCED
+} HotKeySlot;
+
+// Set associative cache of HotKeySlots, sized by db_config.hot_keys_kb.
+typedef struct
+{
+    HotKeySlot *slots;    // HOT_KEYS_WAYS per bucket
+    uint32_t bucket_mask; // number of buckets - 1 (a power of two)
+} HotKeys;
+
+/*
+State of one .vacuum run, see vacuum.c. Node i of `nodes` is placed at page i + 1, skipping the table's root
+page, which never moves. `owner` and `prev_leaf` are indexed by page number.
+*/
+typedef struct
+{
+    struct Table_t *table;
+    uint32_t *nodes;      // current page of every node to place, leaves of each tree first, in placing order
+    uint32_t num_nodes;
+    uint32_t *owner;      // index into nodes of the node a page holds, VACUUM_NO_NODE for an unused page
+    uint32_t *prev_leaf;  // page of the leaf before the one a page holds, 0 for the first leaf of a tree
+    uint32_t num_pages;   // pages owner and prev_leaf cover
+    uint32_t region_end;  // first page after the places of the nodes
+    uint32_t *spare;      // unused pages at or after region_end, nodes in the way are moved there
+    uint32_t num_spare;
+    uint32_t budget;      // steps this run may take, UINT32_MAX without a limit
+    uint32_t steps;       // refills and moves so far
+    uint32_t uncommitted; // pages changed since the last commit, they can not be evicted before it
+    uint32_t refilled;
+    uint32_t moved;
+} Vacuum;
+
 struct Pager_t
 {
-    int file_descriptor;          // 4 bytes
-    uint32_t file_length;         // 4 bytes
-    uint32_t num_pages;           // 4 bytes
-    void *pages[TABLE_MAX_PAGES]; // 100 pointers = (void *) 8 bytes * 100 = 800 bytes
+    int file_descriptor;      // 4 bytes
+    off_t file_length;        // 8 bytes, size of the file at open time
+    uint32_t num_pages;       // 4 bytes, pages in the database (on disk + newly allocated)
+    uint32_t num_frames;      // size of the buffer pool
+    Frame *frames;            // num_frames frames
+    uint32_t *page_table;     // open addressing hash table page_num -> frame index
+    uint32_t page_table_mask; // page table size - 1 (size is a power of two)
+    uint32_t clock_hand;      // next frame the CLOCK eviction looks at
+    uint32_t current_op;      // id of the running operation, see pager_release_pages()
+    Wal *wal;                 // write-ahead log or NULL when it is disabled
+    bool in_transaction;      // between begin and commit/rollback, see pager_begin_transaction()
+    uint32_t transaction_num_pages; // num_pages when the transaction began
+    char *map;                // mmap mode: private mapping of the file, NULL in read()/write() mode
+    off_t map_length;         // size the file was extended to, pages below it may be accessed
+    off_t map_capacity;       // bytes of address space mapped, at least map_length
+    char *retired_maps[PAGER_MMAP_MAX_RETIRED]; // older mappings, page pointers into them may still be in use
+    off_t retired_lengths[PAGER_MMAP_MAX_RETIRED];
+    uint32_t num_retired;
+    pthread_mutex_t mutex;       // see pager_lock()
+    pthread_rwlock_t tree_latch; // readers descending share it, the writer takes it to change internal nodes
+    bool tree_latched;           // the running write operation holds tree_latch
+    bool leaf_write;             // the running write operation called pager_start_leaf_write()
+    uint32_t *latched_frames;    // frames the running write operation latched, released by pager_release_pages()
+    uint32_t num_latched;
+    uint32_t latched_capacity;
+    pthread_t writer_thread;     // the thread that opened the pager, the only one that may write
+    bool op_dirtied;             // the running operation (or transaction) changed a page
+    uint64_t commit_ts;          // timestamp of the last committed write statement
+    PageVersion **page_versions; // newest version of every page, indexed by page number
+    uint32_t page_versions_capacity;
+    PageVersion *oldest_version; // creation order list of all versions
+    PageVersion *newest_version;
+    PageVersion *pending_versions; // first version created by the running operation or transaction
+    uint64_t versions_created;   // readers look at the versions again only when this changed
+    PageVersion *free_versions;  // reclaimed versions kept for reuse, linked through next_created
+    uint32_t num_free_versions;
+    Snapshot *oldest_snapshot;   // open snapshots, in the order they were taken
+    Snapshot *newest_snapshot;
+    uint8_t *verified_pages;     // bitmap of pages whose checksum is known to be good, PAGE_VERIFY_ONCE
+    uint32_t verified_capacity;  // pages the bitmap covers
+    bool recovering;             // the write-ahead log is being replayed, torn pages are about to be repaired
+    pthread_t writeback_thread;       // see pager_start_writeback()
+    bool writeback_started;
+    bool writeback_stop;              // pager_close() asks the write-back thread to finish
+    uint32_t writeback_op;            // current_op at the previous write-back pass
+    pthread_mutex_t writeback_mutex;  // protects writeback_stop
+    pthread_cond_t writeback_cond;    // wakes the write-back thread when it has to stop
+    char *slabs[PAGER_MAX_SLABS];     // page memory of the frames, see pager_alloc_slab()
+    uint32_t num_slabs;
+    bool direct_io;                   // the file is read and written with O_DIRECT, see pager_enable_direct_io()
+    Arena scratch;                    // scratch memory of the writer, see arena.c
+    struct Cursor_t *free_cursors;    // closed writer cursors kept for reuse, linked through `node`
+    uint32_t page_epoch;              // bumped whenever a page may leave its tree, see pager_new_page_epoch()
+    uint64_t page_epoch_ts;           // first commit ts whose snapshots see the current epoch's pages
 };
 typedef struct Pager_t Pager;
 
@@ -106,16 +618,104 @@ struct Table_t
 {
     Pager *pager;
     uint32_t root_page_num;
+    uint32_t rightmost_leaf_page_num; // last leaf seen with next_leaf == 0, 0 when unknown (see find_append_position())
+    uint32_t rightmost_max_key;       // largest key in that leaf when it was remembered
+    uint32_t rightmost_epoch;         // Pager.page_epoch then, a page freed since may belong to another tree
+    uint32_t index_roots[INDEX_NONE]; // root page of the index on each IndexColumn, 0 if there is none (writer only)
+    HotKeys *hot_keys;                // leaves point lookups found their key in, NULL when off and for index trees
+    struct Backup_t *backup;          // the last .backup, NULL before the first one
+    struct WarmCache_t *warm_cache;   // NULL unless db_config.warm_cache
 };
 typedef struct Table_t Table;
 
-typedef struct
+/*
+A .backup, see backup.c. Its thread copies pages [0, num_pages) as they were when the snapshot was taken into
+the backup file, while the writer goes on.
+*/
+struct Backup_t
+{
+    Pager *pager;
+    Snapshot snapshot;      // registered until the copy is done, keeps the old versions of the pages changed since
+    int file_descriptor;    // of the backup file
+    char *path;
+    uint32_t num_pages;     // pages of the database when the backup started
+    uint32_t pages_done;    // pages copied so far, .backup reads it while the thread runs
+    uint32_t pages_patched; // pages written from their version because the file may have changed under the copy
+    bool finished;
+    int error;              // errno of the write that failed, 0 if none did
+    uint64_t elapsed_ns;
+    pthread_t thread;
+};
+typedef struct Backup_t Backup;
+
+/*
+The warm list, see warm_cache.c: pages resident at the last close, loaded into the buffer pool again by a
+thread of their own after open.
+*/
+struct WarmCache_t
+{
+    Pager *pager;
+    char *path;         // "<db_filename>-warm"
+    uint32_t *pages;
+    uint32_t num_pages;
+    bool stop;          // set by warm_cache_close(), the thread stops loading
+    bool started;
+    pthread_t thread;
+};
+typedef struct WarmCache_t WarmCache;
+
+struct Cursor_t
 {
     Table *table;
     uint32_t page_num;
     uint32_t cell_num;
     bool end_of_table; // Indicates a position one past the last element
-} Cursor;
+    // Read cursors only (reader_seek()), the leaf as of the snapshot, latched shared unless it is a version
+    void *node;
+    PageVersion *version;
+    Snapshot snapshot;
+    ReadAhead *read_ahead; // NULL unless reader_read_ahead() was called
+    const RowFilter *filter; // NULL unless reader_set_filter() was called
+};
+typedef struct Cursor_t Cursor;
+
+/*
+Concurrency: any number of threads may read with reader_seek()/reader_advance() (execute_select() uses
+them) while a single thread, the one that opened the table, writes through everything else. The rules:
+    - The pager mutex (pager_lock()) protects the page table, the CLOCK state, the page versions and the
+      write-ahead log file. It is only held for bookkeeping, never while waiting for a latch, commits sync
+      the log without it.
+    - Internal nodes change only while the writer holds the tree latch exclusively, that is during splits,
+      merges and new roots. A reader holds it shared while it takes its snapshot, so a snapshot never falls
+      in the middle of such a change.
+    - Every frame has a latch. The writer latches the leaf it changes, or every page it touches while it
+      holds the tree latch, and keeps the old contents of the page as a PageVersion first when an open
+      snapshot or the open transaction may still need them (pager_preserve_page()).
+    - A reader sees every page as of its snapshot: the oldest version replaced after the snapshot was
+      taken or, without one, the current page latched shared. It holds one page at a time, so it never
+      waits for a latch while holding one and never makes the writer wait for more than a page.
+    - The background write-back thread (pager_start_writeback()) only writes pages under the pager mutex
+      that no operation or cursor holds, it only fills in their checksums.
+A read cursor sees the table as it was when reader_seek() took its snapshot: no statement that committed
+later, no part of an open transaction. Selects of the writer thread see its own changes.
+*/
+
+/*
+A statement prepared once and executed with many parameter sets (see prepared.c). The bound row is kept
+in its serialized form, executing packs it straight into the leaf cell.
+*/
+struct PreparedStatement_t
+{
+    Table *table;
+    StatementType type;
+    char row[sizeof(Row)]; // serialized row (ROW_SIZE bytes), insert/update use all of it, delete only the id
+    uint32_t select_min_id;
+    uint32_t select_max_id;
+};
+typedef struct PreparedStatement_t PreparedStatement;
+
+// Called by parallel_scan() for every row of a part, with the context of that part and the row as read from its leaf
+typedef void (*ScanVisitor)(void *context, const RowView *row);
 
 // Constansts For Pager start here
 // Offset : offsets are used to determine the starting position of each field (member) within a Row structure when the structure is stored in memory.
@@ -128,12 +728,60 @@ const uint32_t USERNAME_OFFSET = ID_SIZE + ID_OFFSET;
 const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
 const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
 
-const uint32_t PAGE_SIZE = 4096;                                 // Maximum size of a single page in bytes
-const uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;             // Number of rows that can fit in a single page
-const uint32_t TABLE_MAX_ROWS = ROWS_PER_PAGE * TABLE_MAX_PAGES; // Total number of rows that can be stored in the entire table
+/*
+Size of a single page in bytes. It is chosen when the database file is created (db_config.page_size) and
+stored in the file header, page_open() reads it back and calls set_page_size(), which also computes the
+node layout values below that depend on it.
+*/
+uint32_t PAGE_SIZE = DEFAULT_PAGE_SIZE;
+/*
+Bytes of a page the nodes may use, PAGE_SIZE minus the trailer. Files with page checksums keep a CRC32C of
+the rest of the page in the last PAGE_TRAILER_SIZE bytes (see pager_verify_page()), older files use the
+whole page.
+*/
+uint32_t PAGE_USABLE_SIZE = DEFAULT_PAGE_SIZE;
 
 // Constansts For Pager end here
 
+/*
+File header. Page 0 of the database file no longer holds a node, it describes the file:
+    offset 0-7   : magic "CRYPTODB", files without it are from before the header existed and get migrated
+    offset 8-11  : page number of the root node
+    offset 12-15 : first page of the freelist (0 = empty, page 0 can never be free)
+    offset 16-19 : number of pages on the freelist
+    offset 20-23 : format version, files older than HEADER_FORMAT_VERSION are upgraded on open
+    offset 24-27 : page size (from version 3, older files use 4096 byte pages)
+    offset 28-31 : bytes reserved at the end of every page, PAGE_TRAILER_SIZE with page checksums, else 0
+    offset 32-35 : root page of the index on username (0 = no index), see index.c
+    offset 36-39 : root page of the index on email
+    offset 40-43 : checksum (FNV-1a, as in the write-ahead log) of bytes 0-39, set whenever page 0 is written
+Older headers end with their checksum: version 3 at offset 28 (no reserved bytes), version 4 at offset 32
+(no index roots). Files older than version 4 keep using whole pages, page checksums need room that only a
+new file has.
+Free pages are chained through the freelist, each one is marked FREE_NODE and stores the next free page.
+*/
+const uint32_t HEADER_PAGE_NUM = 0;
+const char HEADER_MAGIC[] = "CRYPTODB";
+const uint32_t HEADER_MAGIC_SIZE = 8;
+const uint32_t HEADER_MAGIC_OFFSET = 0;
+const uint32_t HEADER_ROOT_PAGE_OFFSET = HEADER_MAGIC_OFFSET + HEADER_MAGIC_SIZE;
+const uint32_t HEADER_FREELIST_HEAD_OFFSET = HEADER_ROOT_PAGE_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_FREELIST_COUNT_OFFSET = HEADER_FREELIST_HEAD_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_FORMAT_VERSION_OFFSET = HEADER_FREELIST_COUNT_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_PAGE_SIZE_OFFSET = HEADER_FORMAT_VERSION_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_RESERVED_SIZE_OFFSET = HEADER_PAGE_SIZE_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_INDEX_ROOTS_OFFSET = HEADER_RESERVED_SIZE_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_CHECKSUM_OFFSET = HEADER_INDEX_ROOTS_OFFSET + INDEX_NONE * sizeof(uint32_t);
+const uint32_t HEADER_V3_CHECKSUM_OFFSET = HEADER_PAGE_SIZE_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_V4_CHECKSUM_OFFSET = HEADER_RESERVED_SIZE_OFFSET + sizeof(uint32_t);
+const uint32_t HEADER_SIZE = HEADER_CHECKSUM_OFFSET + sizeof(uint32_t);
+/*
+0: internal nodes store interleaved child/key cells, 1: separate key and child arrays, 2: slotted leaves,
+3: page size and checksum in the header, 4: reserved bytes for page checksums, 5: secondary index roots,
+6: packed leaves (nothing to upgrade, older leaves are all unpacked)
+*/
+const uint32_t HEADER_FORMAT_VERSION = 6;
+
 /*
 Each node will correspond to one page. Nodes need to store some metadata in a header at the beginning of the page. Every node will store what type of node it is, whether or not it is the root node, and a pointer to its parent (to allow finding a node’s siblings).
 
@@ -162,29 +810,74 @@ const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
 const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
 
 /*
-To scan the entire table, we need to jump to the second leaf node after we reach the end of the first. To do that, we’re going to save a new field in the leaf node header called “next_leaf”, which will hold the page number of the leaf’s sibling node on the right. The rightmost leaf node will have a next_leaf value of 0 to denote no sibling (page 0 is reserved for the root node of the table anyway).
+To scan the entire table, we need to jump to the second leaf node after we reach the end of the first. To do that, we’re going to save a new field in the leaf node header called “next_leaf”, which will hold the page number of the leaf’s sibling node on the right. The rightmost leaf node will have a next_leaf value of 0 to denote no sibling (page 0 is reserved for the file header anyway).
 */
 const uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
 const uint32_t LEAF_NODE_NEXT_LEAF_OFFSET = LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NUM_CELLS_OFFSET;
 
-const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE;
+/*
+Leaves are slotted pages (format version 2). After the header comes an array of slots, one per cell in
+key order, and the cell payloads are packed from the end of the page downwards. Free space is the gap
+between the two plus the fragments deletes and updates leave between payloads, compaction merges them:
+    offset 14-17 : content start, offset of the lowest payload byte (PAGE_USABLE_SIZE when there are none)
+    offset 18-21 : fragmented bytes, freed payload space below the content start is not counted here
+    offset 24    : slots, each { key u32, payload offset u16, payload size u16 }
+A payload holds the username length (1 byte), the username and the email, without padding or NULs. The id
+is the key of the slot, so binary searches only read the slot array.
+*/
+const uint32_t LEAF_NODE_CONTENT_START_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_CONTENT_START_OFFSET = LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+const uint32_t LEAF_NODE_FRAGMENTED_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_FRAGMENTED_OFFSET = LEAF_NODE_CONTENT_START_OFFSET + LEAF_NODE_CONTENT_START_SIZE;
+
+const uint32_t LEAF_NODE_HEADER_SIZE = LEAF_NODE_FRAGMENTED_OFFSET + LEAF_NODE_FRAGMENTED_SIZE;
 // Leaft Node Header Layout end here
 
-// Leaf Node Body layout start here (Now the whole page from here is generally used to store cells(Key+value))
-const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t); // occupies 4 bytes
-const uint32_t LEAF_NODE_KEY_OFFSET = 0;
-// This occupies the size of the whole row currently(id + username + email = 4 + 33 + 256 = 292 bytes)
-const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-// Sum of both key and value to get cell size currently (cell size = key + value = 4 + 292 = 296 bytes)
-const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-// Available space to store key value pair in page currently (current page size - total header = 4096 - 9 = 4088 bytes)
-const uint32_t LEAF_NODE_SPACE_FOR_CELL = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-// Max that can be occupied in one page can be found by dividing Available space by cell size
-const uint32_t LEAF_NODE_MAX_CELL = LEAF_NODE_SPACE_FOR_CELL / LEAF_NODE_CELL_SIZE;
-const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELL + 1) / 2; // leaf node right split count
-// leaf node left split count
-const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELL + 1) - (LEAF_NODE_RIGHT_SPLIT_COUNT);
+// Leaf Node Body layout start here
+const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_SLOTS_OFFSET = (LEAF_NODE_HEADER_SIZE + 7) / 8 * 8;
+const uint32_t LEAF_NODE_SLOT_SIZE = sizeof(LeafSlot);
+/*
+Packed leaves (format version 6) store the keys as 16 bit deltas from a base key, which dense ids allow:
+a leaf is packed when all its keys are within LEAF_NODE_PACKED_MAX_DELTA of the smallest one (and
+db_config.packed_keys is on). The high bit of the node type byte marks it, the header stays the same:
+    offset 24 : base key, the smallest key when the leaf was packed
+    offset 28 : slots, each { key - base u16, payload offset u16, payload size u16 }
+That saves 2 of the 8 bytes per cell. Leaves are packed or unpacked only when they are rebuilt
+(leaf_node_fill()), an insert with a key outside the delta range rebuilds the page.
+*/
+const uint8_t LEAF_NODE_PACKED_FLAG = 0x80;
+const uint32_t LEAF_NODE_PACKED_BASE_OFFSET = LEAF_NODE_SLOTS_OFFSET;
+const uint32_t LEAF_NODE_PACKED_BASE_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_PACKED_SLOTS_OFFSET = LEAF_NODE_PACKED_BASE_OFFSET + LEAF_NODE_PACKED_BASE_SIZE;
+const uint32_t LEAF_NODE_PACKED_SLOT_SIZE = sizeof(PackedLeafSlot);
+const uint32_t LEAF_NODE_PACKED_MAX_DELTA = UINT16_MAX;
+// Slots and payloads (and the base key of a packed leaf) share the rest of the page, PAGE_USABLE_SIZE - LEAF_NODE_SLOTS_OFFSET (see set_page_size())
+uint32_t LEAF_NODE_SPACE_FOR_CELL;
+// Longest payload (username and email at their column limits), a page always holds a dozen of them
+const uint32_t LEAF_NODE_MAX_PAYLOAD_SIZE = 1 + COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE;
+const uint32_t LEAF_NODE_MAX_CELL_SPACE = LEAF_NODE_SLOT_SIZE + 1 + COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE;
+// A leaf whose slots and payloads use less than this (half the space) after a delete is merged with or refilled from a sibling
+uint32_t LEAF_NODE_MIN_FILL;
+
+/*
+Secondary indexes (index.c) are B+trees of their own in the same file, built from the same nodes. Their keys
+are 32 bit like the ids, so a column value is hashed (CRC32C) instead of stored:
+    key         : the top INDEX_BUCKET_BITS bits of the hash pick a bucket, the rest numbers its chunks
+    payload     : up to INDEX_CHUNK_MAX_ENTRIES entries { row id u32, low 16 bits of the hash u16 }
+The chunks of a bucket count down from the highest number, new entries go to the lowest (first) chunk and
+a full one gets a new chunk in front of it. A lookup reads the chunks of one bucket, keeps the ids whose
+16 bit fingerprint matches and then compares the value in the rows themselves.
+*/
+#define INDEX_BUCKET_BITS 12
+const uint32_t INDEX_CHUNK_BITS = 32 - INDEX_BUCKET_BITS;
+const uint32_t INDEX_CHUNK_MASK = (1u << (32 - INDEX_BUCKET_BITS)) - 1;
+const uint32_t INDEX_ENTRY_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+const uint32_t INDEX_CHUNK_MAX_ENTRIES = LEAF_NODE_MAX_PAYLOAD_SIZE / (sizeof(uint32_t) + sizeof(uint16_t));
+
+// Format version 1 leaves: fixed cells of key + serialized row right after a 14 byte header, upgraded on open
+const uint32_t LEGACY_LEAF_NODE_HEADER_SIZE = LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+const uint32_t LEGACY_LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + ROW_SIZE;
 // Leaf Node Body layout end here
 
 /*
@@ -203,20 +896,115 @@ const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NO
 
 /*
 Internal Node Body layout start here
-Notice our huge branching factor. Because each child pointer / key pair is so small, we can fit 510 keys and 511 child pointers in each internal node. That means we’ll never have to traverse many layers of the tree to find a given key!
+The keys and the child pointers are kept in two separate arrays, so internal_node_find_child() can scan
+the keys with vector loads. The key array starts on a 16 byte boundary, the child array follows the
+last key slot:
+    offset 16            : keys[INTERNAL_NODE_MAX_CELL]
+    offset 16 + 4 * max  : children[INTERNAL_NODE_MAX_CELL] (child i holds keys <= keys[i])
+Notice our huge branching factor. Because each child pointer / key pair is so small, we can fit 510 keys and 511 child pointers in each internal node of a 4 KB page (8190 in a 64 KB page). That means we’ll never have to traverse many layers of the tree to find a given key!
 */
 const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
+const uint32_t INTERNAL_NODE_KEYS_OFFSET = (INTERNAL_NODE_HEADER_SIZE + 15) / 16 * 16;
 // Internal Node Body layout end here
 
 /*
-INTERNAL_NODE_MAX_CELL = (Page Size − Header Size) / (Poimter size + key size)
+INTERNAL_NODE_MAX_CELL = (Usable Page Size − Keys Offset) / (Pointer size + key size)
+INTERNAL_NODE_CHILDREN_OFFSET = Keys Offset + INTERNAL_NODE_MAX_CELL * key size
+Both depend on the page size and are set by set_page_size().
 */
-const uint32_t INTERNAL_NODE_MAX_CELL = 3;
+uint32_t INTERNAL_NODE_MAX_CELL;
+uint32_t INTERNAL_NODE_CHILDREN_OFFSET;
+// internal_node_find_child() narrows the search down to this many keys, then compares them all at once
+const uint32_t INTERNAL_NODE_SEARCH_WINDOW = 32;
+// An internal node below this many keys is merged with or refilled from a sibling, a split leaves the smaller half with exactly this many
+// (INTERNAL_NODE_MAX_CELL - 1) / 2, set by set_page_size()
+uint32_t INTERNAL_NODE_MIN_CELL;
+
+// Free page layout: common node header (type FREE_NODE) followed by the next free page
+const uint32_t FREE_PAGE_NEXT_OFFSET = COMMON_NODE_HEADER_SIZE;
+
+/*
+Binary batch protocol (--binary, see binary_protocol.c). Requests and responses are frames, every integer
+is in host byte order:
+    request  : uint32 length | uint8 opcode | payload   (length counts opcode and payload)
+    response : uint32 length | uint8 status | data      (length counts status and data)
+Request payloads, rows are packed in their serialized form (ROW_SIZE bytes, strings NUL terminated):
+    BINARY_OP_INSERT : rows                  data: one ExecuteResult byte per row
+    BINARY_OP_UPDATE : rows                  data: one ExecuteResult byte per row
+    BINARY_OP_DELETE : uint32 ids            data: one ExecuteResult byte per id
+    BINARY_OP_SELECT : uint32 min, uint32 max data: the rows with min <= id <= max, packed
+A status other than BINARY_STATUS_OK comes without data. A write frame is one unit of durability, it is
+committed to the write-ahead log once, but not atomic for readers: every row becomes visible to snapshots
+as soon as it is applied, so a concurrent reader may see part of a frame.
+*/
+const uint8_t BINARY_OP_INSERT = 1;
+const uint8_t BINARY_OP_UPDATE = 2;
+const uint8_t BINARY_OP_DELETE = 3;
+const uint8_t BINARY_OP_SELECT = 4;
+const uint8_t BINARY_STATUS_OK = 0;
+const uint8_t BINARY_STATUS_BAD_REQUEST = 1; // unknown opcode, payload size or unterminated string
+const uint32_t BINARY_MAX_FRAME = 16 * 1024 * 1024;
+
+// Response frames being built, binary_execute() appends one after `size`
+typedef struct
+{
+    char *data;
+    uint32_t size;
+    uint32_t capacity;
+} BinaryResponse;
+
+/*
+Network server (--serve, see server.c): binary protocol frames over TCP. Every event loop thread owns the
+connections it accepted. Requests that write are executed by loop 0, which runs on the writer thread, the
+other loops hand them over and wait for the response before they read on; selects run on any loop.
+*/
+typedef struct ServerConnection_t
+{
+    int fd;
+    struct ServerLoop_t *loop;       // loop that accepted the connection, the only one touching its buffers
+    char *input;                     // bytes read and not yet executed, starting with a request frame
+    uint32_t input_size;
+    uint32_t input_capacity;
+    BinaryResponse output;           // responses not yet sent, from output_sent on
+    uint32_t output_sent;
+    BinaryResponse forwarded;        // response of the write request loop 0 is executing for this connection
+    bool waiting;                    // a write request was handed to loop 0
+    bool input_closed;               // the client has sent everything, close once it has all responses
+    bool closing;                    // the peer is gone, free the connection once loop 0 is done with it
+    uint32_t events;                 // events the connection is registered for
+    struct ServerConnection_t *next_job; // in loop 0's queue of write requests, then in the owner's done list
+    struct ServerConnection_t *prev;     // connections of the loop
+    struct ServerConnection_t *next;
+} ServerConnection;
+
+typedef struct ServerLoop_t
+{
+    struct Server_t *server;
+    uint32_t index;             // loop 0 runs on the writer thread
+    int epoll_fd;
+    int wake_fd;                // eventfd, signalled when jobs or finished jobs arrive and on shutdown
+    pthread_t thread;
+    pthread_mutex_t mutex;      // protects jobs and done
+    ServerConnection *jobs;     // loop 0: write requests of the other loops, in arrival order
+    ServerConnection *jobs_tail;
+    ServerConnection *done;     // connections whose write request loop 0 has executed
+    ServerConnection *connections; // every open connection of the loop
+} ServerLoop;
+
+typedef struct Server_t
+{
+    Table *table;
+    int listen_fd;
+    uint32_t num_loops;
+    ServerLoop *loops;
+} Server;
 
 //db.c
+extern DbConfig db_config;
 Table *db_open(const char *filename);
+int parse_db_option(int argc, char *argv[], int i);
 void print_prompt();
 void db_close(Table *table);
 
@@ -230,30 +1018,183 @@ MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table);
 PrepareResult prepare_insert(InputBuffer *input_buffer, Statement *statement);
 PrepareResult preare_update(InputBuffer *input_buffer, Statement *statement);
 PrepareResult prepare_delete(InputBuffer *input_buffer, Statement *statement);
+PrepareResult prepare_select(InputBuffer *input_buffer, Statement *statement);
 PrepareResult prepare_statement(InputBuffer *input_buffer, Statement *statement);
+ExecuteResult execute_insert_row(Table *table, const void *row);
 ExecuteResult execute_insert(Statement *statement, Table *table);
+ExecuteResult execute_update_row(Table *table, const void *row);
 ExecuteResult execute_update(Statement *statement, Table *table);
+ExecuteResult execute_delete_key(Table *table, uint32_t row_key);
 ExecuteResult execute_delete(Statement *statement, Table *table);
 ExecuteResult execute_select(Statement *statement, Table *table);
 ExecuteResult execute_statement(Statement *statement, Table *table);
 
+// crc32c.c
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+// index.c
+void index_load(Table *table);
+bool index_any(Table *table);
+void index_add_row(Table *table, const RowView *row);
+void index_remove_row(Table *table, const RowView *row);
+void index_update_row(Table *table, const RowView *old_row, const RowView *new_row);
+ExecuteResult index_create(Table *table, IndexColumn column);
+uint32_t index_root_at(Pager *pager, Snapshot *snapshot, IndexColumn column);
+uint32_t index_lookup(Pager *pager, uint32_t root_page_num, const Snapshot *snapshot, const char *value,
+                      uint32_t length, uint32_t **ids);
+
+// wal.c
+uint32_t wal_checksum(uint32_t hash, const void *data, uint32_t length);
+Wal *wal_open(Pager *pager, const char *db_filename);
+void wal_log_range(Pager *pager, uint32_t page_num, uint32_t offset, uint32_t length);
+void wal_note_page(Pager *pager, uint32_t page_num);
+void wal_capture_pending(Pager *pager);
+void wal_commit(Pager *pager);
+void wal_sync(Wal *wal, off_t lsn);
+void wal_sync_lagging(Wal *wal);
+void wal_rollback(Wal *wal);
+void wal_checkpoint(Pager *pager);
+void wal_close(Pager *pager);
+
+// stats.c
+extern DbStats db_stats;
+uint64_t stats_now_ns();
+void stats_record_latency(StatementType type, uint64_t ns);
+MetaCommandResult stats_command(const char *argument);
+
+// transaction.c
+ExecuteResult transaction_begin(Table *table);
+ExecuteResult transaction_commit(Table *table);
+ExecuteResult transaction_rollback(Table *table);
+
+// vacuum.c
+MetaCommandResult vacuum_command(Table *table, const char *argument);
+
+// backup.c
+MetaCommandResult backup_command(Table *table, const char *argument);
+void backup_wait(Table *table);
+bool backup_running(Table *table);
+
+// warm_cache.c
+WarmCache *warm_cache_open(Pager *pager, const char *db_filename);
+void warm_cache_close(WarmCache *warm_cache);
+
+// prepared.c
+void prepared_init(PreparedStatement *prepared, Table *table, StatementType type);
+PrepareResult prepared_bind_row(PreparedStatement *prepared, uint32_t id, const char *username, const char *email);
+void prepared_bind_id(PreparedStatement *prepared, uint32_t id);
+void prepared_bind_range(PreparedStatement *prepared, uint32_t min_id, uint32_t max_id);
+ExecuteResult prepared_execute(PreparedStatement *prepared);
+
+// binary_protocol.c
+void binary_response_reserve(BinaryResponse *response, uint32_t extra);
+bool binary_request_writes(uint8_t opcode);
+void binary_execute(Table *table, const char *request, uint32_t length, BinaryResponse *response);
+void serve_binary(Table *table, int in_fd, int out_fd);
+
+// server.c
+void serve_network(Table *table, uint16_t port, uint32_t num_loops);
+
+// output.c
+void output_sink_init(OutputSink *sink, int fd, OutputMode mode);
+void output_sink_free(OutputSink *sink);
+OutputSink *output_stdout_sink();
+void output_flush(OutputSink *sink);
+void output_row(OutputSink *sink, const RowView *row);
+void output_row_columns(OutputSink *sink, const RowView *row, uint32_t columns);
+bool output_parse_mode(const char *name, OutputMode *mode);
+MetaCommandResult output_mode_command(const char *argument);
+
+// parallel_scan.c
+uint32_t parallel_scan_threads();
+uint32_t parallel_scan(Table *table, uint32_t min_id, uint32_t max_id, uint32_t threads, ScanVisitor visit,
+                       void *contexts, size_t context_size);
+uint64_t parallel_count(Table *table, uint32_t min_id, uint32_t max_id);
+
+// bulk_load.c
+uint32_t bulk_load_leaf_capacity(void);
+ExecuteResult bulk_load(Table *table, Row *rows, uint32_t num_rows);
+MetaCommandResult import_file(Table *table, const char *filename);
+
 // pager.c
+bool page_size_is_valid(uint32_t page_size);
+void set_page_size(uint32_t page_size, uint32_t reserved_size);
 Pager *page_open(const char *filename);
 void *get_page(Pager *pager, uint32_t page_num);
 void pager_flush(Pager *pager, uint32_t page_num);
+void pager_mark_dirty(Pager *pager, uint32_t page_num);
+void pager_mark_dirty_range(Pager *pager, uint32_t page_num, uint32_t offset, uint32_t length);
+Frame *pager_frame(Pager *pager, uint32_t page_num);
+void pager_flush_dirty(Pager *pager);
+void pager_pin(Pager *pager, uint32_t page_num);
+void pager_unpin(Pager *pager, uint32_t page_num);
+void pager_release_pages(Pager *pager);
+void pager_lock(Pager *pager);
+void pager_unlock(Pager *pager);
+void pager_open_snapshot(Pager *pager, Snapshot *snapshot);
+void pager_open_shared_snapshot(Pager *pager, Snapshot *snapshot);
+void pager_close_snapshot(Pager *pager, Snapshot *snapshot);
+void *pager_fetch_snapshot(Pager *pager, uint32_t page_num, Snapshot *snapshot, PageVersion **version);
+void pager_release_snapshot(Pager *pager, uint32_t page_num, PageVersion *version);
+bool pager_page_changed(Pager *pager, uint32_t page_num, const Snapshot *snapshot);
+void pager_copy_snapshot_page(Pager *pager, uint32_t page_num, Snapshot *snapshot, void *destination);
+void pager_start_leaf_write(Pager *pager);
+void pager_latch_tree(Pager *pager);
+void pager_latch_page(Pager *pager, uint32_t page_num);
+void pager_begin_transaction(Pager *pager);
+void pager_commit_transaction(Pager *pager);
+void pager_rollback_transaction(Pager *pager);
+void pager_new_page_epoch(Pager *pager);
+bool pager_truncate(Pager *pager, uint32_t num_pages);
+void pager_advise(Pager *pager, PagerAccess access);
+void pager_start_writeback(Pager *pager);
+void pager_close(Pager *pager);
 void serialize_row(Row *source, void *destination);
+void serialize_row_view(const RowView *source, void *destination);
 void deserialize_row(void *source, Row *destination);
+void deserialize_row_view(const void *source, RowView *destination);
 uint32_t get_unused_page_num(Pager *pager);
 
+// arena.c
+void *arena_alloc(Arena *arena, size_t size);
+ArenaMark arena_mark(Arena *arena);
+void arena_rewind(Arena *arena, ArenaMark mark);
+void arena_free(Arena *arena);
+
 // cursor.c
 Cursor *start_table(Table *table);
-void *cursor_value(Cursor *cursor);
+Cursor *table_seek(Table *table, uint32_t key);
+void cursor_row(Cursor *cursor, RowView *row);
 void cursor_advance(Cursor *cursor);
+Cursor *cursor_open(Table *table, uint32_t page_num);
+void cursor_close(Cursor *cursor);
+Cursor *reader_seek(Table *table, uint32_t key);
+Cursor *reader_seek_snapshot(Table *table, uint32_t key, const Snapshot *snapshot);
+void reader_row(Cursor *cursor, RowView *row);
+const void *reader_payload(Cursor *cursor, uint32_t *size);
+uint32_t reader_key(Cursor *cursor);
+void reader_advance(Cursor *cursor);
+void reader_close(Cursor *cursor);
+void reader_set_filter(Cursor *cursor, const RowFilter *filter);
+bool row_filter_matches(const RowFilter *filter, const RowView *row);
+
+// read_ahead.c
+void reader_read_ahead(Cursor *cursor, uint32_t max_key);
+void read_ahead_advance(Cursor *cursor);
+void read_ahead_close(Cursor *cursor);
+
+// hot_keys.c
+HotKeys *hot_keys_create(uint32_t kb);
+void hot_keys_free(HotKeys *hot_keys);
+uint32_t hot_keys_epoch(Cursor *cursor);
+bool hot_keys_lookup(Cursor *cursor, uint32_t key, uint32_t epoch);
+void hot_keys_remember(Cursor *cursor, uint32_t key, uint32_t epoch);
 
 // internal_node.c
 uint32_t *internal_node_num_keys(void *node);
 uint32_t *internal_node_right_child(void *node);
-uint32_t *internal_node_cell(void *node, uint32_t cell_num);
+uint32_t *internal_node_keys(void *node);
+uint32_t *internal_node_children(void *node);
 uint32_t *internal_node_child(void *node, uint32_t child_num);
 uint32_t *internal_node_key(void *node, uint32_t key_num);
 void initialize_internal_node(void *node);
@@ -262,17 +1203,38 @@ Cursor *find_internal_node(Table *table, uint32_t page_num, uint32_t key);
 void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t child_page_num);
 void internal_node_insert(Table *table, uint32_t parent_page_num, uint32_t child_page_num);
 uint32_t *update_internal_node_key(void *node, uint32_t old_key, uint32_t new_key);
+uint32_t internal_node_child_index(void *node, uint32_t child_page_num);
+void internal_node_remove_key(void *node, uint32_t key_num);
+void internal_node_rebalance(Table *table, uint32_t page_num);
+void upgrade_internal_nodes(Pager *pager, uint32_t page_num);
 
 // leaf_node.c
 uint32_t *leaf_node_num_cells(void *node);
-void *leaf_node_cell(void *node, uint32_t cell_num);
-uint32_t *leaf_node_key(void *node, uint32_t cell_num);
 uint32_t *leaf_node_next_leaf(void *node);
-void *leaf_node_value(void *node, uint32_t cell_num);
+uint32_t leaf_node_key(void *node, uint32_t cell_num);
+uint32_t leaf_node_lower_bound(void *node, uint32_t key);
+void *leaf_node_cell(void *node, uint32_t cell_num);
+uint32_t leaf_node_cell_size(void *node, uint32_t cell_num);
+void leaf_node_row(void *node, uint32_t cell_num, RowView *row);
+uint32_t leaf_node_payload_size(const void *row);
+uint32_t leaf_node_used_space(void *node);
+uint32_t leaf_node_space_for(uint32_t num_cells, uint32_t payload_bytes, uint32_t min_key, uint32_t max_key);
+bool leaf_node_has_room(void *node, uint32_t key, uint32_t payload_size);
+bool leaf_node_can_replace(void *node, uint32_t cell_num, uint32_t payload_size);
+bool leaf_node_underfull_after_delete(void *node, uint32_t cell_num);
+void leaf_node_append(void *node, uint32_t key, const void *row);
+void leaf_node_fill_rows(Pager *pager, void *node, const Row *rows, uint32_t num_rows);
 void initialize_leaf_node(void *node);
 Cursor *find_leaf_node(Table *table, uint32_t page_num, uint32_t key);
-void leaf_node_split_insert(Cursor *cursor, uint32_t key, Row *value);
-void leaf_node_insert(Cursor *cursor, uint32_t key, Row *value);
+void leaf_node_split_insert(Cursor *cursor, uint32_t key, const void *payload, uint32_t size);
+void leaf_node_insert_payload(Cursor *cursor, uint32_t key, const void *payload, uint32_t size);
+void leaf_node_insert(Cursor *cursor, uint32_t key, const void *value);
+void leaf_node_replace_payload(Cursor *cursor, const void *payload, uint32_t size);
+void leaf_node_replace(Cursor *cursor, const void *value);
+void leaf_node_delete(Cursor *cursor);
+void leaf_node_rebalance(Table *table, uint32_t page_num);
+bool leaf_node_refill(Table *table, uint32_t *page_num, uint32_t capacity);
+void upgrade_leaf_nodes(Pager *pager, uint32_t root_page_num);
 
 // btree.c
 NodeType get_node_type(void *node);
@@ -282,6 +1244,27 @@ void set_node_root(void *node, bool is_root);
 uint32_t *node_parent(void *node);
 uint32_t get_node_max_key(Pager *pager, void *node);
 Cursor *find_table(Table *table, uint32_t key);
+Cursor *find_append_position(Table *table, uint32_t key);
+void remember_rightmost_leaf(Table *table, uint32_t leaf_page_num);
+uint32_t tree_height(Table *table);
+void collapse_root(Table *table);
+void node_after_remove(Table *table, uint32_t page_num);
+
+// header.c
+bool header_is_valid(void *header);
+void initialize_header(void *header, uint32_t root_page_num);
+uint32_t *header_root_page_num(void *header);
+uint32_t *header_freelist_head(void *header);
+uint32_t *header_freelist_count(void *header);
+uint32_t *header_format_version(void *header);
+uint32_t *header_page_size(void *header);
+uint32_t *header_reserved_size(void *header);
+uint32_t *header_index_roots(void *header);
+uint32_t header_checksum(void *header);
+uint32_t *header_stored_checksum(void *header);
+uint32_t *free_page_next(void *page);
+void free_page(Pager *pager, uint32_t page_num);
+uint32_t freelist_pop(Pager *pager);
 void create_new_root(Table *table, uint32_t right_child_page_num);
 
 // test.c
@@ -0,0 +1,75 @@
+#include "constants.h"
+
+/*
+CRC32C (Castagnoli polynomial, reflected 0x82F63B78), the checksum in the trailer of every page. With
+SSE4.2 (x86, e.g. -msse4.2 or -march=native) or the ARMv8 CRC extension the CPU computes it 8 bytes per
+instruction, otherwise a slicing-by-8 table does 8 bytes per step.
+*/
+
+#if !defined(__SSE4_2__) && !(defined(__ARM_FEATURE_CRC32) && defined(__aarch64__))
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_build_table()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int slice = 1; slice < 8; slice++)
+            crc32c_table[slice][i] = (crc32c_table[slice - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[slice - 1][i] & 0xff];
+}
+#endif
+
+/**
+ * @brief Computes the CRC32C of a block of bytes.
+ *
+ * @param crc 0 to start, or the result for the bytes before `data` to continue a checksum.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ *
+ * @return The CRC32C of everything so far.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t crc64 = crc;
+    for (; length >= 8; length -= 8, bytes += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; length > 0; length--)
+        crc = _mm_crc32_u8(crc, *bytes++);
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+    for (; length >= 8; length -= 8, bytes += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; length--)
+        crc = __crc32cb(crc, *bytes++);
+#else
+    pthread_once(&crc32c_table_once, crc32c_build_table);
+    // Little endian words, the low byte goes through the last table
+    for (; length >= 8; length -= 8, bytes += 8)
+    {
+        uint32_t low = crc ^ ((uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+        crc = crc32c_table[7][low & 0xff] ^ crc32c_table[6][(low >> 8) & 0xff] ^ crc32c_table[5][(low >> 16) & 0xff] ^
+              crc32c_table[4][low >> 24] ^ crc32c_table[3][bytes[4]] ^ crc32c_table[2][bytes[5]] ^
+              crc32c_table[1][bytes[6]] ^ crc32c_table[0][bytes[7]];
+    }
+    for (; length > 0; length--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *bytes++) & 0xff];
+#endif
+    return ~crc;
+}
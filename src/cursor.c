@@ -26,20 +26,49 @@ Cursor *start_table(Table *table)
 }
 
 /**
- * @brief Retrieves the memory location of a specific row in a table.
+ * @brief Positions a cursor on the first row with an id of at least `key`.
  *
- * This function uses paging to locate the correct memory page and then determines
- * the exact byte offset of the row within that page.
+ * find_table() returns the position where `key` would be inserted, which can be
+ * one past the last cell of its leaf (the parent keys only bound the leaves from
+ * above). In that case the cursor moves on to the first cell of the next leaf.
+ *
+ * @param table A pointer to the table to search.
+ * @param key The smallest id the caller is interested in.
+ *
+ * @return A cursor on the first matching row, `end_of_table` is set if there is none.
+ */
+Cursor *table_seek(Table *table, uint32_t key)
+{
+    Cursor *cursor = find_table(table, key);
+    void *node = get_page(table->pager, cursor->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (num_cells == 0)
+    {
+        cursor->end_of_table = true; // only the root leaf of an empty table has no cells
+    }
+    else if (cursor->cell_num >= num_cells)
+    {
+        // cursor_advance() steps to the next leaf once cell_num passes the last cell
+        cursor->cell_num = num_cells - 1;
+        cursor_advance(cursor);
+    }
+    return cursor;
+}
+
+/**
+ * @brief Reads the row the cursor points to.
+ *
+ * This function uses paging to locate the correct memory page and then reads the row
+ * from its cell in place.
  *
  * @param cursor A pointer to a Cursor object, which tracks the current position in the table.
  *               It contains details like the table reference, pager, page number, and cell number.
- *
- * @return A pointer to the location in memory where the specified row is stored.
+ * @param row Filled in, its strings point into the page and are not NUL terminated.
  */
-void *cursor_value(Cursor *cursor)
+void cursor_row(Cursor *cursor, RowView *row)
 {
     void *page = get_page(cursor->table->pager, cursor->page_num); // Fetch the Page from the Pager
-    return leaf_node_value(page, cursor->cell_num);
+    leaf_node_row(page, cursor->cell_num, row);
 }
 
 /**
@@ -52,6 +81,7 @@ void *cursor_value(Cursor *cursor)
  */
 void cursor_advance(Cursor *cursor)
 {
+    db_stats.cursor_advances++;
     void *node = get_page(cursor->table->pager, cursor->page_num); // Fetch the current node (page) from the pager
 
     cursor->cell_num += 1; // Move the cursor to the next cell
@@ -67,8 +97,280 @@ void cursor_advance(Cursor *cursor)
         }
         else
         {
+            // Move the pin along with the cursor
+            pager_pin(cursor->table->pager, next_page_num);
+            pager_unpin(cursor->table->pager, cursor->page_num);
             cursor->page_num = next_page_num;
             cursor->cell_num = 0;
         }
     }
 }
+
+/**
+ * @brief Makes a writer cursor on the first cell of a leaf and pins the leaf.
+ *
+ * Cursors closed with cursor_close() are kept on the pager and handed out again, so a statement does not
+ * malloc() one. Only the writer thread may call this, read cursors come from reader_seek().
+ *
+ * @param table A pointer to the table.
+ * @param page_num The leaf the cursor is positioned on.
+ * @return The cursor, release it with cursor_close().
+ */
+Cursor *cursor_open(Table *table, uint32_t page_num)
+{
+    Pager *pager = table->pager;
+    Cursor *cursor = pager->free_cursors;
+    if (cursor != NULL)
+        pager->free_cursors = cursor->node;
+    else
+        cursor = malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->page_num = page_num;
+    cursor->cell_num = 0;
+    cursor->end_of_table = false;
+    cursor->node = NULL;
+    cursor->read_ahead = NULL;
+    pager_pin(pager, page_num);
+    return cursor;
+}
+
+/**
+ * @brief Releases a cursor created by find_table(), find_leaf_node() or start_table().
+ *
+ * Unpins the page the cursor is positioned on and keeps the cursor for the next cursor_open().
+ *
+ * @param cursor A pointer to the Cursor to release.
+ */
+void cursor_close(Cursor *cursor)
+{
+    Pager *pager = cursor->table->pager;
+    pager_unpin(pager, cursor->page_num);
+    cursor->node = pager->free_cursors;
+    pager->free_cursors = cursor;
+}
+
+/*
+Read cursors. They can be used from any thread while the writer keeps working, see the concurrency notes
+in constants.h. Every page is read as of the snapshot the cursor took in reader_seek(), so a scan sees the
+table of one moment however long it runs. The cursor holds its leaf (a version of it or the latched current
+page), the row it points to can not change under it.
+*/
+
+/*
+Descends from the root to the leaf for `key`. One page is held at a time, the snapshot keeps them consistent.
+With a hot key cache a key found before goes straight to its leaf, see hot_keys.c.
+*/
+static void reader_descend(Cursor *cursor, uint32_t key)
+{
+    Pager *pager = cursor->table->pager;
+    uint32_t epoch = cursor->table->hot_keys != NULL ? hot_keys_epoch(cursor) : HOT_KEYS_NO_EPOCH;
+    if (epoch != HOT_KEYS_NO_EPOCH && hot_keys_lookup(cursor, key, epoch))
+        return;
+
+    uint32_t page_num = cursor->table->root_page_num;
+    PageVersion *version;
+    void *node = pager_fetch_snapshot(pager, page_num, &cursor->snapshot, &version);
+    while (get_node_type(node) == INTERNAL_NODE)
+    {
+        uint32_t child_page_num = *internal_node_child(node, internal_node_find_child(node, key));
+        pager_release_snapshot(pager, page_num, version);
+        page_num = child_page_num;
+        node = pager_fetch_snapshot(pager, page_num, &cursor->snapshot, &version);
+    }
+
+    cursor->page_num = page_num;
+    cursor->cell_num = leaf_node_lower_bound(node, key);
+    cursor->node = node;
+    cursor->version = version;
+    if (epoch != HOT_KEYS_NO_EPOCH && cursor->cell_num < *leaf_node_num_cells(node) &&
+        leaf_node_key(node, cursor->cell_num) == key)
+        hot_keys_remember(cursor, key, epoch);
+}
+
+// Whether `length` bytes of `value` match a like pattern, see RowFilter. A % backs off to the last one seen.
+static bool like_matches(const char *pattern, uint32_t pattern_length, const char *value, uint32_t length)
+{
+    uint32_t p = 0, v = 0;
+    uint32_t star = UINT32_MAX, star_v = 0;
+    while (v < length)
+    {
+        if (p < pattern_length && (pattern[p] == '_' || pattern[p] == value[v]))
+        {
+            p++;
+            v++;
+        }
+        else if (p < pattern_length && pattern[p] == '%')
+        {
+            star = p++;
+            star_v = v;
+        }
+        else if (star != UINT32_MAX)
+        {
+            p = star + 1;
+            v = ++star_v;
+        }
+        else
+            return false;
+    }
+    while (p < pattern_length && pattern[p] == '%')
+        p++;
+    return p == pattern_length;
+}
+
+// Whether a row passes the condition of a filter, the row is usually read in place (leaf_node_row()).
+bool row_filter_matches(const RowFilter *filter, const RowView *row)
+{
+    if (filter->column == INDEX_NONE)
+        return true;
+    const char *value = filter->column == INDEX_USERNAME ? row->username : row->email;
+    uint32_t length = filter->column == INDEX_USERNAME ? row->username_length : row->email_length;
+    if (filter->like)
+        return like_matches(filter->value, filter->value_length, value, length);
+    return length == filter->value_length && memcmp(value, filter->value, length) == 0;
+}
+
+/*
+Moves past the end of a leaf to the first cell of the next one, the leaf is let go before the next one is
+fetched. With a filter the cells that fail it are passed over too, until a row past filter->max_key.
+*/
+static void reader_settle(Cursor *cursor)
+{
+    Pager *pager = cursor->table->pager;
+    const RowFilter *filter = cursor->filter;
+    while (true)
+    {
+        if (cursor->cell_num < *leaf_node_num_cells(cursor->node))
+        {
+            if (filter == NULL || filter->column == INDEX_NONE)
+                return;
+            RowView row;
+            leaf_node_row(cursor->node, cursor->cell_num, &row);
+            if (row.id > filter->max_key || row_filter_matches(filter, &row))
+                return;
+            cursor->cell_num++;
+            continue;
+        }
+        uint32_t next_page_num = *leaf_node_next_leaf(cursor->node);
+        pager_release_snapshot(pager, cursor->page_num, cursor->version);
+        cursor->node = NULL;
+        if (next_page_num == 0)
+        {
+            cursor->end_of_table = true;
+            return;
+        }
+        if (cursor->read_ahead != NULL)
+            read_ahead_advance(cursor);
+        cursor->node = pager_fetch_snapshot(pager, next_page_num, &cursor->snapshot, &cursor->version);
+        cursor->page_num = next_page_num;
+        cursor->cell_num = 0;
+    }
+}
+
+/**
+ * @brief Takes a snapshot and positions a read cursor on the first row with an id of at least `key`.
+ *
+ * @param table A pointer to the table to read.
+ * @param key The smallest id the caller is interested in.
+ *
+ * @return A cursor on the first matching row, `end_of_table` is set if there is none. Release it with reader_close().
+ */
+Cursor *reader_seek(Table *table, uint32_t key)
+{
+    Cursor *cursor = malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->end_of_table = false;
+    cursor->read_ahead = NULL;
+    cursor->filter = NULL;
+    pager_open_snapshot(table->pager, &cursor->snapshot);
+    reader_descend(cursor, key);
+    reader_settle(cursor);
+    return cursor;
+}
+
+/**
+ * @brief Like reader_seek() but reads as of a snapshot the caller already holds, so several cursors (on
+ * several threads) see the same moment of the table.
+ *
+ * @param table A pointer to the table to read.
+ * @param key The smallest id the caller is interested in.
+ * @param snapshot Taken with pager_open_snapshot(), it must stay open until the cursor is closed.
+ *
+ * @return A cursor on the first matching row, release it with reader_close() (which leaves the snapshot open).
+ */
+Cursor *reader_seek_snapshot(Table *table, uint32_t key, const Snapshot *snapshot)
+{
+    Cursor *cursor = malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->end_of_table = false;
+    cursor->read_ahead = NULL;
+    cursor->filter = NULL;
+    cursor->snapshot.ts = snapshot->ts;
+    cursor->snapshot.registered = false; // the owner keeps it registered, reader_close() leaves it alone
+    cursor->snapshot.older = NULL;
+    cursor->snapshot.newer = NULL;
+    reader_descend(cursor, key);
+    reader_settle(cursor);
+    return cursor;
+}
+
+/**
+ * @brief Makes a read cursor skip the rows a filter rejects and fill in only the columns it projects. The
+ * cursor moves on to the first row that passes, unless it is on one already.
+ *
+ * @param cursor A read cursor (reader_seek()).
+ * @param filter Kept by the cursor, the caller keeps it (and its value) alive until reader_close().
+ */
+void reader_set_filter(Cursor *cursor, const RowFilter *filter)
+{
+    cursor->filter = filter;
+    if (!cursor->end_of_table)
+        reader_settle(cursor);
+}
+
+void reader_row(Cursor *cursor, RowView *row)
+{
+    const RowFilter *filter = cursor->filter;
+    if (filter != NULL && (filter->columns & (SELECT_COLUMN_USERNAME | SELECT_COLUMN_EMAIL)) == 0)
+    {
+        // An id is all the slot holds, the payload is not touched
+        row->id = leaf_node_key(cursor->node, cursor->cell_num);
+        row->username_length = row->email_length = 0;
+        row->username = row->email = NULL;
+        return;
+    }
+    leaf_node_row(cursor->node, cursor->cell_num, row);
+    if (filter != NULL && (filter->columns & SELECT_COLUMN_USERNAME) == 0)
+        row->username_length = 0;
+    if (filter != NULL && (filter->columns & SELECT_COLUMN_EMAIL) == 0)
+        row->email_length = 0;
+}
+
+// The payload of the cell the cursor points to as it is stored, for trees whose cells are not rows (index.c).
+const void *reader_payload(Cursor *cursor, uint32_t *size)
+{
+    *size = leaf_node_cell_size(cursor->node, cursor->cell_num);
+    return leaf_node_cell(cursor->node, cursor->cell_num);
+}
+
+uint32_t reader_key(Cursor *cursor)
+{
+    return leaf_node_key(cursor->node, cursor->cell_num);
+}
+
+void reader_advance(Cursor *cursor)
+{
+    __atomic_add_fetch(&db_stats.cursor_advances, 1, __ATOMIC_RELAXED);
+    cursor->cell_num++;
+    reader_settle(cursor);
+}
+
+// Lets go of the leaf, the read-ahead and the snapshot, versions only this cursor could still see are freed.
+void reader_close(Cursor *cursor)
+{
+    if (cursor->read_ahead != NULL)
+        read_ahead_close(cursor);
+    if (cursor->node != NULL)
+        pager_release_snapshot(cursor->table->pager, cursor->page_num, cursor->version);
+    pager_close_snapshot(cursor->table->pager, &cursor->snapshot);
+    free(cursor);
+}
@@ -1,10 +1,160 @@
 #include "constants.h"
 
+// Defaults, main.c overrides them from the command line before db_open() is called
+DbConfig db_config = {
+    BUFFER_POOL_DEFAULT_FRAMES,   // buffer_pool_frames
+    false,                        // pager_mmap
+    true,                         // wal_enabled
+    WAL_DEFAULT_GROUP_COMMIT_MS,  // wal_group_commit_ms
+    WAL_DEFAULT_CHECKPOINT_BYTES, // wal_checkpoint_bytes
+    BULK_LOAD_DEFAULT_FILL,       // bulk_load_fill
+    0,                            // scan_threads
+    OUTPUT_TEXT,                  // output_mode
+    DEFAULT_PAGE_SIZE,            // page_size
+    true,                         // page_checksums
+    PAGE_VERIFY_ONCE,             // page_verify
+    true,                         // packed_keys
+    READ_AHEAD_DEFAULT_LEAVES,    // read_ahead_leaves
+    PAGER_DEFAULT_WRITEBACK_MS,   // writeback_ms
+    false,                        // pager_direct
+    0,                            // hot_keys_kb
+    false,                        // warm_cache
+};
+
+/**
+ * @brief Parses one database option from the command line into db_config.
+ *
+ * Shared by every program built on the engine (main.c, bench.c), so the same flags
+ * mean the same thing everywhere:
+ *     --frames N, --mmap, --no-wal, --group-commit-ms N, --checkpoint-kb N, --fill N, --scan-threads N,
+ *     --output text|csv|json|binary, --page-size N (bytes, new files only), --no-page-checksums (new files),
+ *     --verify-pages once|always|off, --no-packed-keys, --read-ahead N (leaves, 0 off),
+ *     --writeback-ms N (0 off), --direct-io, --hot-keys-kb N (0 off), --warm-cache
+ *
+ * @param argc Number of command line arguments.
+ * @param argv The command line arguments.
+ * @param i Index of the option to parse.
+ *
+ * @return Number of arguments consumed (option plus value), 0 if argv[i] is not a
+ *         database option.
+ */
+int parse_db_option(int argc, char *argv[], int i)
+{
+    if (strcmp(argv[i], "--mmap") == 0)
+    {
+        db_config.pager_mmap = true;
+        return 1;
+    }
+    if (strcmp(argv[i], "--direct-io") == 0)
+    {
+        db_config.pager_direct = true;
+        return 1;
+    }
+    if (strcmp(argv[i], "--no-wal") == 0)
+    {
+        db_config.wal_enabled = false;
+        return 1;
+    }
+    if (strcmp(argv[i], "--no-page-checksums") == 0)
+    {
+        db_config.page_checksums = false;
+        return 1;
+    }
+    if (strcmp(argv[i], "--no-packed-keys") == 0)
+    {
+        db_config.packed_keys = false;
+        return 1;
+    }
+    if (strcmp(argv[i], "--warm-cache") == 0)
+    {
+        db_config.warm_cache = true;
+        return 1;
+    }
+    if (i + 1 >= argc)
+        return 0;
+    if (strcmp(argv[i], "--output") == 0)
+        return output_parse_mode(argv[i + 1], &db_config.output_mode) ? 2 : 0;
+    if (strcmp(argv[i], "--verify-pages") == 0)
+    {
+        static const char *modes[] = {"once", "always", "off"};
+        for (uint32_t mode = 0; mode < sizeof(modes) / sizeof(modes[0]); mode++)
+        {
+            if (strcmp(argv[i + 1], modes[mode]) == 0)
+            {
+                db_config.page_verify = (PageVerify)mode;
+                return 2;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t value = (uint32_t)atoi(argv[i + 1]);
+    if (strcmp(argv[i], "--frames") == 0)
+        db_config.buffer_pool_frames = value;
+    else if (strcmp(argv[i], "--group-commit-ms") == 0)
+        db_config.wal_group_commit_ms = value;
+    else if (strcmp(argv[i], "--checkpoint-kb") == 0)
+        db_config.wal_checkpoint_bytes = value * 1024;
+    else if (strcmp(argv[i], "--fill") == 0)
+        db_config.bulk_load_fill = value;
+    else if (strcmp(argv[i], "--scan-threads") == 0)
+        db_config.scan_threads = value;
+    else if (strcmp(argv[i], "--page-size") == 0 && page_size_is_valid(value))
+        db_config.page_size = value;
+    else if (strcmp(argv[i], "--read-ahead") == 0)
+        db_config.read_ahead_leaves = value;
+    else if (strcmp(argv[i], "--writeback-ms") == 0)
+        db_config.writeback_ms = value;
+    else if (strcmp(argv[i], "--hot-keys-kb") == 0)
+        db_config.hot_keys_kb = value;
+    else
+        return 0;
+    return 2;
+}
+
+/*
+Files written before the file header existed keep the root node in page 0. The root is copied to a new
+page at the end of the file, its children are pointed at it and page 0 becomes the header. Nothing else
+references page 0 (a next_leaf of 0 already meant "no sibling"), so no other page has to change.
+*/
+static void migrate_legacy_file(Pager *pager)
+{
+    uint32_t root_page_num = pager->num_pages;
+    void *old_root = get_page(pager, HEADER_PAGE_NUM);
+    void *root = get_page(pager, root_page_num);
+    memcpy(root, old_root, PAGE_SIZE);
+    pager_mark_dirty(pager, root_page_num);
+    upgrade_internal_nodes(pager, root_page_num); // legacy files also use the oldest node layouts
+    upgrade_leaf_nodes(pager, root_page_num);
+    root = get_page(pager, root_page_num);
+    old_root = get_page(pager, HEADER_PAGE_NUM);
+
+    if (get_node_type(root) == INTERNAL_NODE)
+    {
+        for (uint32_t i = 0; i <= *internal_node_num_keys(root); i++)
+        {
+            uint32_t child_page_num = *internal_node_child(root, i);
+            void *child = get_page(pager, child_page_num);
+            *node_parent(child) = root_page_num;
+            pager_mark_dirty(pager, child_page_num);
+        }
+    }
+
+    initialize_header(old_root, root_page_num);
+    pager_mark_dirty(pager, HEADER_PAGE_NUM);
+    printf("Upgraded database file, root moved to page %u.\n", root_page_num);
+}
+
 /**
  * @brief Opens a database file and initializes the table structure.
  *
  * This function loads the database file and sets up the pager for managing pages.
- * If the database file is new (empty), it initializes the first page as a leaf node.
+ * If the database file is new (empty), it writes the file header to page 0 and
+ * initializes page 1 as the root leaf node. Files without a header are migrated,
+ * files written with an older node layout (see HEADER_FORMAT_VERSION) are upgraded.
+ * Unless db_config.wal_enabled is false the write-ahead log is opened first, which
+ * replays whatever a crashed session left in it. With db_config.warm_cache the pages
+ * resident at the last close are loaded again in the background, see warm_cache.c.
  *
  * @param filename The name of the database file to open.
  * @return A pointer to a Table structure representing the database.
@@ -12,20 +162,61 @@
 Table *db_open(const char *filename)
 {
     Pager *pager = page_open(filename);
+    if (db_config.wal_enabled)
+        wal_open(pager, filename);
 
     Table *table = (Table *)malloc(sizeof(Table));
     table->pager = pager;
-    table->root_page_num = 0;
 
     if (pager->num_pages == 0)
     {
-        // New database file. Initialize page 0 as leaf node.
-        void *root = get_page(pager, 0);
+        // New database file. Page 0 is the header, page 1 the root leaf node.
+        uint32_t root_page_num = HEADER_PAGE_NUM + 1;
+        initialize_header(get_page(pager, HEADER_PAGE_NUM), root_page_num);
+        pager_mark_dirty(pager, HEADER_PAGE_NUM);
+
+        void *root = get_page(pager, root_page_num);
         initialize_leaf_node(root);
         set_node_root(root, true);
-        *node_parent(root) = 0;
+        pager_mark_dirty(pager, root_page_num);
+    }
+    else
+    {
+        if (!header_is_valid(get_page(pager, HEADER_PAGE_NUM)))
+            migrate_legacy_file(pager);
+
+        void *header = get_page(pager, HEADER_PAGE_NUM);
+        uint32_t version = *header_format_version(header);
+        if (version < HEADER_FORMAT_VERSION)
+        {
+            uint32_t root_page_num = *header_root_page_num(header);
+            if (version < 1)
+                upgrade_internal_nodes(pager, root_page_num);
+            if (version < 2)
+                upgrade_leaf_nodes(pager, root_page_num);
+            header = get_page(pager, HEADER_PAGE_NUM);
+            if (version < 3)
+                *header_page_size(header) = PAGE_SIZE;
+            if (version < 4)
+                *header_reserved_size(header) = 0; // where a version 3 header kept its checksum
+            if (version < 5)
+                memset(header_index_roots(header), 0, INDEX_NONE * sizeof(uint32_t)); // a version 4 checksum
+            *header_format_version(header) = HEADER_FORMAT_VERSION;
+            pager_mark_dirty(pager, HEADER_PAGE_NUM);
+        }
     }
 
+    table->root_page_num = *header_root_page_num(get_page(pager, HEADER_PAGE_NUM));
+    table->rightmost_leaf_page_num = 0; // learned by the first insert that reaches it
+    table->rightmost_max_key = 0;
+    table->rightmost_epoch = 0;
+    table->hot_keys = db_config.hot_keys_kb > 0 ? hot_keys_create(db_config.hot_keys_kb) : NULL;
+    table->backup = NULL;
+    index_load(table);
+    pager_release_pages(pager);
+    wal_commit(pager);
+    pager_start_writeback(pager);
+    table->warm_cache = db_config.warm_cache ? warm_cache_open(pager, filename) : NULL;
     return table;
 }
 
@@ -36,40 +227,25 @@ void print_prompt()
 
 /*
 The function db_close is responsible for closing the database properly. It does the following:
-    1) Writes all pages in memory to the database file.
+    0) Rolls back a transaction that is still open, waits for a running .backup and saves the warm list,
+       then checkpoints and closes the write-ahead log.
+    1) Writes all modified pages in the buffer pool to the database file.
     2) Frees allocated memory for pages.
     3) Closes the file descriptor (database file).
     4) Frees the Pager struct.
+    5) Frees the hot key cache, when there is one.
 */
 void db_close(Table *table)
 {
-    Pager *pager = table->pager; // Pointer to the table
-
-    for (uint32_t i = 0; i < pager->num_pages; i++)
-    {
-        if (pager->pages[i] == NULL)
-            continue;
-        pager_flush(pager, i); // save to db
-        free(pager->pages[i]);
-        pager->pages[i] = NULL;
-    }
-
-    int result = close(pager->file_descriptor); // close the file descriptor
-    if (result == -1)
-    {
-        printf("Error closing database: \n");
-        exit(EXIT_FAILURE);
-    }
-    // Again check the full page if anything is there instead of null in those pointer remove it
-    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++)
-    {
-        void *page = pager->pages[i];
-        if (page)
-        {
-            free(page);
-            pager->pages[i] = NULL;
-        }
-    }
-    // Finally free the newly created paer too.
-    free(pager);
+    if (transaction_rollback(table) == EXECUTE_SUCCESS)
+        printf("Rolled back the open transaction.\n");
+    backup_wait(table);
+    if (table->warm_cache != NULL)
+        warm_cache_close(table->warm_cache);
+    table->warm_cache = NULL;
+    pager_close(table->pager);
+    table->pager = NULL;
+    if (table->hot_keys != NULL)
+        hot_keys_free(table->hot_keys);
+    table->hot_keys = NULL;
 }
@@ -0,0 +1,150 @@
+#include "constants.h"
+
+/**
+ * @brief Checks whether a page holds a file header.
+ *
+ * @param header Pointer to page 0 of the database file.
+ *
+ * @return `true` if the page starts with HEADER_MAGIC, `false` for files written
+ *         before the header existed (their page 0 is the root node).
+ */
+bool header_is_valid(void *header)
+{
+    return memcmp(header + HEADER_MAGIC_OFFSET, HEADER_MAGIC, HEADER_MAGIC_SIZE) == 0;
+}
+
+/**
+ * @brief Initializes the file header of a new (or migrated) database.
+ *
+ * @param header Pointer to page 0 of the database file.
+ * @param root_page_num Page that holds the root node of the table.
+ */
+void initialize_header(void *header, uint32_t root_page_num)
+{
+    memset(header, 0, PAGE_SIZE);
+    memcpy(header + HEADER_MAGIC_OFFSET, HEADER_MAGIC, HEADER_MAGIC_SIZE);
+    *header_root_page_num(header) = root_page_num;
+    *header_freelist_head(header) = 0;
+    *header_freelist_count(header) = 0;
+    *header_format_version(header) = HEADER_FORMAT_VERSION;
+    *header_page_size(header) = PAGE_SIZE;
+    *header_reserved_size(header) = PAGE_SIZE - PAGE_USABLE_SIZE;
+    *header_stored_checksum(header) = header_checksum(header);
+}
+
+uint32_t *header_root_page_num(void *header)
+{
+    return header + HEADER_ROOT_PAGE_OFFSET;
+}
+
+uint32_t *header_freelist_head(void *header)
+{
+    return header + HEADER_FREELIST_HEAD_OFFSET;
+}
+
+uint32_t *header_freelist_count(void *header)
+{
+    return header + HEADER_FREELIST_COUNT_OFFSET;
+}
+
+// Layout version of the nodes in the file, see HEADER_FORMAT_VERSION.
+uint32_t *header_format_version(void *header)
+{
+    return header + HEADER_FORMAT_VERSION_OFFSET;
+}
+
+// Page size of the file, 0 in files older than format version 3 (they use 4096 byte pages).
+uint32_t *header_page_size(void *header)
+{
+    return header + HEADER_PAGE_SIZE_OFFSET;
+}
+
+// Bytes at the end of every page the nodes leave alone (the page checksum), 0 in files older than version 4.
+uint32_t *header_reserved_size(void *header)
+{
+    return header + HEADER_RESERVED_SIZE_OFFSET;
+}
+
+// Root pages of the secondary indexes, indexed by IndexColumn (0 = no index), 0 in files older than version 5.
+uint32_t *header_index_roots(void *header)
+{
+    return header + HEADER_INDEX_ROOTS_OFFSET;
+}
+
+// Older headers end with their checksum: version 3 had no reserved size, version 4 no index roots.
+static uint32_t header_checksum_offset(void *header)
+{
+    uint32_t version = *header_format_version(header);
+    if (version == 3)
+        return HEADER_V3_CHECKSUM_OFFSET;
+    return version == 4 ? HEADER_V4_CHECKSUM_OFFSET : HEADER_CHECKSUM_OFFSET;
+}
+
+uint32_t *header_stored_checksum(void *header)
+{
+    return header + header_checksum_offset(header);
+}
+
+// Checksum of the header fields in front of the stored checksum, the pager stores it whenever page 0 is written.
+uint32_t header_checksum(void *header)
+{
+    return wal_checksum(WAL_CHECKSUM_SEED, header, header_checksum_offset(header));
+}
+
+// Returns a pointer to the page number of the next free page stored in a free page (0 ends the list).
+uint32_t *free_page_next(void *page)
+{
+    return page + FREE_PAGE_NEXT_OFFSET;
+}
+
+/**
+ * @brief Puts a page that is no longer part of the tree on the freelist.
+ *
+ * The page is cleared, marked FREE_NODE and pushed on the front of the list stored
+ * in the file header, so get_unused_page_num() hands it out before the file grows.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The page to free, nothing may reference it any more.
+ */
+void free_page(Pager *pager, uint32_t page_num)
+{
+    void *header = get_page(pager, HEADER_PAGE_NUM);
+    void *page = get_page(pager, page_num);
+
+    memset(page, 0, PAGE_SIZE);
+    set_node_type(page, FREE_NODE);
+    *free_page_next(page) = *header_freelist_head(header);
+    *header_freelist_head(header) = page_num;
+    *header_freelist_count(header) += 1;
+
+    pager_mark_dirty(pager, page_num);
+    pager_mark_dirty(pager, HEADER_PAGE_NUM);
+    pager_new_page_epoch(pager);
+}
+
+/**
+ * @brief Takes the first page off the freelist.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ *
+ * @return The page number of a free page, or 0 when the freelist is empty. The page
+ *         still holds its free page contents, the caller has to initialize it.
+ */
+uint32_t freelist_pop(Pager *pager)
+{
+    void *header = get_page(pager, HEADER_PAGE_NUM);
+    uint32_t page_num = *header_freelist_head(header);
+    if (page_num == 0)
+        return 0;
+
+    void *page = get_page(pager, page_num);
+    if (get_node_type(page) != FREE_NODE)
+    {
+        printf("Freelist is corrupted, page %u is not free\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+    *header_freelist_head(header) = *free_page_next(page);
+    *header_freelist_count(header) -= 1;
+    pager_mark_dirty(pager, HEADER_PAGE_NUM);
+    return page_num;
+}
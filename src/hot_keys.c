@@ -0,0 +1,193 @@
+#include "constants.h"
+
+/*
+Hot key cache for point lookups (--hot-keys-kb). A lookup normally descends from the root, one page fetch
+(pager mutex, pin, shared latch) per level. The cache remembers which leaf a key was found in, so a lookup
+on a key it knows fetches that leaf alone and finds the cell with one binary search.
+
+The cache is a hint, never the truth. A hit is checked against the leaf as of the cursor's snapshot: it has
+to be a leaf and hold the key, otherwise the lookup descends from the root like any other and remembers the
+leaf it ends up in. So splits, merges and deletes that move a key need no hook, the next lookup notices.
+What the check cannot tell is a page that left the tree and came back as part of another one (an index
+leaf holds keys too). Pages only leave a tree through free_page() or a rolled back transaction, which start
+a new page epoch (pager_new_page_epoch()). Every slot carries the epoch it was filled in and only counts in
+that epoch, by snapshots no older than the epoch, which are the ones that cannot see a page before it was
+freed. Freeing a page is rare next to lookups, the cache then refills as the keys are looked up again.
+
+Slots are 16 bytes, four to a cache line sized bucket, and are filled by whichever thread looked the key
+up. Every slot is a small seqlock (HotKeySlot.sequence), readers never write anything but the referenced
+bit. A full bucket evicts CLOCK style: a slot hit since eviction last passed it gets another chance.
+*/
+
+/**
+ * @brief Allocates the cache, `kb` kilobytes rounded down to a power of two buckets.
+ *
+ * @param kb Memory budget, db_config.hot_keys_kb, at least 1.
+ * @return Empty cache, free it with hot_keys_free().
+ */
+HotKeys *hot_keys_create(uint32_t kb)
+{
+    size_t num_buckets = 1;
+    while (num_buckets * 2 * HOT_KEYS_BUCKET_SIZE <= (size_t)kb * 1024 && num_buckets < (1u << 31))
+        num_buckets *= 2;
+    size_t length = num_buckets * HOT_KEYS_BUCKET_SIZE;
+    HotKeys *hot_keys = malloc(sizeof(HotKeys));
+#ifdef _WIN32
+    hot_keys->slots = _aligned_malloc(length, HOT_KEYS_BUCKET_SIZE);
+#else
+    if (posix_memalign((void **)&hot_keys->slots, HOT_KEYS_BUCKET_SIZE, length) != 0)
+        hot_keys->slots = NULL;
+#endif
+    if (hot_keys->slots == NULL)
+    {
+        printf("Out of memory for the hot key cache\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(hot_keys->slots, 0, length);
+    hot_keys->bucket_mask = (uint32_t)(num_buckets - 1);
+    return hot_keys;
+}
+
+void hot_keys_free(HotKeys *hot_keys)
+{
+#ifdef _WIN32
+    _aligned_free(hot_keys->slots);
+#else
+    free(hot_keys->slots);
+#endif
+    free(hot_keys);
+}
+
+static HotKeySlot *hot_keys_bucket(HotKeys *hot_keys, uint32_t key)
+{
+    uint32_t hash = key * 0x9E3779B1u;
+    hash ^= hash >> 16;
+    return &hot_keys->slots[(size_t)(hash & hot_keys->bucket_mask) * HOT_KEYS_WAYS];
+}
+
+/*
+The page epoch the cursor's lookups are checked against, or HOT_KEYS_NO_EPOCH when its snapshot is older
+than the epoch. The writer inside a transaction does not use the cache either: it sees pages a rollback
+may still take back, and its snapshot is the latest one.
+*/
+uint32_t hot_keys_epoch(Cursor *cursor)
+{
+    Pager *pager = cursor->table->pager;
+    if (cursor->snapshot.ts == PAGER_TS_LATEST && pager->in_transaction)
+        return HOT_KEYS_NO_EPOCH;
+    // pager_new_page_epoch() stores the ts first, an epoch read here comes with its ts or a newer one
+    uint32_t epoch = __atomic_load_n(&pager->page_epoch, __ATOMIC_ACQUIRE) & ~HOT_KEY_REFERENCED;
+    if (cursor->snapshot.ts < __atomic_load_n(&pager->page_epoch_ts, __ATOMIC_RELAXED))
+        return HOT_KEYS_NO_EPOCH;
+    return epoch;
+}
+
+// Reads a slot, false if a thread was rewriting it meanwhile.
+static bool hot_key_read(HotKeySlot *slot, HotKeySlot *copy)
+{
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    copy->key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+    copy->page_num = __atomic_load_n(&slot->page_num, __ATOMIC_RELAXED);
+    copy->epoch = __atomic_load_n(&slot->epoch, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (sequence & 1) == 0 && __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+// Fills a slot, unless another thread is filling it right now (the cache loses nothing but a hint).
+static void hot_key_write(HotKeySlot *slot, uint32_t key, uint32_t page_num, uint32_t epoch)
+{
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    if ((sequence & 1) || !__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, false,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->page_num, page_num, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->epoch, epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Positions the cursor in `page_num` if the page, as of the cursor's snapshot, is a leaf holding `key`.
+static bool hot_keys_enter(Cursor *cursor, uint32_t page_num, uint32_t key)
+{
+    Pager *pager = cursor->table->pager;
+    PageVersion *version;
+    void *node = pager_fetch_snapshot(pager, page_num, &cursor->snapshot, &version);
+    if (get_node_type(node) == LEAF_NODE)
+    {
+        uint32_t cell_num = leaf_node_lower_bound(node, key);
+        if (cell_num < *leaf_node_num_cells(node) && leaf_node_key(node, cell_num) == key)
+        {
+            cursor->page_num = page_num;
+            cursor->cell_num = cell_num;
+            cursor->node = node;
+            cursor->version = version;
+            return true;
+        }
+    }
+    pager_release_snapshot(pager, page_num, version);
+    return false;
+}
+
+/**
+ * @brief Positions a read cursor on `key` through the cache, for reader_descend().
+ *
+ * @param cursor A read cursor of a table with a cache, holding no page.
+ * @param key The id looked up.
+ * @param epoch hot_keys_epoch() of the cursor, taken before the lookup.
+ *
+ * @return true if the cursor now holds the leaf with `key`, false if it has to descend from the root.
+ */
+bool hot_keys_lookup(Cursor *cursor, uint32_t key, uint32_t epoch)
+{
+    HotKeySlot *bucket = hot_keys_bucket(cursor->table->hot_keys, key);
+    for (uint32_t i = 0; i < HOT_KEYS_WAYS; i++)
+    {
+        HotKeySlot slot;
+        if (!hot_key_read(&bucket[i], &slot) || slot.key != key || slot.page_num == 0 ||
+            (slot.epoch & ~HOT_KEY_REFERENCED) != epoch)
+            continue;
+        if (!(slot.epoch & HOT_KEY_REFERENCED))
+            __atomic_fetch_or(&bucket[i].epoch, HOT_KEY_REFERENCED, __ATOMIC_RELAXED);
+        if (!hot_keys_enter(cursor, slot.page_num, key))
+            break;
+        __atomic_add_fetch(&db_stats.hot_key_hits, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    __atomic_add_fetch(&db_stats.hot_key_misses, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+/*
+Remembers that `key` is in the leaf the cursor holds. The key's own slot is rewritten, otherwise an empty
+one or one of an older epoch is taken before a slot in use is evicted.
+*/
+void hot_keys_remember(Cursor *cursor, uint32_t key, uint32_t epoch)
+{
+    HotKeySlot *bucket = hot_keys_bucket(cursor->table->hot_keys, key);
+    HotKeySlot *victim = NULL;
+    for (uint32_t i = 0; i < HOT_KEYS_WAYS; i++)
+    {
+        HotKeySlot slot;
+        if (!hot_key_read(&bucket[i], &slot))
+            continue;
+        if (slot.key == key && slot.page_num != 0)
+        {
+            victim = &bucket[i];
+            break;
+        }
+        if (victim == NULL && (slot.page_num == 0 || (slot.epoch & ~HOT_KEY_REFERENCED) != epoch))
+            victim = &bucket[i];
+    }
+    // Second chance, starting at a slot that depends on the key so that the bucket's slots take turns
+    for (uint32_t i = 0; victim == NULL && i < 2 * HOT_KEYS_WAYS; i++)
+    {
+        HotKeySlot *slot = &bucket[(key + i) % HOT_KEYS_WAYS];
+        if (__atomic_load_n(&slot->epoch, __ATOMIC_RELAXED) & HOT_KEY_REFERENCED)
+            __atomic_fetch_and(&slot->epoch, ~HOT_KEY_REFERENCED, __ATOMIC_RELAXED);
+        else
+            victim = slot;
+    }
+    if (victim != NULL)
+        hot_key_write(victim, key, cursor->page_num, epoch);
+}
@@ -0,0 +1,401 @@
+#include "constants.h"
+
+/*
+Secondary indexes on username and email, layout in constants.h. Each one is a B+tree of its own with its
+root page in the file header, the node code does not care which tree a page belongs to: a Table with that
+root page is all it needs. The writer keeps the roots in table->index_roots and maintains every index inside
+the statement that changes a row, readers take the root from the header as of their snapshot.
+*/
+
+// Bucket key (chunk number 0) and fingerprint of a column value.
+static uint32_t index_hash(const char *value, uint32_t length, uint16_t *fingerprint)
+{
+    uint32_t hash = crc32c(0, value, length);
+    *fingerprint = (uint16_t)hash;
+    return hash >> INDEX_CHUNK_BITS << INDEX_CHUNK_BITS;
+}
+
+static void index_column_value(const RowView *row, IndexColumn column, const char **value, uint32_t *length)
+{
+    *value = column == INDEX_USERNAME ? row->username : row->email;
+    *length = column == INDEX_USERNAME ? row->username_length : row->email_length;
+}
+
+// The tree of one index, it shares the pager with the table.
+static Table index_tree(Table *table, uint32_t root_page_num)
+{
+    Table tree = {.pager = table->pager, .root_page_num = root_page_num};
+    return tree;
+}
+
+static void index_entry(uint8_t *entry, uint32_t id, uint16_t fingerprint)
+{
+    memcpy(entry, &id, sizeof(id));
+    memcpy(entry + sizeof(id), &fingerprint, sizeof(fingerprint));
+}
+
+/**
+ * @brief Reads the index roots from the file header into table->index_roots.
+ *
+ * Called by db_open() and again after a rollback, which may have taken away an index the
+ * transaction created.
+ *
+ * @param table The open table.
+ */
+void index_load(Table *table)
+{
+    void *header = get_page(table->pager, HEADER_PAGE_NUM);
+    memcpy(table->index_roots, header_index_roots(header), sizeof(table->index_roots));
+}
+
+// Whether the table has an index at all, writes to it then latch the whole tree (see start_row_write()).
+bool index_any(Table *table)
+{
+    for (uint32_t column = 0; column < INDEX_NONE; column++)
+        if (table->index_roots[column] != 0)
+            return true;
+    return false;
+}
+
+// Adds an entry to the first chunk of its bucket, or puts a new chunk in front of it when that is full.
+static void index_add(Table *tree, const char *value, uint32_t length, uint32_t id)
+{
+    uint16_t fingerprint;
+    uint32_t bucket = index_hash(value, length, &fingerprint);
+    uint8_t payload[LEAF_NODE_MAX_PAYLOAD_SIZE];
+    uint32_t chunk_key = bucket | INDEX_CHUNK_MASK;
+
+    Cursor *cursor = table_seek(tree, bucket);
+    if (!cursor->end_of_table)
+    {
+        void *node = get_page(tree->pager, cursor->page_num);
+        uint32_t key = leaf_node_key(node, cursor->cell_num);
+        if (key <= (bucket | INDEX_CHUNK_MASK))
+        {
+            uint32_t size = leaf_node_cell_size(node, cursor->cell_num);
+            if (size + INDEX_ENTRY_SIZE <= INDEX_CHUNK_MAX_ENTRIES * INDEX_ENTRY_SIZE)
+            {
+                memcpy(payload, leaf_node_cell(node, cursor->cell_num), size);
+                index_entry(payload + size, id, fingerprint);
+                leaf_node_replace_payload(cursor, payload, size + INDEX_ENTRY_SIZE);
+                cursor_close(cursor);
+                return;
+            }
+            if (key == bucket)
+            {
+                printf("Too many rows share an index bucket\n");
+                exit(EXIT_FAILURE);
+            }
+            chunk_key = key - 1;
+        }
+    }
+    cursor_close(cursor);
+
+    cursor = find_table(tree, chunk_key);
+    index_entry(payload, id, fingerprint);
+    leaf_node_insert_payload(cursor, chunk_key, payload, INDEX_ENTRY_SIZE);
+    cursor_close(cursor);
+}
+
+// Takes an entry out of its chunk, the last entry of the chunk takes its place. An emptied chunk is deleted.
+static void index_remove(Table *tree, const char *value, uint32_t length, uint32_t id)
+{
+    uint16_t fingerprint;
+    uint32_t bucket = index_hash(value, length, &fingerprint);
+    uint8_t entry[INDEX_ENTRY_SIZE];
+    index_entry(entry, id, fingerprint);
+
+    Cursor *cursor = table_seek(tree, bucket);
+    while (!cursor->end_of_table)
+    {
+        void *node = get_page(tree->pager, cursor->page_num);
+        if (leaf_node_key(node, cursor->cell_num) > (bucket | INDEX_CHUNK_MASK))
+            break;
+        uint32_t size = leaf_node_cell_size(node, cursor->cell_num);
+        const uint8_t *chunk = leaf_node_cell(node, cursor->cell_num);
+        for (uint32_t offset = 0; offset < size; offset += INDEX_ENTRY_SIZE)
+        {
+            if (memcmp(chunk + offset, entry, INDEX_ENTRY_SIZE) != 0)
+                continue;
+            if (size == INDEX_ENTRY_SIZE)
+            {
+                leaf_node_delete(cursor);
+            }
+            else
+            {
+                uint8_t payload[LEAF_NODE_MAX_PAYLOAD_SIZE];
+                memcpy(payload, chunk, size - INDEX_ENTRY_SIZE);
+                if (offset != size - INDEX_ENTRY_SIZE)
+                    memcpy(payload + offset, chunk + size - INDEX_ENTRY_SIZE, INDEX_ENTRY_SIZE);
+                leaf_node_replace_payload(cursor, payload, size - INDEX_ENTRY_SIZE);
+            }
+            cursor_close(cursor);
+            return;
+        }
+        cursor_advance(cursor);
+    }
+    printf("Index has no entry for row %u\n", id);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Adds a row to every index of the table.
+ *
+ * Part of the statement that inserts the row (or gives it new values), after the table itself changed.
+ *
+ * @param table The table, its index roots tell which indexes there are.
+ * @param row The row, see deserialize_row_view() for one in serialized form.
+ */
+void index_add_row(Table *table, const RowView *row)
+{
+    for (IndexColumn column = 0; column < INDEX_NONE; column++)
+    {
+        if (table->index_roots[column] == 0)
+            continue;
+        Table tree = index_tree(table, table->index_roots[column]);
+        const char *value;
+        uint32_t length;
+        index_column_value(row, column, &value, &length);
+        index_add(&tree, value, length, row->id);
+    }
+}
+
+/**
+ * @brief Removes a row from every index of the table.
+ *
+ * @param table The table, its index roots tell which indexes there are.
+ * @param row The row as it is in the table. Its strings must not point into a page the removal changes,
+ *            copy a row read from a leaf first.
+ */
+void index_remove_row(Table *table, const RowView *row)
+{
+    for (IndexColumn column = 0; column < INDEX_NONE; column++)
+    {
+        if (table->index_roots[column] == 0)
+            continue;
+        Table tree = index_tree(table, table->index_roots[column]);
+        const char *value;
+        uint32_t length;
+        index_column_value(row, column, &value, &length);
+        index_remove(&tree, value, length, row->id);
+    }
+}
+
+/**
+ * @brief Moves a row whose values changed to its new entries, indexes whose column kept its value are left alone.
+ *
+ * @param table The table, its index roots tell which indexes there are.
+ * @param old_row The row before the update, copied out of its leaf (see index_remove_row()).
+ * @param new_row The row after the update.
+ */
+void index_update_row(Table *table, const RowView *old_row, const RowView *new_row)
+{
+    for (IndexColumn column = 0; column < INDEX_NONE; column++)
+    {
+        if (table->index_roots[column] == 0)
+            continue;
+        const char *old_value, *new_value;
+        uint32_t old_length, new_length;
+        index_column_value(old_row, column, &old_value, &old_length);
+        index_column_value(new_row, column, &new_value, &new_length);
+        if (old_length == new_length && memcmp(old_value, new_value, old_length) == 0)
+            continue;
+        Table tree = index_tree(table, table->index_roots[column]);
+        index_remove(&tree, old_value, old_length, old_row->id);
+        index_add(&tree, new_value, new_length, new_row->id);
+    }
+}
+
+typedef struct
+{
+    uint32_t key; // bucket key, chunk number 0
+    uint32_t id;
+    uint16_t fingerprint;
+} IndexBuildEntry;
+
+static int compare_build_entries(const void *a, const void *b)
+{
+    const IndexBuildEntry *x = a, *y = b;
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/**
+ * @brief Implements `create index on username|email`.
+ *
+ * The rows are read through a read cursor and their entries sorted by bucket, then the chunks are
+ * inserted in key order so every insert appends to the right-most leaf. Like bulk_load() the pages are
+ * committed to the write-ahead log in batches, the index only becomes visible when its root is stored
+ * in the header at the end.
+ *
+ * @param table The table to index.
+ * @param column The column to index.
+ *
+ * @return EXECUTE_SUCCESS or EXECUTE_INDEX_EXISTS.
+ */
+ExecuteResult index_create(Table *table, IndexColumn column)
+{
+    if (table->index_roots[column] != 0)
+        return EXECUTE_INDEX_EXISTS;
+    Pager *pager = table->pager;
+
+    uint32_t capacity = 1024;
+    uint32_t num_entries = 0;
+    IndexBuildEntry *entries = malloc(sizeof(IndexBuildEntry) * capacity);
+    Cursor *cursor = reader_seek(table, 0);
+    RowView row;
+    while (!cursor->end_of_table)
+    {
+        if (num_entries == capacity)
+        {
+            capacity *= 2;
+            entries = realloc(entries, sizeof(IndexBuildEntry) * capacity);
+        }
+        if (entries == NULL)
+        {
+            printf("Out of memory for the index entries\n");
+            exit(EXIT_FAILURE);
+        }
+        reader_row(cursor, &row);
+        const char *value;
+        uint32_t length;
+        index_column_value(&row, column, &value, &length);
+        IndexBuildEntry *entry = &entries[num_entries++];
+        entry->key = index_hash(value, length, &entry->fingerprint);
+        entry->id = row.id;
+        reader_advance(cursor);
+    }
+    reader_close(cursor);
+    qsort(entries, num_entries, sizeof(IndexBuildEntry), compare_build_entries);
+
+    uint32_t root_page_num = get_unused_page_num(pager);
+    void *root = get_page(pager, root_page_num);
+    initialize_leaf_node(root);
+    set_node_root(root, true);
+    pager_mark_dirty(pager, root_page_num);
+    pager_release_pages(pager);
+
+    // Chunks of a bucket count down from INDEX_CHUNK_MASK, only the first (lowest) one is not full
+    Table tree = index_tree(table, root_page_num);
+    uint8_t payload[LEAF_NODE_MAX_PAYLOAD_SIZE];
+    uint32_t chunks_written = 0;
+    for (uint32_t start = 0; start < num_entries;)
+    {
+        uint32_t end = start;
+        while (end < num_entries && entries[end].key == entries[start].key)
+            end++;
+        uint32_t num_chunks = (end - start + INDEX_CHUNK_MAX_ENTRIES - 1) / INDEX_CHUNK_MAX_ENTRIES;
+        if (num_chunks > INDEX_CHUNK_MASK + 1)
+        {
+            printf("Too many rows share an index bucket\n");
+            exit(EXIT_FAILURE);
+        }
+        uint32_t chunk_key = entries[start].key | (INDEX_CHUNK_MASK - (num_chunks - 1));
+        uint32_t first_size = (end - start) - (num_chunks - 1) * INDEX_CHUNK_MAX_ENTRIES;
+        for (uint32_t i = start; i < end; chunk_key++)
+        {
+            uint32_t count = i == start ? first_size : INDEX_CHUNK_MAX_ENTRIES;
+            for (uint32_t j = 0; j < count; j++)
+                index_entry(payload + j * INDEX_ENTRY_SIZE, entries[i + j].id, entries[i + j].fingerprint);
+            i += count;
+
+            cursor = find_append_position(&tree, chunk_key);
+            if (cursor == NULL)
+                cursor = find_table(&tree, chunk_key);
+            leaf_node_insert_payload(cursor, chunk_key, payload, count * INDEX_ENTRY_SIZE);
+            if (chunk_key > tree.rightmost_max_key)
+                remember_rightmost_leaf(&tree, cursor->page_num);
+            cursor_close(cursor);
+            pager_release_pages(pager);
+            if (++chunks_written % BULK_LOAD_COMMIT_PAGES == 0)
+                wal_commit(pager);
+        }
+        start = end;
+    }
+    free(entries);
+
+    void *header = get_page(pager, HEADER_PAGE_NUM);
+    header_index_roots(header)[column] = root_page_num;
+    pager_mark_dirty_range(pager, HEADER_PAGE_NUM, HEADER_INDEX_ROOTS_OFFSET + column * sizeof(uint32_t),
+                           sizeof(uint32_t));
+    table->index_roots[column] = root_page_num;
+    return EXECUTE_SUCCESS;
+}
+
+/**
+ * @brief Root page of an index as of a snapshot, for readers on any thread.
+ *
+ * @param pager The pager.
+ * @param snapshot Taken with pager_open_snapshot().
+ * @param column The indexed column.
+ *
+ * @return The root page, 0 if the column had no index at that moment.
+ */
+uint32_t index_root_at(Pager *pager, Snapshot *snapshot, IndexColumn column)
+{
+    PageVersion *version;
+    void *header = pager_fetch_snapshot(pager, HEADER_PAGE_NUM, snapshot, &version);
+    uint32_t root_page_num = header_index_roots(header)[column];
+    pager_release_snapshot(pager, HEADER_PAGE_NUM, version);
+    return root_page_num;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Looks a value up in an index.
+ *
+ * @param pager The pager.
+ * @param root_page_num Root of the index, see index_root_at().
+ * @param snapshot The snapshot to read the index as of.
+ * @param value The column value.
+ * @param length Its length.
+ * @param ids Set to the ids of the candidate rows in ascending order, free() it. Other values with the
+ *            same hash show up here too, the caller compares the rows themselves.
+ *
+ * @return Number of candidate ids.
+ */
+uint32_t index_lookup(Pager *pager, uint32_t root_page_num, const Snapshot *snapshot, const char *value,
+                      uint32_t length, uint32_t **ids)
+{
+    uint16_t fingerprint;
+    uint32_t bucket = index_hash(value, length, &fingerprint);
+    Table tree = {.pager = pager, .root_page_num = root_page_num};
+    uint32_t capacity = 16;
+    uint32_t count = 0;
+    *ids = malloc(sizeof(uint32_t) * capacity);
+
+    Cursor *cursor = reader_seek_snapshot(&tree, bucket, snapshot);
+    while (!cursor->end_of_table && reader_key(cursor) <= (bucket | INDEX_CHUNK_MASK))
+    {
+        uint32_t size;
+        const uint8_t *chunk = reader_payload(cursor, &size);
+        for (uint32_t offset = 0; offset < size; offset += INDEX_ENTRY_SIZE)
+        {
+            uint16_t entry_fingerprint;
+            memcpy(&entry_fingerprint, chunk + offset + sizeof(uint32_t), sizeof(entry_fingerprint));
+            if (entry_fingerprint != fingerprint)
+                continue;
+            if (count == capacity)
+            {
+                capacity *= 2;
+                *ids = realloc(*ids, sizeof(uint32_t) * capacity);
+            }
+            memcpy(&(*ids)[count++], chunk + offset, sizeof(uint32_t));
+        }
+        reader_advance(cursor);
+    }
+    reader_close(cursor);
+    qsort(*ids, count, sizeof(uint32_t), compare_ids);
+    // An interrupted bulk_load() can leave a second entry for a row that was inserted again later
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; i++)
+        if (unique == 0 || (*ids)[unique - 1] != (*ids)[i])
+            (*ids)[unique++] = (*ids)[i];
+    return unique;
+}
@@ -1,11 +1,11 @@
 #include "constants.h"
 
-// Intialize new input buffer
+// Intialize new input buffer, sized so statement lines are read without growing it
 InputBuffer *new_input_buffer()
 {
     InputBuffer *input_buffer = (InputBuffer *)malloc(sizeof(InputBuffer));
-    input_buffer->buffer = NULL;
-    input_buffer->buffer_length = 0;
+    input_buffer->buffer = malloc(INPUT_BUFFER_INITIAL_SIZE);
+    input_buffer->buffer_length = input_buffer->buffer != NULL ? INPUT_BUFFER_INITIAL_SIZE : 0;
     input_buffer->input_length = 0;
 
     return input_buffer;
@@ -59,7 +59,7 @@ ssize_t getline(char **lineptr, size_t *n, FILE *stream)
 
     if (*lineptr == NULL || *n == 0)
     {
-        *n = 128; // Initial buffer size
+        *n = INPUT_BUFFER_INITIAL_SIZE; // Initial buffer size
         *lineptr = malloc(*n);
         if (*lineptr == NULL)
         {
@@ -72,7 +72,7 @@ ssize_t getline(char **lineptr, size_t *n, FILE *stream)
         // Resize the buffer if necessary
         if (pos + 1 >= *n)
         {
-            size_t new_size = *n + (*n >> 2); // Increase by 25%
+            size_t new_size = *n * 2; // Double, a long line costs a few reallocations instead of dozens
             char *new_ptr = realloc(*lineptr, new_size);
             if (new_ptr == NULL)
             {
@@ -31,19 +31,32 @@ uint32_t *internal_node_right_child(void *node)
 }
 
 /**
- * Retrieves a pointer to a specific key-child pair (cell) in an internal node.
+ * Retrieves a pointer to the key array of an internal node.
  *
  * @param node Pointer to the internal node in memory.
- * @param cell_num The index of the key-child pair within the internal node.
- * @return Pointer to the memory location where the specified cell is stored.
+ * @return Pointer to the first of `INTERNAL_NODE_MAX_CELL` key slots.
  *
- * Internal nodes store child pointers and keys in pairs, starting after the node header.
- * Each cell consists of a child pointer followed by a key. This function calculates the
- * correct memory location based on the given cell index.
+ * The keys are stored contiguously at `INTERNAL_NODE_KEYS_OFFSET`, separate from the
+ * child pointers, so a search only touches the keys and can load several at once.
  */
-uint32_t *internal_node_cell(void *node, uint32_t cell_num)
+uint32_t *internal_node_keys(void *node)
 {
-    return node + INTERNAL_NODE_HEADER_SIZE + cell_num * INTERNAL_NODE_CELL_SIZE;
+    return node + INTERNAL_NODE_KEYS_OFFSET;
+}
+
+/**
+ * Retrieves a pointer to the child array of an internal node.
+ *
+ * @param node Pointer to the internal node in memory.
+ * @return Pointer to the first of `INTERNAL_NODE_MAX_CELL` child slots.
+ *
+ * Child `i` belongs to key `i`. The right child is not part of the array, it is
+ * stored in the header (`internal_node_right_child`). Unlike `internal_node_child`
+ * no bounds are checked, which is what code rebuilding a node needs.
+ */
+uint32_t *internal_node_children(void *node)
+{
+    return node + INTERNAL_NODE_CHILDREN_OFFSET;
 }
 
 /**
@@ -54,7 +67,7 @@ uint32_t *internal_node_cell(void *node, uint32_t cell_num)
  * @return Pointer to the memory location where the specified child pointer is stored.
  *
  * Internal nodes store child pointers in two locations:
- * - The first `num_key` children are stored within cells (`internal_node_cell`).
+ * - The first `num_key` children are stored in the child array (`internal_node_children`).
  * - The rightmost child (which has no associated key) is stored separately
  *   at `internal_node_right_child`.
  *
@@ -83,7 +96,7 @@ uint32_t *internal_node_child(void *node, uint32_t child_num)
     }
     else
     {
-        uint32_t *child = internal_node_cell(node, child_num);
+        uint32_t *child = internal_node_children(node) + child_num;
         if (*child == INVALID_PAGE_NUM)
         {
             printf("Tried to access child %d of node, but was invalid page\n", child_num);
@@ -102,11 +115,10 @@ uint32_t *internal_node_child(void *node, uint32_t child_num)
  * Return: A pointer to the key at the specified index.
  *
  * Description:
- * - Internal nodes store key-value pairs, where each key is associated with a child pointer.
- * - Each key is stored after its corresponding child pointer within the node.
- * - This function calculates the address of the key by getting the address of the cell
- *   at `key_num` using `internal_node_cell()` and then adding `INTERNAL_NODE_CHILD_SIZE`
- *   to skip the child pointer.
+ * - Internal nodes store one key per child pointer (except the right child), the key is
+ *   the maximum key found below that child.
+ * - The keys are stored in their own array (`internal_node_keys()`), so the address is
+ *   simply the start of that array plus `key_num` keys.
  *
  * Example:
  * Given an internal node storing keys `[10, 20, 30]` with corresponding children,
@@ -114,7 +126,7 @@ uint32_t *internal_node_child(void *node, uint32_t child_num)
  */
 uint32_t *internal_node_key(void *node, uint32_t key_num)
 {
-    return internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
+    return internal_node_keys(node) + key_num;
 }
 
 /**
@@ -143,21 +155,64 @@ void initialize_internal_node(void *node)
     *internal_node_num_keys(node) = 0;
     *node_parent(node) = 0;
     /*
-    Necessary because the root page number is 0; by not initializing an internal
+    Necessary because page 0 is the file header; by not initializing an internal
     node's right child to an invalid page number when initializing the node, we may
-    end up with 0 as the node's right child, which makes the node a parent of the root
+    end up with 0 as the node's right child, which would treat the header as a node
     */
     *internal_node_right_child(node) = INVALID_PAGE_NUM;
 }
 
+/*
+Counts how many of `count` sorted keys are smaller than `key`. Every key is compared, there is no branch
+that depends on the data, so for the handful of keys left by the binary search this is cheaper than
+continuing to halve the range. Vector registers compare 8 (AVX2) or 4 (SSE2, NEON) keys at a time.
+SSE2 and AVX2 only compare signed integers, flipping the sign bit of both sides gives the unsigned order.
+*/
+static uint32_t internal_node_count_smaller(const uint32_t *keys, uint32_t count, uint32_t key)
+{
+    uint32_t smaller = 0;
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32((int)key), sign);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i)), sign);
+        __m256i less = _mm256_cmpgt_epi32(needle, block);
+        smaller += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+    }
+#elif defined(__SSE2__)
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi32((int)key), sign);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(keys + i)), sign);
+        __m128i less = _mm_cmpgt_epi32(needle, block);
+        smaller += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint32x4_t needle = vdupq_n_u32(key);
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4_t less = vcltq_u32(vld1q_u32(keys + i), needle); // all bits set where keys[i] < key
+        smaller += vaddvq_u32(vshrq_n_u32(less, 31));
+    }
+#endif
+    for (; i < count; i++)
+        smaller += keys[i] < key;
+    return smaller;
+}
+
 /**
  * @brief Finds the appropriate child index in an internal B-tree node for a given key.
  *
  * Functionality:
- *      - This function performs a **binary search** within an internal node
- *        to determine the correct child index that should be followed for a given key.
- *      - It compares the key against stored keys and returns the **index**
- *        where traversal should continue.
+ *      - This function returns the index of the first key that is **greater than or
+ *        equal** to the given key, which is the child that should be followed for it
+ *        (`num_keys`, the right child, if every key is smaller).
+ *      - A **binary search** over the contiguous key array narrows the range down to
+ *        `INTERNAL_NODE_SEARCH_WINDOW` keys, which are then compared all at once with
+ *        vector instructions (see internal_node_count_smaller()).
  *      - This is essential for efficient tree navigation during searches and insertions.
  *
  * @param node A pointer to the internal B-tree node.
@@ -174,21 +229,21 @@ void initialize_internal_node(void *node)
 uint32_t internal_node_find_child(void *node, uint32_t key)
 {
     uint32_t num_keys = *(internal_node_num_keys(node));
+    const uint32_t *keys = internal_node_keys(node);
 
-    /* Binary search to find index of child to search */
+    /* Binary search until only a small window of keys is left */
     uint32_t min_index = 0;
     uint32_t max_index = num_keys;
 
-    while (min_index != max_index)
+    while (max_index - min_index > INTERNAL_NODE_SEARCH_WINDOW)
     {
         uint32_t index = (min_index + max_index) / 2;
-        uint32_t key_at_index = *(internal_node_key(node, index));
-        if (key <= key_at_index)
+        if (key <= keys[index])
             max_index = index;
         else
             min_index = index + 1;
     }
-    return min_index;
+    return min_index + internal_node_count_smaller(keys + min_index, max_index - min_index, key);
 }
 
 /**
@@ -226,11 +281,17 @@ Cursor *find_internal_node(Table *table, uint32_t page_num, uint32_t key)
         return find_leaf_node(table, child_page_num, key);
     case INTERNAL_NODE:
         return find_internal_node(table, child_page_num, key);
+    case FREE_NODE:
+        break;
     }
+    // A freed page is still referenced by its parent
+    printf("Tree is corrupted, page %u is on the freelist\n", child_page_num);
+    exit(EXIT_FAILURE);
 }
 
 void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t child_page_num)
 {
+    db_stats.internal_splits++;
     uint32_t old_page_num = parent_page_num;
     void *old_node = get_page(table->pager, old_page_num);
     uint32_t old_max = get_node_max_key(table->pager, old_node);
@@ -257,9 +318,11 @@ void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t
     uint32_t splitting_root = is_root_node(old_node);
     void *parent;
     void *new_node;
+    uint32_t grand_parent_page_num; // page whose key for old_node has to be updated
     if (splitting_root)
     {
         create_new_root(table, new_page_num);
+        grand_parent_page_num = table->root_page_num;
         parent = get_page(table->pager, table->root_page_num);
         /*
         If we are splitting the root, we need to update old_node to point
@@ -271,10 +334,13 @@ void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t
     }
     else
     {
-        parent = get_page(table->pager, *node_parent(old_node));
+        grand_parent_page_num = *node_parent(old_node);
+        parent = get_page(table->pager, grand_parent_page_num);
         new_node = get_page(table->pager, new_page_num);
         initialize_internal_node(new_node);
+        pager_mark_dirty(table->pager, new_page_num);
     }
+    pager_mark_dirty(table->pager, old_page_num);
     uint32_t *old_num_keys = internal_node_num_keys(old_node);
 
     uint32_t cur_page_num = *internal_node_right_child(old_node); // beacause every node is filled completly
@@ -283,6 +349,7 @@ void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t
     // First put right child into new node and set right child of old node to invalid page number
     internal_node_insert(table, new_page_num, cur_page_num);
     *node_parent(curr) = new_page_num;
+    pager_mark_dirty(table->pager, cur_page_num);
     *internal_node_right_child(old_node) = INVALID_PAGE_NUM;
 
     // For each key until you get to the middle key, move the key and the child to the new node
@@ -293,6 +360,7 @@ void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t
 
         internal_node_insert(table, new_page_num, cur_page_num);
         *node_parent(curr) = new_page_num;
+        pager_mark_dirty(table->pager, cur_page_num);
         (*old_num_keys)--;
     }
     // Set child before middle key, which is now the highest key, to be node's right child, and decrement number of keys
@@ -306,14 +374,17 @@ void internal_node_split_insert(Table *table, uint32_t parent_page_num, uint32_t
 
     internal_node_insert(table, destination_page_num, child_page_num);
     *node_parent(child) = destination_page_num;
+    pager_mark_dirty(table->pager, child_page_num);
 
     update_internal_node_key(parent, old_max, get_node_max_key(table->pager, old_node));
+    pager_mark_dirty(table->pager, grand_parent_page_num);
 
+    /*
+    internal_node_insert() sets the parent pointer of new_node itself. If the parent has to split as well
+    old_node and new_node can end up under different parents, so it must not be copied from old_node here.
+    */
     if (!splitting_root)
-    {
         internal_node_insert(table, *node_parent(old_node), new_page_num);
-        *node_parent(new_node) = *node_parent(old_node);
-    }
 }
 
 /**
@@ -363,6 +434,9 @@ void internal_node_insert(Table *table, uint32_t parent_page_num, uint32_t child
     if (right_child_page_num == INVALID_PAGE_NUM)
     {
         *internal_node_right_child(parent) = child_page_num;
+        *node_parent(child) = parent_page_num;
+        pager_mark_dirty(table->pager, parent_page_num);
+        pager_mark_dirty(table->pager, child_page_num);
         return;
     }
     void *right_child = get_page(table->pager, right_child_page_num);
@@ -389,13 +463,10 @@ void internal_node_insert(Table *table, uint32_t parent_page_num, uint32_t child
     }
     else
     {
-        // Make space for the new cell
-        for (uint32_t i = orignal_num_keys; i > index; i--)
-        {
-            void *destination = internal_node_cell(parent, i);
-            void *source = internal_node_cell(parent, i - 1);
-            memcpy(destination, source, INTERNAL_NODE_CELL_SIZE);
-        }
+        // Make space for the new key and child
+        uint32_t num_moved = orignal_num_keys - index;
+        memmove(internal_node_key(parent, index + 1), internal_node_key(parent, index), num_moved * INTERNAL_NODE_KEY_SIZE);
+        memmove(internal_node_children(parent) + index + 1, internal_node_children(parent) + index, num_moved * INTERNAL_NODE_CHILD_SIZE);
         // Insert the new child at the correct position
         *internal_node_child(parent, index) = child_page_num;
         *internal_node_key(parent, index) = child_max_key;
@@ -404,6 +475,8 @@ void internal_node_insert(Table *table, uint32_t parent_page_num, uint32_t child
     // Update the child's parent pointer to the parent node
     void *child_node = get_page(table->pager, child_page_num);
     *node_parent(child_node) = parent_page_num;
+    pager_mark_dirty(table->pager, parent_page_num);
+    pager_mark_dirty(table->pager, child_page_num);
 }
 
 /**
@@ -429,5 +502,194 @@ void internal_node_insert(Table *table, uint32_t parent_page_num, uint32_t child
 uint32_t *update_internal_node_key(void *node, uint32_t old_key, uint32_t new_key)
 {
     uint32_t old_child_index = internal_node_find_child(node, old_key);
-    *internal_node_key(node, old_child_index) = new_key;
+    // The right child has no key. Writing one past the last key would overwrite the first child pointer.
+    if (old_child_index < *internal_node_num_keys(node))
+        *internal_node_key(node, old_child_index) = new_key;
+}
+
+/**
+ * @brief Finds the position of a child in an internal node.
+ *
+ * @param node A pointer to the internal B-tree node.
+ * @param child_page_num Page number of the child to look for.
+ *
+ * @return The child index, `num_keys` when it is the right child.
+ */
+uint32_t internal_node_child_index(void *node, uint32_t child_page_num)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        if (*internal_node_child(node, i) == child_page_num)
+            return i;
+    }
+    if (*internal_node_right_child(node) == child_page_num)
+        return num_keys;
+    printf("Page %u is not a child of its parent\n", child_page_num);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Removes the key between two children after they were merged into the left one.
+ *
+ * Child `key_num + 1` (possibly the right child) is replaced by child `key_num`, which
+ * now holds both, and the cell `key_num` is removed. The surviving entry keeps the key
+ * of the right child, which is the correct maximum of the merged node.
+ *
+ * @param node A pointer to the internal B-tree node.
+ * @param key_num Index of the left child of the merged pair.
+ */
+void internal_node_remove_key(void *node, uint32_t key_num)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+    uint32_t num_moved = num_keys - key_num - 1;
+    *internal_node_child(node, key_num + 1) = *internal_node_child(node, key_num);
+    memmove(internal_node_key(node, key_num), internal_node_key(node, key_num + 1), num_moved * INTERNAL_NODE_KEY_SIZE);
+    memmove(internal_node_children(node) + key_num, internal_node_children(node) + key_num + 1,
+            num_moved * INTERNAL_NODE_CHILD_SIZE);
+    *internal_node_num_keys(node) = num_keys - 1;
+}
+
+/**
+ * @brief Fixes an underfull internal node by merging it with or borrowing children from a sibling.
+ *
+ * Functionality:
+ *      - Picks the left sibling under the same parent (the right one for the first child).
+ *      - Collects the children and keys of both nodes in order, the parent's separator key
+ *        goes between them.
+ *      - If all children fit into one node they are moved into the left node, the right
+ *        node is freed and the parent loses a key (checked again by node_after_remove()).
+ *      - Otherwise the children are split evenly and the separator in the parent is replaced.
+ *      - Children that changed nodes get their parent pointer updated.
+ *
+ * @param table A pointer to the table structure containing the B-tree.
+ * @param page_num Page number of the underfull internal node, it must not be the root.
+ */
+void internal_node_rebalance(Table *table, uint32_t page_num)
+{
+    Pager *pager = table->pager;
+    void *node = get_page(pager, page_num);
+    uint32_t parent_page_num = *node_parent(node);
+    void *parent = get_page(pager, parent_page_num);
+    if (*internal_node_num_keys(parent) == 0)
+        return;
+
+    uint32_t index = internal_node_child_index(parent, page_num);
+    uint32_t left_index = index > 0 ? index - 1 : index;
+    uint32_t left_page_num = *internal_node_child(parent, left_index);
+    uint32_t right_page_num = *internal_node_child(parent, left_index + 1);
+    void *left = get_page(pager, left_page_num);
+    void *right = get_page(pager, right_page_num);
+    uint32_t left_keys = *internal_node_num_keys(left);
+    uint32_t right_keys = *internal_node_num_keys(right);
+
+    uint32_t num_children = left_keys + 1 + right_keys + 1;
+    ArenaMark mark = arena_mark(&pager->scratch);
+    uint32_t *children = arena_alloc(&pager->scratch, sizeof(uint32_t) * num_children);
+    uint32_t *keys = arena_alloc(&pager->scratch, sizeof(uint32_t) * num_children); // keys[i] belongs to children[i], the last one is unused
+    for (uint32_t i = 0; i <= left_keys; i++)
+    {
+        children[i] = *internal_node_child(left, i);
+        keys[i] = i < left_keys ? *internal_node_key(left, i) : *internal_node_key(parent, left_index);
+    }
+    for (uint32_t i = 0; i <= right_keys; i++)
+    {
+        children[left_keys + 1 + i] = *internal_node_child(right, i);
+        keys[left_keys + 1 + i] = i < right_keys ? *internal_node_key(right, i) : 0;
+    }
+
+    bool merge = num_children <= INTERNAL_NODE_MAX_CELL + 1;
+    uint32_t left_children = merge ? num_children : num_children / 2;
+
+    // Rebuild the left node from children[0, left_children)
+    *internal_node_num_keys(left) = left_children - 1;
+    for (uint32_t i = 0; i + 1 < left_children; i++)
+    {
+        internal_node_children(left)[i] = children[i];
+        *internal_node_key(left, i) = keys[i];
+    }
+    *internal_node_right_child(left) = children[left_children - 1];
+    pager_mark_dirty(pager, left_page_num);
+
+    if (!merge)
+    {
+        // Rebuild the right node from the rest
+        uint32_t right_children = num_children - left_children;
+        *internal_node_num_keys(right) = right_children - 1;
+        for (uint32_t i = 0; i + 1 < right_children; i++)
+        {
+            internal_node_children(right)[i] = children[left_children + i];
+            *internal_node_key(right, i) = keys[left_children + i];
+        }
+        *internal_node_right_child(right) = children[num_children - 1];
+        *internal_node_key(parent, left_index) = keys[left_children - 1];
+        pager_mark_dirty(pager, right_page_num);
+        pager_mark_dirty(pager, parent_page_num);
+    }
+
+    // Point every child that moved to another node at its new parent
+    for (uint32_t i = 0; i < num_children; i++)
+    {
+        bool was_left = i <= left_keys;
+        bool is_left = i < left_children;
+        if (was_left != is_left)
+        {
+            void *child = get_page(pager, children[i]);
+            *node_parent(child) = is_left ? left_page_num : right_page_num;
+            pager_mark_dirty(pager, children[i]);
+        }
+    }
+    arena_rewind(&pager->scratch, mark);
+
+    if (merge)
+    {
+        db_stats.internal_merges++;
+        internal_node_remove_key(parent, left_index);
+        pager_mark_dirty(pager, parent_page_num);
+        free_page(pager, right_page_num);
+        node_after_remove(table, parent_page_num);
+    }
+}
+
+/**
+ * @brief Rewrites the internal nodes of a tree that still use the format version 0 layout.
+ *
+ * Version 0 files store each child pointer next to its key, in cells that start right
+ * after the internal node header. The keys and children of every node are copied out
+ * and written back into the separate arrays. All children of an internal node have
+ * the same type, so only the first one is read to decide whether to descend further
+ * and the leaves are never touched.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num Root of the (sub)tree to upgrade.
+ */
+void upgrade_internal_nodes(Pager *pager, uint32_t page_num)
+{
+    void *node = get_page(pager, page_num);
+    if (get_node_type(node) != INTERNAL_NODE)
+        return;
+
+    uint32_t num_keys = *internal_node_num_keys(node);
+    uint32_t *cells = node + INTERNAL_NODE_HEADER_SIZE; // child 0, key 0, child 1, key 1, ...
+    uint32_t *children = malloc(sizeof(uint32_t) * (num_keys + 1));
+    uint32_t *keys = malloc(sizeof(uint32_t) * (num_keys + 1));
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        children[i] = cells[2 * i];
+        keys[i] = cells[2 * i + 1];
+    }
+    children[num_keys] = *internal_node_right_child(node);
+    memcpy(internal_node_keys(node), keys, num_keys * INTERNAL_NODE_KEY_SIZE);
+    memcpy(internal_node_children(node), children, num_keys * INTERNAL_NODE_CHILD_SIZE);
+    pager_mark_dirty(pager, page_num);
+
+    bool descend = get_node_type(get_page(pager, children[0])) == INTERNAL_NODE;
+    pager_release_pages(pager);
+    if (descend)
+    {
+        for (uint32_t i = 0; i <= num_keys; i++)
+            upgrade_internal_nodes(pager, children[i]);
+    }
+    free(children);
+    free(keys);
 }
@@ -17,86 +17,323 @@ uint32_t *leaf_node_num_cells(void *node)
 }
 
 /**
- * @brief Retrieves a pointer to a specific cell (key-value pair) in a leaf node (aka page).
+ * @brief  Retrieves the pointer to the next leaf node in a B-tree.
  *
- * A leaf node consists of a header (metadata) and a body that stores key-value pairs sequentially.
- * This function calculates the memory offset for the specified cell and returns a pointer to it.
+ * Functionality:
+ *      - A **leaf node** in a B-tree may have a pointer to the **next leaf node** for efficient traversal.
+ *      - This function returns a pointer to that **next leaf node offset**.
+ *      - Used in **sequential scans** where nodes are linked for faster ordered access.
  *
- * The offset is determined by skipping the header and adding an offset based on the cell index.
+ * @param node A pointer to the current leaf node in the B-tree.
  *
- * @param node A pointer to the beginning of the leaf node (aka page) in memory.
- * @param cell_num The index of the cell to retrieve (0-based index).
+ * @return `uint32_t*` A pointer to the memory location storing the next leaf node's page number.
  *
- * @return A pointer to the memory location of the requested cell within the leaf node.
+ * Example Usage:
+ * ```
+ * uint32_t next_leaf = *leaf_node_next_leaf(current_node);
+ * if (next_leaf != 0) {
+ *     void *next_node = get_page(pager, next_leaf);
+ * }
+ * ```
  */
-void *leaf_node_cell(void *node, uint32_t cell_num)
+uint32_t *leaf_node_next_leaf(void *node)
+{
+    return node + LEAF_NODE_NEXT_LEAF_OFFSET;
+}
+
+static uint32_t *leaf_node_content_start(void *node)
+{
+    return node + LEAF_NODE_CONTENT_START_OFFSET;
+}
+
+static uint32_t *leaf_node_fragmented(void *node)
+{
+    return node + LEAF_NODE_FRAGMENTED_OFFSET;
+}
+
+// Whether the leaf stores its keys as 16 bit deltas from a base key, see the packed leaf layout.
+static bool leaf_node_packed(void *node)
+{
+    return (*(uint8_t *)(node + NODE_TYPE_OFFSET) & LEAF_NODE_PACKED_FLAG) != 0;
+}
+
+static uint32_t *leaf_node_base_key(void *node)
+{
+    return node + LEAF_NODE_PACKED_BASE_OFFSET;
+}
+
+static uint32_t leaf_node_slot_size(void *node)
+{
+    return leaf_node_packed(node) ? LEAF_NODE_PACKED_SLOT_SIZE : LEAF_NODE_SLOT_SIZE;
+}
+
+// Returns the slot of a cell (a LeafSlot, or a PackedLeafSlot in a packed leaf), slots are kept in key order.
+static void *leaf_node_slot(void *node, uint32_t cell_num)
 {
-    return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
+    if (leaf_node_packed(node))
+        return node + LEAF_NODE_PACKED_SLOTS_OFFSET + cell_num * LEAF_NODE_PACKED_SLOT_SIZE;
+    return node + LEAF_NODE_SLOTS_OFFSET + cell_num * LEAF_NODE_SLOT_SIZE;
+}
+
+// Payload offset and size of a cell, the last two fields of both slot layouts.
+static uint16_t *leaf_node_slot_payload(void *node, uint32_t cell_num)
+{
+    return leaf_node_slot(node, cell_num) + leaf_node_slot_size(node) - 2 * sizeof(uint16_t);
+}
+
+static void leaf_node_set_slot(void *node, uint32_t cell_num, uint32_t key, uint32_t offset, uint32_t size)
+{
+    uint16_t *payload = leaf_node_slot_payload(node, cell_num);
+    if (leaf_node_packed(node))
+        ((PackedLeafSlot *)leaf_node_slot(node, cell_num))->delta = (uint16_t)(key - *leaf_node_base_key(node));
+    else
+        ((LeafSlot *)leaf_node_slot(node, cell_num))->key = key;
+    payload[0] = (uint16_t)offset;
+    payload[1] = (uint16_t)size;
+}
+
+// Whether a key can get a slot without rebuilding the page: any key in an unpacked leaf, one in delta range in a packed leaf.
+static bool leaf_node_key_fits(void *node, uint32_t key)
+{
+    return !leaf_node_packed(node) ||
+           (key >= *leaf_node_base_key(node) && key - *leaf_node_base_key(node) <= LEAF_NODE_PACKED_MAX_DELTA);
 }
 
 /**
  * @brief Retrieves the key of a specific cell in a leaf node (aka page).
  *
- * Each cell in a leaf node contains a key-value pair. This function locates the requested cell
- * and extracts the key from it.
+ * The key lives in the slot of the cell, a binary search over the keys never touches the payloads. In a
+ * packed leaf it is decoded from the base key and the delta in the slot.
  *
  * @param node A pointer to the beginning of the leaf node (aka page) in memory.
  * @param cell_num The index of the cell to retrieve the key from (0-based index).
  *
- * @return The key (an unsigned 32-bit integer) stored in the specified cell.
+ * @return The key of the specified cell.
  */
-uint32_t *leaf_node_key(void *node, uint32_t cell_num)
+uint32_t leaf_node_key(void *node, uint32_t cell_num)
 {
-    return leaf_node_cell(node, cell_num);
+    if (leaf_node_packed(node))
+        return *leaf_node_base_key(node) + ((PackedLeafSlot *)leaf_node_slot(node, cell_num))->delta;
+    return ((LeafSlot *)leaf_node_slot(node, cell_num))->key;
 }
 
 /**
- * @brief Retrieves a pointer to the value stored in a specific cell of a leaf node (aka page).
+ * @brief Binary search for the first cell whose key is at least `key`.
  *
- * Each cell in a leaf node consists of a key-value pair. The key is stored at the beginning,
- * followed by the value. This function calculates the offset to access the value by skipping
- * the key portion of the cell.
+ * A packed leaf is searched on the 16 bit deltas, keys outside its range are answered from the base key
+ * without looking at the slots.
  *
- * @param node A pointer to the beginning of the leaf node (aka page) in memory.
- * @param cell_num The index of the cell to retrieve the value from (0-based index).
+ * @param node The leaf.
+ * @param key The key to look for.
  *
- * @return A pointer to the memory location where the value is stored in the specified cell.
+ * @return The cell of the key, or where it would be inserted (the number of cells if it is past the last).
  */
-void *leaf_node_value(void *node, uint32_t cell_num)
+uint32_t leaf_node_lower_bound(void *node, uint32_t key)
+{
+    uint32_t min_index = 0;
+    uint32_t one_past_max_index = *leaf_node_num_cells(node);
+    if (leaf_node_packed(node))
+    {
+        uint32_t base = *leaf_node_base_key(node);
+        if (key <= base)
+            return 0;
+        if (key - base > LEAF_NODE_PACKED_MAX_DELTA)
+            return one_past_max_index;
+        const PackedLeafSlot *slots = node + LEAF_NODE_PACKED_SLOTS_OFFSET;
+        uint16_t delta = (uint16_t)(key - base);
+        while (min_index != one_past_max_index)
+        {
+            uint32_t mid_index = (min_index + one_past_max_index) / 2;
+            if (slots[mid_index].delta < delta)
+                min_index = mid_index + 1;
+            else
+                one_past_max_index = mid_index;
+        }
+        return min_index;
+    }
+    const LeafSlot *slots = node + LEAF_NODE_SLOTS_OFFSET;
+    while (min_index != one_past_max_index)
+    {
+        uint32_t mid_index = (min_index + one_past_max_index) / 2;
+        if (slots[mid_index].key < key)
+            min_index = mid_index + 1;
+        else
+            one_past_max_index = mid_index;
+    }
+    return min_index;
+}
+
+// Returns the payload of a cell, leaf_node_cell_size() bytes.
+void *leaf_node_cell(void *node, uint32_t cell_num)
 {
-    return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+    return node + leaf_node_slot_payload(node, cell_num)[0];
+}
+
+// Size of the payload of a cell.
+uint32_t leaf_node_cell_size(void *node, uint32_t cell_num)
+{
+    return leaf_node_slot_payload(node, cell_num)[1];
 }
 
 /**
- * @brief  Retrieves the pointer to the next leaf node in a B-tree.
+ * @brief Reads a row in place from its leaf cell.
  *
- * Functionality:
- *      - A **leaf node** in a B-tree may have a pointer to the **next leaf node** for efficient traversal.
- *      - This function returns a pointer to that **next leaf node offset**.
- *      - Used in **sequential scans** where nodes are linked for faster ordered access.
+ * @param node A pointer to the beginning of the leaf node (aka page) in memory.
+ * @param cell_num The index of the cell.
+ * @param row Filled in, its strings point into the page.
+ */
+void leaf_node_row(void *node, uint32_t cell_num, RowView *row)
+{
+    const uint16_t *slot_payload = leaf_node_slot_payload(node, cell_num);
+    const uint8_t *payload = node + slot_payload[0];
+    row->id = leaf_node_key(node, cell_num);
+    row->username_length = payload[0];
+    row->username = (const char *)payload + 1;
+    row->email = row->username + row->username_length;
+    row->email_length = slot_payload[1] - 1 - row->username_length;
+}
+
+// Size of the payload a serialized row (ROW_SIZE bytes, see serialize_row()) is stored as.
+uint32_t leaf_node_payload_size(const void *row)
+{
+    return 1 + strnlen(row + USERNAME_OFFSET, COLUMN_USERNAME_SIZE) + strnlen(row + EMAIL_OFFSET, COLUMN_EMAIL_SIZE);
+}
+
+// Writes the payload of a serialized row, returns its size.
+static uint32_t leaf_node_encode(const void *row, uint8_t *payload)
+{
+    uint32_t username_length = strnlen(row + USERNAME_OFFSET, COLUMN_USERNAME_SIZE);
+    uint32_t email_length = strnlen(row + EMAIL_OFFSET, COLUMN_EMAIL_SIZE);
+    payload[0] = (uint8_t)username_length;
+    memcpy(payload + 1, row + USERNAME_OFFSET, username_length);
+    memcpy(payload + 1 + username_length, row + EMAIL_OFFSET, email_length);
+    return 1 + username_length + email_length;
+}
+
+// Bytes between the end of the slot array and the lowest payload.
+static uint32_t leaf_node_gap(void *node)
+{
+    return *leaf_node_content_start(node) - ((uint32_t)(leaf_node_slot(node, 0) - node) + *leaf_node_num_cells(node) * leaf_node_slot_size(node));
+}
+
+// Bytes taken by slots and live payloads, and the base key of a packed leaf.
+uint32_t leaf_node_used_space(void *node)
+{
+    return LEAF_NODE_SPACE_FOR_CELL - leaf_node_gap(node) - *leaf_node_fragmented(node);
+}
+
+// Bytes taken by live payloads alone.
+static uint32_t leaf_node_payload_bytes(void *node)
+{
+    uint32_t slots = *leaf_node_num_cells(node) * leaf_node_slot_size(node);
+    return leaf_node_used_space(node) - slots - (leaf_node_packed(node) ? LEAF_NODE_PACKED_BASE_SIZE : 0);
+}
+
+// Whether leaf_node_fill() packs cells whose keys lie in [min_key, max_key].
+static bool leaf_node_can_pack(uint32_t min_key, uint32_t max_key)
+{
+    return db_config.packed_keys && max_key - min_key <= LEAF_NODE_PACKED_MAX_DELTA;
+}
+
+/**
+ * @brief Space a leaf rebuilt from a set of cells uses, in the layout leaf_node_fill() picks for them.
  *
- * @param node A pointer to the current leaf node in the B-tree.
+ * @param num_cells Number of cells, at least one.
+ * @param payload_bytes Their payloads together.
+ * @param min_key Smallest key among them.
+ * @param max_key Largest key among them.
  *
- * @return `uint32_t*` A pointer to the memory location storing the next leaf node's page number.
+ * @return Bytes of LEAF_NODE_SPACE_FOR_CELL the cells take.
+ */
+uint32_t leaf_node_space_for(uint32_t num_cells, uint32_t payload_bytes, uint32_t min_key, uint32_t max_key)
+{
+    if (leaf_node_can_pack(min_key, max_key))
+        return LEAF_NODE_PACKED_BASE_SIZE + num_cells * LEAF_NODE_PACKED_SLOT_SIZE + payload_bytes;
+    return num_cells * LEAF_NODE_SLOT_SIZE + payload_bytes;
+}
+
+/**
+ * @brief Whether a new cell fits, in place or after compacting (and possibly repacking) the page.
  *
- * Example Usage:
- * ```
- * uint32_t next_leaf = *leaf_node_next_leaf(current_node);
- * if (next_leaf != 0) {
- *     void *next_node = get_page(pager, next_leaf);
- * }
- * ```
+ * @param node The leaf.
+ * @param key Key of the new cell, one outside the delta range of a packed leaf needs the page rebuilt.
+ * @param payload_size Size of its payload.
  */
-uint32_t *leaf_node_next_leaf(void *node)
+bool leaf_node_has_room(void *node, uint32_t key, uint32_t payload_size)
 {
-    return node + LEAF_NODE_NEXT_LEAF_OFFSET;
+    if (leaf_node_key_fits(node, key) &&
+        leaf_node_used_space(node) + leaf_node_slot_size(node) + payload_size <= LEAF_NODE_SPACE_FOR_CELL)
+        return true;
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t min_key = key, max_key = key;
+    if (num_cells > 0)
+    {
+        min_key = key < leaf_node_key(node, 0) ? key : leaf_node_key(node, 0);
+        max_key = key > leaf_node_key(node, num_cells - 1) ? key : leaf_node_key(node, num_cells - 1);
+    }
+    return leaf_node_space_for(num_cells + 1, leaf_node_payload_bytes(node) + payload_size, min_key, max_key) <=
+           LEAF_NODE_SPACE_FOR_CELL;
+}
+
+// Whether the payload of a cell can be replaced by one of this size without splitting the leaf.
+bool leaf_node_can_replace(void *node, uint32_t cell_num, uint32_t payload_size)
+{
+    return leaf_node_used_space(node) - leaf_node_cell_size(node, cell_num) + payload_size <= LEAF_NODE_SPACE_FOR_CELL;
+}
+
+// Whether deleting a cell leaves a non-root leaf for leaf_node_rebalance(), see LEAF_NODE_MIN_FILL.
+bool leaf_node_underfull_after_delete(void *node, uint32_t cell_num)
+{
+    return leaf_node_used_space(node) - leaf_node_slot_size(node) - leaf_node_cell_size(node, cell_num) < LEAF_NODE_MIN_FILL;
+}
+
+// Drops every cell and unpacks the leaf, the rest of the header (type, root flag, parent, next leaf) is kept.
+static void leaf_node_clear(void *node)
+{
+    *(uint8_t *)(node + NODE_TYPE_OFFSET) &= (uint8_t)~LEAF_NODE_PACKED_FLAG;
+    *leaf_node_num_cells(node) = 0;
+    *leaf_node_content_start(node) = PAGE_USABLE_SIZE;
+    *leaf_node_fragmented(node) = 0;
+}
+
+// Takes `size` bytes below the content start, the caller made sure the gap holds them.
+static uint32_t leaf_node_allocate(void *node, uint32_t size)
+{
+    *leaf_node_content_start(node) -= size;
+    return *leaf_node_content_start(node);
+}
+
+// Adds a cell after the last one, the gap must hold its slot and payload and the key must fit (leaf_node_key_fits()).
+static void leaf_node_append_payload(void *node, uint32_t key, const void *payload, uint32_t size)
+{
+    uint32_t cell_num = *leaf_node_num_cells(node);
+    uint32_t offset = leaf_node_allocate(node, size);
+    memcpy(node + offset, payload, size);
+    leaf_node_set_slot(node, cell_num, key, offset, size);
+    *leaf_node_num_cells(node) = cell_num + 1;
+}
+
+/**
+ * @brief Appends a serialized row after the last cell of a leaf that is being filled in key order.
+ *
+ * Used by the format upgrade, the caller checked leaf_node_has_room() and the page has no fragments.
+ *
+ * @param node The leaf.
+ * @param key Id of the row, larger than every key in the leaf.
+ * @param row The row in its serialized form (ROW_SIZE bytes, see serialize_row()).
+ */
+void leaf_node_append(void *node, uint32_t key, const void *row)
+{
+    uint8_t payload[LEAF_NODE_MAX_PAYLOAD_SIZE];
+    uint32_t size = leaf_node_encode(row, payload);
+    leaf_node_append_payload(node, key, payload, size);
 }
 
 /**
  * @brief Initializes a leaf node (aka page) by setting the number of cells to zero.
  *
- * This function prepares a new leaf node by ensuring it starts with zero key-value pairs.
- * The number of cells in a leaf node is stored in the header at a fixed offset.
+ * This function prepares a new leaf node by ensuring it starts with zero key-value pairs and the whole
+ * page after the header free.
  *
  * @param node A pointer to the beginning of the leaf node (aka page) in memory.
  */
@@ -104,7 +341,7 @@ void initialize_leaf_node(void *node)
 {
     set_node_type(node, LEAF_NODE);
     set_node_root(node, false);
-    *leaf_node_num_cells(node) = 0;
+    leaf_node_clear(node);
     *leaf_node_next_leaf(node) = 0;
     *node_parent(node) = 0;
 }
@@ -121,37 +358,135 @@ void initialize_leaf_node(void *node)
  * @param page_num Page number of the leaf node to search.
  * @param key The key to find in the leaf node.
  * @return Cursor* A pointer to a newly allocated cursor pointing to
- *         the key's position in the leaf node.
+ *         the key's position in the leaf node. The cursor pins its page,
+ *         release it with cursor_close().
  */
 Cursor *find_leaf_node(Table *table, uint32_t page_num, uint32_t key)
 {
     void *node = get_page(table->pager, page_num);
-    uint32_t num_cell = *leaf_node_num_cells(node);
 
-    Cursor *cursor = malloc(sizeof(Cursor));
-    cursor->table = table;
-    cursor->page_num = page_num;
+    Cursor *cursor = cursor_open(table, page_num); // keeps the leaf resident for as long as the cursor lives
+    cursor->cell_num = leaf_node_lower_bound(node, key);
+    return cursor;
+}
 
-    uint32_t min_index = 0;
-    uint32_t one_past_max_index = num_cell;
+/*
+Pages are rebuilt from a list of cells that point into copies of the pages involved (or at a new payload),
+that is how compaction, splits, merges and redistribution all work.
+*/
+typedef struct
+{
+    uint32_t key;
+    const void *payload;
+    uint32_t size;
+} LeafCellRef;
 
-    // check until min_index equals to one_past_max_index
-    while (min_index != one_past_max_index)
+// Appends references to every cell of `node` to `cells`, returns how many there are.
+static uint32_t leaf_node_collect(void *node, LeafCellRef *cells)
+{
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    for (uint32_t i = 0; i < num_cells; i++)
     {
-        uint32_t mid_index = (min_index + one_past_max_index) / 2;
-        uint32_t key_at_mid_index = *leaf_node_key(node, mid_index);
-        if (key_at_mid_index == key)
-        {
-            cursor->cell_num = mid_index;
-            return cursor;
-        }
-        if (key < key_at_mid_index)
-            one_past_max_index = mid_index;
-        else
-            min_index = mid_index + 1;
+        cells[i].key = leaf_node_key(node, i);
+        cells[i].payload = leaf_node_cell(node, i);
+        cells[i].size = leaf_node_cell_size(node, i);
     }
-    cursor->cell_num = min_index;
-    return cursor;
+    return num_cells;
+}
+
+// leaf_node_space_for() a list of cells in key order.
+static uint32_t leaf_node_cells_space(const LeafCellRef *cells, uint32_t num_cells)
+{
+    uint32_t payload_bytes = 0;
+    for (uint32_t i = 0; i < num_cells; i++)
+        payload_bytes += cells[i].size;
+    return num_cells == 0 ? 0 : leaf_node_space_for(num_cells, payload_bytes, cells[0].key, cells[num_cells - 1].key);
+}
+
+/*
+Rewrites a leaf with the given cells (in key order), without fragments. The leaf is packed whenever the
+keys allow it, a rebuild is the only time a leaf changes between the two layouts.
+*/
+static void leaf_node_fill(void *node, const LeafCellRef *cells, uint32_t num_cells)
+{
+    if (leaf_node_cells_space(cells, num_cells) > LEAF_NODE_SPACE_FOR_CELL)
+    {
+        printf("Leaf cells do not fit into a page\n");
+        exit(EXIT_FAILURE);
+    }
+    leaf_node_clear(node);
+    if (num_cells > 0 && leaf_node_can_pack(cells[0].key, cells[num_cells - 1].key))
+    {
+        *(uint8_t *)(node + NODE_TYPE_OFFSET) |= LEAF_NODE_PACKED_FLAG;
+        *leaf_node_base_key(node) = cells[0].key;
+    }
+    for (uint32_t i = 0; i < num_cells; i++)
+        leaf_node_append_payload(node, cells[i].key, cells[i].payload, cells[i].size);
+}
+
+/**
+ * @brief Fills an empty leaf with rows in key order, packed if their ids allow it.
+ *
+ * Used by the bulk load, the caller checked leaf_node_space_for() for the rows.
+ *
+ * @param pager The pager, the encoded rows are built in its scratch memory.
+ * @param node The leaf.
+ * @param rows The rows, sorted by id.
+ * @param num_rows Number of rows.
+ */
+void leaf_node_fill_rows(Pager *pager, void *node, const Row *rows, uint32_t num_rows)
+{
+    ArenaMark mark = arena_mark(&pager->scratch);
+    uint8_t *payloads = arena_alloc(&pager->scratch, (size_t)num_rows * LEAF_NODE_MAX_PAYLOAD_SIZE);
+    LeafCellRef *cells = arena_alloc(&pager->scratch, sizeof(LeafCellRef) * num_rows);
+    char serialized[sizeof(Row)];
+    for (uint32_t i = 0; i < num_rows; i++)
+    {
+        serialize_row((Row *)&rows[i], serialized);
+        cells[i].key = rows[i].id;
+        cells[i].payload = payloads + (size_t)i * LEAF_NODE_MAX_PAYLOAD_SIZE;
+        cells[i].size = leaf_node_encode(serialized, payloads + (size_t)i * LEAF_NODE_MAX_PAYLOAD_SIZE);
+    }
+    leaf_node_fill(node, cells, num_rows);
+    arena_rewind(&pager->scratch, mark);
+}
+
+/*
+Number of cells for the left one of two leaves so both get about the same number of bytes. The bytes are
+counted with unpacked slots, so either half fits into a page however it ends up laid out.
+*/
+static uint32_t leaf_node_split_point(const LeafCellRef *cells, uint32_t num_cells)
+{
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < num_cells; i++)
+        total += LEAF_NODE_SLOT_SIZE + cells[i].size;
+    uint32_t left = 0;
+    uint32_t left_count = 0;
+    while (left_count + 1 < num_cells && left + LEAF_NODE_SLOT_SIZE + cells[left_count].size <= total / 2)
+        left += LEAF_NODE_SLOT_SIZE + cells[left_count++].size;
+    return left_count > 0 ? left_count : 1;
+}
+
+// Copy of a page in the writer's scratch memory, the caller rewinds it (see arena.c).
+static void *leaf_node_copy(Pager *pager, void *node)
+{
+    void *copy = arena_alloc(&pager->scratch, PAGE_SIZE);
+    memcpy(copy, node, PAGE_SIZE);
+    return copy;
+}
+
+// Cell list of a leaf with one more cell at `cell_num` (cell_num == num_cells appends), in scratch memory.
+static LeafCellRef *leaf_node_cells_with(Pager *pager, void *node, uint32_t cell_num, uint32_t key,
+                                         const void *payload, uint32_t size, uint32_t *num_cells)
+{
+    LeafCellRef *cells = arena_alloc(&pager->scratch, sizeof(LeafCellRef) * (*leaf_node_num_cells(node) + 1));
+    uint32_t count = leaf_node_collect(node, cells);
+    memmove(cells + cell_num + 1, cells + cell_num, (count - cell_num) * sizeof(LeafCellRef));
+    cells[cell_num].key = key;
+    cells[cell_num].payload = payload;
+    cells[cell_num].size = size;
+    *num_cells = count + 1;
+    return cells;
 }
 
 /**
@@ -159,65 +494,49 @@ Cursor *find_leaf_node(Table *table, uint32_t page_num, uint32_t key)
  *
  * @param cursor Pointer to the cursor indicating the insertion position.
  * @param key The key to insert into the leaf node.
- * @param value Pointer to the row data to be stored in the leaf node.
+ * @param payload The payload of the new cell, at most LEAF_NODE_MAX_PAYLOAD_SIZE bytes.
+ * @param size Size of the payload.
  *
- * @note This function handles the case when a leaf node is full and needs to be split.
- *       It creates a new node, redistributes existing keys between the old and new node,
- *       inserts the new key in the appropriate location, and updates the parent if needed.
+ * @note This function handles the case when a leaf node has no room for the new cell.
+ *       It creates a new node, moves the upper cells there so both nodes hold about the same
+ *       number of bytes, inserts the new key in the appropriate location, and updates the parent.
+ *       Both pages are rebuilt without fragments.
  */
-void leaf_node_split_insert(Cursor *cursor, uint32_t key, Row *value)
+void leaf_node_split_insert(Cursor *cursor, uint32_t key, const void *payload, uint32_t size)
 {
+    db_stats.leaf_splits++;
     void *old_node = get_page(cursor->table->pager, cursor->page_num); // Get the current full leaf node
     uint32_t old_max = get_node_max_key(cursor->table->pager, old_node);
     // Allocate a new page for the split node
     uint32_t new_page_num = get_unused_page_num(cursor->table->pager); // load an unused page from memory
     void *new_node = get_page(cursor->table->pager, new_page_num);
     initialize_leaf_node(new_node); // Initialize the new leaf node
+
+    ArenaMark mark = arena_mark(&cursor->table->pager->scratch);
+    void *old_copy = leaf_node_copy(cursor->table->pager, old_node);
+    uint32_t num_cells;
+    LeafCellRef *cells = leaf_node_cells_with(cursor->table->pager, old_copy, cursor->cell_num, key, payload, size,
+                                              &num_cells);
+
+    /*
+    Appending past the end of the right-most leaf (increasing ids) would leave every left leaf half full
+    forever with a 50/50 split. Like SQLite's append optimization the old leaf keeps all its cells in that
+    case and the new leaf starts with just the new one (100/0).
+    */
+    bool appending = *leaf_node_next_leaf(old_node) == 0 && cursor->cell_num == num_cells - 1;
+    uint32_t left_split_count = appending ? num_cells - 1 : leaf_node_split_point(cells, num_cells);
+
     // we are copying parent of old node to new_node as they will have sme parent
     *node_parent(new_node) = *node_parent(old_node);
     // give whatever is stored in old_node next leaf to new_node next leaf.
     *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
     *leaf_node_next_leaf(old_node) = new_page_num; // old node points to new node.
 
-    // Redistribute keys between the old and new node
-    for (int32_t i = LEAF_NODE_MAX_CELL; i >= 0; i--)
-    {
-        void *destination_node;
-
-        // Determine if the key should go to the new or old node
-        if (i >= LEAF_NODE_LEFT_SPLIT_COUNT)
-            destination_node = new_node; // upper half
-        else
-            destination_node = old_node; // lower half
-
-        // Get the index within the respective node
-        uint32_t index_within_node = i % LEAF_NODE_LEFT_SPLIT_COUNT;
-        void *destination = leaf_node_cell(destination_node, index_within_node);
-
-        /*
-        To better understand this logic below is example:
-            Assume the following initial leaf node (max 4 cells), and we want to insert key 25 at index 2:
-                  Index	    Old Keys Before Insert	    New Keys After Insert
-                    0	            10	                        10
-                    1	            20	                        20
-                    2	            30	                        25 (Inserted)
-                    3	            40	                        30
-                    4	            50	                        40
-                    5	        (Overflow)	                    50
-        */
-        if (i == cursor->cell_num)
-        {
-            serialize_row(value, leaf_node_value(destination_node, index_within_node)); // Insert the new key-value pair at the correct location
-            *leaf_node_key(destination_node, index_within_node) = key;
-        }
-        else if (i > cursor->cell_num)
-            memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE); // Shift right
-        else
-            memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE); // Copy existing
-    }
-    // Update the number of cells in both nodes after splitting
-    *(leaf_node_num_cells(old_node)) = LEAF_NODE_LEFT_SPLIT_COUNT;
-    *(leaf_node_num_cells(new_node)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+    leaf_node_fill(old_node, cells, left_split_count);
+    leaf_node_fill(new_node, cells + left_split_count, num_cells - left_split_count);
+    arena_rewind(&cursor->table->pager->scratch, mark);
+    pager_mark_dirty(cursor->table->pager, cursor->page_num);
+    pager_mark_dirty(cursor->table->pager, new_page_num);
 
     // If the old node was the root, create a new root
     if (is_root_node(old_node))
@@ -229,42 +548,382 @@ void leaf_node_split_insert(Cursor *cursor, uint32_t key, Row *value)
         void *parent = get_page(cursor->table->pager, parent_page_num);
 
         update_internal_node_key(parent, old_max, new_max);
+        pager_mark_dirty(cursor->table->pager, parent_page_num);
         internal_node_insert(cursor->table, parent_page_num, new_page_num);
         return;
     }
 }
 
+// Logs the header fields a cell change touches: cell count, content start and fragmented bytes.
+static void leaf_node_mark_header(Pager *pager, uint32_t page_num)
+{
+    pager_mark_dirty_range(pager, page_num, LEAF_NODE_NUM_CELLS_OFFSET, LEAF_NODE_HEADER_SIZE - LEAF_NODE_NUM_CELLS_OFFSET);
+}
+
 /**
- * Inserts a key-value pair into a leaf node at the specified cursor position.
- * If the node is full, it prints a message and exits (branching not implemented yet).
+ * Inserts a cell with any payload into a leaf node at the specified cursor position.
+ * If the node has no room, it is split (see leaf_node_split_insert()).
+ *
+ * The leaves do not look into payloads, so trees other than the table (the secondary indexes, see
+ * index.c) store their cells through here.
  *
  * @param cursor Pointer to the cursor indicating the insertion position.
  * @param key The key to insert into the leaf node.
- * @param value Pointer to the row data to be stored in the leaf node.
+ * @param payload The payload of the new cell, at most LEAF_NODE_MAX_PAYLOAD_SIZE bytes.
+ * @param size Size of the payload.
  *
- * @note If the insertion position is not at the end, existing entries are shifted to make space.
- * @note If the leaf node is full, the function exits with an error message.
+ * @note The slots from the insert position onwards move up by one, the payload goes below the lowest
+ *       one. When that gap is too small but the fragments make up for it the page is compacted first.
  */
-void leaf_node_insert(Cursor *cursor, uint32_t key, Row *value)
+void leaf_node_insert_payload(Cursor *cursor, uint32_t key, const void *payload, uint32_t size)
 {
-    void *node = get_page(cursor->table->pager, cursor->page_num);
+    Pager *pager = cursor->table->pager;
+    void *node = get_page(pager, cursor->page_num);
 
     uint32_t num_cell = *leaf_node_num_cells(node);
-    if (num_cell >= LEAF_NODE_MAX_CELL)
+    if (!leaf_node_has_room(node, key, size))
     {
-        leaf_node_split_insert(cursor, key, value);
+        leaf_node_split_insert(cursor, key, payload, size);
         return; // resaon for bug there wasnt return here
     }
-    if (cursor->cell_num < num_cell)
+    uint32_t slot_size = leaf_node_slot_size(node);
+    if (!leaf_node_key_fits(node, key) || leaf_node_gap(node) < slot_size + size)
+    {
+        // Compact (and repack for a key outside the delta range): rebuild the page with the new cell in place
+        ArenaMark mark = arena_mark(&pager->scratch);
+        void *copy = leaf_node_copy(pager, node);
+        uint32_t num_cells;
+        LeafCellRef *cells = leaf_node_cells_with(pager, copy, cursor->cell_num, key, payload, size, &num_cells);
+        leaf_node_fill(node, cells, num_cells);
+        arena_rewind(&pager->scratch, mark);
+        pager_mark_dirty(pager, cursor->page_num);
+        return;
+    }
+
+    // Make room for the new slot
+    memmove(leaf_node_slot(node, cursor->cell_num + 1), leaf_node_slot(node, cursor->cell_num),
+            (num_cell - cursor->cell_num) * slot_size);
+    uint32_t offset = leaf_node_allocate(node, size);
+    memcpy(node + offset, payload, size);
+    leaf_node_set_slot(node, cursor->cell_num, key, offset, size);
+    *leaf_node_num_cells(node) += 1;
+
+    // Only the header, the slots from the insert position onwards and the new payload changed
+    uint32_t slots_offset = leaf_node_slot(node, cursor->cell_num) - node;
+    leaf_node_mark_header(pager, cursor->page_num);
+    pager_mark_dirty_range(pager, cursor->page_num, slots_offset, (num_cell + 1 - cursor->cell_num) * slot_size);
+    pager_mark_dirty_range(pager, cursor->page_num, offset, size);
+}
+
+/**
+ * Inserts a row into a leaf node at the specified cursor position, see leaf_node_insert_payload().
+ *
+ * @param cursor Pointer to the cursor indicating the insertion position.
+ * @param key The key to insert into the leaf node.
+ * @param value The row in its serialized form (ROW_SIZE bytes, see serialize_row()), stored as a payload.
+ */
+void leaf_node_insert(Cursor *cursor, uint32_t key, const void *value)
+{
+    uint8_t payload[LEAF_NODE_MAX_PAYLOAD_SIZE];
+    uint32_t size = leaf_node_encode(value, payload);
+    leaf_node_insert_payload(cursor, key, payload, size);
+}
+
+/**
+ * Replaces the payload of the cell the cursor points to.
+ *
+ * @param cursor Pointer to the cursor positioned on the cell to change.
+ * @param payload The new payload, at most LEAF_NODE_MAX_PAYLOAD_SIZE bytes.
+ * @param size Size of the payload.
+ *
+ * @note A payload that does not grow is overwritten in place. A larger one goes below the lowest payload,
+ *       the page is compacted if only the fragments have room for it, and if the leaf has no room at all
+ *       the cell is taken out and inserted again, which splits the leaf (leaf_node_can_replace() tells
+ *       the caller in advance).
+ */
+void leaf_node_replace_payload(Cursor *cursor, const void *payload, uint32_t size)
+{
+    Pager *pager = cursor->table->pager;
+    void *node = get_page(pager, cursor->page_num);
+    uint16_t *slot_payload = leaf_node_slot_payload(node, cursor->cell_num);
+    uint32_t old_size = slot_payload[1];
+    uint32_t slot_offset = leaf_node_slot(node, cursor->cell_num) - node;
+
+    if (size <= old_size || leaf_node_gap(node) >= size)
     {
-        // Make room for new cell
-        for (uint32_t i = num_cell; i > cursor->cell_num; i--)
+        uint32_t offset = slot_payload[0];
+        if (size > old_size)
         {
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
+            *leaf_node_fragmented(node) += old_size;
+            offset = leaf_node_allocate(node, size);
         }
+        else
+            *leaf_node_fragmented(node) += old_size - size;
+        memcpy(node + offset, payload, size);
+        slot_payload[0] = (uint16_t)offset;
+        slot_payload[1] = (uint16_t)size;
+        leaf_node_mark_header(pager, cursor->page_num);
+        pager_mark_dirty_range(pager, cursor->page_num, slot_offset, leaf_node_slot_size(node));
+        pager_mark_dirty_range(pager, cursor->page_num, offset, size);
+        return;
     }
-    *(leaf_node_num_cells(node)) += 1;
-    *(leaf_node_key)(node, cursor->cell_num) = key;
-    serialize_row(value, leaf_node_value(node, cursor->cell_num));
+
+    if (leaf_node_can_replace(node, cursor->cell_num, size))
+    {
+        ArenaMark mark = arena_mark(&pager->scratch);
+        void *copy = leaf_node_copy(pager, node);
+        LeafCellRef *cells = arena_alloc(&pager->scratch, sizeof(LeafCellRef) * *leaf_node_num_cells(copy));
+        uint32_t num_cells = leaf_node_collect(copy, cells);
+        cells[cursor->cell_num].payload = payload;
+        cells[cursor->cell_num].size = size;
+        leaf_node_fill(node, cells, num_cells);
+        arena_rewind(&pager->scratch, mark);
+        pager_mark_dirty(pager, cursor->page_num);
+        return;
+    }
+
+    // No room even after compaction: take the cell out and insert the new version, the leaf splits
+    uint32_t key = leaf_node_key(node, cursor->cell_num);
+    uint32_t num_cell = *leaf_node_num_cells(node);
+    *leaf_node_fragmented(node) += old_size;
+    memmove(leaf_node_slot(node, cursor->cell_num), leaf_node_slot(node, cursor->cell_num + 1),
+            (num_cell - 1 - cursor->cell_num) * leaf_node_slot_size(node));
+    *leaf_node_num_cells(node) -= 1;
+    pager_mark_dirty(pager, cursor->page_num);
+    leaf_node_insert_payload(cursor, key, payload, size);
+}
+
+/**
+ * Replaces the payload of the cell the cursor points to with a new version of the row, see
+ * leaf_node_replace_payload().
+ *
+ * @param cursor Pointer to the cursor positioned on the cell to change.
+ * @param value The row in its serialized form (ROW_SIZE bytes), its id is the key of the cell.
+ */
+void leaf_node_replace(Cursor *cursor, const void *value)
+{
+    uint8_t payload[LEAF_NODE_MAX_PAYLOAD_SIZE];
+    uint32_t size = leaf_node_encode(value, payload);
+    leaf_node_replace_payload(cursor, payload, size);
+}
+
+/**
+ * Deletes the cell the cursor points to.
+ *
+ * @param cursor Pointer to the cursor positioned on the cell to delete.
+ *
+ * @note The following slots are shifted left to fill the gap, the payload becomes a fragment (or
+ *       gap, if it was the lowest one). If a non-root leaf drops below LEAF_NODE_MIN_FILL it is
+ *       merged with or refilled from a sibling, so deletes give pages back to the freelist instead
+ *       of leaving half empty leaves behind.
+ */
+void leaf_node_delete(Cursor *cursor)
+{
+    Pager *pager = cursor->table->pager;
+    void *node = get_page(pager, cursor->page_num);
+    uint32_t num_cell = *leaf_node_num_cells(node);
+    void *slot = leaf_node_slot(node, cursor->cell_num);
+    uint32_t slot_size = leaf_node_slot_size(node);
+    const uint16_t *slot_payload = leaf_node_slot_payload(node, cursor->cell_num);
+
+    if (slot_payload[0] == *leaf_node_content_start(node))
+        *leaf_node_content_start(node) += slot_payload[1];
+    else
+        *leaf_node_fragmented(node) += slot_payload[1];
+    // Shift all subsequent slots left to fill the gap (for imagination consider it an array of size num_cell)
+    memmove(slot, leaf_node_slot(node, cursor->cell_num + 1), (num_cell - 1 - cursor->cell_num) * slot_size);
+    // Reduce the count of stored rows
+    (*leaf_node_num_cells(node))--;
+    uint32_t slots_offset = slot - node;
+    leaf_node_mark_header(pager, cursor->page_num);
+    pager_mark_dirty_range(pager, cursor->page_num, slots_offset, (num_cell - 1 - cursor->cell_num) * slot_size);
+
+    if (!is_root_node(node) && leaf_node_used_space(node) < LEAF_NODE_MIN_FILL)
+        leaf_node_rebalance(cursor->table, cursor->page_num);
 }
 
+/**
+ * Fixes an underfull leaf by merging it with or borrowing cells from a sibling.
+ *
+ * @param table Pointer to the table containing the B-tree.
+ * @param page_num Page number of the underfull leaf, it must not be the root.
+ *
+ * @note The sibling is the left neighbour under the same parent, or the right one for
+ *       the first child. If both leaves fit into one page the right one is appended to
+ *       the left one and freed, otherwise the bytes are split evenly between them and
+ *       the separator key in the parent is updated. A merge removes a key from the
+ *       parent, which is then checked by node_after_remove().
+ */
+void leaf_node_rebalance(Table *table, uint32_t page_num)
+{
+    Pager *pager = table->pager;
+    void *node = get_page(pager, page_num);
+    uint32_t parent_page_num = *node_parent(node);
+    void *parent = get_page(pager, parent_page_num);
+    if (*internal_node_num_keys(parent) == 0)
+        return; // no sibling to work with, the parent is fixed up on its own
+
+    uint32_t index = internal_node_child_index(parent, page_num);
+    uint32_t left_index = index > 0 ? index - 1 : index; // pair (left_index, left_index + 1)
+    uint32_t left_page_num = *internal_node_child(parent, left_index);
+    uint32_t right_page_num = *internal_node_child(parent, left_index + 1);
+    void *left = get_page(pager, left_page_num);
+    void *right = get_page(pager, right_page_num);
+
+    // Both leaves are rebuilt from copies, so the cells can move either way
+    ArenaMark mark = arena_mark(&pager->scratch);
+    void *left_copy = leaf_node_copy(pager, left);
+    void *right_copy = leaf_node_copy(pager, right);
+    LeafCellRef *cells =
+        arena_alloc(&pager->scratch, sizeof(LeafCellRef) * (*leaf_node_num_cells(left) + *leaf_node_num_cells(right)));
+    uint32_t total = leaf_node_collect(left_copy, cells);
+    total += leaf_node_collect(right_copy, cells + total);
+    bool merge = leaf_node_cells_space(cells, total) <= LEAF_NODE_SPACE_FOR_CELL;
+
+    if (merge)
+    {
+        // Merge: right is the next leaf of left, append its cells and unlink it
+        db_stats.leaf_merges++;
+        leaf_node_fill(left, cells, total);
+        *leaf_node_next_leaf(left) = *leaf_node_next_leaf(right);
+        pager_mark_dirty(pager, left_page_num);
+        arena_rewind(&pager->scratch, mark);
+
+        internal_node_remove_key(parent, left_index);
+        pager_mark_dirty(pager, parent_page_num);
+        free_page(pager, right_page_num);
+        node_after_remove(table, parent_page_num);
+        return;
+    }
+
+    // Redistribute: about half of the bytes on each side
+    uint32_t left_target = leaf_node_split_point(cells, total);
+    leaf_node_fill(left, cells, left_target);
+    leaf_node_fill(right, cells + left_target, total - left_target);
+    *internal_node_key(parent, left_index) = leaf_node_key(left, left_target - 1);
+    arena_rewind(&pager->scratch, mark);
+    pager_mark_dirty(pager, left_page_num);
+    pager_mark_dirty(pager, right_page_num);
+    pager_mark_dirty(pager, parent_page_num);
+}
+
+/**
+ * @brief Moves cells of the next leaf into a leaf until it holds `capacity` bytes, for .vacuum.
+ *
+ * Only a next leaf under the same parent is used. If both leaves fit into `capacity` the next
+ * one is merged into this one and freed as leaf_node_rebalance() does, otherwise it keeps its
+ * upper cells and the separator key is updated. The next leaf may end up below
+ * LEAF_NODE_MIN_FILL, it is the one refilled next, unless it is the parent's last child, which
+ * keeps at least that much.
+ *
+ * @param table Pointer to the table (or index tree) the leaf belongs to.
+ * @param page_num In: the leaf to refill. Out: the leaf to refill next, the same one after a
+ *                 merge (it may take cells of the leaf after that), 0 at the end of the tree.
+ * @param capacity Bytes of LEAF_NODE_SPACE_FOR_CELL the leaf should use, see bulk_load_leaf_capacity().
+ *
+ * @return Whether any cell moved.
+ */
+bool leaf_node_refill(Table *table, uint32_t *page_num, uint32_t capacity)
+{
+    Pager *pager = table->pager;
+    uint32_t left_page_num = *page_num;
+    void *left = get_page(pager, left_page_num);
+    uint32_t right_page_num = *leaf_node_next_leaf(left);
+    *page_num = right_page_num;
+    if (right_page_num == 0 || leaf_node_used_space(left) >= capacity)
+        return false;
+    void *right = get_page(pager, right_page_num);
+    uint32_t parent_page_num = *node_parent(left);
+    if (*node_parent(right) != parent_page_num)
+        return false;
+
+    ArenaMark mark = arena_mark(&pager->scratch);
+    void *left_copy = leaf_node_copy(pager, left);
+    void *right_copy = leaf_node_copy(pager, right);
+    uint32_t left_cells = *leaf_node_num_cells(left);
+    LeafCellRef *cells = arena_alloc(&pager->scratch, sizeof(LeafCellRef) * (left_cells + *leaf_node_num_cells(right)));
+    uint32_t total = leaf_node_collect(left_copy, cells);
+    total += leaf_node_collect(right_copy, cells + total);
+
+    // The longest run of cells from the left that stays within capacity
+    uint32_t count = 0;
+    uint32_t payload_bytes = 0;
+    while (count < total &&
+           leaf_node_space_for(count + 1, payload_bytes + cells[count].size, cells[0].key, cells[count].key) <= capacity)
+        payload_bytes += cells[count++].size;
+    void *parent = get_page(pager, parent_page_num);
+    uint32_t left_index = internal_node_child_index(parent, left_page_num);
+
+    if (count == total)
+    {
+        db_stats.leaf_merges++;
+        leaf_node_fill(left, cells, total);
+        *leaf_node_next_leaf(left) = *leaf_node_next_leaf(right);
+        pager_mark_dirty(pager, left_page_num);
+        arena_rewind(&pager->scratch, mark);
+
+        internal_node_remove_key(parent, left_index);
+        pager_mark_dirty(pager, parent_page_num);
+        free_page(pager, right_page_num);
+        node_after_remove(table, parent_page_num);
+        // A root left with this leaf as its only child took its contents, the tree is a single leaf now
+        *page_num = get_node_type(get_page(pager, left_page_num)) == LEAF_NODE ? left_page_num : 0;
+        return true;
+    }
+
+    bool right_is_last = left_index + 1 == *internal_node_num_keys(parent);
+    while (right_is_last && count > left_cells && leaf_node_cells_space(cells + count, total - count) < LEAF_NODE_MIN_FILL)
+        count--;
+    if (count <= left_cells)
+    {
+        arena_rewind(&pager->scratch, mark);
+        return false;
+    }
+    leaf_node_fill(left, cells, count);
+    leaf_node_fill(right, cells + count, total - count);
+    *internal_node_key(parent, left_index) = cells[count - 1].key;
+    arena_rewind(&pager->scratch, mark);
+    pager_mark_dirty(pager, left_page_num);
+    pager_mark_dirty(pager, right_page_num);
+    pager_mark_dirty(pager, parent_page_num);
+    return true;
+}
+
+/**
+ * @brief Rewrites the leaves of a tree that still use the format version 1 layout.
+ *
+ * Version 1 leaves store fixed cells of key and serialized row right after the header. Every leaf is
+ * copied out and rebuilt as a slotted page, following the leaf chain from the left-most leaf. Internal
+ * nodes only hold keys and page numbers and stay as they are.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param root_page_num Root of the tree.
+ */
+void upgrade_leaf_nodes(Pager *pager, uint32_t root_page_num)
+{
+    uint32_t page_num = root_page_num;
+    void *node = get_page(pager, page_num);
+    while (get_node_type(node) == INTERNAL_NODE)
+    {
+        page_num = *internal_node_child(node, 0);
+        node = get_page(pager, page_num);
+    }
+
+    while (page_num != 0)
+    {
+        node = get_page(pager, page_num);
+        ArenaMark mark = arena_mark(&pager->scratch);
+        void *copy = leaf_node_copy(pager, node);
+        uint32_t num_cells = *leaf_node_num_cells(copy);
+        leaf_node_clear(node);
+        for (uint32_t i = 0; i < num_cells; i++)
+        {
+            void *cell = copy + LEGACY_LEAF_NODE_HEADER_SIZE + i * LEGACY_LEAF_NODE_CELL_SIZE;
+            leaf_node_append(node, *(uint32_t *)cell, cell + LEAF_NODE_KEY_SIZE);
+        }
+        arena_rewind(&pager->scratch, mark);
+        pager_mark_dirty(pager, page_num);
+        page_num = *leaf_node_next_leaf(node);
+        pager_release_pages(pager);
+    }
+}
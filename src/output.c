@@ -0,0 +1,405 @@
+#include "constants.h"
+
+/*
+Output sinks for select results. Rows are formatted straight from the leaf cell into a buffer of
+OUTPUT_CHUNKS chunks, the full chunks go out with a single writev() once the last one fills up or the
+select ends. Nothing goes through stdio, which locks and parses a format string for every row; whatever
+stdio still holds is flushed first so the prompt and messages stay in order with the rows.
+
+Modes (.mode or --output):
+    text     (1, user1, person1@example.com), the REPL format
+    csv      1,user1,person1@example.com, fields with a comma, quote or line break are quoted
+    json     {"id":1,"username":"user1","email":"person1@example.com"}, one object per line
+    binary   the serialized row, ROW_SIZE bytes (see serialize_row()), like the binary protocol
+*/
+
+static const char *OUTPUT_MODE_NAMES[] = {"text", "csv", "json", "binary"};
+
+static pthread_key_t output_sink_key;
+static pthread_once_t output_sink_once = PTHREAD_ONCE_INIT;
+
+void output_sink_init(OutputSink *sink, int fd, OutputMode mode)
+{
+    sink->fd = fd;
+    sink->mode = mode;
+    sink->chunk = 0;
+    memset(sink->used, 0, sizeof(sink->used));
+    sink->buffer = malloc(OUTPUT_CHUNKS * OUTPUT_CHUNK_SIZE);
+    if (sink->buffer == NULL)
+    {
+        printf("Out of memory for the output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void output_sink_free(OutputSink *sink)
+{
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
+
+static void output_sink_destroy(void *sink)
+{
+    output_sink_free(sink);
+    free(sink);
+}
+
+static void output_sink_create_key()
+{
+    pthread_key_create(&output_sink_key, output_sink_destroy);
+}
+
+// The sink of the calling thread on stdout, its buffer is kept for the next select of the thread.
+OutputSink *output_stdout_sink()
+{
+    pthread_once(&output_sink_once, output_sink_create_key);
+    OutputSink *sink = pthread_getspecific(output_sink_key);
+    if (sink == NULL)
+    {
+        sink = malloc(sizeof(OutputSink));
+        if (sink == NULL)
+        {
+            printf("Out of memory for the output buffer\n");
+            exit(EXIT_FAILURE);
+        }
+        output_sink_init(sink, STDOUT_FILENO, db_config.output_mode);
+        pthread_setspecific(output_sink_key, sink);
+    }
+    sink->fd = fileno(stdout); // bench.c points stdout somewhere else with freopen()
+    sink->mode = db_config.output_mode;
+    return sink;
+}
+
+// Writes every chunk filled so far, in order.
+void output_flush(OutputSink *sink)
+{
+    if (sink->chunk == 0 && sink->used[0] == 0)
+        return;
+    fflush(stdout);
+    uint32_t num_chunks = sink->used[sink->chunk] > 0 ? sink->chunk + 1 : sink->chunk;
+#ifdef _WIN32
+    for (uint32_t i = 0; i < num_chunks; i++)
+    {
+        const char *data = sink->buffer + i * OUTPUT_CHUNK_SIZE;
+        uint32_t done = 0;
+        while (done < sink->used[i])
+        {
+            int bytes = write(sink->fd, data + done, sink->used[i] - done);
+            if (bytes < 0)
+            {
+                printf("Error writing output: %d\n", errno);
+                exit(EXIT_FAILURE);
+            }
+            done += bytes;
+        }
+    }
+#else
+    struct iovec iov[OUTPUT_CHUNKS];
+    for (uint32_t i = 0; i < num_chunks; i++)
+    {
+        iov[i].iov_base = sink->buffer + i * OUTPUT_CHUNK_SIZE;
+        iov[i].iov_len = sink->used[i];
+    }
+    struct iovec *pending = iov;
+    int num_pending = (int)num_chunks;
+    while (num_pending > 0)
+    {
+        ssize_t bytes = writev(sink->fd, pending, num_pending);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("Error writing output: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        // A short write (a full pipe) leaves the rest of the chunks for the next call
+        while (num_pending > 0 && (size_t)bytes >= pending->iov_len)
+        {
+            bytes -= pending->iov_len;
+            pending++;
+            num_pending--;
+        }
+        if (num_pending > 0)
+        {
+            pending->iov_base = (char *)pending->iov_base + bytes;
+            pending->iov_len -= bytes;
+        }
+    }
+#endif
+    sink->chunk = 0;
+    memset(sink->used, 0, sizeof(sink->used));
+}
+
+// Room for `size` more bytes in the current chunk, moving to the next one (or flushing) if needed.
+static char *output_reserve(OutputSink *sink, uint32_t size)
+{
+    if (sink->used[sink->chunk] + size > OUTPUT_CHUNK_SIZE)
+    {
+        if (sink->chunk + 1 == OUTPUT_CHUNKS)
+            output_flush(sink);
+        else
+            sink->chunk++;
+    }
+    return sink->buffer + sink->chunk * OUTPUT_CHUNK_SIZE + sink->used[sink->chunk];
+}
+
+// Ids are printed as signed 32 bit numbers, the way print_row() always printed them.
+static char *output_id(char *out, uint32_t id)
+{
+    uint32_t value = id;
+    if ((int32_t)id < 0)
+    {
+        *out++ = '-';
+        value = 0u - id;
+    }
+    char digits[10];
+    char *digit = digits + sizeof(digits);
+    do
+    {
+        *--digit = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    size_t length = digits + sizeof(digits) - digit;
+    memcpy(out, digit, length);
+    return out + length;
+}
+
+static char *output_text_field(char *out, const char *field, size_t length)
+{
+    memcpy(out, field, length);
+    return out + length;
+}
+
+static char *output_csv_field(char *out, const char *field, size_t length)
+{
+    size_t plain = 0;
+    while (plain < length && field[plain] != ',' && field[plain] != '"' && field[plain] != '\r' && field[plain] != '\n')
+        plain++;
+    if (plain == length)
+    {
+        memcpy(out, field, length);
+        return out + length;
+    }
+    *out++ = '"';
+    for (size_t i = 0; i < length; i++)
+    {
+        if (field[i] == '"')
+            *out++ = '"';
+        *out++ = field[i];
+    }
+    *out++ = '"';
+    return out;
+}
+
+static char *output_json_field(char *out, const char *name, const char *field, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    *out++ = ',';
+    *out++ = '"';
+    out = output_text_field(out, name, strlen(name));
+    *out++ = '"';
+    *out++ = ':';
+    *out++ = '"';
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)field[i];
+        if (c == '"' || c == '\\')
+        {
+            *out++ = '\\';
+            *out++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            memcpy(out, "\\u00", 4);
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 15];
+            out += 6;
+        }
+        else
+            *out++ = (char)c;
+    }
+    *out++ = '"';
+    return out;
+}
+
+/**
+ * @brief Formats one row into the sink in the sink's mode.
+ *
+ * @param sink The sink.
+ * @param row The row, usually read in place from its leaf (see reader_row()).
+ */
+void output_row(OutputSink *sink, const RowView *row)
+{
+    char *start = output_reserve(sink, OUTPUT_MAX_ROW_SIZE);
+    char *out = start;
+    uint32_t id = row->id;
+    switch (sink->mode)
+    {
+    case (OUTPUT_TEXT):
+        *out++ = '(';
+        out = output_id(out, id);
+        memcpy(out, ", ", 2);
+        out = output_text_field(out + 2, row->username, row->username_length);
+        memcpy(out, ", ", 2);
+        out = output_text_field(out + 2, row->email, row->email_length);
+        *out++ = ')';
+        *out++ = '\n';
+        break;
+    case (OUTPUT_CSV):
+        out = output_id(out, id);
+        *out++ = ',';
+        out = output_csv_field(out, row->username, row->username_length);
+        *out++ = ',';
+        out = output_csv_field(out, row->email, row->email_length);
+        *out++ = '\n';
+        break;
+    case (OUTPUT_JSON):
+        memcpy(out, "{\"id\":", 6);
+        out = output_id(out + 6, id);
+        out = output_json_field(out, "username", row->username, row->username_length);
+        out = output_json_field(out, "email", row->email, row->email_length);
+        *out++ = '}';
+        *out++ = '\n';
+        break;
+    case (OUTPUT_BINARY):
+        serialize_row_view(row, out);
+        out += ROW_SIZE;
+        break;
+    }
+    sink->used[sink->chunk] += (uint32_t)(out - start);
+}
+
+/**
+ * @brief Like output_row() but formats only some of the columns ("select id, email"), always in table
+ * order. Binary rows keep their fixed layout, the columns left out are zero.
+ *
+ * @param sink The sink.
+ * @param row The row, only the columns in `columns` are read.
+ * @param columns SELECT_COLUMN_* bits, at least one.
+ */
+void output_row_columns(OutputSink *sink, const RowView *row, uint32_t columns)
+{
+    if (columns == SELECT_COLUMNS_ALL)
+    {
+        output_row(sink, row);
+        return;
+    }
+    char *start = output_reserve(sink, OUTPUT_MAX_ROW_SIZE);
+    char *out = start;
+    const char *separator = "";
+    switch (sink->mode)
+    {
+    case (OUTPUT_TEXT):
+        *out++ = '(';
+        if (columns & SELECT_COLUMN_ID)
+        {
+            out = output_id(out, row->id);
+            separator = ", ";
+        }
+        if (columns & SELECT_COLUMN_USERNAME)
+        {
+            out = output_text_field(out, separator, strlen(separator));
+            out = output_text_field(out, row->username, row->username_length);
+            separator = ", ";
+        }
+        if (columns & SELECT_COLUMN_EMAIL)
+        {
+            out = output_text_field(out, separator, strlen(separator));
+            out = output_text_field(out, row->email, row->email_length);
+        }
+        *out++ = ')';
+        *out++ = '\n';
+        break;
+    case (OUTPUT_CSV):
+        if (columns & SELECT_COLUMN_ID)
+        {
+            out = output_id(out, row->id);
+            separator = ",";
+        }
+        if (columns & SELECT_COLUMN_USERNAME)
+        {
+            out = output_text_field(out, separator, strlen(separator));
+            out = output_csv_field(out, row->username, row->username_length);
+            separator = ",";
+        }
+        if (columns & SELECT_COLUMN_EMAIL)
+        {
+            out = output_text_field(out, separator, strlen(separator));
+            out = output_csv_field(out, row->email, row->email_length);
+        }
+        *out++ = '\n';
+        break;
+    case (OUTPUT_JSON):
+    {
+        *out++ = '{';
+        char *fields = out;
+        if (columns & SELECT_COLUMN_ID)
+        {
+            memcpy(out, "\"id\":", 5);
+            out = output_id(out + 5, row->id);
+        }
+        if (columns & SELECT_COLUMN_USERNAME)
+            out = output_json_field(out, "username", row->username, row->username_length);
+        if (columns & SELECT_COLUMN_EMAIL)
+            out = output_json_field(out, "email", row->email, row->email_length);
+        if ((columns & SELECT_COLUMN_ID) == 0)
+        {
+            // The other fields start with a comma, the first one does not need it
+            memmove(fields, fields + 1, out - fields - 1);
+            out--;
+        }
+        *out++ = '}';
+        *out++ = '\n';
+        break;
+    }
+    case (OUTPUT_BINARY):
+    {
+        RowView projected = *row;
+        if ((columns & SELECT_COLUMN_ID) == 0)
+            projected.id = 0;
+        if ((columns & SELECT_COLUMN_USERNAME) == 0)
+            projected.username_length = 0;
+        if ((columns & SELECT_COLUMN_EMAIL) == 0)
+            projected.email_length = 0;
+        serialize_row_view(&projected, out);
+        out += ROW_SIZE;
+        break;
+    }
+    }
+    sink->used[sink->chunk] += (uint32_t)(out - start);
+}
+
+// Looks up a mode by name, false for an unknown one.
+bool output_parse_mode(const char *name, OutputMode *mode)
+{
+    for (uint32_t i = 0; i < sizeof(OUTPUT_MODE_NAMES) / sizeof(OUTPUT_MODE_NAMES[0]); i++)
+    {
+        if (strcmp(name, OUTPUT_MODE_NAMES[i]) == 0)
+        {
+            *mode = (OutputMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Implements the `.mode` meta command.
+ *
+ *     .mode          prints the current mode
+ *     .mode NAME     switches to text, csv, json or binary
+ *
+ * @param argument Text after ".mode ", empty for the plain command.
+ *
+ * @return META_COMMAND_SUCCESS, or META_COMMAND_UNRECOGNIZED_COMMAND for an unknown mode.
+ */
+MetaCommandResult output_mode_command(const char *argument)
+{
+    if (strcmp(argument, "") == 0)
+    {
+        printf("%s\n", OUTPUT_MODE_NAMES[db_config.output_mode]);
+        return META_COMMAND_SUCCESS;
+    }
+    return output_parse_mode(argument, &db_config.output_mode) ? META_COMMAND_SUCCESS
+                                                                : META_COMMAND_UNRECOGNIZED_COMMAND;
+}
@@ -1,11 +1,131 @@
 #include "constants.h"
 
+static void page_table_insert(Pager *pager, uint32_t page_num, uint32_t frame_index);
+static void page_table_rebuild(Pager *pager);
+static void pager_map_grow(Pager *pager, off_t needed_length);
+static void pager_trim_zero_tail(Pager *pager);
+static void pager_init_frames(Pager *pager, uint32_t first, uint32_t last);
+static void pager_alloc_slab(Pager *pager, uint32_t first, uint32_t last);
+static void pager_enable_direct_io(Pager *pager);
+static uint32_t pager_fetch_frame(Pager *pager, uint32_t page_num, bool writer);
+static void pager_remember_latch(Pager *pager, uint32_t frame_index);
+static void pager_init_latch(pthread_rwlock_t *latch);
+static void pager_preserve_page(Pager *pager, uint32_t frame_index);
+static void pager_stamp_versions(Pager *pager, uint64_t end_ts);
+static void pager_reclaim_versions(Pager *pager);
+static void pager_prepare_write(void *data, uint32_t page_num);
+
+// The pager mutex guards the page table, the CLOCK state, frame ownership and the write-ahead log file
+void pager_lock(Pager *pager)
+{
+    pthread_mutex_lock(&pager->mutex);
+}
+
+void pager_unlock(Pager *pager)
+{
+    pthread_mutex_unlock(&pager->mutex);
+}
+
+// Page sizes are powers of two from MIN_PAGE_SIZE to MAX_PAGE_SIZE.
+bool page_size_is_valid(uint32_t page_size)
+{
+    return page_size >= MIN_PAGE_SIZE && page_size <= MAX_PAGE_SIZE && (page_size & (page_size - 1)) == 0;
+}
+
+/**
+ * @brief Sets PAGE_SIZE, PAGE_USABLE_SIZE and the node layout values that follow from them.
+ *
+ * Called by page_open() once the page size of the file is known, before any page is read.
+ *
+ * @param page_size A valid page size, see page_size_is_valid().
+ * @param reserved_size Bytes at the end of every page the nodes must not use, 0 or PAGE_TRAILER_SIZE.
+ */
+void set_page_size(uint32_t page_size, uint32_t reserved_size)
+{
+    PAGE_SIZE = page_size;
+    PAGE_USABLE_SIZE = page_size - reserved_size;
+    LEAF_NODE_SPACE_FOR_CELL = PAGE_USABLE_SIZE - LEAF_NODE_SLOTS_OFFSET;
+    LEAF_NODE_MIN_FILL = LEAF_NODE_SPACE_FOR_CELL / 2;
+    INTERNAL_NODE_MAX_CELL = (PAGE_USABLE_SIZE - INTERNAL_NODE_KEYS_OFFSET) / INTERNAL_NODE_CELL_SIZE;
+    INTERNAL_NODE_CHILDREN_OFFSET = INTERNAL_NODE_KEYS_OFFSET + INTERNAL_NODE_MAX_CELL * INTERNAL_NODE_KEY_SIZE;
+    INTERNAL_NODE_MIN_CELL = (INTERNAL_NODE_MAX_CELL - 1) / 2;
+}
+
+/*
+Whether the file has nothing written yet: it is empty, or its first page is still all zeros. An mmap mode
+session that was killed before it wrote the header leaves such a file behind (see pager_trim_zero_tail()),
+and its write-ahead log holds pages laid out with the configured size, not as a header-less legacy file.
+*/
+static bool pager_file_is_blank(int fd, off_t file_length)
+{
+    if (file_length == 0)
+        return true;
+    uint8_t start[MIN_PAGE_SIZE];
+    ssize_t bytes_read = pread(fd, start, sizeof(start), 0);
+    if (bytes_read <= 0)
+        return false;
+    for (ssize_t i = 0; i < bytes_read; i++)
+        if (start[i] != 0)
+            return false;
+    return true;
+}
+
+/*
+Page size and reserved bytes per page of the file behind fd, passed to set_page_size(). A new (blank) file
+gets db_config.page_size and a checksum trailer unless db_config.page_checksums is off. Files from before
+format version 3 (and header-less legacy files) use whole 4096 byte pages, version 3 whole pages of the
+stored size. A header that stores a page size must also carry a matching checksum, otherwise the file is
+rejected: with a wrong page size every other page would be read from the wrong offset.
+*/
+static void pager_read_layout(int fd, off_t file_length)
+{
+    if (pager_file_is_blank(fd, file_length))
+    {
+        if (!page_size_is_valid(db_config.page_size))
+        {
+            printf("Invalid page size %u, use a power of two from %u to %u\n", db_config.page_size, MIN_PAGE_SIZE,
+                   MAX_PAGE_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        set_page_size(db_config.page_size, db_config.page_checksums ? PAGE_TRAILER_SIZE : 0);
+        return;
+    }
+
+    char header[HEADER_SIZE];
+    if (file_length < HEADER_SIZE || pread(fd, header, HEADER_SIZE, 0) != HEADER_SIZE || !header_is_valid(header) ||
+        *header_format_version(header) < 3)
+    {
+        set_page_size(4096, 0);
+        return;
+    }
+    if (*header_stored_checksum(header) != header_checksum(header))
+    {
+        printf("Database header is corrupted (checksum mismatch)\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t page_size = *header_page_size(header);
+    uint32_t reserved_size = *header_format_version(header) >= 4 ? *header_reserved_size(header) : 0;
+    if (!page_size_is_valid(page_size))
+    {
+        printf("Database header has an unsupported page size %u\n", page_size);
+        exit(EXIT_FAILURE);
+    }
+    if (reserved_size != 0 && reserved_size != PAGE_TRAILER_SIZE)
+    {
+        printf("Database header has an unsupported page trailer of %u bytes\n", reserved_size);
+        exit(EXIT_FAILURE);
+    }
+    set_page_size(page_size, reserved_size);
+}
+
 /*
 Page_open perform following functionality:
     Opens (or creates) a file.
-    Gets its size.
+    Gets its size and page layout (set_page_size()).
     Allocates memory for a Pager struct.
-    Initializes the struct and returns a pointer to it.
+    Sets up an empty buffer pool of db_config.buffer_pool_frames frames and returns a pointer to it.
+    With db_config.pager_mmap the file is also mapped into memory, see pager_map_grow().
+    With db_config.pager_direct it is read and written past the OS page cache, see pager_enable_direct_io().
 */
 Pager *page_open(const char *filename)
 {
@@ -23,6 +143,7 @@ Pager *page_open(const char *filename)
     }
     // Getting File Size off_t is usually a 64-bit integer
     off_t file_length = lseek(fd, 0, SEEK_END); // Moves the file offset to the end (SEEK_END). Returns the file size
+    pager_read_layout(fd, file_length);
 
     // Allocating Memory for Pager
     Pager *pager = (Pager *)malloc(sizeof(Pager));
@@ -31,142 +152,1688 @@ Pager *page_open(const char *filename)
     pager->num_pages = (file_length / PAGE_SIZE);
     if (file_length % PAGE_SIZE)
     {
-        printf("%d\n", file_length);
+        printf("%lld\n", (long long)file_length);
         printf("Db file does not have whole number pages it is likely corrupted\n");
         exit(EXIT_FAILURE);
     }
 
-    //  Initializing Page Pointers as NULL
-    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++)
-        pager->pages[i] = NULL;
+    pager_trim_zero_tail(pager);
+
+    uint32_t num_frames = db_config.buffer_pool_frames;
+    if (num_frames < BUFFER_POOL_MIN_FRAMES)
+        num_frames = BUFFER_POOL_MIN_FRAMES;
+
+    pager->clock_hand = 0;
+    pager->current_op = 1;
+    pager->wal = NULL; // db_open() attaches the write-ahead log
+    pager->in_transaction = false;
+    pager->transaction_num_pages = 0;
+
+    // Recursive, the write-ahead log holds it across checkpoints that flush pages and so lock it again
+    pthread_mutexattr_t mutex_attributes;
+    pthread_mutexattr_init(&mutex_attributes);
+    pthread_mutexattr_settype(&mutex_attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&pager->mutex, &mutex_attributes);
+    pthread_mutexattr_destroy(&mutex_attributes);
+    pager_init_latch(&pager->tree_latch);
+    pager->tree_latched = false;
+    pager->leaf_write = false;
+    pager->writer_thread = pthread_self();
+    pager->op_dirtied = false;
+    pager->commit_ts = 0;
+    pager->page_versions = NULL;
+    pager->page_versions_capacity = 0;
+    pager->oldest_version = NULL;
+    pager->newest_version = NULL;
+    pager->pending_versions = NULL;
+    pager->versions_created = 0;
+    pager->free_versions = NULL;
+    pager->num_free_versions = 0;
+    pager->oldest_snapshot = NULL;
+    pager->newest_snapshot = NULL;
+    pager->latched_frames = malloc(sizeof(uint32_t) * PAGER_MIN_LATCHED_FRAMES);
+    pager->num_latched = 0;
+    pager->latched_capacity = PAGER_MIN_LATCHED_FRAMES;
+    pager->verified_pages = NULL;
+    pager->verified_capacity = 0;
+    pager->recovering = false;
+    pager->writeback_started = false;
+    pager->writeback_stop = false;
+    pager->writeback_op = 0;
+    pthread_mutex_init(&pager->writeback_mutex, NULL);
+    pthread_cond_init(&pager->writeback_cond, NULL);
+    pager->num_slabs = 0;
+    pager->direct_io = false;
+    pager->scratch = (Arena){NULL, 0, NULL};
+    pager->free_cursors = NULL;
+    pager->page_epoch = 0;
+    pager->page_epoch_ts = 0;
+
+    pager->map = NULL;
+    pager->map_length = 0;
+    pager->map_capacity = 0;
+    pager->num_retired = 0;
+    if (db_config.pager_mmap)
+    {
+#ifdef _WIN32
+        printf("mmap mode is not available on this platform, using read()/write()\n");
+#else
+        pager_map_grow(pager, file_length > 0 ? file_length : PAGER_MMAP_MIN_EXTENT);
+        pager_advise(pager, PAGER_ACCESS_RANDOM);
+#endif
+    }
+    if (db_config.pager_direct)
+        pager_enable_direct_io(pager);
+
+    //  Initializing every frame as empty, in read()/write() mode their page memory is one slab
+    pager->num_frames = num_frames;
+    pager->frames = (Frame *)malloc(sizeof(Frame) * num_frames);
+    pager_init_frames(pager, 0, num_frames);
+
+    pager->page_table = NULL;
+    page_table_rebuild(pager);
 
     return pager;
 }
 
 /*
-This function is responsible for retrieving a page from the pager. It handles both retrieving an already cached page and loading a page from a file into memory if it is not yet cached.
-    Parameters:
-        Pager *pager → A pointer to the Pager structure that manages database pages.
-        uint32_t page_num → The page number being requested.
-    return value:
-        void * → The function returns a pointer to the requested page.
+The mmap mode extends the file in whole extents and only cuts it back in pager_close(), so a session that
+did not close cleanly leaves zeroed pages at the end. A page in use is never all zeros, so they are not
+counted as pages of the database, otherwise every crash would leave the next session allocating after them.
+*/
+static void pager_trim_zero_tail(Pager *pager)
+{
+    char *page = malloc(PAGE_SIZE);
+    while (pager->num_pages > 0)
+    {
+        ssize_t bytes_read = pread(pager->file_descriptor, page, PAGE_SIZE, (off_t)(pager->num_pages - 1) * PAGE_SIZE);
+        if (bytes_read != PAGE_SIZE)
+        {
+            printf("Error reading file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < PAGE_SIZE; i++)
+        {
+            if (page[i] != 0)
+            {
+                free(page);
+                return;
+            }
+        }
+        pager->num_pages--;
+    }
+    free(page);
+}
 
-    Working step:
-        1) Check if page_num is Valid
-        2) Check if Page is Already Loaded in Memory
-        3) Allocate Memory for the Page
-        4) Determine the Number of Pages in the File
-        5) Load the Page from the File (if it exists)
-        6) Store the Page in Memory
+// Home slot of a page number in the page table (Fibonacci hashing).
+static uint32_t page_table_slot(Pager *pager, uint32_t page_num)
+{
+    return (page_num * 2654435761u) & pager->page_table_mask;
+}
+
+/**
+ * @brief Looks up the frame holding a page.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The page being looked up.
+ *
+ * @return The index of the frame holding the page or INVALID_PAGE_NUM if the page is not resident.
  */
-void *get_page(Pager *pager, uint32_t page_num)
+static uint32_t page_table_lookup(Pager *pager, uint32_t page_num)
+{
+    uint32_t slot = page_table_slot(pager, page_num);
+    while (pager->page_table[slot] != INVALID_PAGE_NUM)
+    {
+        uint32_t frame_index = pager->page_table[slot];
+        if (pager->frames[frame_index].page_num == page_num)
+            return frame_index;
+        slot = (slot + 1) & pager->page_table_mask;
+    }
+    return INVALID_PAGE_NUM;
+}
+
+static void page_table_insert(Pager *pager, uint32_t page_num, uint32_t frame_index)
+{
+    uint32_t slot = page_table_slot(pager, page_num);
+    while (pager->page_table[slot] != INVALID_PAGE_NUM)
+        slot = (slot + 1) & pager->page_table_mask;
+    pager->page_table[slot] = frame_index;
+}
+
+/*
+(Re)creates the page table for the current number of frames. It is kept at most half full so linear
+probing stays short.
+*/
+static void page_table_rebuild(Pager *pager)
+{
+    uint32_t page_table_size = 1;
+    while (page_table_size < pager->num_frames * 2)
+        page_table_size <<= 1;
+    free(pager->page_table);
+    pager->page_table_mask = page_table_size - 1;
+    pager->page_table = (uint32_t *)malloc(sizeof(uint32_t) * page_table_size);
+    for (uint32_t i = 0; i < page_table_size; i++)
+        pager->page_table[i] = INVALID_PAGE_NUM;
+
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        if (pager->frames[i].page_num != INVALID_PAGE_NUM)
+            page_table_insert(pager, pager->frames[i].page_num, i);
+    }
+}
+
+/*
+Removes a page from the page table. Linear probing cannot simply empty the slot because that would cut
+the probe chain of every entry stored after it, so the following entries are shifted back instead
+(backward shift deletion).
+*/
+static void page_table_remove(Pager *pager, uint32_t page_num)
 {
-    if (page_num > TABLE_MAX_PAGES)
+    uint32_t slot = page_table_slot(pager, page_num);
+    while (pager->frames[pager->page_table[slot]].page_num != page_num)
+        slot = (slot + 1) & pager->page_table_mask;
+
+    uint32_t hole = slot;
+    pager->page_table[hole] = INVALID_PAGE_NUM;
+    slot = (slot + 1) & pager->page_table_mask;
+    while (pager->page_table[slot] != INVALID_PAGE_NUM)
+    {
+        uint32_t frame_index = pager->page_table[slot];
+        uint32_t home = page_table_slot(pager, pager->frames[frame_index].page_num);
+        // Move the entry into the hole unless its home slot lies cyclically in (hole, slot]
+        bool home_after_hole = ((slot - home) & pager->page_table_mask) < ((slot - hole) & pager->page_table_mask);
+        if (!home_after_hole)
+        {
+            pager->page_table[hole] = frame_index;
+            pager->page_table[slot] = INVALID_PAGE_NUM;
+            hole = slot;
+        }
+        slot = (slot + 1) & pager->page_table_mask;
+    }
+}
+
+/*
+Doubles the number of frames. Only used when a single operation holds every frame (a split cascading
+through a deep tree can touch more pages than a small pool has). The new frames get a slab of their own,
+so pointers already handed out by get_page() stay valid while the Frame array itself moves.
+*/
+static void pager_grow(Pager *pager)
+{
+    uint32_t old_num_frames = pager->num_frames;
+    pager->num_frames = old_num_frames * 2;
+    pager->frames = (Frame *)realloc(pager->frames, sizeof(Frame) * pager->num_frames);
+    pager_init_frames(pager, old_num_frames, pager->num_frames);
+    page_table_rebuild(pager);
+    pager->clock_hand = old_num_frames; // first new frame is empty
+}
+
+// Empties frames [first, last). Latches are allocated on their own so they stay put when the Frame array moves.
+static void pager_init_frames(Pager *pager, uint32_t first, uint32_t last)
+{
+    if (pager->map == NULL)
+        pager_alloc_slab(pager, first, last);
+    for (uint32_t i = first; i < last; i++)
+    {
+        if (pager->map != NULL)
+            pager->frames[i].data = NULL; // points into the mapping once the frame is used
+        else
+            pager->frames[i].data = pager->slabs[pager->num_slabs - 1] + (size_t)(i - first) * PAGE_SIZE;
+        pager->frames[i].page_num = INVALID_PAGE_NUM;
+        pager->frames[i].pin_count = 0;
+        pager->frames[i].touched_op = 0;
+        pager->frames[i].dirty = false;
+        pager->frames[i].referenced = false;
+        pager->frames[i].wal_pending = false;
+        pager->frames[i].wal_lsn = 0;
+        pager->frames[i].latch = malloc(sizeof(pthread_rwlock_t));
+        pager_init_latch(pager->frames[i].latch);
+        pager->frames[i].writer_latched = false;
+    }
+}
+
+/*
+Page memory for frames [first, last) in read()/write() mode, one region (slab) instead of a malloc() per
+frame. The slab is aligned to PAGER_SLAB_ALIGNMENT and PAGE_SIZE is a multiple of it, so every frame starts
+on a memory page, as O_DIRECT needs. A slab of PAGER_HUGE_PAGE_SIZE or more is aligned to that and offered
+for transparent huge pages: a large pool is then mapped with a few TLB entries instead of one per 4 kB.
+The memory is only touched (and really allocated by the OS) as frames get used.
+*/
+static void pager_alloc_slab(Pager *pager, uint32_t first, uint32_t last)
+{
+    if (pager->num_slabs == PAGER_MAX_SLABS)
     {
-        printf("Tried to fetch page total page. %d > %d", page_num, TABLE_MAX_PAGES);
+        printf("Too many buffer pool slabs\n");
         exit(EXIT_FAILURE);
     }
+    size_t length = (size_t)(last - first) * PAGE_SIZE;
+    size_t alignment = length >= PAGER_HUGE_PAGE_SIZE ? PAGER_HUGE_PAGE_SIZE : PAGER_SLAB_ALIGNMENT;
+#ifdef _WIN32
+    char *slab = _aligned_malloc(length, alignment);
+#else
+    char *slab = NULL;
+    if (posix_memalign((void **)&slab, alignment, length) != 0)
+        slab = NULL;
+#endif
+    if (slab == NULL)
+    {
+        printf("Out of memory for %u buffer pool frames\n", last - first);
+        exit(EXIT_FAILURE);
+    }
+#ifdef MADV_HUGEPAGE
+    if (alignment == PAGER_HUGE_PAGE_SIZE)
+        madvise(slab, length, MADV_HUGEPAGE);
+#endif
+    pager->slabs[pager->num_slabs] = slab;
+    pager->num_slabs++;
+}
+
+/*
+Switches the open file to direct I/O (O_DIRECT, F_NOCACHE on macOS). Pages then move straight between the
+frames and the disk instead of being kept a second time in the OS page cache, so the buffer pool is the only
+cache of the database and memory use is what --frames sets. O_DIRECT needs aligned buffers, offsets and
+lengths: every read and write of the file after this is a whole page at a page aligned offset, from a frame
+in a slab (see pager_alloc_slab()), and page sizes are multiples of 4 kB. The layout, which was read before,
+is the only small read. Commits still sync the file, O_DIRECT does not flush the disk's write cache.
+Without support for it (tmpfs, Windows) or in mmap mode the page cache stays in use.
+*/
+static void pager_enable_direct_io(Pager *pager)
+{
+    if (pager->map != NULL)
+    {
+        printf("Direct I/O does not apply to mmap mode, using the mapping\n");
+        return;
+    }
+#if defined(O_DIRECT)
+    int flags = fcntl(pager->file_descriptor, F_GETFL);
+    if (flags != -1 && fcntl(pager->file_descriptor, F_SETFL, flags | O_DIRECT) != -1)
+        pager->direct_io = true;
+#elif defined(F_NOCACHE)
+    if (fcntl(pager->file_descriptor, F_NOCACHE, 1) != -1)
+        pager->direct_io = true;
+#endif
+    if (!pager->direct_io)
+        printf("Direct I/O is not available for this file, using the OS page cache\n");
+}
+
+static void pager_init_latch(pthread_rwlock_t *latch)
+{
+    pthread_rwlockattr_t latch_attributes;
+    pthread_rwlockattr_init(&latch_attributes);
+#ifdef __GLIBC__
+    // A steady stream of readers must not keep the writer out of the tree or off a hot leaf forever
+    pthread_rwlockattr_setkind_np(&latch_attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(latch, &latch_attributes);
+    pthread_rwlockattr_destroy(&latch_attributes);
+}
 
-    // Cache miss. Allocate memory and load from file.
-    if (pager->pages[page_num] == NULL)
+/*
+Picks a frame for a page that is not resident using the CLOCK algorithm. The clock hand sweeps over the
+frames: empty frames are taken right away, pinned frames and frames touched by the running operation are
+skipped, a frame with its reference bit set gets a second chance (the bit is cleared) and the first frame
+without it becomes the victim. A dirty victim is written back with pager_flush() before it is reused,
+after the write-ahead log has been synced past its last record (a page must never reach the database file
+before the log that describes it). If every frame is held by the running operation the pool is grown instead,
+for a reader (may_grow false) INVALID_PAGE_NUM is returned: only the writer may move the Frame array, it
+keeps Frame pointers across calls. Called with the pager mutex held.
+*/
+static uint32_t pager_evict(Pager *pager, bool may_grow)
+{
+    for (uint32_t step = 0; step < 2 * pager->num_frames; step++)
     {
-        void *page = malloc(PAGE_SIZE); // Alllocate a new page of PAGE_SIZE memory
+        uint32_t frame_index = pager->clock_hand;
+        Frame *frame = &pager->frames[frame_index];
+        pager->clock_hand = (pager->clock_hand + 1) % pager->num_frames;
+
+        if (frame->page_num == INVALID_PAGE_NUM)
+            return frame_index;
+        if (frame->pin_count > 0 || frame->touched_op == pager->current_op)
+            continue;
+        // The log only redoes, a page with records of the open transaction stays in memory until the commit
+        if (frame->dirty && pager->wal != NULL && frame->wal_lsn > pager->wal->file_length)
+            continue;
+        // Inside a transaction every dirty page belongs to it and the file must keep the old version,
+        // a page whose full image still has to be logged must stay until wal_capture_pending()
+        if (frame->dirty && (pager->in_transaction || frame->wal_pending))
+            continue;
+        if (frame->referenced)
+        {
+            frame->referenced = false;
+            continue;
+        }
+
+        if (frame->dirty)
+        {
+            if (pager->wal != NULL)
+                wal_sync(pager->wal, frame->wal_lsn);
+            pager_flush(pager, frame->page_num);
+        }
+        page_table_remove(pager, frame->page_num);
+        frame->page_num = INVALID_PAGE_NUM;
+        return frame_index;
+    }
+    if (!may_grow)
+        return INVALID_PAGE_NUM;
+    pager_grow(pager);
+    return pager_evict(pager, true);
+}
+
+/*
+mmap mode. Makes sure the first needed_length bytes of the file are mapped. The file is extended with
+ftruncate() in extents that double up to PAGER_MMAP_MAX_EXTENT, pager_close() cuts it back to the pages
+actually in use. The mapping itself reserves PAGER_MMAP_RESERVE bytes of address space (mapping past the
+end of the file is allowed, only touching it is not), so growing the file normally needs no remap.
+
+The mapping is MAP_PRIVATE: writes through page pointers stay in memory like frames of the read() mode
+until the pager writes them back with pwrite(), so dirty tracking and the write-ahead log rule work the
+same in both modes. When the reservation is too small a mapping twice the size is created and the old one
+is kept until close because the running operation may still hold page pointers into it.
+*/
+static void pager_map_grow(Pager *pager, off_t needed_length)
+{
+#ifndef _WIN32
+    off_t extent = pager->map_length;
+    if (extent < PAGER_MMAP_MIN_EXTENT)
+        extent = PAGER_MMAP_MIN_EXTENT;
+    if (extent > PAGER_MMAP_MAX_EXTENT)
+        extent = PAGER_MMAP_MAX_EXTENT;
+    off_t new_length = pager->map_length;
+    while (new_length < needed_length)
+        new_length += extent;
 
-        uint32_t num_pages = pager->file_length / PAGE_SIZE; // Determine the Number of Pages in the File
-        /**
-         The function calculates how many pages are currently stored in the database file.
-         If the file size is not a perfect multiple of PAGE_SIZE, then there is a partial page at the end.
-         In this case, we increment num_pages to include that partial page.
-         */
-        if (pager->file_length % PAGE_SIZE)
-            num_pages += 1;
+    if (new_length > pager->file_length)
+    {
+        if (ftruncate(pager->file_descriptor, new_length) == -1)
+        {
+            printf("Error extending file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        pager->file_length = new_length;
+    }
 
-        if (page_num <= num_pages)
+    if (new_length > pager->map_capacity)
+    {
+        off_t new_capacity = pager->map_capacity > 0 ? pager->map_capacity * 2 : PAGER_MMAP_RESERVE;
+        while (new_capacity < new_length)
+            new_capacity *= 2;
+        if (pager->map != NULL)
         {
-            lseek(pager->file_descriptor, PAGE_SIZE * page_num, SEEK_SET);
-            // page size chunks of data is read from file and than stored on page variable described above
-            ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
-            if (bytes_read == -1)
+            if (pager->num_retired == PAGER_MMAP_MAX_RETIRED)
             {
-                printf("Error reading file: %d\n", errno);
+                printf("Too many remaps of the database file\n");
                 exit(EXIT_FAILURE);
             }
+            pager->retired_maps[pager->num_retired] = pager->map;
+            pager->retired_lengths[pager->num_retired] = pager->map_capacity;
+            pager->num_retired++;
         }
-        pager->pages[page_num] = page;
-
-        if (page_num >= pager->num_pages)
+        char *map = mmap(NULL, new_capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE, pager->file_descriptor, 0);
+        if (map == MAP_FAILED)
         {
-            pager->num_pages = page_num + 1;
+            printf("Error mapping file: %d\n", errno);
+            exit(EXIT_FAILURE);
         }
+        pager->map = map;
+        pager->map_capacity = new_capacity;
     }
-    return pager->pages[page_num];
+    pager->map_length = new_length;
+#endif
 }
 
 /**
- * @brief Writes a specific page from memory to the database file on disk.
+ * @brief Tells the pager how the next pages will be accessed.
  *
- * This function ensures that any modifications made to a page in memory (pager->pages[])
- * are saved to the database file, preventing data loss before program termination
- * or continued execution.
+ * In mmap mode this becomes an madvise() over the whole mapping: sequential scans
+ * (execute_select) get aggressive read-ahead, point lookups get none. The read()
+ * mode ignores the hint.
  *
  * @param pager A pointer to the Pager struct that manages the database file.
- * @param page_num The index of the page to be flushed (written) to disk.
+ * @param access PAGER_ACCESS_SEQUENTIAL or PAGER_ACCESS_RANDOM.
  */
-void pager_flush(Pager *pager, uint32_t page_num)
+void pager_advise(Pager *pager, PagerAccess access)
+{
+#ifndef _WIN32
+    if (pager->map == NULL)
+        return;
+    madvise(pager->map, pager->map_capacity, access == PAGER_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+}
+
+/*
+mmap mode. Once a page has been written back its private copy matches the file, so it is dropped and
+later accesses share the OS page cache again instead of keeping an anonymous copy around.
+*/
+static void pager_map_written(Pager *pager, void *data, size_t length)
+{
+#ifndef _WIN32
+    if (pager->map != NULL)
+        madvise(data, length, MADV_DONTNEED);
+#endif
+}
+
+// CRC32C of a page as stored in its trailer
+static uint32_t pager_page_checksum(const void *data)
+{
+    return crc32c(0, data, PAGE_SIZE - PAGE_TRAILER_SIZE);
+}
+
+// A page that was allocated but never written back is all zeros, trailer included
+static bool pager_page_is_blank(const uint8_t *data)
 {
-    if (pager->pages[page_num] == NULL)
+    for (uint32_t i = 0; i < PAGE_SIZE; i++)
+        if (data[i] != 0)
+            return false;
+    return true;
+}
+
+/*
+Checks the trailer of a page that was just read from the file, see db_config.page_verify. With
+PAGE_VERIFY_ONCE every page is checked the first time it is read in this session: the verified_pages
+bitmap remembers it, a page evicted and read again is trusted. Files without trailers have nothing to
+check, and neither has the WAL replay (pager->recovering), which repairs pages whose last write may have
+been torn by the crash. Called with the pager lock held.
+*/
+static void pager_verify_page(Pager *pager, const void *data, uint32_t page_num)
+{
+    if (PAGE_USABLE_SIZE == PAGE_SIZE || db_config.page_verify == PAGE_VERIFY_OFF || pager->recovering)
+        return;
+    if (db_config.page_verify == PAGE_VERIFY_ONCE)
     {
-        printf("Tried to flush null page\n");
-        exit(EXIT_FAILURE);
+        if (page_num / 8 >= pager->verified_capacity)
+        {
+            uint32_t new_capacity = pager->verified_capacity > 0 ? pager->verified_capacity : 64;
+            while (page_num / 8 >= new_capacity)
+                new_capacity *= 2;
+            pager->verified_pages = realloc(pager->verified_pages, new_capacity);
+            if (pager->verified_pages == NULL)
+            {
+                printf("Out of memory for the page checksum bitmap\n");
+                exit(EXIT_FAILURE);
+            }
+            memset(pager->verified_pages + pager->verified_capacity, 0, new_capacity - pager->verified_capacity);
+            pager->verified_capacity = new_capacity;
+        }
+        uint8_t bit = 1 << (page_num % 8);
+        if (pager->verified_pages[page_num / 8] & bit)
+            return;
+        pager->verified_pages[page_num / 8] |= bit;
     }
-    off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET); // SEEK_SET offset is calculated from begining.
 
-    if (offset == -1)
+    uint32_t stored;
+    memcpy(&stored, (const char *)data + PAGE_SIZE - PAGE_TRAILER_SIZE, sizeof(stored));
+    __atomic_add_fetch(&db_stats.pages_verified, 1, __ATOMIC_RELAXED);
+    if (stored != pager_page_checksum(data) && !(stored == 0 && pager_page_is_blank(data)))
     {
-        printf("Error seeking: %d\n", errno);
+        printf("Page %u is corrupted (checksum mismatch)\n", page_num);
         exit(EXIT_FAILURE);
     }
-    // If we flush the file we write the data inside pager to databse so it isnt lost.
-    ssize_t byte_written = write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
+}
 
-    if (byte_written == -1)
+/*
+read() mode: fills a frame with a page from the file, or with zeros for a page that is not in the file yet.
+page_open() only accepts files of whole pages and the pager only writes whole pages, so a page is either
+entirely in the file or not at all and is read with one PAGE_SIZE read at a page aligned offset (as direct
+I/O needs). Pages past the end are not read.
+*/
+static void load_page(Pager *pager, void *data, uint32_t page_num)
+{
+    uint32_t num_pages = pager->file_length / PAGE_SIZE; // Determine the Number of Pages in the File
+
+    if (page_num >= num_pages)
     {
-        printf("Error Saving: %d\n", errno);
-        exit(EXIT_FAILURE);
+        // Frames are reused, so a page that is not in the file must not show the previous one
+        memset(data, 0, PAGE_SIZE);
+    }
+    else
+    {
+        // page size chunks of data is read from file and than stored on page variable described above
+        off_t offset = (off_t)PAGE_SIZE * page_num;
+        uint32_t done = 0;
+        while (done < PAGE_SIZE && offset + done < pager->file_length)
+        {
+            ssize_t bytes_read = pread(pager->file_descriptor, (char *)data + done, PAGE_SIZE - done, offset + done);
+            if (bytes_read == -1 && errno == EINTR)
+                continue;
+            if (bytes_read <= 0)
+            {
+                printf("Error reading file: %d\n", bytes_read == 0 ? EIO : errno);
+                exit(EXIT_FAILURE);
+            }
+            done += bytes_read;
+        }
+        __atomic_add_fetch(&db_stats.bytes_read, done, __ATOMIC_RELAXED);
+        pager_verify_page(pager, data, page_num);
     }
 }
 
 /*
-The serialize_row function is responsible for converting (serializing) a Row structure into a binary format so that it can be stored in a buffer (destination).
+This function is responsible for retrieving a page from the pager. It handles both retrieving an already cached page and loading a page from a file into memory if it is not yet cached.
     Parameters:
-        Row *source → A pointer to the Row structure that contains the data to be serialized.
-        void *destination → A pointer to a block of memory (buffer) where the serialized data will be
-    return value: The function does not return a value.
-*/
-void serialize_row(Row *source, void *destination)
+        Pager *pager → A pointer to the Pager structure that manages database pages.
+        uint32_t page_num → The page number being requested.
+    return value:
+        void * → The function returns a pointer to the requested page.
+
+    The pointer stays valid until the running operation ends (pager_release_pages()) or, for a pinned
+    page, until it is unpinned.
+
+    Working step:
+        1) Check if page_num is Valid
+        2) Look the page up in the page table
+        3) On a miss pick a frame with CLOCK (writing back a dirty victim)
+        4) mmap mode: point the frame into the mapping, growing it if needed
+           read() mode: load the Page from the File (if it exists) or zero it for a fresh page
+        5) Register the frame in the page table
+ */
+void *get_page(Pager *pager, uint32_t page_num)
 {
-    // Copies the id field from source to destination at the correct offset (ID_OFFSET).
-    memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
-    memcpy(destination + USERNAME_OFFSET, &(source->username), USERNAME_SIZE); // same for username
-    memcpy(destination + EMAIL_OFFSET, &(source->email), EMAIL_SIZE);          // same for email
+    // Writes that did not announce themselves with pager_start_leaf_write() may restructure the tree
+    if (!pager->leaf_write && !pager->tree_latched)
+        pager_latch_tree(pager);
+
+    pager_lock(pager);
+    uint32_t frame_index = pager_fetch_frame(pager, page_num, true);
+    Frame *frame = &pager->frames[frame_index];
+    frame->touched_op = pager->current_op;
+    void *data = frame->data;
+    bool latch = pager->tree_latched && !frame->writer_latched;
+    if (latch)
+    {
+        pager_remember_latch(pager, frame_index);
+        pager_preserve_page(pager, frame_index);
+    }
+    pthread_rwlock_t *page_latch = frame->latch;
+    pager_unlock(pager);
+
+    // Outside of the pager mutex, a reader holding the page may need it to finish
+    if (latch)
+        pthread_rwlock_wrlock(page_latch);
+    return data;
 }
 
 /*
-The deserialize_row function reconstructs a Row structure from a serialized binary format stored in a memory buffer (source). Essentially, this function reverses what serialize_row did.
-    Parameters:
-        void *source → A pointer to a block of memory containing serialized Row data.
-        Row *destination → A pointer to a Row structure where the deserialized data will be stored.
-    return value: The function does not return a value.
+Looks a page up and loads it into a frame on a miss, the part of get_page() and pager_fetch_snapshot() that
+works on the page table and the CLOCK state. Called with the pager mutex held. A reader (writer false)
+waits for a frame when all of them are held instead of growing the pool.
 */
-void deserialize_row(void *source, Row *destination)
+static uint32_t pager_fetch_frame(Pager *pager, uint32_t page_num, bool writer)
 {
-    // Copies the id field from source into destination->id
-    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
-    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE); // same here
-    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);          // same here
+    if (page_num == INVALID_PAGE_NUM)
+    {
+        printf("Tried to fetch invalid page number %u\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+
+    // Cache miss. Find a frame and load from file.
+    if (frame_index == INVALID_PAGE_NUM)
+    {
+        frame_index = pager_evict(pager, writer);
+        while (frame_index == INVALID_PAGE_NUM)
+        {
+            pager_unlock(pager);
+            sched_yield();
+            pager_lock(pager);
+            // Someone else may have loaded the page in the meantime
+            frame_index = page_table_lookup(pager, page_num);
+            if (frame_index != INVALID_PAGE_NUM)
+            {
+                __atomic_add_fetch(&db_stats.page_hits, 1, __ATOMIC_RELAXED);
+                pager->frames[frame_index].referenced = true;
+                return frame_index;
+            }
+            frame_index = pager_evict(pager, false);
+        }
+        Frame *frame = &pager->frames[frame_index];
+        if (pager->map != NULL)
+        {
+            // mmap mode, the frame points straight into the mapping so there is nothing to read or copy
+            off_t offset = (off_t)page_num * PAGE_SIZE;
+            if (offset + PAGE_SIZE > pager->map_length)
+                pager_map_grow(pager, offset + PAGE_SIZE);
+            frame->data = pager->map + offset;
+            if (page_num < pager->num_pages)
+                pager_verify_page(pager, frame->data, page_num);
+        }
+        else
+            load_page(pager, frame->data, page_num);
+
+        __atomic_add_fetch(&db_stats.page_misses, 1, __ATOMIC_RELAXED);
+        if (page_num < pager->num_pages)
+            __atomic_add_fetch(&db_stats.pages_read, 1, __ATOMIC_RELAXED);
+        frame->page_num = page_num;
+        frame->pin_count = 0;
+        frame->dirty = false;
+        frame->wal_pending = false;
+        frame->wal_lsn = 0;
+        page_table_insert(pager, page_num, frame_index);
+
+        if (page_num >= pager->num_pages)
+        {
+            pager->num_pages = page_num + 1;
+        }
+    }
+    else
+    {
+        __atomic_add_fetch(&db_stats.page_hits, 1, __ATOMIC_RELAXED);
+    }
+
+    pager->frames[frame_index].referenced = true;
+    return frame_index;
 }
 
+static void pager_release_shared(Pager *pager, uint32_t page_num)
+{
+    pager_lock(pager);
+    Frame *frame = &pager->frames[page_table_lookup(pager, page_num)];
+    pthread_rwlock_unlock(frame->latch);
+    frame->pin_count--;
+    pager_unlock(pager);
+}
+
+/*
+Keeps the contents of a page the writer is about to change as a new PageVersion when a snapshot could
+still need them: the open transaction needs every page as it was before the transaction, an open snapshot
+needs pages whose newest version was replaced before the snapshot was taken (the snapshot would read the
+page itself). A page is preserved at most once per statement or transaction, the version stays pending
+until pager_release_pages() or pager_commit_transaction() stamps it. Called with the pager mutex held when
+the writer latches the page, before it changes. Readers may still hold the page shared, only the writer
+changes pages.
+*/
+static void pager_preserve_page(Pager *pager, uint32_t frame_index)
+{
+    Frame *frame = &pager->frames[frame_index];
+    uint32_t page_num = frame->page_num;
+    PageVersion *newest = page_num < pager->page_versions_capacity ? pager->page_versions[page_num] : NULL;
+    if (newest != NULL && newest->end_ts == PAGER_TS_PENDING)
+        return;
+    bool needed = pager->in_transaction;
+    if (pager->newest_snapshot != NULL && (newest == NULL || newest->end_ts <= pager->newest_snapshot->ts))
+        needed = true;
+    if (!needed)
+        return;
+
+    if (page_num >= pager->page_versions_capacity)
+    {
+        uint32_t capacity = pager->page_versions_capacity ? pager->page_versions_capacity : 1024;
+        while (capacity <= page_num)
+            capacity *= 2;
+        pager->page_versions = realloc(pager->page_versions, sizeof(PageVersion *) * capacity);
+        memset(pager->page_versions + pager->page_versions_capacity, 0,
+               sizeof(PageVersion *) * (capacity - pager->page_versions_capacity));
+        pager->page_versions_capacity = capacity;
+    }
+    PageVersion *version = pager->free_versions;
+    if (version != NULL)
+    {
+        pager->free_versions = version->next_created;
+        pager->num_free_versions--;
+    }
+    else
+        version = malloc(sizeof(PageVersion) + PAGE_SIZE);
+    if (version == NULL || pager->page_versions == NULL)
+    {
+        printf("Out of memory for page versions\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(version->data, frame->data, PAGE_SIZE);
+    version->page_num = page_num;
+    version->readers = 0;
+    version->end_ts = PAGER_TS_PENDING;
+    version->older = newest;
+    version->newer = NULL;
+    version->next_created = NULL;
+    if (newest != NULL)
+        newest->newer = version;
+    pager->page_versions[page_num] = version;
+    if (pager->newest_version != NULL)
+        pager->newest_version->next_created = version;
+    else
+        pager->oldest_version = version;
+    pager->newest_version = version;
+    if (pager->pending_versions == NULL)
+        pager->pending_versions = version;
+    __atomic_add_fetch(&pager->versions_created, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&db_stats.page_versions, 1, __ATOMIC_RELAXED);
+}
+
+// Stamps the pending versions with the commit timestamp of the statement that replaced them. Called with the pager mutex held.
+static void pager_stamp_versions(Pager *pager, uint64_t end_ts)
+{
+    for (PageVersion *version = pager->pending_versions; version != NULL; version = version->next_created)
+        version->end_ts = end_ts;
+    pager->pending_versions = NULL;
+}
+
+/*
+Frees the versions no open snapshot can read any more, those replaced at or before the oldest snapshot.
+Versions are created in commit order, so they are freed from the oldest until one is still needed (or
+still being read). Only the writer calls this, at the end of its statements, and keeps up to
+PAGER_MAX_FREE_VERSIONS of them for the next pages it preserves. Called with the pager mutex held.
+*/
+static void pager_reclaim_versions(Pager *pager)
+{
+    while (pager->oldest_version != NULL)
+    {
+        PageVersion *version = pager->oldest_version;
+        if (version->end_ts == PAGER_TS_PENDING || version->readers > 0)
+            return;
+        if (pager->oldest_snapshot != NULL && version->end_ts > pager->oldest_snapshot->ts)
+            return;
+        // The oldest version overall is also the oldest of its page
+        if (version->newer != NULL)
+            version->newer->older = NULL;
+        else
+            pager->page_versions[version->page_num] = NULL;
+        pager->oldest_version = version->next_created;
+        if (pager->oldest_version == NULL)
+            pager->newest_version = NULL;
+        if (pager->num_free_versions < PAGER_MAX_FREE_VERSIONS)
+        {
+            version->next_created = pager->free_versions;
+            pager->free_versions = version;
+            pager->num_free_versions++;
+        }
+        else
+            free(version);
+    }
+}
+
+// The version of a page a snapshot reads or NULL for the current page. Called with the pager mutex held.
+static PageVersion *pager_visible_version(Pager *pager, uint32_t page_num, uint64_t ts)
+{
+    if (page_num >= pager->page_versions_capacity)
+        return NULL;
+    PageVersion *visible = NULL;
+    for (PageVersion *version = pager->page_versions[page_num]; version != NULL && version->end_ts > ts;
+         version = version->older)
+        visible = version;
+    return visible;
+}
+
+/**
+ * @brief Takes a snapshot for a read cursor, see the concurrency notes in constants.h.
+ *
+ * The snapshot sees every statement that committed so far and nothing after. It is taken under the tree
+ * latch, so no split or merge is half done, a leaf-only write in progress changes a single page and is
+ * either seen completely or not at all. The writer thread gets PAGER_TS_LATEST and sees its own changes.
+ *
+ * @param pager The pager of the table.
+ * @param snapshot Filled in, registered until pager_close_snapshot().
+ */
+void pager_open_snapshot(Pager *pager, Snapshot *snapshot)
+{
+    snapshot->older = NULL;
+    snapshot->newer = NULL;
+    if (pthread_equal(pthread_self(), pager->writer_thread))
+    {
+        snapshot->ts = PAGER_TS_LATEST;
+        snapshot->registered = false;
+        return;
+    }
+    pager_open_shared_snapshot(pager, snapshot);
+}
+
+/*
+Like pager_open_snapshot() but always registered, also on the writer thread, which takes it between two
+statements and hands it to a thread of its own (see backup.c). It sees every statement committed so far.
+*/
+void pager_open_shared_snapshot(Pager *pager, Snapshot *snapshot)
+{
+    snapshot->older = NULL;
+    snapshot->newer = NULL;
+    pthread_rwlock_rdlock(&pager->tree_latch);
+    pager_lock(pager);
+    snapshot->ts = pager->commit_ts;
+    snapshot->registered = true;
+    snapshot->older = pager->newest_snapshot;
+    if (pager->newest_snapshot != NULL)
+        pager->newest_snapshot->newer = snapshot;
+    else
+        pager->oldest_snapshot = snapshot;
+    pager->newest_snapshot = snapshot;
+    pager_unlock(pager);
+    pthread_rwlock_unlock(&pager->tree_latch);
+}
+
+void pager_close_snapshot(Pager *pager, Snapshot *snapshot)
+{
+    if (!snapshot->registered)
+        return;
+    pager_lock(pager);
+    if (snapshot->older != NULL)
+        snapshot->older->newer = snapshot->newer;
+    else
+        pager->oldest_snapshot = snapshot->newer;
+    if (snapshot->newer != NULL)
+        snapshot->newer->older = snapshot->older;
+    else
+        pager->newest_snapshot = snapshot->older;
+    snapshot->registered = false;
+    pager_unlock(pager); // the writer frees the versions nobody needs any more, see pager_reclaim_versions()
+}
+
+/**
+ * @brief Read access to a page as of a snapshot, for any thread.
+ *
+ * Either a version of the page, which nobody changes, or the current page pinned and latched shared.
+ * Versions are only created when the writer latches a page, so if none was created while this reader
+ * waited for the shared latch the current page is still the right one.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The page to read.
+ * @param snapshot Snapshot of the reader.
+ * @param version Set to the version read or NULL for the current page, pass it to pager_release_snapshot().
+ *
+ * @return The page contents, valid until pager_release_snapshot().
+ */
+void *pager_fetch_snapshot(Pager *pager, uint32_t page_num, Snapshot *snapshot, PageVersion **version)
+{
+    pager_lock(pager);
+    *version = pager_visible_version(pager, page_num, snapshot->ts);
+    if (*version != NULL)
+    {
+        (*version)->readers++;
+        pager_unlock(pager);
+        return (*version)->data;
+    }
+    uint32_t frame_index = pager_fetch_frame(pager, page_num, false);
+    Frame *frame = &pager->frames[frame_index];
+    frame->pin_count++;
+    void *data = frame->data;
+    pthread_rwlock_t *page_latch = frame->latch;
+    uint64_t versions_created = pager->versions_created;
+    pager_unlock(pager);
+    pthread_rwlock_rdlock(page_latch);
+    if (__atomic_load_n(&pager->versions_created, __ATOMIC_ACQUIRE) == versions_created)
+        return data;
+
+    // The writer may have changed the page while this reader waited for the latch
+    pager_lock(pager);
+    *version = pager_visible_version(pager, page_num, snapshot->ts);
+    if (*version != NULL)
+        (*version)->readers++;
+    pager_unlock(pager);
+    if (*version == NULL)
+        return data;
+    pager_release_shared(pager, page_num);
+    return (*version)->data;
+}
+
+void pager_release_snapshot(Pager *pager, uint32_t page_num, PageVersion *version)
+{
+    if (version == NULL)
+    {
+        pager_release_shared(pager, page_num);
+        return;
+    }
+    pager_lock(pager);
+    version->readers--;
+    pager_unlock(pager);
+}
+
+// Whether the writer changed a page since a snapshot was taken, so reading it from the file may not show it as of the snapshot.
+bool pager_page_changed(Pager *pager, uint32_t page_num, const Snapshot *snapshot)
+{
+    pager_lock(pager);
+    bool changed = pager_visible_version(pager, page_num, snapshot->ts) != NULL;
+    pager_unlock(pager);
+    return changed;
+}
+
+// Copies a page as of a snapshot, with the checksums it would be written to the file with.
+void pager_copy_snapshot_page(Pager *pager, uint32_t page_num, Snapshot *snapshot, void *destination)
+{
+    PageVersion *version;
+    void *data = pager_fetch_snapshot(pager, page_num, snapshot, &version);
+    memcpy(destination, data, PAGE_SIZE);
+    pager_release_snapshot(pager, page_num, version);
+    pager_prepare_write(destination, page_num);
+}
+
+// Records that the writer holds the latch of a frame until the operation ends. Called with the pager mutex held.
+static void pager_remember_latch(Pager *pager, uint32_t frame_index)
+{
+    if (pager->num_latched == pager->latched_capacity)
+    {
+        pager->latched_capacity *= 2;
+        pager->latched_frames = realloc(pager->latched_frames, sizeof(uint32_t) * pager->latched_capacity);
+    }
+    pager->latched_frames[pager->num_latched++] = frame_index;
+    pager->frames[frame_index].writer_latched = true;
+}
+
+/*
+Announces that the running write operation changes at most one leaf (an insert into a leaf with room, an
+update, a delete that leaves the leaf full enough). Readers may keep descending the tree meanwhile. The
+operation latches that leaf with pager_latch_page() before changing it, or calls pager_latch_tree() first if
+it turns out to need a split or merge after all.
+*/
+void pager_start_leaf_write(Pager *pager)
+{
+    pager->leaf_write = true;
+}
+
+/*
+Takes the tree latch exclusively for the rest of the operation: readers can not take a snapshot until it
+ends and every page get_page() hands out from now on is latched exclusively as well. Must be called before
+the operation latches any page, calling it again once the tree is latched does nothing.
+*/
+void pager_latch_tree(Pager *pager)
+{
+    if (pager->tree_latched)
+        return;
+    if (pager->num_latched > 0)
+    {
+        printf("Tried to latch the tree while holding page latches\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_rwlock_wrlock(&pager->tree_latch);
+    pager->tree_latched = true;
+}
+
+// Latches a page exclusively for the rest of the running write operation.
+void pager_latch_page(Pager *pager, uint32_t page_num)
+{
+    pager_lock(pager);
+    uint32_t frame_index = pager_fetch_frame(pager, page_num, true);
+    Frame *frame = &pager->frames[frame_index];
+    frame->touched_op = pager->current_op;
+    bool latch = !frame->writer_latched;
+    if (latch)
+    {
+        pager_remember_latch(pager, frame_index);
+        pager_preserve_page(pager, frame_index);
+    }
+    pthread_rwlock_t *page_latch = frame->latch;
+    pager_unlock(pager);
+    if (latch)
+        pthread_rwlock_wrlock(page_latch);
+}
+
+/*
+Last changes to a page on its way to the file: page 0 gets the checksum of its header fields, then every
+page its CRC32C in the trailer (when the file has one), so the trailer covers the header checksum too.
+*/
+static void pager_prepare_write(void *data, uint32_t page_num)
+{
+    if (page_num == HEADER_PAGE_NUM && header_is_valid(data))
+        *header_stored_checksum(data) = header_checksum(data);
+    if (PAGE_USABLE_SIZE < PAGE_SIZE)
+    {
+        uint32_t checksum = pager_page_checksum(data);
+        memcpy((char *)data + PAGE_SIZE - PAGE_TRAILER_SIZE, &checksum, sizeof(checksum));
+    }
+}
+
+/**
+ * @brief Writes a specific page from memory to the database file on disk.
+ *
+ * This function ensures that any modifications made to a resident page are saved to the
+ * database file, preventing data loss before program termination, frame reuse or
+ * continued execution.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The index of the page to be flushed (written) to disk.
+ */
+void pager_flush(Pager *pager, uint32_t page_num)
+{
+    pager_lock(pager);
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    if (frame_index == INVALID_PAGE_NUM)
+    {
+        printf("Tried to flush null page\n");
+        exit(EXIT_FAILURE);
+    }
+    Frame *frame = &pager->frames[frame_index];
+    off_t offset = lseek(pager->file_descriptor, (off_t)page_num * PAGE_SIZE, SEEK_SET); // SEEK_SET offset is calculated from begining.
+
+    if (offset == -1)
+    {
+        printf("Error seeking: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    // If we flush the file we write the data inside pager to databse so it isnt lost.
+    pager_prepare_write(frame->data, frame->page_num);
+    ssize_t byte_written = write(pager->file_descriptor, frame->data, PAGE_SIZE);
+
+    if (byte_written == -1)
+    {
+        printf("Error Saving: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    frame->dirty = false;
+    __atomic_add_fetch(&db_stats.pages_written, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&db_stats.bytes_written, byte_written, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&db_stats.flushes, 1, __ATOMIC_RELAXED);
+    pager_map_written(pager, frame->data, PAGE_SIZE);
+    // An evicted page may be read back later, so get_page() has to know it now exists in the file
+    if (offset + PAGE_SIZE > pager->file_length)
+        pager->file_length = offset + PAGE_SIZE;
+    pager_unlock(pager);
+}
+
+/**
+ * @brief Records that a resident page was modified.
+ *
+ * Every code path that writes through a pointer returned by get_page() must call this
+ * for that page before the operation ends, otherwise the change is lost when the frame
+ * is evicted. Only dirty pages are written back by eviction and pager_flush_dirty().
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The page that was modified, it must be resident.
+ */
+void pager_mark_dirty(Pager *pager, uint32_t page_num)
+{
+    // The write-back thread reads the flags under the mutex and clears dirty when it writes the page
+    pager_lock(pager);
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    if (frame_index == INVALID_PAGE_NUM)
+    {
+        printf("Tried to mark page %u dirty which is not resident\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+    pager->frames[frame_index].dirty = true;
+    pager->op_dirtied = true;
+    if (pager->wal != NULL)
+        wal_note_page(pager, page_num);
+    pager_unlock(pager);
+}
+
+/**
+ * @brief Records that a byte range of a resident page was modified.
+ *
+ * Same as pager_mark_dirty() but the write-ahead log only records the given bytes
+ * instead of a full page image. Only valid when the caller changed nothing else on
+ * the page during the running operation.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The page that was modified, it must be resident.
+ * @param offset First modified byte within the page.
+ * @param length Number of modified bytes.
+ */
+void pager_mark_dirty_range(Pager *pager, uint32_t page_num, uint32_t offset, uint32_t length)
+{
+    pager_lock(pager); // see pager_mark_dirty()
+    Frame *frame = pager_frame(pager, page_num);
+    if (frame == NULL)
+    {
+        printf("Tried to mark page %u dirty which is not resident\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+    frame->dirty = true;
+    pager->op_dirtied = true;
+    // A transaction logs each page it changed once at commit, its ranges would add up to more than that
+    if (pager->wal != NULL && pager->in_transaction)
+        wal_note_page(pager, page_num);
+    else if (pager->wal != NULL && !frame->wal_pending)
+        wal_log_range(pager, page_num, offset, length);
+    pager_unlock(pager);
+}
+
+// Returns the frame holding a page or NULL when the page is not resident.
+Frame *pager_frame(Pager *pager, uint32_t page_num)
+{
+    pager_lock(pager);
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    pager_unlock(pager);
+    if (frame_index == INVALID_PAGE_NUM)
+        return NULL;
+    return &pager->frames[frame_index];
+}
+
+static int compare_frames_by_page_num(const void *a, const void *b)
+{
+    uint32_t page_a = (*(Frame *const *)a)->page_num;
+    uint32_t page_b = (*(Frame *const *)b)->page_num;
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+/*
+Writes a run of frames holding consecutive pages. On POSIX systems the whole
+run goes out with a single pwritev(), elsewhere it falls back to one lseek + write per page.
+*/
+static void pager_write_run(Pager *pager, Frame **run, uint32_t run_length)
+{
+    uint32_t first_page_num = run[0]->page_num;
+    off_t offset = (off_t)first_page_num * PAGE_SIZE;
+#ifdef _WIN32
+    for (uint32_t i = 0; i < run_length; i++)
+        pager_flush(pager, run[i]->page_num);
+#else
+    struct iovec iov[PAGER_MAX_IOVEC];
+    for (uint32_t i = 0; i < run_length; i++)
+    {
+        pager_prepare_write(run[i]->data, run[i]->page_num);
+        iov[i].iov_base = run[i]->data;
+        iov[i].iov_len = PAGE_SIZE;
+    }
+    ssize_t expected = (ssize_t)run_length * PAGE_SIZE;
+    ssize_t byte_written = pwritev(pager->file_descriptor, iov, run_length, offset);
+    if (byte_written != expected)
+    {
+        printf("Error Saving: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < run_length; i++)
+    {
+        run[i]->dirty = false;
+        pager_map_written(pager, run[i]->data, PAGE_SIZE);
+    }
+    __atomic_add_fetch(&db_stats.pages_written, run_length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&db_stats.bytes_written, byte_written, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&db_stats.flushes, 1, __ATOMIC_RELAXED);
+    if (offset + expected > pager->file_length)
+        pager->file_length = offset + expected;
+#endif
+}
+
+// Writes dirty frames sorted by page number, consecutive pages are coalesced into one pager_write_run().
+static void pager_write_frames(Pager *pager, Frame **dirty, uint32_t num_dirty)
+{
+    qsort(dirty, num_dirty, sizeof(Frame *), compare_frames_by_page_num);
+
+    uint32_t run_start = 0;
+    for (uint32_t i = 1; i <= num_dirty; i++)
+    {
+        bool run_continues = i < num_dirty &&
+                             dirty[i]->page_num == dirty[i - 1]->page_num + 1 &&
+                             i - run_start < PAGER_MAX_IOVEC;
+        if (!run_continues)
+        {
+            pager_write_run(pager, &dirty[run_start], i - run_start);
+            run_start = i;
+        }
+    }
+}
+
+/**
+ * @brief Writes every dirty resident page back to the database file.
+ *
+ * Clean pages are skipped entirely. The dirty pages are sorted by page number and
+ * consecutive pages are coalesced into one vectored write, so a flush costs one
+ * syscall per contiguous run instead of an lseek + write per page.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ */
+void pager_flush_dirty(Pager *pager)
+{
+    pager_lock(pager);
+    Frame **dirty = (Frame **)malloc(sizeof(Frame *) * pager->num_frames);
+    uint32_t num_dirty = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        if (pager->frames[i].page_num != INVALID_PAGE_NUM && pager->frames[i].dirty)
+            dirty[num_dirty++] = &pager->frames[i];
+    }
+    pager_write_frames(pager, dirty, num_dirty);
+    free(dirty);
+    pager_unlock(pager);
+}
+
+/*
+One pass of the background write-back: writes the dirty pages eviction could write back right now, those
+no operation or cursor holds, outside of a transaction and (with the log) whose records are synced, as long
+as the writer did not touch them since the previous pass. The log is synced first when the commits have not
+done so for a group commit window. Called with the pager mutex held.
+*/
+static void pager_write_back(Pager *pager)
+{
+    if (pager->in_transaction)
+        return; // the file keeps the version from before the transaction
+    if (pager->wal != NULL)
+        wal_sync_lagging(pager->wal);
+    off_t synced_length = pager->wal != NULL ? __atomic_load_n(&pager->wal->synced_length, __ATOMIC_ACQUIRE) : 0;
+    Frame **dirty = (Frame **)malloc(sizeof(Frame *) * pager->num_frames);
+    uint32_t num_dirty = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        Frame *frame = &pager->frames[i];
+        if (frame->page_num == INVALID_PAGE_NUM || !frame->dirty || frame->pin_count > 0 ||
+            frame->touched_op == pager->current_op || frame->wal_pending)
+            continue;
+        // A page the writer keeps changing would only be written again, it waits until it cools down
+        if (pager->current_op - frame->touched_op <= pager->current_op - pager->writeback_op)
+            continue;
+        if (pager->wal != NULL && frame->wal_lsn > synced_length)
+            continue;
+        dirty[num_dirty++] = frame;
+    }
+    pager_write_frames(pager, dirty, num_dirty);
+    __atomic_add_fetch(&db_stats.pages_written_back, num_dirty, __ATOMIC_RELAXED);
+    pager->writeback_op = pager->current_op;
+    free(dirty);
+}
+
+static void *pager_writeback_main(void *argument)
+{
+    Pager *pager = argument;
+    pthread_mutex_lock(&pager->writeback_mutex);
+    while (!pager->writeback_stop)
+    {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += db_config.writeback_ms / 1000;
+        wake.tv_nsec += (long)(db_config.writeback_ms % 1000) * 1000000;
+        if (wake.tv_nsec >= 1000000000)
+        {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&pager->writeback_cond, &pager->writeback_mutex, &wake);
+        if (pager->writeback_stop)
+            break;
+        pthread_mutex_unlock(&pager->writeback_mutex);
+        pager_lock(pager);
+        pager_write_back(pager);
+        pager_unlock(pager);
+        pthread_mutex_lock(&pager->writeback_mutex);
+    }
+    pthread_mutex_unlock(&pager->writeback_mutex);
+    return NULL;
+}
+
+/*
+Starts the background write-back thread (unless db_config.writeback_ms is 0). Every writeback_ms it writes
+the dirty pages that are safe to write (see pager_write_back()), so eviction mostly finds clean victims,
+checkpoints and db_close() have little left to write and a page the writer is done with reaches the file
+within about two intervals. Called by db_open() once the write-ahead log is attached and replayed, pager_close() stops it.
+*/
+void pager_start_writeback(Pager *pager)
+{
+    if (db_config.writeback_ms == 0)
+        return;
+    if (pthread_create(&pager->writeback_thread, NULL, pager_writeback_main, pager) != 0)
+    {
+        printf("Unable to start the write-back thread\n");
+        exit(EXIT_FAILURE);
+    }
+    pager->writeback_started = true;
+}
+
+/**
+ * @brief Pins a page so it stays resident until pager_unpin() is called.
+ *
+ * Cursors pin the page they are positioned on, so the page survives even after the
+ * operation that created the cursor released its pages.
+ *
+ * @param pager A pointer to the Pager struct that manages the database file.
+ * @param page_num The page to pin, it is loaded if it is not resident.
+ */
+void pager_pin(Pager *pager, uint32_t page_num)
+{
+    get_page(pager, page_num);
+    pager_lock(pager);
+    pager->frames[page_table_lookup(pager, page_num)].pin_count++;
+    pager_unlock(pager);
+}
+
+void pager_unpin(Pager *pager, uint32_t page_num)
+{
+    pager_lock(pager);
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    if (frame_index == INVALID_PAGE_NUM || pager->frames[frame_index].pin_count == 0)
+    {
+        printf("Tried to unpin page %u which is not pinned\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+    pager->frames[frame_index].pin_count--;
+    pager_unlock(pager);
+}
+
+/*
+Ends the running operation. Every page fetched with get_page() since the previous call becomes a
+candidate for eviction again (unless it is pinned), so callers must not use page pointers obtained
+before this call. execute_statement() calls this after every statement and long scans call it between
+rows so their working set stays bounded by the pool size. Full images of the pages the operation marked
+dirty are handed to the write-ahead log first, while those pages are still guaranteed to be resident.
+Inside a transaction the images wait for the commit, dirty pages can not be evicted until then.
+The latches the operation took are released here as well, it is the end of every write operation, and the
+statement becomes visible to snapshots taken from now on.
+*/
+void pager_release_pages(Pager *pager)
+{
+    pager_lock(pager);
+    if (pager->wal != NULL && !pager->in_transaction)
+        wal_capture_pending(pager);
+    if (!pager->in_transaction)
+    {
+        // The statement commits for snapshots before its pages can be latched by readers again
+        if (pager->op_dirtied)
+            pager_stamp_versions(pager, ++pager->commit_ts);
+        pager->op_dirtied = false;
+        pager_reclaim_versions(pager);
+    }
+    for (uint32_t i = 0; i < pager->num_latched; i++)
+    {
+        Frame *frame = &pager->frames[pager->latched_frames[i]];
+        frame->writer_latched = false;
+        pthread_rwlock_unlock(frame->latch);
+    }
+    pager->num_latched = 0;
+    pager->current_op++;
+    pager_unlock(pager);
+    if (pager->tree_latched)
+    {
+        pager->tree_latched = false;
+        pthread_rwlock_unlock(&pager->tree_latch);
+    }
+    pager->leaf_write = false;
+}
+
+/*
+Starts a transaction. The pages that are dirty so far are written back first (after the log records
+describing them are synced), from then on every dirty page belongs to the transaction. Eviction skips
+those pages, so the database file and the log only ever hold committed data and a rollback can simply
+forget them. The buffer pool grows when a transaction modifies more pages than it has frames.
+*/
+void pager_begin_transaction(Pager *pager)
+{
+    if (pager->wal != NULL)
+        wal_sync(pager->wal, pager->wal->file_length);
+    pager_lock(pager);
+    pager_flush_dirty(pager);
+    pager->in_transaction = true;
+    pager->transaction_num_pages = pager->num_pages;
+    pager_unlock(pager);
+}
+
+/*
+Ends a transaction keeping its changes, they become visible to snapshots at once. The caller writes them
+to the log or the database file under the same pager mutex.
+*/
+void pager_commit_transaction(Pager *pager)
+{
+    pager_lock(pager);
+    pager->in_transaction = false;
+    if (pager->op_dirtied)
+        pager_stamp_versions(pager, ++pager->commit_ts);
+    pager->op_dirtied = false;
+    pager_reclaim_versions(pager);
+    pager_unlock(pager);
+}
+
+/**
+ * @brief Starts a new page epoch: the pages of the tree may have changed owner.
+ *
+ * Called whenever a page leaves its tree, by free_page(), pager_rollback_transaction() and
+ * .vacuum moving a node to another page (vacuum.c).
+ * Hot key cache entries (hot_keys.c) of earlier epochs stop counting, and snapshots taken
+ * before the next commit do not use the cache at all.
+ *
+ * @param pager The pager, on the writer thread.
+ */
+void pager_new_page_epoch(Pager *pager)
+{
+    __atomic_store_n(&pager->page_epoch_ts, pager->commit_ts + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&pager->page_epoch, (pager->page_epoch + 1) & ~HOT_KEY_REFERENCED, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Cuts the database file back to its first `num_pages` pages, for .vacuum.
+ *
+ * The pages past the end must be unused: out of every tree and off the freelist. Snapshots that
+ * still see them read the versions the writer preserved when it last changed them. The log is
+ * checkpointed first, so replaying it can not bring the pages back. Frames holding them are emptied,
+ * mmap mode drops its private copies so a page allocated there again starts out as zeros.
+ *
+ * @param pager The pager, on the writer thread, outside of a transaction and of any operation.
+ * @param num_pages Pages to keep, at least 1.
+ *
+ * @return false, changing nothing, when a reader has one of the pages pinned right now.
+ */
+bool pager_truncate(Pager *pager, uint32_t num_pages)
+{
+    if (num_pages >= pager->num_pages)
+        return true;
+    if (pager->wal != NULL)
+        wal_checkpoint(pager);
+    pager_lock(pager);
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        Frame *frame = &pager->frames[i];
+        if (frame->page_num != INVALID_PAGE_NUM && frame->page_num >= num_pages && frame->pin_count > 0)
+        {
+            pager_unlock(pager);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        Frame *frame = &pager->frames[i];
+        if (frame->page_num == INVALID_PAGE_NUM || frame->page_num < num_pages)
+            continue;
+        page_table_remove(pager, frame->page_num);
+        frame->page_num = INVALID_PAGE_NUM;
+        frame->referenced = false;
+        frame->dirty = false;
+        frame->wal_pending = false;
+        frame->wal_lsn = 0;
+    }
+    off_t length = (off_t)num_pages * PAGE_SIZE;
+#ifndef _WIN32
+    if (pager->map != NULL)
+    {
+        if (pager->map_length > length)
+            madvise(pager->map + length, pager->map_length - length, MADV_DONTNEED);
+        pager->map_length = length;
+    }
+#endif
+    if (pager->file_length > length)
+    {
+        if (ftruncate(pager->file_descriptor, length) == -1)
+        {
+            printf("Error truncating file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        pager->file_length = length;
+    }
+    pager->num_pages = num_pages;
+    pager_unlock(pager);
+    return true;
+}
+
+/*
+Ends a transaction without keeping its changes. Dirty frames and frames of pages allocated by the
+transaction are emptied, the next get_page() reads the version from before the transaction again.
+mmap mode drops the private copies of those pages, the mapping then shows the file contents again.
+A frame a reader has pinned can not be emptied, its old contents are read back into it instead
+(a page the transaction allocated becomes zeroes again, what a fresh page looks like).
+*/
+void pager_rollback_transaction(Pager *pager)
+{
+    if (pager->wal != NULL)
+        wal_rollback(pager->wal);
+    pager_latch_tree(pager);
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        pager_lock(pager);
+        Frame *frame = &pager->frames[i];
+        if (frame->page_num == INVALID_PAGE_NUM || (!frame->dirty && frame->page_num < pager->transaction_num_pages))
+        {
+            pager_unlock(pager);
+            continue;
+        }
+        // Wait for readers of the page outside of the mutex, the running operation keeps the frame from being evicted
+        frame->touched_op = pager->current_op;
+        pthread_rwlock_t *page_latch = frame->latch;
+        pager_unlock(pager);
+        pthread_rwlock_wrlock(page_latch);
+        pager_lock(pager);
+#ifndef _WIN32
+        if (pager->map != NULL)
+            madvise(frame->data, PAGE_SIZE, MADV_DONTNEED);
+#endif
+        if (frame->pin_count > 0)
+        {
+            if (pager->map == NULL)
+                load_page(pager, frame->data, frame->page_num);
+        }
+        else
+        {
+            page_table_remove(pager, frame->page_num);
+            frame->page_num = INVALID_PAGE_NUM;
+            frame->referenced = false;
+        }
+        frame->dirty = false;
+        frame->wal_pending = false;
+        frame->wal_lsn = 0;
+        pager_unlock(pager);
+        pthread_rwlock_unlock(page_latch);
+    }
+    pager_lock(pager);
+    pager->num_pages = pager->transaction_num_pages;
+    pager->in_transaction = false;
+    pager_new_page_epoch(pager); // pages the transaction allocated are unused again
+    // The versions hold what the pages are again, they cover the same snapshots a committed change would
+    pager_stamp_versions(pager, pager->commit_ts);
+    pager->op_dirtied = false;
+    pager_unlock(pager);
+    pager_release_pages(pager);
+}
+
+/*
+Stops the write-back thread, writes every dirty resident page back to the file, closes the file descriptor
+and frees the buffer pool together with the Pager struct. The write-ahead log is checkpointed and closed first.
+*/
+void pager_close(Pager *pager)
+{
+    if (pager->writeback_started)
+    {
+        pthread_mutex_lock(&pager->writeback_mutex);
+        pager->writeback_stop = true;
+        pthread_cond_signal(&pager->writeback_cond);
+        pthread_mutex_unlock(&pager->writeback_mutex);
+        pthread_join(pager->writeback_thread, NULL);
+    }
+    if (pager->wal != NULL)
+        wal_close(pager);
+    pager_flush_dirty(pager); // save to db, clean pages are not rewritten
+    if (pager->map != NULL)
+    {
+#ifndef _WIN32
+        // Frames point into the mappings, they own no memory
+        munmap(pager->map, pager->map_capacity);
+        for (uint32_t i = 0; i < pager->num_retired; i++)
+            munmap(pager->retired_maps[i], pager->retired_lengths[i]);
+        // Give back the unused part of the last extent
+        if (ftruncate(pager->file_descriptor, (off_t)pager->num_pages * PAGE_SIZE) == -1)
+        {
+            printf("Error truncating file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+#endif
+    }
+    for (uint32_t i = 0; i < pager->num_slabs; i++)
+    {
+#ifdef _WIN32
+        _aligned_free(pager->slabs[i]);
+#else
+        free(pager->slabs[i]);
+#endif
+    }
+
+    int result = close(pager->file_descriptor); // close the file descriptor
+    if (result == -1)
+    {
+        printf("Error closing database: \n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+    {
+        pthread_rwlock_destroy(pager->frames[i].latch);
+        free(pager->frames[i].latch);
+    }
+    pthread_rwlock_destroy(&pager->tree_latch);
+    pthread_mutex_destroy(&pager->mutex);
+    pthread_cond_destroy(&pager->writeback_cond);
+    pthread_mutex_destroy(&pager->writeback_mutex);
+    while (pager->oldest_version != NULL)
+    {
+        PageVersion *version = pager->oldest_version;
+        pager->oldest_version = version->next_created;
+        free(version);
+    }
+    while (pager->free_versions != NULL)
+    {
+        PageVersion *version = pager->free_versions;
+        pager->free_versions = version->next_created;
+        free(version);
+    }
+    while (pager->free_cursors != NULL)
+    {
+        Cursor *cursor = pager->free_cursors;
+        pager->free_cursors = cursor->node;
+        free(cursor);
+    }
+    arena_free(&pager->scratch);
+    free(pager->page_versions);
+    free(pager->latched_frames);
+    free(pager->verified_pages);
+    free(pager->page_table);
+    free(pager->frames);
+    // Finally free the newly created paer too.
+    free(pager);
+}
+
+/*
+The serialize_row function is responsible for converting (serializing) a Row structure into a binary format so that it can be stored in a buffer (destination).
+    Parameters:
+        Row *source → A pointer to the Row structure that contains the data to be serialized.
+        void *destination → A pointer to a block of memory (buffer) where the serialized data will be
+    return value: The function does not return a value.
+*/
+void serialize_row(Row *source, void *destination)
+{
+    // Copies the id field from source to destination at the correct offset (ID_OFFSET).
+    memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
+    memcpy(destination + USERNAME_OFFSET, &(source->username), USERNAME_SIZE); // same for username
+    memcpy(destination + EMAIL_OFFSET, &(source->email), EMAIL_SIZE);          // same for email
+}
+
+// Same layout as serialize_row(), for a row read in place from its leaf (see leaf_node_row()).
+void serialize_row_view(const RowView *source, void *destination)
+{
+    memset(destination, 0, ROW_SIZE);
+    memcpy(destination + ID_OFFSET, &source->id, ID_SIZE);
+    memcpy(destination + USERNAME_OFFSET, source->username, source->username_length);
+    memcpy(destination + EMAIL_OFFSET, source->email, source->email_length);
+}
+
+/*
+The deserialize_row function reconstructs a Row structure from a serialized binary format stored in a memory buffer (source). Essentially, this function reverses what serialize_row did.
+    Parameters:
+        void *source → A pointer to a block of memory containing serialized Row data.
+        Row *destination → A pointer to a Row structure where the deserialized data will be stored.
+    return value: The function does not return a value.
+*/
+void deserialize_row(void *source, Row *destination)
+{
+    // Copies the id field from source into destination->id
+    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
+    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE); // same here
+    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);          // same here
+}
+
+// The fields of a serialized row in place, its strings point into `source` (see serialize_row()).
+void deserialize_row_view(const void *source, RowView *destination)
+{
+    memcpy(&destination->id, source + ID_OFFSET, ID_SIZE);
+    destination->username = source + USERNAME_OFFSET;
+    destination->username_length = strnlen(destination->username, COLUMN_USERNAME_SIZE);
+    destination->email = source + EMAIL_OFFSET;
+    destination->email_length = strnlen(destination->email, COLUMN_EMAIL_SIZE);
+}
+
+/*
+Returns a page the caller may initialize as a new node. Pages freed by merges are reused first (see
+freelist_pop()), only when the freelist is empty does the file grow by one page.
+*/
 uint32_t get_unused_page_num(Pager *pager)
 {
+    uint32_t page_num = freelist_pop(pager);
+    if (page_num != 0)
+        return page_num;
     return pager->num_pages;
 }
@@ -0,0 +1,210 @@
+#include "constants.h"
+
+/*
+Parallel range scans. The id range is cut into parts at separator keys of the internal nodes, as of one
+snapshot, so every part covers whole subtrees and roughly the same number of leaves. Each part is read by
+its own read cursor (reader_seek_snapshot(), all of them on the shared snapshot) that advances privately
+from its first id to its last, nothing is shared between the threads but the buffer pool.
+
+Part i only ever holds ids below those of part i + 1 and every part gets its own context, so the caller
+merges the results: in part order for an ordered result (concatenation), in any order when the result is
+an aggregate.
+*/
+
+typedef struct
+{
+    Table *table;
+    const Snapshot *snapshot;
+    uint32_t min_id; // inclusive
+    uint32_t max_id; // inclusive
+    ScanVisitor visit;
+    void *context;
+    pthread_t thread;
+} ParallelScanPart;
+
+// Number of threads a parallel scan uses, --scan-threads or one per online CPU.
+uint32_t parallel_scan_threads()
+{
+    uint32_t threads = db_config.scan_threads;
+    if (threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    return threads < PARALLEL_SCAN_MAX_THREADS ? threads : PARALLEL_SCAN_MAX_THREADS;
+}
+
+static void *parallel_scan_part(void *argument)
+{
+    ParallelScanPart *part = argument;
+    Cursor *cursor = reader_seek_snapshot(part->table, part->min_id, part->snapshot);
+    reader_read_ahead(cursor, part->max_id);
+    RowView row;
+    while (!cursor->end_of_table && reader_key(cursor) <= part->max_id)
+    {
+        reader_row(cursor, &row);
+        part->visit(part->context, &row);
+        reader_advance(cursor);
+    }
+    reader_close(cursor);
+    return NULL;
+}
+
+/*
+Collects the separator keys of the highest level of internal nodes that has enough of them to cut the
+range into about PARALLEL_SCAN_KEYS_PER_PART keys per part, going one level deeper while there are too few.
+Only keys inside [min_id, max_id) are kept, they come out in ascending order. Returns how many were found.
+*/
+static uint32_t parallel_scan_separators(Table *table, Snapshot *snapshot, uint32_t min_id, uint32_t max_id,
+                                         uint32_t wanted, uint32_t **separators)
+{
+    Pager *pager = table->pager;
+    uint32_t num_pages = 1;
+    uint32_t *pages = malloc(sizeof(uint32_t));
+    uint32_t num_keys = 0;
+    uint32_t *keys = NULL;
+    pages[0] = table->root_page_num;
+
+    while (num_keys < wanted)
+    {
+        // The next level: children of every page in order, with the separator between two pages kept in between
+        uint32_t *next_pages = NULL;
+        uint32_t *next_keys = NULL;
+        uint32_t num_next_pages = 0;
+        uint32_t num_next_keys = 0;
+        bool leaves = false;
+        for (uint32_t i = 0; i < num_pages && !leaves; i++)
+        {
+            PageVersion *version;
+            void *node = pager_fetch_snapshot(pager, pages[i], snapshot, &version);
+            if (get_node_type(node) != INTERNAL_NODE)
+            {
+                leaves = true;
+                pager_release_snapshot(pager, pages[i], version);
+                break;
+            }
+            uint32_t node_keys = *internal_node_num_keys(node);
+            next_pages = realloc(next_pages, (num_next_pages + node_keys + 1) * sizeof(uint32_t));
+            next_keys = realloc(next_keys, (num_next_keys + node_keys + 1) * sizeof(uint32_t));
+            if (next_pages == NULL || next_keys == NULL)
+            {
+                printf("Out of memory for a parallel scan\n");
+                exit(EXIT_FAILURE);
+            }
+            for (uint32_t child = 0; child <= node_keys; child++)
+            {
+                next_pages[num_next_pages++] = *internal_node_child(node, child);
+                if (child < node_keys)
+                    next_keys[num_next_keys++] = *internal_node_key(node, child);
+            }
+            pager_release_snapshot(pager, pages[i], version);
+            if (i + 1 < num_pages)
+                next_keys[num_next_keys++] = keys[i];
+        }
+        if (leaves)
+        {
+            free(next_pages);
+            free(next_keys);
+            break;
+        }
+        free(pages);
+        free(keys);
+        pages = next_pages;
+        keys = next_keys;
+        num_pages = num_next_pages;
+        num_keys = num_next_keys;
+    }
+    free(pages);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < num_keys; i++)
+        if (keys[i] >= min_id && keys[i] < max_id)
+            keys[kept++] = keys[i];
+    *separators = keys;
+    return kept;
+}
+
+/**
+ * @brief Visits every row with an id in [min_id, max_id] on up to `threads` threads, all reading one snapshot.
+ *
+ * The calling thread scans the last part itself. On the writer thread the scan sees the writer's own
+ * changes and must run between two operations, when the writer holds no latches (as any select does).
+ *
+ * @param table The open table.
+ * @param min_id First id of the range.
+ * @param max_id Last id of the range, inclusive.
+ * @param threads Most parts to cut the range into, at most PARALLEL_SCAN_MAX_THREADS.
+ * @param visit Called with the context of the part and the row, on the thread of the part. The row points
+ *              into the leaf and is only valid during the call.
+ * @param contexts One context per thread, context_size bytes apart, part i uses the i-th.
+ * @param context_size Size of one context.
+ *
+ * @return Number of parts the range was cut into, contexts after those are not touched.
+ */
+uint32_t parallel_scan(Table *table, uint32_t min_id, uint32_t max_id, uint32_t threads, ScanVisitor visit,
+                       void *contexts, size_t context_size)
+{
+    if (min_id > max_id)
+        return 0;
+    if (threads > PARALLEL_SCAN_MAX_THREADS)
+        threads = PARALLEL_SCAN_MAX_THREADS;
+    if (threads == 0)
+        threads = 1;
+
+    Snapshot snapshot;
+    pager_open_snapshot(table->pager, &snapshot);
+    uint32_t *separators = NULL;
+    uint32_t num_separators = 0;
+    if (threads > 1)
+        num_separators = parallel_scan_separators(table, &snapshot, min_id, max_id,
+                                                  threads * PARALLEL_SCAN_KEYS_PER_PART, &separators);
+
+    // Cut at evenly spaced separators, a separator is the last id of the part on its left
+    uint32_t num_parts = num_separators + 1 < threads ? num_separators + 1 : threads;
+    ParallelScanPart parts[PARALLEL_SCAN_MAX_THREADS];
+    for (uint32_t i = 0; i < num_parts; i++)
+    {
+        parts[i].table = table;
+        parts[i].snapshot = &snapshot;
+        parts[i].min_id = i == 0 ? min_id : parts[i - 1].max_id + 1;
+        parts[i].max_id = i + 1 == num_parts ? max_id : separators[(uint64_t)(i + 1) * (num_separators + 1) / num_parts - 1];
+        parts[i].visit = visit;
+        parts[i].context = (char *)contexts + i * context_size;
+    }
+    free(separators);
+
+    pager_advise(table->pager, PAGER_ACCESS_SEQUENTIAL);
+    for (uint32_t i = 0; i + 1 < num_parts; i++)
+    {
+        if (pthread_create(&parts[i].thread, NULL, parallel_scan_part, &parts[i]) != 0)
+        {
+            printf("Unable to start a parallel scan thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    parallel_scan_part(&parts[num_parts - 1]);
+    for (uint32_t i = 0; i + 1 < num_parts; i++)
+        pthread_join(parts[i].thread, NULL);
+    pager_advise(table->pager, PAGER_ACCESS_RANDOM);
+
+    pager_close_snapshot(table->pager, &snapshot);
+    return num_parts;
+}
+
+static void parallel_count_row(void *context, const RowView *row)
+{
+    (void)row;
+    (*(uint64_t *)context)++;
+}
+
+// Number of rows with an id in [min_id, max_id], counted by a parallel scan (the parts are summed unordered).
+uint64_t parallel_count(Table *table, uint32_t min_id, uint32_t max_id)
+{
+    uint64_t counts[PARALLEL_SCAN_MAX_THREADS] = {0};
+    uint32_t num_parts = parallel_scan(table, min_id, max_id, parallel_scan_threads(), parallel_count_row,
+                                       counts, sizeof(counts[0]));
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < num_parts; i++)
+        total += counts[i];
+    return total;
+}
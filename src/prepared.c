@@ -0,0 +1,127 @@
+#include "constants.h"
+
+/*
+Prepared statements for programs that link the database in directly (bench.c, the binary protocol).
+The statement type is chosen once, after that each execution only binds new parameters, nothing is
+parsed:
+
+    PreparedStatement insert;
+    prepared_init(&insert, table, STATEMENT_INSERT);
+    for (...)
+    {
+        prepared_bind_row(&insert, id, username, email);
+        prepared_execute(&insert);
+    }
+
+Binding writes the row in its serialized form, executing packs those bytes into the leaf cell.
+*/
+
+void prepared_init(PreparedStatement *prepared, Table *table, StatementType type)
+{
+    memset(prepared, 0, sizeof(*prepared));
+    prepared->table = table;
+    prepared->type = type;
+    prepared->select_min_id = 0;
+    prepared->select_max_id = UINT32_MAX;
+}
+
+/**
+ * @brief Binds the row of an insert or update.
+ *
+ * @param prepared The prepared statement.
+ * @param id Id of the row, the key.
+ * @param username NUL terminated, at most COLUMN_USERNAME_SIZE characters.
+ * @param email NUL terminated, at most COLUMN_EMAIL_SIZE characters.
+ *
+ * @return PREPARE_SUCCESS, or PREPARE_STRING_TOO_LONG and the previous binding is kept.
+ */
+PrepareResult prepared_bind_row(PreparedStatement *prepared, uint32_t id, const char *username, const char *email)
+{
+    size_t username_length = strlen(username);
+    size_t email_length = strlen(email);
+    if (username_length > COLUMN_USERNAME_SIZE || email_length > COLUMN_EMAIL_SIZE)
+        return PREPARE_STRING_TOO_LONG;
+
+    memcpy(prepared->row + ID_OFFSET, &id, ID_SIZE);
+    // Zero the tail as well so the cell bytes do not depend on what was bound before
+    memset(prepared->row + USERNAME_OFFSET, 0, USERNAME_SIZE + EMAIL_SIZE);
+    memcpy(prepared->row + USERNAME_OFFSET, username, username_length);
+    memcpy(prepared->row + EMAIL_OFFSET, email, email_length);
+    return PREPARE_SUCCESS;
+}
+
+// Binds the id of a delete.
+void prepared_bind_id(PreparedStatement *prepared, uint32_t id)
+{
+    memcpy(prepared->row + ID_OFFSET, &id, ID_SIZE);
+}
+
+// Binds the inclusive id range of a select, min_id > max_id selects nothing.
+void prepared_bind_range(PreparedStatement *prepared, uint32_t min_id, uint32_t max_id)
+{
+    prepared->select_min_id = min_id;
+    prepared->select_max_id = max_id;
+}
+
+/**
+ * @brief Runs the statement with its current parameters, as its own transaction like execute_statement()
+ * unless a transaction was started with a prepared STATEMENT_BEGIN.
+ *
+ * A delete does not print anything, a select prints its rows like the REPL does.
+ *
+ * @return The ExecuteResult of the statement.
+ */
+ExecuteResult prepared_execute(PreparedStatement *prepared)
+{
+    uint64_t start_ns = stats_now_ns();
+    Table *table = prepared->table;
+    ExecuteResult result = EXECUTE_SUCCESS;
+    switch (prepared->type)
+    {
+    case (STATEMENT_INSERT):
+        result = execute_insert_row(table, prepared->row);
+        break;
+    case (STATEMENT_UPDATE):
+        result = execute_update_row(table, prepared->row);
+        break;
+    case (STATEMENT_DELETE):
+    {
+        uint32_t id;
+        memcpy(&id, prepared->row + ID_OFFSET, ID_SIZE);
+        result = execute_delete_key(table, id);
+        break;
+    }
+    case (STATEMENT_SELECT):
+    {
+        // Like execute_statement(), a select may run on a reader thread and must not end the writer's operation
+        Statement statement;
+        statement.type = STATEMENT_SELECT;
+        statement.select_min_id = prepared->select_min_id;
+        statement.select_max_id = prepared->select_max_id;
+        statement.select_count = false;
+        statement.select_columns = SELECT_COLUMNS_ALL;
+        statement.select_like = false;
+        statement.column = INDEX_NONE;
+        result = execute_select(&statement, table);
+        stats_record_latency(prepared->type, stats_now_ns() - start_ns);
+        return result;
+    }
+    case (STATEMENT_BEGIN):
+        result = transaction_begin(table);
+        break;
+    case (STATEMENT_COMMIT):
+        result = transaction_commit(table);
+        break;
+    case (STATEMENT_ROLLBACK):
+        result = transaction_rollback(table);
+        break;
+    case (STATEMENT_CREATE_INDEX):
+        // Nothing binds the column, a one-off statement gains nothing from being prepared
+        printf("Create index can not be prepared, run it through execute_statement()\n");
+        exit(EXIT_FAILURE);
+    }
+    pager_release_pages(table->pager);
+    wal_commit(table->pager);
+    stats_record_latency(prepared->type, stats_now_ns() - start_ns);
+    return result;
+}
@@ -16,9 +16,46 @@ MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table)
     else if (strcmp(input_buffer->buffer, ".btree") == 0)
     {
         printf("Tree:\n");
-        print_tree(table->pager, 0, 0);
+        print_tree(table->pager, table->root_page_num, 0);
+        pager_release_pages(table->pager);
         return META_COMMAND_SUCCESS;
     }
+    else if (strncmp(input_buffer->buffer, ".import ", 8) == 0)
+    {
+        return import_file(table, input_buffer->buffer + 8);
+    }
+    else if (strcmp(input_buffer->buffer, ".mode") == 0)
+    {
+        return output_mode_command("");
+    }
+    else if (strncmp(input_buffer->buffer, ".mode ", 6) == 0)
+    {
+        return output_mode_command(input_buffer->buffer + 6);
+    }
+    else if (strcmp(input_buffer->buffer, ".stats") == 0)
+    {
+        return stats_command("");
+    }
+    else if (strncmp(input_buffer->buffer, ".stats ", 7) == 0)
+    {
+        return stats_command(input_buffer->buffer + 7);
+    }
+    else if (strcmp(input_buffer->buffer, ".vacuum") == 0)
+    {
+        return vacuum_command(table, "");
+    }
+    else if (strncmp(input_buffer->buffer, ".vacuum ", 8) == 0)
+    {
+        return vacuum_command(table, input_buffer->buffer + 8);
+    }
+    else if (strcmp(input_buffer->buffer, ".backup") == 0)
+    {
+        return backup_command(table, "");
+    }
+    else if (strncmp(input_buffer->buffer, ".backup ", 8) == 0)
+    {
+        return backup_command(table, input_buffer->buffer + 8);
+    }
     else
     {
         return META_COMMAND_UNRECOGNIZED_COMMAND;
@@ -147,6 +184,192 @@ PrepareResult prepare_delete(InputBuffer *input_buffer, Statement *statement)
     return PREPARE_SUCCESS;
 }
 
+// Skips spaces and returns true if the input continues with `word`, which is then consumed as well.
+static bool consume(char **input, const char *word)
+{
+    while (**input == ' ')
+        (*input)++;
+    size_t length = strlen(word);
+    if (strncmp(*input, word, length) != 0)
+        return false;
+    *input += length;
+    return true;
+}
+
+// Parses a non negative id, the result is 64 bit so > UINT32_MAX and empty ranges can be detected.
+static PrepareResult consume_id(char **input, uint64_t *id)
+{
+    while (**input == ' ')
+        (*input)++;
+    if (**input == '-')
+        return PREPARE_NEGATIVE_ID;
+    if (**input < '0' || **input > '9')
+        return PREPARE_SYNTAX_ERROR;
+    char *end;
+    *id = strtoull(*input, &end, 10);
+    if (*id > UINT32_MAX)
+        return PREPARE_SYNTAX_ERROR;
+    *input = end;
+    return PREPARE_SUCCESS;
+}
+
+// Parses a column value, it ends at the next space. Too long for the column means no row can have it.
+static PrepareResult consume_value(char **input, uint32_t max_length, char *value)
+{
+    while (**input == ' ')
+        (*input)++;
+    size_t length = strcspn(*input, " ");
+    if (length == 0)
+        return PREPARE_SYNTAX_ERROR;
+    if (length > max_length)
+        return PREPARE_STRING_TOO_LONG;
+    memcpy(value, *input, length);
+    value[length] = '\0';
+    *input += length;
+    return PREPARE_SUCCESS;
+}
+
+/*
+The prepare_select function parses the columns to print and an optional where clause that restricts the
+select to a range of ids and at most one column value:
+    select
+    select *
+    select id                           (any of id, username, email, printed in that order)
+    select username, email where id < 10
+    select count(*)                     (the number of rows, counted by a parallel scan)
+    select where id = 5
+    select where id >= 10 and id < 20
+    select where id between 10 and 20   (inclusive)
+    select where username = alice       (through the index when the column has one, see index.c)
+    select id where email like %@b.c    (% matches any run of characters, _ any one, scanned in place)
+    select count(*) where email = a@b.c and id < 100
+Conditions are combined with "and", operators are = >= > <= < and spaces around them are optional.
+The result is a single inclusive range [select_min_id, select_max_id] plus the column and its value.
+A like pattern without % or _ is an equality, so it can still use an index.
+*/
+PrepareResult prepare_select(InputBuffer *input_buffer, Statement *statement)
+{
+    statement->type = STATEMENT_SELECT;
+    uint64_t min_id = 0;
+    uint64_t max_id = UINT32_MAX;
+    statement->column = INDEX_NONE;
+
+    char *input = input_buffer->buffer + strlen("select");
+    statement->select_count = consume(&input, "count(*)");
+    statement->select_columns = 0;
+    statement->select_like = false;
+    if (!statement->select_count && !consume(&input, "*"))
+    {
+        do
+        {
+            uint32_t column = consume(&input, "id")         ? SELECT_COLUMN_ID
+                              : consume(&input, "username") ? SELECT_COLUMN_USERNAME
+                              : consume(&input, "email")    ? SELECT_COLUMN_EMAIL
+                                                            : 0;
+            if (column == 0)
+            {
+                if (statement->select_columns != 0)
+                    return PREPARE_SYNTAX_ERROR; // a comma without a column after it
+                break;
+            }
+            statement->select_columns |= column;
+        } while (consume(&input, ","));
+    }
+    if (statement->select_columns == 0)
+        statement->select_columns = SELECT_COLUMNS_ALL;
+    if (consume(&input, "where"))
+    {
+        do
+        {
+            uint64_t id;
+            PrepareResult result;
+            IndexColumn column = consume(&input, "username") ? INDEX_USERNAME
+                                 : consume(&input, "email")  ? INDEX_EMAIL
+                                                             : INDEX_NONE;
+            if (column != INDEX_NONE)
+            {
+                if (statement->column != INDEX_NONE)
+                    return PREPARE_SYNTAX_ERROR;
+                bool like = consume(&input, "like ");
+                if (!like && !consume(&input, "="))
+                    return PREPARE_SYNTAX_ERROR;
+                uint32_t max_length = column == INDEX_USERNAME ? COLUMN_USERNAME_SIZE : COLUMN_EMAIL_SIZE;
+                if (like)
+                    max_length = COLUMN_EMAIL_SIZE; // % can stand for nothing, a pattern may be longer
+                if ((result = consume_value(&input, max_length, statement->value)) != PREPARE_SUCCESS)
+                    return result;
+                statement->column = column;
+                statement->select_like = like && strpbrk(statement->value, "%_") != NULL;
+                continue;
+            }
+            if (!consume(&input, "id"))
+                return PREPARE_SYNTAX_ERROR;
+
+            if (consume(&input, "between"))
+            {
+                uint64_t upper;
+                if ((result = consume_id(&input, &id)) != PREPARE_SUCCESS)
+                    return result;
+                if (!consume(&input, "and"))
+                    return PREPARE_SYNTAX_ERROR;
+                if ((result = consume_id(&input, &upper)) != PREPARE_SUCCESS)
+                    return result;
+                min_id = id > min_id ? id : min_id;
+                max_id = upper < max_id ? upper : max_id;
+                continue;
+            }
+
+            // Longer operators first so ">=" is not read as ">"
+            const char *operators[] = {">=", "<=", ">", "<", "="};
+            int op = 0;
+            while (op < 5 && !consume(&input, operators[op]))
+                op++;
+            if (op == 5)
+                return PREPARE_SYNTAX_ERROR;
+            if ((result = consume_id(&input, &id)) != PREPARE_SUCCESS)
+                return result;
+
+            switch (op)
+            {
+            case 0: // >=
+                min_id = id > min_id ? id : min_id;
+                break;
+            case 1: // <=
+                max_id = id < max_id ? id : max_id;
+                break;
+            case 2: // >
+                min_id = id + 1 > min_id ? id + 1 : min_id;
+                break;
+            case 3: // <
+                if (id == 0)
+                    min_id = max_id + 1; // nothing is below 0
+                else
+                    max_id = id - 1 < max_id ? id - 1 : max_id;
+                break;
+            case 4: // =
+                min_id = id > min_id ? id : min_id;
+                max_id = id < max_id ? id : max_id;
+                break;
+            }
+        } while (consume(&input, "and"));
+    }
+
+    while (*input == ' ')
+        input++;
+    if (*input != '\0')
+        return PREPARE_SYNTAX_ERROR;
+
+    if (min_id > max_id || min_id > UINT32_MAX)
+    {
+        // Empty range
+        min_id = 1;
+        max_id = 0;
+    }
+    statement->select_min_id = (uint32_t)min_id;
+    statement->select_max_id = (uint32_t)max_id;
+    return PREPARE_SUCCESS;
+}
+
 PrepareResult prepare_statement(InputBuffer *input_buffer, Statement *statement)
 {
     if (strncmp(input_buffer->buffer, "insert", 6) == 0)
@@ -161,113 +384,365 @@ PrepareResult prepare_statement(InputBuffer *input_buffer, Statement *statement)
     {
         return prepare_delete(input_buffer, statement);
     }
-    else if (strcmp(input_buffer->buffer, "select") == 0)
+    else if (strncmp(input_buffer->buffer, "select", 6) == 0)
+    {
+        return prepare_select(input_buffer, statement);
+    }
+    else if (strcmp(input_buffer->buffer, "create index on username") == 0)
+    {
+        statement->type = STATEMENT_CREATE_INDEX;
+        statement->column = INDEX_USERNAME;
+    }
+    else if (strcmp(input_buffer->buffer, "create index on email") == 0)
     {
-        statement->type = STATEMENT_SELECT;
-        return PREPARE_SUCCESS;
+        statement->type = STATEMENT_CREATE_INDEX;
+        statement->column = INDEX_EMAIL;
     }
+    else if (strcmp(input_buffer->buffer, "begin") == 0)
+        statement->type = STATEMENT_BEGIN;
+    else if (strcmp(input_buffer->buffer, "commit") == 0)
+        statement->type = STATEMENT_COMMIT;
+    else if (strcmp(input_buffer->buffer, "rollback") == 0)
+        statement->type = STATEMENT_ROLLBACK;
     else
         return PREPARE_UNRECOGNIZED_STATEMENT;
+    return PREPARE_SUCCESS;
 }
 
-ExecuteResult execute_insert(Statement *statement, Table *table)
+// Only the writer changes pages, so it can look around before it decides which latches it needs. A row
+// write on an indexed table changes index leaves too, readers must not see one without the others.
+static void start_row_write(Table *table)
 {
+    if (index_any(table))
+        pager_latch_tree(table->pager);
+    else
+        pager_start_leaf_write(table->pager);
+}
 
-    Row *row_to_insert = &(statement->row_to_insert);
-    uint32_t key_to_insert = row_to_insert->id;
-    Cursor *cursor = find_table(table, key_to_insert);
+/**
+ * @brief Inserts one row given in its serialized form (ROW_SIZE bytes, see serialize_row()).
+ *
+ * The bytes are packed straight into the leaf cell, there is no Row or Statement in
+ * between. The binary protocol inserts the records of a request this way.
+ *
+ * @param table The table to insert into.
+ * @param row The serialized row, its id is the key.
+ *
+ * @return EXECUTE_SUCCESS or EXECUTE_DUPLICATE_KEY.
+ */
+ExecuteResult execute_insert_row(Table *table, const void *row)
+{
+    uint32_t key_to_insert;
+    memcpy(&key_to_insert, row + ID_OFFSET, ID_SIZE);
+    start_row_write(table);
+    Cursor *cursor = find_append_position(table, key_to_insert);
+    if (cursor == NULL)
+        cursor = find_table(table, key_to_insert);
 
     void *node = get_page(cursor->table->pager, cursor->page_num);
     uint32_t num_cells = *leaf_node_num_cells(node);
+    if (!leaf_node_has_room(node, key_to_insert, leaf_node_payload_size(row)))
+        pager_latch_tree(table->pager); // the insert splits the leaf
+    pager_latch_page(table->pager, cursor->page_num);
 
     if (cursor->cell_num < num_cells)
     {
-        uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
+        uint32_t key_at_index = leaf_node_key(node, cursor->cell_num);
         if (key_at_index == key_to_insert)
+        {
+            cursor_close(cursor);
             return EXECUTE_DUPLICATE_KEY;
+        }
     }
 
-    leaf_node_insert(cursor, row_to_insert->id, row_to_insert);
+    leaf_node_insert(cursor, key_to_insert, row);
+    if (key_to_insert > table->rightmost_max_key)
+        remember_rightmost_leaf(table, cursor->page_num);
+    cursor_close(cursor);
 
-    free(cursor);
+    if (index_any(table))
+    {
+        RowView view;
+        deserialize_row_view(row, &view);
+        index_add_row(table, &view);
+    }
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_update(Statement *statement, Table *table)
+ExecuteResult execute_insert(Statement *statement, Table *table)
+{
+    char row[sizeof(Row)];
+    serialize_row(&statement->row_to_insert, row);
+    return execute_insert_row(table, row);
+}
+
+/**
+ * @brief Replaces username and email of an existing row, given the new row in its serialized form.
+ *
+ * @param table The table to update.
+ * @param row The serialized row (ROW_SIZE bytes), its id selects the row to change.
+ *
+ * @return EXECUTE_SUCCESS or EXECUTE_NOT_FOUND.
+ */
+ExecuteResult execute_update_row(Table *table, const void *row)
 {
-    Row *row_to_update = &(statement->row_to_insert);
-    uint32_t key_to_update = row_to_update->id;
+    uint32_t key_to_update;
+    memcpy(&key_to_update, row + ID_OFFSET, ID_SIZE);
+    start_row_write(table);
     Cursor *cursor = find_table(table, key_to_update);
 
     void *node = get_page(cursor->table->pager, cursor->page_num);
 
-    void *row_location = leaf_node_value(node, cursor->cell_num);
+    // find_table() returns the insert position when the key is missing, that cell belongs to another row
+    if (cursor->cell_num >= *leaf_node_num_cells(node) || leaf_node_key(node, cursor->cell_num) != key_to_update)
+    {
+        cursor_close(cursor);
+        return EXECUTE_NOT_FOUND;
+    }
 
-    memcpy(row_location + USERNAME_OFFSET, row_to_update->username, USERNAME_SIZE);
-    memcpy(row_location + EMAIL_OFFSET, row_to_update->email, EMAIL_SIZE); // same here
+    // A longer row may not fit into the leaf any more, it is split then
+    if (!leaf_node_can_replace(node, cursor->cell_num, leaf_node_payload_size(row)))
+        pager_latch_tree(table->pager);
+    pager_latch_page(table->pager, cursor->page_num);
 
-    free(cursor);
+    // The old values, copied before the replace changes the leaf
+    bool indexed = index_any(table);
+    char old_row[sizeof(Row)];
+    RowView old_view, new_view;
+    if (indexed)
+    {
+        leaf_node_row(node, cursor->cell_num, &old_view);
+        serialize_row_view(&old_view, old_row);
+        deserialize_row_view(old_row, &old_view);
+    }
+    leaf_node_replace(cursor, row);
+    cursor_close(cursor);
+
+    if (indexed)
+    {
+        deserialize_row_view(row, &new_view);
+        index_update_row(table, &old_view, &new_view);
+    }
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_delete(Statement *statement, Table *table)
+ExecuteResult execute_update(Statement *statement, Table *table)
 {
-    Row *row_to_delete = &(statement->row_to_insert);
-    uint32_t row_key = row_to_delete->id;
+    char row[sizeof(Row)];
+    serialize_row(&statement->row_to_insert, row);
+    return execute_update_row(table, row);
+}
+
+/**
+ * @brief Deletes the row with the given id without printing anything.
+ *
+ * @param table The table to delete from.
+ * @param row_key Id of the row.
+ *
+ * @return EXECUTE_SUCCESS or EXECUTE_NOT_FOUND.
+ */
+ExecuteResult execute_delete_key(Table *table, uint32_t row_key)
+{
+    start_row_write(table);
     Cursor *cursor = find_table(table, row_key);
 
     void *node = get_page(cursor->table->pager, cursor->page_num);
     uint32_t num_cell = *(leaf_node_num_cells(node));
 
     // Check if the cursor points to a valid cell
-    if (cursor->cell_num >= num_cell)
+    if (cursor->cell_num >= num_cell || leaf_node_key(node, cursor->cell_num) != row_key)
     {
-        printf("Error: No row found with id %d\n", row_key);
-        free(cursor);
-        return EXECUTE_NOT_FOUND; // Or define a new error type
+        cursor_close(cursor);
+        return EXECUTE_NOT_FOUND;
     }
 
-    // Shift all subsequent rows left to fill the gap (for imagination consider it an array of size num_cell)
-    for (uint32_t i = cursor->cell_num; i < num_cell - 1; i++)
+    // A leaf that drops below the minimum is merged or refilled, that changes its parent
+    if (!is_root_node(node) && leaf_node_underfull_after_delete(node, cursor->cell_num))
+        pager_latch_tree(table->pager);
+    pager_latch_page(table->pager, cursor->page_num);
+
+    bool indexed = index_any(table);
+    char old_row[sizeof(Row)];
+    RowView old_view;
+    if (indexed)
     {
-        memcpy(
-            leaf_node_cell(node, i),     // Destination: current cell
-            leaf_node_cell(node, i + 1), // Source: next cell
-            LEAF_NODE_CELL_SIZE);
+        leaf_node_row(node, cursor->cell_num, &old_view);
+        serialize_row_view(&old_view, old_row);
+        deserialize_row_view(old_row, &old_view);
     }
-    // Reduce the count of stored rows
-    (*leaf_node_num_cells(node))--;
-    printf("deleted %d\n", row_key);
-    free(cursor);
+    leaf_node_delete(cursor);
+    cursor_close(cursor);
+
+    if (indexed)
+        index_remove_row(table, &old_view);
     return EXECUTE_SUCCESS;
 }
 
+ExecuteResult execute_delete(Statement *statement, Table *table)
+{
+    uint32_t row_key = statement->row_to_insert.id;
+    ExecuteResult result = execute_delete_key(table, row_key);
+    if (result == EXECUTE_SUCCESS)
+        printf("deleted %d\n", row_key);
+    else
+        printf("Error: No row found with id %d\n", row_key);
+    return result;
+}
+
+/*
+A select with a column condition. With an index on the column only the candidate rows it names are
+looked up, each by its id, otherwise the cursor compares every row in range in place on its leaf and
+stops only on the ones that match (see reader_set_filter()). The index and the rows are read as of the
+same snapshot, so they agree with each other even while the writer goes on. A like pattern always scans.
+*/
+static ExecuteResult execute_select_where(Statement *statement, Table *table)
+{
+    uint32_t min_id = statement->select_min_id;
+    uint32_t max_id = statement->select_max_id;
+    RowFilter filter = {statement->select_columns, statement->column, statement->select_like,
+                        statement->value, (uint32_t)strlen(statement->value), max_id};
+    Snapshot snapshot;
+    pager_open_snapshot(table->pager, &snapshot);
+    OutputSink *sink = output_stdout_sink();
+    uint64_t count = 0;
+    RowView row;
+
+    uint32_t root_page_num = statement->select_like ? 0 : index_root_at(table->pager, &snapshot, statement->column);
+    if (root_page_num != 0)
+    {
+        uint32_t *ids;
+        uint32_t num_ids = index_lookup(table->pager, root_page_num, &snapshot, statement->value,
+                                        strlen(statement->value), &ids);
+        for (uint32_t i = 0; i < num_ids; i++)
+        {
+            if (ids[i] < min_id || ids[i] > max_id)
+                continue;
+            Cursor *cursor = reader_seek_snapshot(table, ids[i], &snapshot);
+            if (!cursor->end_of_table && reader_key(cursor) == ids[i])
+            {
+                reader_row(cursor, &row);
+                if (row_filter_matches(&filter, &row))
+                {
+                    count++;
+                    if (!statement->select_count)
+                        output_row_columns(sink, &row, statement->select_columns);
+                }
+            }
+            reader_close(cursor);
+        }
+        free(ids);
+    }
+    else if (min_id <= max_id)
+    {
+        pager_advise(table->pager, PAGER_ACCESS_SEQUENTIAL);
+        Cursor *cursor = reader_seek_snapshot(table, min_id, &snapshot);
+        reader_read_ahead(cursor, max_id);
+        reader_set_filter(cursor, &filter);
+        while (!cursor->end_of_table && reader_key(cursor) <= max_id)
+        {
+            count++;
+            if (!statement->select_count)
+            {
+                reader_row(cursor, &row);
+                output_row_columns(sink, &row, statement->select_columns);
+            }
+            reader_advance(cursor);
+        }
+        reader_close(cursor);
+        pager_advise(table->pager, PAGER_ACCESS_RANDOM);
+    }
+    pager_close_snapshot(table->pager, &snapshot);
+
+    if (statement->select_count)
+        printf("(%llu)\n", (unsigned long long)count);
+    else
+        output_flush(sink);
+    return EXECUTE_SUCCESS;
+}
+
+// Runs on any thread, next to the writer (see the concurrency notes in constants.h).
 ExecuteResult execute_select(Statement *statement, Table *table)
 {
-    Cursor *cursor = start_table(table);
-    Row row; // if we use Row *row than memory is unintialized and program may crash to avoid this using Row row
+    uint32_t min_id = statement->select_min_id;
+    uint32_t max_id = statement->select_max_id;
+    if (statement->column != INDEX_NONE)
+        return execute_select_where(statement, table);
+    if (statement->select_count)
+    {
+        printf("(%llu)\n", (unsigned long long)parallel_count(table, min_id, max_id));
+        return EXECUTE_SUCCESS;
+    }
+    if (min_id > max_id)
+        return EXECUTE_SUCCESS; // empty range
+
+    // A scan walks the leaves in order, let the OS read ahead (mmap mode only)
+    pager_advise(table->pager, PAGER_ACCESS_SEQUENTIAL);
+    // Seek to the first id in range instead of starting at the first leaf, the scan stops after max_id
+    Cursor *cursor = reader_seek(table, min_id);
+    reader_read_ahead(cursor, max_id);
+    // Only the printed columns are read from the cells ("select id" never touches the payloads)
+    RowFilter filter = {statement->select_columns, INDEX_NONE, false, NULL, 0, max_id};
+    if (statement->select_columns != SELECT_COLUMNS_ALL)
+        reader_set_filter(cursor, &filter);
+    // Rows are formatted straight from the leaf cells, see output.c
+    OutputSink *sink = output_stdout_sink();
+    RowView row;
 
     while (!(cursor->end_of_table))
     {
-        deserialize_row(cursor_value(cursor), &row);
-        print_row(&row);
-        cursor_advance(cursor);
+        if (reader_key(cursor) > max_id)
+            break;
+        reader_row(cursor, &row);
+        output_row_columns(sink, &row, statement->select_columns);
+        reader_advance(cursor);
     }
-    free(cursor);
+    reader_close(cursor);
+    output_flush(sink);
+    pager_advise(table->pager, PAGER_ACCESS_RANDOM);
     return EXECUTE_SUCCESS;
 }
 
 ExecuteResult execute_statement(Statement *statement, Table *table)
 {
+    uint64_t start_ns = stats_now_ns();
+    ExecuteResult result = EXECUTE_SUCCESS;
+    // A select neither ends a write operation nor commits, readers on other threads may run it through here
+    if (statement->type == STATEMENT_SELECT)
+    {
+        result = execute_select(statement, table);
+        stats_record_latency(statement->type, stats_now_ns() - start_ns);
+        return result;
+    }
     switch (statement->type)
     {
     case (STATEMENT_INSERT):
-        return execute_insert(statement, table);
+        result = execute_insert(statement, table);
+        break;
     case (STATEMENT_UPDATE):
-        return execute_update(statement, table);
+        result = execute_update(statement, table);
+        break;
     case (STATEMENT_DELETE):
-        return execute_delete(statement, table);
+        result = execute_delete(statement, table);
+        break;
     case (STATEMENT_SELECT):
-        return execute_select(statement, table);
+        break;
+    case (STATEMENT_BEGIN):
+        result = transaction_begin(table);
+        break;
+    case (STATEMENT_COMMIT):
+        result = transaction_commit(table);
+        break;
+    case (STATEMENT_ROLLBACK):
+        result = transaction_rollback(table);
+        break;
+    case (STATEMENT_CREATE_INDEX):
+        result = index_create(table, statement->column);
+        break;
     }
+    // Statement is done with its page pointers, let the buffer pool evict them again
+    pager_release_pages(table->pager);
+    // Outside of begin/commit every statement is its own transaction, make its changes durable in the write-ahead log
+    wal_commit(table->pager);
+    stats_record_latency(statement->type, stats_now_ns() - start_ns);
+    return result;
 }
\ No newline at end of file
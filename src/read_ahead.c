@@ -0,0 +1,138 @@
+#include "constants.h"
+
+/*
+Read-ahead for scans. A page that is not resident is read synchronously by the thread that needs it and a
+scan only learns the next leaf from next_leaf of the one it is on, so a cold scan waits for one read per
+leaf. After reader_read_ahead() the scan also knows the leaves ahead of it: the children of the internal
+node above them, as of its snapshot. Up to db_config.read_ahead_leaves of them are announced to the OS with
+posix_fadvise(POSIX_FADV_WILLNEED), which starts reading them in the background, many at once, so by the
+time the scan misses on a leaf it comes from the OS cache. Runs of consecutive pages (a bulk loaded table)
+are announced with one call. Platforms without posix_fadvise() leave it to the OS read-ahead, with direct
+I/O (--direct-io) nothing is read ahead: reads do not go through the OS cache the hints would fill.
+
+The internal node is read again for every node's worth of leaves, between two leaves when the scan holds no
+page (see the concurrency notes in constants.h). Nothing read ahead goes into the buffer pool, a leaf that
+was split or merged since the snapshot only costs a read the scan did not need.
+*/
+
+static void read_ahead_hint(Pager *pager, uint32_t page_num, uint32_t num_pages)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(pager->file_descriptor, (off_t)page_num * PAGE_SIZE, (off_t)num_pages * PAGE_SIZE, POSIX_FADV_WILLNEED);
+#endif
+    __atomic_add_fetch(&db_stats.pages_read_ahead, num_pages, __ATOMIC_RELAXED);
+}
+
+/*
+Descends to the leaf holding `key` and keeps the children of the internal node above it, from that leaf to
+the one holding max_key, along with the first key after the node. Called while the cursor holds no page.
+*/
+static void read_ahead_load(Cursor *cursor, uint32_t key)
+{
+    Pager *pager = cursor->table->pager;
+    ReadAhead *stream = cursor->read_ahead;
+    stream->num_leaves = 0;
+    stream->next_leaf = 0;
+    stream->next_key = 0;
+
+    uint32_t page_num = cursor->table->root_page_num;
+    uint32_t next_key = 0; // first key after the node being read, 0 when no node follows it
+    PageVersion *version;
+    void *node = pager_fetch_snapshot(pager, page_num, &cursor->snapshot, &version);
+    while (get_node_type(node) == INTERNAL_NODE)
+    {
+        uint32_t num_keys = *internal_node_num_keys(node);
+        uint32_t child_index = internal_node_find_child(node, key);
+        if (num_keys + 1 > stream->leaves_capacity)
+        {
+            stream->leaves_capacity = num_keys + 1;
+            stream->leaves = realloc(stream->leaves, sizeof(uint32_t) * stream->leaves_capacity);
+        }
+        // The children are the leaves if the child turns out to be one
+        stream->num_leaves = 0;
+        for (uint32_t i = child_index; i <= num_keys; i++)
+        {
+            stream->leaves[stream->num_leaves++] = *internal_node_child(node, i);
+            if (i < num_keys && *internal_node_key(node, i) >= stream->max_key)
+                break;
+        }
+        stream->next_key = next_key;
+
+        if (child_index < num_keys)
+            next_key = *internal_node_key(node, child_index) + 1;
+        uint32_t child_page_num = *internal_node_child(node, child_index);
+        pager_release_snapshot(pager, page_num, version);
+        page_num = child_page_num;
+        node = pager_fetch_snapshot(pager, page_num, &cursor->snapshot, &version);
+    }
+    pager_release_snapshot(pager, page_num, version);
+}
+
+/**
+ * @brief Announces the leaves ahead of a read cursor to the OS, for scans.
+ *
+ * Nothing happens when db_config.read_ahead_leaves is 0, the pager uses direct I/O
+ * or the scan ends in the cursor's leaf. reader_close() ends the read-ahead again.
+ *
+ * @param cursor A read cursor from reader_seek() or reader_seek_snapshot().
+ * @param max_key The last key the scan reads, nothing after its leaf is read ahead.
+ */
+void reader_read_ahead(Cursor *cursor, uint32_t max_key)
+{
+    if (db_config.read_ahead_leaves == 0 || cursor->table->pager->direct_io || cursor->end_of_table ||
+        cursor->read_ahead != NULL)
+        return;
+    uint32_t last_key = leaf_node_key(cursor->node, *leaf_node_num_cells(cursor->node) - 1);
+    if (last_key >= max_key || *leaf_node_next_leaf(cursor->node) == 0)
+        return;
+
+    // The cursor holds its leaf, the internal node is read when it moves on to the next one
+    ReadAhead *stream = malloc(sizeof(ReadAhead));
+    stream->leaves = NULL;
+    stream->num_leaves = 0;
+    stream->leaves_capacity = 0;
+    stream->next_leaf = 0;
+    stream->next_key = last_key + 1;
+    stream->max_key = max_key;
+    stream->ahead = 0;
+    cursor->read_ahead = stream;
+}
+
+/*
+Called by reader_settle() when the scan is about to enter the next leaf and holds no page. Once no more than
+half of read_ahead_leaves are announced ahead of the scan, the next ones are.
+*/
+void read_ahead_advance(Cursor *cursor)
+{
+    ReadAhead *stream = cursor->read_ahead;
+    if (stream->ahead > 0)
+        stream->ahead--;
+    if (stream->ahead > db_config.read_ahead_leaves / 2)
+        return;
+    while (stream->ahead < db_config.read_ahead_leaves)
+    {
+        if (stream->next_leaf == stream->num_leaves)
+        {
+            if (stream->next_key == 0 || stream->next_key > stream->max_key)
+                return;
+            read_ahead_load(cursor, stream->next_key);
+            if (stream->num_leaves == 0)
+                return; // the tree is a single leaf now
+        }
+        uint32_t first = stream->next_leaf;
+        uint32_t run = 1;
+        while (first + run < stream->num_leaves && stream->ahead + run < db_config.read_ahead_leaves &&
+               stream->leaves[first + run] == stream->leaves[first] + run)
+            run++;
+        read_ahead_hint(cursor->table->pager, stream->leaves[first], run);
+        stream->next_leaf += run;
+        stream->ahead += run;
+    }
+}
+
+void read_ahead_close(Cursor *cursor)
+{
+    free(cursor->read_ahead->leaves);
+    free(cursor->read_ahead);
+    cursor->read_ahead = NULL;
+}
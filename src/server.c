@@ -0,0 +1,454 @@
+#include "constants.h"
+
+/*
+Network server (--serve PORT). Clients connect over TCP to the loopback address (there is no
+authentication, so nothing listens on other interfaces) and send binary protocol frames (constants.h).
+Everyone shares the one open table and its buffer pool instead of running a process of their own.
+
+Every event loop is a thread with its own epoll set, by default one per online CPU. They all wait on the
+listening socket (EPOLLEXCLUSIVE wakes just one of them per connection) and the loop that accepts a
+connection serves it from then on. Requests are pipelined: a client may send many frames without waiting,
+every complete frame of a read is executed in order and their responses go out together with one send().
+While responses are still waiting to be sent the connection is not read, so a slow client only holds
+back itself.
+
+Only the writer thread may change the table (see the concurrency notes in constants.h), that is loop 0,
+which runs on the thread that opened it. Other loops execute selects themselves through reader cursors
+and hand write requests to loop 0: the connection waits (it is not read) until loop 0 has executed the
+request and handed the response back, so the frames of a connection are still executed in order. Loop 0
+executes everything handed to it at one wakeup in a row.
+
+SIGINT and SIGTERM stop the loops, responses not sent yet are dropped and db_close() runs as after the REPL.
+*/
+
+#ifdef __linux__
+
+static volatile sig_atomic_t server_stopping = 0;
+static Server *server_running; // for the signal handler
+
+static void server_wake(ServerLoop *loop)
+{
+    uint64_t one = 1;
+    ssize_t written = write(loop->wake_fd, &one, sizeof(one));
+    (void)written; // the counter is already set when it fails
+}
+
+static void server_signal(int signal_number)
+{
+    (void)signal_number;
+    server_stopping = 1;
+    for (uint32_t i = 0; i < server_running->num_loops; i++)
+        server_wake(&server_running->loops[i]);
+}
+
+// Registers the connection for what it can do next: send responses, or read once nothing is in flight.
+static void server_watch(ServerConnection *connection)
+{
+    uint32_t events = 0;
+    if (connection->output_sent < connection->output.size)
+        events = EPOLLOUT;
+    else if (!connection->waiting && !connection->input_closed)
+        events = EPOLLIN;
+    if (events == connection->events)
+        return;
+    struct epoll_event event = {events, {.ptr = connection}};
+    epoll_ctl(connection->loop->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+static void server_free(ServerConnection *connection)
+{
+    ServerLoop *loop = connection->loop;
+    if (connection->prev != NULL)
+        connection->prev->next = connection->next;
+    else
+        loop->connections = connection->next;
+    if (connection->next != NULL)
+        connection->next->prev = connection->prev;
+    free(connection->input);
+    free(connection->output.data);
+    free(connection->forwarded.data);
+    free(connection);
+}
+
+// Closes the socket. A connection whose write request loop 0 still has is freed once it comes back.
+static void server_close(ServerConnection *connection)
+{
+    epoll_ctl(connection->loop->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    if (connection->waiting)
+        connection->closing = true;
+    else
+        server_free(connection);
+}
+
+static void server_accept(ServerLoop *loop)
+{
+    while (true)
+    {
+        int fd = accept4(loop->server->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                printf("Error accepting a connection: %d\n", errno);
+            return; // another loop took it, or nothing is left
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // responses are already batched
+
+        ServerConnection *connection = calloc(1, sizeof(ServerConnection));
+        connection->fd = fd;
+        connection->loop = loop;
+        connection->input_capacity = SERVER_READ_SIZE;
+        connection->input = malloc(connection->input_capacity);
+        connection->output = (BinaryResponse){malloc(SERVER_READ_SIZE), 0, SERVER_READ_SIZE};
+        connection->forwarded = (BinaryResponse){malloc(SERVER_READ_SIZE), 0, SERVER_READ_SIZE};
+        if (connection->input == NULL || connection->output.data == NULL || connection->forwarded.data == NULL)
+        {
+            printf("Out of memory for a connection\n");
+            exit(EXIT_FAILURE);
+        }
+        connection->events = EPOLLIN;
+        connection->next = loop->connections;
+        if (loop->connections != NULL)
+            loop->connections->prev = connection;
+        loop->connections = connection;
+        struct epoll_event event = {EPOLLIN, {.ptr = connection}};
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Hands the write request at the start of the input to loop 0.
+static void server_forward(ServerConnection *connection)
+{
+    ServerLoop *writer = &connection->loop->server->loops[0];
+    connection->waiting = true;
+    connection->next_job = NULL;
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->jobs_tail != NULL)
+        writer->jobs_tail->next_job = connection;
+    else
+        writer->jobs = connection;
+    writer->jobs_tail = connection;
+    pthread_mutex_unlock(&writer->mutex);
+    server_wake(writer);
+}
+
+/*
+Executes the complete request frames at the start of the input, up to the first write request when this
+is not loop 0. Returns false for a frame that can not be valid, the connection is closed then.
+*/
+static bool server_execute(ServerConnection *connection)
+{
+    ServerLoop *loop = connection->loop;
+    uint32_t offset = 0;
+    bool forward = false;
+    while (connection->input_size - offset >= sizeof(uint32_t))
+    {
+        uint32_t length;
+        memcpy(&length, connection->input + offset, sizeof(uint32_t));
+        if (length == 0 || length > BINARY_MAX_FRAME)
+            return false;
+        if (connection->input_size - offset - sizeof(uint32_t) < length)
+            break;
+        const char *request = connection->input + offset + sizeof(uint32_t);
+        if (loop->index != 0 && binary_request_writes((uint8_t)request[0]))
+        {
+            forward = true;
+            break;
+        }
+        binary_execute(loop->server->table, request, length, &connection->output);
+        offset += sizeof(uint32_t) + length;
+    }
+    // The rest moves to the front, a forwarded request then starts at input[0] and stays there
+    memmove(connection->input, connection->input + offset, connection->input_size - offset);
+    connection->input_size -= offset;
+    if (forward)
+        server_forward(connection);
+    return true;
+}
+
+// Sends as much of the pending responses as the socket takes, false on an error.
+static bool server_flush(ServerConnection *connection)
+{
+    while (connection->output_sent < connection->output.size)
+    {
+        ssize_t bytes = send(connection->fd, connection->output.data + connection->output_sent,
+                             connection->output.size - connection->output_sent, MSG_NOSIGNAL);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        connection->output_sent += bytes;
+    }
+    if (connection->output_sent == connection->output.size)
+    {
+        connection->output_sent = 0;
+        connection->output.size = 0;
+    }
+    server_watch(connection);
+    return true;
+}
+
+// One read per wakeup (epoll reports the rest again), false when the connection has to be closed.
+static bool server_read(ServerConnection *connection)
+{
+    if (connection->input_capacity - connection->input_size < SERVER_READ_SIZE)
+    {
+        while (connection->input_capacity - connection->input_size < SERVER_READ_SIZE)
+            connection->input_capacity *= 2;
+        connection->input = realloc(connection->input, connection->input_capacity);
+        if (connection->input == NULL)
+        {
+            printf("Out of memory for a connection\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ssize_t bytes = recv(connection->fd, connection->input + connection->input_size,
+                         connection->input_capacity - connection->input_size, 0);
+    if (bytes == 0)
+    {
+        // The client sent everything, it still gets the responses
+        connection->input_closed = true;
+        return true;
+    }
+    if (bytes < 0)
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    connection->input_size += bytes;
+    return server_execute(connection);
+}
+
+// Closes a connection whose client has sent everything once it has all its responses.
+static void server_settle(ServerConnection *connection)
+{
+    if (connection->input_closed && !connection->waiting && connection->output.size == 0)
+        server_close(connection);
+}
+
+// Loop 0: executes the write requests the other loops handed over and hands the responses back.
+static void server_run_jobs(ServerLoop *loop)
+{
+    pthread_mutex_lock(&loop->mutex);
+    ServerConnection *jobs = loop->jobs;
+    loop->jobs = NULL;
+    loop->jobs_tail = NULL;
+    pthread_mutex_unlock(&loop->mutex);
+
+    while (jobs != NULL)
+    {
+        ServerConnection *connection = jobs;
+        jobs = connection->next_job;
+        uint32_t length;
+        memcpy(&length, connection->input, sizeof(uint32_t));
+        binary_execute(loop->server->table, connection->input + sizeof(uint32_t), length, &connection->forwarded);
+
+        ServerLoop *owner = connection->loop;
+        pthread_mutex_lock(&owner->mutex);
+        connection->next_job = owner->done;
+        owner->done = connection;
+        pthread_mutex_unlock(&owner->mutex);
+        server_wake(owner);
+    }
+}
+
+// Takes back connections whose write request loop 0 executed and goes on with their next requests.
+static void server_finish_jobs(ServerLoop *loop)
+{
+    pthread_mutex_lock(&loop->mutex);
+    ServerConnection *done = loop->done;
+    loop->done = NULL;
+    pthread_mutex_unlock(&loop->mutex);
+
+    while (done != NULL)
+    {
+        ServerConnection *connection = done;
+        done = connection->next_job;
+        connection->waiting = false;
+        if (connection->closing)
+        {
+            server_free(connection);
+            continue;
+        }
+        binary_response_reserve(&connection->output, connection->forwarded.size);
+        memcpy(connection->output.data + connection->output.size, connection->forwarded.data, connection->forwarded.size);
+        connection->output.size += connection->forwarded.size;
+        connection->forwarded.size = 0;
+
+        uint32_t length;
+        memcpy(&length, connection->input, sizeof(uint32_t));
+        connection->input_size -= sizeof(uint32_t) + length;
+        memmove(connection->input, connection->input + sizeof(uint32_t) + length, connection->input_size);
+        if (!server_execute(connection) || !server_flush(connection))
+            server_close(connection);
+        else
+            server_settle(connection);
+    }
+}
+
+static void server_loop_run(ServerLoop *loop)
+{
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stopping)
+    {
+        int num_events = epoll_wait(loop->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (num_events < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("Error waiting for events: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < num_events && !server_stopping; i++)
+        {
+            void *source = events[i].data.ptr;
+            if (source == NULL)
+            {
+                server_accept(loop);
+                continue;
+            }
+            if (source == loop)
+            {
+                uint64_t count;
+                ssize_t bytes = read(loop->wake_fd, &count, sizeof(count));
+                (void)bytes;
+                if (loop->index == 0)
+                    server_run_jobs(loop);
+                server_finish_jobs(loop);
+                continue;
+            }
+
+            ServerConnection *connection = source;
+            uint32_t ready = events[i].events;
+            bool ok = (ready & EPOLLERR) == 0;
+            if (ok && (ready & (EPOLLIN | EPOLLHUP)))
+                ok = (connection->events & EPOLLIN) ? server_read(connection) : (ready & EPOLLIN) != 0;
+            if (ok)
+                ok = server_flush(connection);
+            if (!ok)
+                server_close(connection);
+            else
+                server_settle(connection);
+        }
+    }
+}
+
+static void *server_loop_main(void *argument)
+{
+    server_loop_run(argument);
+    return NULL;
+}
+
+/**
+ * @brief Serves binary protocol clients over TCP until SIGINT or SIGTERM.
+ *
+ * Must be called on the thread that opened the table, it becomes event loop 0 (see the top of server.c).
+ *
+ * @param table The open table.
+ * @param port TCP port on the loopback address, 0 picks a free one (the port is printed).
+ * @param num_loops Event loop threads, 0 for one per online CPU.
+ */
+void serve_network(Table *table, uint16_t port, uint32_t num_loops)
+{
+    if (num_loops == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_loops = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+
+    Server server;
+    server.table = table;
+    server.num_loops = num_loops;
+    server.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int on = 1;
+    setsockopt(server.listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t address_length = sizeof(address);
+    if (server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(server.listen_fd, SERVER_BACKLOG) < 0 ||
+        getsockname(server.listen_fd, (struct sockaddr *)&address, &address_length) < 0)
+    {
+        printf("Unable to listen on port %u: %d\n", port, errno);
+        exit(EXIT_FAILURE);
+    }
+
+    server.loops = calloc(num_loops, sizeof(ServerLoop));
+    for (uint32_t i = 0; i < num_loops; i++)
+    {
+        ServerLoop *loop = &server.loops[i];
+        loop->server = &server;
+        loop->index = i;
+        loop->epoll_fd = epoll_create1(0);
+        loop->wake_fd = eventfd(0, EFD_NONBLOCK);
+        if (loop->epoll_fd < 0 || loop->wake_fd < 0)
+        {
+            printf("Unable to set up event loop %u: %d\n", i, errno);
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_init(&loop->mutex, NULL);
+        struct epoll_event listen_event = {EPOLLIN | EPOLLEXCLUSIVE, {.ptr = NULL}};
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event);
+        struct epoll_event wake_event = {EPOLLIN, {.ptr = loop}};
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &wake_event);
+    }
+
+    server_running = &server;
+    server_stopping = 0;
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = server_signal;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    printf("Serving on port %u with %u event loops\n", ntohs(address.sin_port), num_loops);
+    fflush(stdout);
+    for (uint32_t i = 1; i < num_loops; i++)
+        pthread_create(&server.loops[i].thread, NULL, server_loop_main, &server.loops[i]);
+    server_loop_run(&server.loops[0]);
+    for (uint32_t i = 1; i < num_loops; i++)
+        pthread_join(server.loops[i].thread, NULL);
+
+    // Every loop has stopped, nothing is in flight between them any more
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    for (uint32_t i = 0; i < num_loops; i++)
+    {
+        ServerLoop *loop = &server.loops[i];
+        while (loop->connections != NULL)
+        {
+            ServerConnection *connection = loop->connections;
+            if (connection->fd >= 0)
+                close(connection->fd);
+            server_free(connection);
+        }
+        close(loop->epoll_fd);
+        close(loop->wake_fd);
+        pthread_mutex_destroy(&loop->mutex);
+    }
+    free(server.loops);
+    close(server.listen_fd);
+    server_running = NULL;
+}
+
+#else
+
+void serve_network(Table *table, uint16_t port, uint32_t num_loops)
+{
+    (void)table;
+    (void)port;
+    (void)num_loops;
+    printf("The network server needs epoll, it is only available on Linux\n");
+    exit(EXIT_FAILURE);
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include "constants.h"
+
+DbStats db_stats; // zero initialized, counting starts when the process does
+
+static const char *STATS_STATEMENT_NAMES[STATS_STATEMENT_TYPES] = {"insert", "select", "update", "delete",
+                                                                     "begin", "commit", "rollback", "index"};
+
+// Nanoseconds from a monotonic clock, only differences between two calls are meaningful.
+uint64_t stats_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/**
+ * @brief Adds one statement to the latency histogram of its type.
+ *
+ * @param type Type of the statement that ran.
+ * @param ns How long execute_statement() took, including the commit.
+ */
+void stats_record_latency(StatementType type, uint64_t ns)
+{
+    LatencyHistogram *histogram = &db_stats.latency[type];
+    uint64_t us = ns / 1000;
+    uint32_t bucket = 0;
+    while (us > 0 && bucket < STATS_LATENCY_BUCKETS - 1)
+    {
+        us >>= 1;
+        bucket++;
+    }
+    // Selects are recorded by reader threads too. The histogram is a seqlock: a thread makes the sequence odd
+    // (which keeps the other recording threads out), updates every field and makes it even again, `.stats`
+    // copies the fields until it sees the same even sequence before and after (stats_read_histogram()).
+    uint64_t sequence = __atomic_load_n(&histogram->sequence, __ATOMIC_RELAXED);
+    while (sequence % 2 == 1 || !__atomic_compare_exchange_n(&histogram->sequence, &sequence, sequence + 1, true,
+                                                             __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        sequence = __atomic_load_n(&histogram->sequence, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&histogram->buckets[bucket], histogram->buckets[bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->total_ns, histogram->total_ns + ns, __ATOMIC_RELAXED);
+    if (ns > histogram->max_ns)
+        __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Copies the histogram of one statement type as of a single moment, see stats_record_latency().
+static void stats_read_histogram(StatementType type, LatencyHistogram *copy)
+{
+    LatencyHistogram *histogram = &db_stats.latency[type];
+    uint64_t sequence;
+    do
+    {
+        sequence = __atomic_load_n(&histogram->sequence, __ATOMIC_ACQUIRE);
+        copy->count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+        copy->total_ns = __atomic_load_n(&histogram->total_ns, __ATOMIC_RELAXED);
+        copy->max_ns = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+        for (uint32_t bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+            copy->buckets[bucket] = __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (sequence % 2 == 1 || __atomic_load_n(&histogram->sequence, __ATOMIC_RELAXED) != sequence);
+    copy->sequence = sequence;
+}
+
+/*
+Upper bound in microseconds of the bucket that holds the given percentile, 0 without samples. The highest
+bucket in use holds the maximum, so its statements end there (rounded up to a microsecond) rather than at
+the power of two. Takes a copy from stats_read_histogram(), the buckets and the maximum have to agree.
+*/
+static uint64_t stats_percentile_us(const LatencyHistogram *histogram, double percentile)
+{
+    uint64_t rank = (uint64_t)(histogram->count * percentile / 100.0 + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank)
+            return seen == histogram->count ? (histogram->max_ns + 999) / 1000 : 1ull << bucket;
+    }
+    return 0;
+}
+
+// Reader threads and the write-back thread add to some counters while `.stats` runs.
+static uint64_t stats_counter(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void stats_print_text()
+{
+    uint64_t lookups = stats_counter(&db_stats.page_hits) + stats_counter(&db_stats.page_misses);
+    printf("Buffer pool: %llu hits, %llu misses (%.1f%% hit rate), %llu page versions kept for snapshots\n",
+           (unsigned long long)stats_counter(&db_stats.page_hits),
+           (unsigned long long)stats_counter(&db_stats.page_misses),
+           lookups ? 100.0 * stats_counter(&db_stats.page_hits) / lookups : 0.0,
+           (unsigned long long)stats_counter(&db_stats.page_versions));
+    printf("Database file: %llu pages read (%llu bytes, %llu checksums verified, %llu read ahead), "
+           "%llu pages written (%llu bytes, %llu in the background) in %llu flushes\n",
+           (unsigned long long)stats_counter(&db_stats.pages_read),
+           (unsigned long long)stats_counter(&db_stats.bytes_read),
+           (unsigned long long)stats_counter(&db_stats.pages_verified),
+           (unsigned long long)stats_counter(&db_stats.pages_read_ahead),
+           (unsigned long long)stats_counter(&db_stats.pages_written),
+           (unsigned long long)stats_counter(&db_stats.bytes_written),
+           (unsigned long long)stats_counter(&db_stats.pages_written_back),
+           (unsigned long long)stats_counter(&db_stats.flushes));
+    printf("B+tree: %llu leaf splits, %llu internal splits, %llu root promotions, %llu leaf merges, "
+           "%llu internal merges, %llu cursor advances\n",
+           (unsigned long long)stats_counter(&db_stats.leaf_splits),
+           (unsigned long long)stats_counter(&db_stats.internal_splits),
+           (unsigned long long)stats_counter(&db_stats.root_promotions),
+           (unsigned long long)stats_counter(&db_stats.leaf_merges),
+           (unsigned long long)stats_counter(&db_stats.internal_merges),
+           (unsigned long long)stats_counter(&db_stats.cursor_advances));
+    if (db_config.warm_cache)
+        printf("Warm cache: %llu pages loaded after open\n", (unsigned long long)stats_counter(&db_stats.pages_warmed));
+    if (db_config.hot_keys_kb > 0)
+        printf("Hot key cache: %llu hits, %llu misses\n", (unsigned long long)stats_counter(&db_stats.hot_key_hits),
+               (unsigned long long)stats_counter(&db_stats.hot_key_misses));
+    printf("Write-ahead log: %llu commits (%llu bytes), %llu syncs, %llu checkpoints\n",
+           (unsigned long long)stats_counter(&db_stats.wal_commits),
+           (unsigned long long)stats_counter(&db_stats.wal_bytes_written),
+           (unsigned long long)stats_counter(&db_stats.wal_syncs),
+           (unsigned long long)stats_counter(&db_stats.checkpoints));
+    printf("Latency     count     avg us   p50 us   p99 us  p999 us     max us\n");
+    for (uint32_t type = 0; type < STATS_STATEMENT_TYPES; type++)
+    {
+        LatencyHistogram copy;
+        LatencyHistogram *histogram = &copy;
+        stats_read_histogram(type, histogram);
+        // Percentiles are bucket upper bounds (powers of two, the maximum in the highest), average and maximum exact
+        printf("%-8s %8llu %10.2f %8llu %8llu %8llu %10.2f\n", STATS_STATEMENT_NAMES[type],
+               (unsigned long long)histogram->count,
+               histogram->count ? histogram->total_ns / 1000.0 / histogram->count : 0.0,
+               (unsigned long long)stats_percentile_us(histogram, 50.0),
+               (unsigned long long)stats_percentile_us(histogram, 99.0),
+               (unsigned long long)stats_percentile_us(histogram, 99.9),
+               histogram->max_ns / 1000.0);
+    }
+}
+
+/*
+Prints every counter as one JSON object on a single line, for monitoring scripts. Histogram buckets are
+raw counts, bucket i holds statements that took less than 2^i microseconds (and at least 2^(i-1)).
+*/
+static void stats_print_json()
+{
+    const struct
+    {
+        const char *name;
+        uint64_t value;
+    } counters[] = {
+        {"page_hits", stats_counter(&db_stats.page_hits)},
+        {"page_misses", stats_counter(&db_stats.page_misses)},
+        {"pages_read", stats_counter(&db_stats.pages_read)},
+        {"bytes_read", stats_counter(&db_stats.bytes_read)},
+        {"pages_verified", stats_counter(&db_stats.pages_verified)},
+        {"pages_written", stats_counter(&db_stats.pages_written)},
+        {"pages_written_back", stats_counter(&db_stats.pages_written_back)},
+        {"pages_read_ahead", stats_counter(&db_stats.pages_read_ahead)},
+        {"pages_warmed", stats_counter(&db_stats.pages_warmed)},
+        {"bytes_written", stats_counter(&db_stats.bytes_written)},
+        {"flushes", stats_counter(&db_stats.flushes)},
+        {"leaf_splits", stats_counter(&db_stats.leaf_splits)},
+        {"internal_splits", stats_counter(&db_stats.internal_splits)},
+        {"root_promotions", stats_counter(&db_stats.root_promotions)},
+        {"leaf_merges", stats_counter(&db_stats.leaf_merges)},
+        {"internal_merges", stats_counter(&db_stats.internal_merges)},
+        {"cursor_advances", stats_counter(&db_stats.cursor_advances)},
+        {"hot_key_hits", stats_counter(&db_stats.hot_key_hits)},
+        {"hot_key_misses", stats_counter(&db_stats.hot_key_misses)},
+        {"page_versions", stats_counter(&db_stats.page_versions)},
+        {"wal_commits", stats_counter(&db_stats.wal_commits)},
+        {"wal_bytes_written", stats_counter(&db_stats.wal_bytes_written)},
+        {"wal_syncs", stats_counter(&db_stats.wal_syncs)},
+        {"checkpoints", stats_counter(&db_stats.checkpoints)},
+    };
+
+    printf("{");
+    for (uint32_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+        printf("\"%s\":%llu,", counters[i].name, (unsigned long long)counters[i].value);
+    printf("\"latency\":{");
+    for (uint32_t type = 0; type < STATS_STATEMENT_TYPES; type++)
+    {
+        LatencyHistogram copy;
+        LatencyHistogram *histogram = &copy;
+        stats_read_histogram(type, histogram);
+        printf("%s\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"max_ns\":%llu,\"buckets\":[", type ? "," : "",
+               STATS_STATEMENT_NAMES[type], (unsigned long long)histogram->count,
+               (unsigned long long)histogram->total_ns, (unsigned long long)histogram->max_ns);
+        for (uint32_t bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+            printf("%s%llu", bucket ? "," : "", (unsigned long long)histogram->buckets[bucket]);
+        printf("]}");
+    }
+    printf("}}\n");
+}
+
+/**
+ * @brief Implements the `.stats` meta command.
+ *
+ *     .stats        counters and latency histograms in readable form
+ *     .stats json   the same as a single line of JSON
+ *     .stats reset  sets everything back to zero
+ *
+ * @param argument Text after ".stats ", empty for the plain command.
+ *
+ * @return META_COMMAND_SUCCESS, or META_COMMAND_UNRECOGNIZED_COMMAND for an unknown argument.
+ */
+MetaCommandResult stats_command(const char *argument)
+{
+    if (strcmp(argument, "") == 0)
+        stats_print_text();
+    else if (strcmp(argument, "json") == 0)
+        stats_print_json();
+    else if (strcmp(argument, "reset") == 0)
+        memset(&db_stats, 0, sizeof(db_stats));
+    else
+        return META_COMMAND_UNRECOGNIZED_COMMAND;
+    return META_COMMAND_SUCCESS;
+}
@@ -5,11 +5,10 @@ void print_constant()
     printf("ROW_SIZE: %d\n", ROW_SIZE);
     printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
     printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
-    printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
-    printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_SPACE_FOR_CELL);
-    printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELL);
-    printf("LEAF_NODE_LEFT_SPLIT_COUNT: %d\n", LEAF_NODE_LEFT_SPLIT_COUNT);
-    printf("LEAF_NODE_RIGHT_SPLIT_COUNT: %d\n", LEAF_NODE_RIGHT_SPLIT_COUNT);
+    printf("LEAF_NODE_SLOT_SIZE: %d\n", (int)LEAF_NODE_SLOT_SIZE);
+    printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", (int)LEAF_NODE_SPACE_FOR_CELL);
+    printf("LEAF_NODE_MAX_CELL_SPACE: %d\n", (int)LEAF_NODE_MAX_CELL_SPACE);
+    printf("LEAF_NODE_MIN_FILL: %d\n", (int)LEAF_NODE_MIN_FILL);
 }
 
 void indent(uint32_t level)
@@ -38,8 +37,10 @@ void print_tree(Pager *pager, uint32_t page_num, uint32_t indentation_level)
         for (uint32_t i = 0; i < num_keys; i++)
         {
             indent(indentation_level + 1);
-            printf("- %d\n", *leaf_node_key(node, i));
+            printf("- %d\n", leaf_node_key(node, i));
         }
+        // Nothing above this leaf holds on to its page pointer, so large trees fit through a small pool
+        pager_release_pages(pager);
         break;
     case (INTERNAL_NODE):
         num_keys = *internal_node_num_keys(node);
@@ -51,6 +52,7 @@ void print_tree(Pager *pager, uint32_t page_num, uint32_t indentation_level)
             {
                 child = *internal_node_child(node, i);
                 print_tree(pager, child, indentation_level + 1);
+                node = get_page(pager, page_num); // the recursion may have released our page
 
                 indent(indentation_level + 1);
                 printf("- key %d\n", *internal_node_key(node, i));
@@ -59,5 +61,9 @@ void print_tree(Pager *pager, uint32_t page_num, uint32_t indentation_level)
             print_tree(pager, child, indentation_level + 1);
         }
         break;
+    case (FREE_NODE):
+        // Reached from a parent, so a page was freed while the tree still points to it
+        printf("Tree is corrupted, page %u is on the freelist\n", page_num);
+        exit(EXIT_FAILURE);
     }
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "constants.h"
+
+/*
+Explicit transactions. Without them every statement commits on its own. Between begin and commit the
+statements only change pages in the buffer pool, the pager keeps those pages resident and away from the
+database file (see pager_begin_transaction()). Commit then logs one image of every changed page and
+writes the log once, rollback throws the pages away without any I/O.
+*/
+
+ExecuteResult transaction_begin(Table *table)
+{
+    if (table->pager->in_transaction)
+        return EXECUTE_TRANSACTION_OPEN;
+    pager_begin_transaction(table->pager);
+    return EXECUTE_SUCCESS;
+}
+
+/**
+ * @brief Makes the changes of the open transaction permanent.
+ *
+ * With the write-ahead log the transaction becomes a single log write and commit record (synced by the
+ * group commit rules like any other commit), without it the changed pages are written to the database
+ * file right away.
+ *
+ * @return EXECUTE_SUCCESS or EXECUTE_NO_TRANSACTION.
+ */
+ExecuteResult transaction_commit(Table *table)
+{
+    Pager *pager = table->pager;
+    if (!pager->in_transaction)
+        return EXECUTE_NO_TRANSACTION;
+    // Under the pager mutex, a reader evicting a page in between would see it as committed
+    pager_lock(pager);
+    pager_commit_transaction(pager);
+    if (pager->wal != NULL)
+        wal_commit(pager);
+    else
+        pager_flush_dirty(pager);
+    pager_unlock(pager);
+    return EXECUTE_SUCCESS;
+}
+
+/**
+ * @brief Discards the changes of the open transaction.
+ *
+ * @return EXECUTE_SUCCESS or EXECUTE_NO_TRANSACTION.
+ */
+ExecuteResult transaction_rollback(Table *table)
+{
+    if (!table->pager->in_transaction)
+        return EXECUTE_NO_TRANSACTION;
+    pager_rollback_transaction(table->pager);
+    // The remembered right-most leaf may be a page the transaction created
+    table->rightmost_leaf_page_num = 0;
+    table->rightmost_max_key = 0;
+    // So may an index created by the transaction, the header tells which ones are left
+    index_load(table);
+    pager_release_pages(table->pager);
+    return EXECUTE_SUCCESS;
+}
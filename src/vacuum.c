@@ -0,0 +1,408 @@
+#include "constants.h"
+
+/*
+.vacuum compacts the table and its indexes in place, in two phases.
+
+Refill: the leaves of every tree are walked in key order and each one takes cells from the next leaf until it
+holds as much as a bulk load puts into a leaf (bulk_load_leaf_capacity()), see leaf_node_refill(). A next
+leaf that fits completely is merged and freed. Internal nodes are only changed by the splits and merges
+this causes, a leaf is only refilled from a next leaf under the same parent.
+
+Placing: the nodes are then moved to the front of the file in the order a scan visits them, the leaves of
+a tree one after another, then its internal nodes, then the next tree. Node i goes to page i + 1 (page 0 is
+the file header and the table's root page stays where it is, readers start there). A node in the way is
+first moved to an unused page after that region. Every move fixes the pointer in the parent (or the
+index root in the header), the parent pointers of an internal node's children and the next_leaf of the
+previous leaf. Afterwards the next_leaf links of a tree point to the following page and the file is cut
+back to the pages still in use, the unused pages left below that go back on the freelist.
+
+Both phases consist of small write operations, readers keep running in between and see consistent trees
+through their snapshots, the old page of a moved node keeps the version they read. The operations are
+committed in batches of VACUUM_COMMIT_PAGES changed pages, fewer when the buffer pool is small: pages
+changed since the last commit can not be evicted. The freelist is emptied before the first move, since moves
+write over free pages, so a crash in the middle loses the free pages (not the data) until the next
+.vacuum, which finds the unused pages again. `.vacuum N` stops after N refills and moves, running it again
+continues where it stopped: leaves already full and nodes already in place are skipped.
+*/
+
+// Ends an operation that changed `pages` pages and commits the batch once it is big enough.
+static void vacuum_changed(Vacuum *vacuum, uint32_t pages)
+{
+    Pager *pager = vacuum->table->pager;
+    pager_release_pages(pager);
+    vacuum->uncommitted += pages;
+    if (vacuum->uncommitted >= VACUUM_COMMIT_PAGES || vacuum->uncommitted >= pager->num_frames / 4)
+    {
+        wal_commit(pager);
+        vacuum->uncommitted = 0;
+    }
+}
+
+// Ends a refill or move. Returns false once the run used up its budget.
+static bool vacuum_step(Vacuum *vacuum, uint32_t pages)
+{
+    vacuum_changed(vacuum, pages);
+    vacuum->steps++;
+    return vacuum->steps < vacuum->budget;
+}
+
+// Refills the leaves of one tree from left to right, false when the budget ran out.
+static bool vacuum_refill_tree(Vacuum *vacuum, Table *tree)
+{
+    Pager *pager = tree->pager;
+    uint32_t capacity = bulk_load_leaf_capacity();
+    Snapshot snapshot;
+    pager_open_snapshot(pager, &snapshot);
+
+    // Leaves are read first, only one that takes cells is fetched for writing
+    uint32_t page_num = tree->root_page_num;
+    PageVersion *version;
+    void *node = pager_fetch_snapshot(pager, page_num, &snapshot, &version);
+    while (get_node_type(node) == INTERNAL_NODE)
+    {
+        uint32_t child_page_num = *internal_node_child(node, 0);
+        pager_release_snapshot(pager, page_num, version);
+        page_num = child_page_num;
+        node = pager_fetch_snapshot(pager, page_num, &snapshot, &version);
+    }
+    while (page_num != 0)
+    {
+        bool worth_refilling = leaf_node_used_space(node) < capacity && *leaf_node_next_leaf(node) != 0;
+        uint32_t next_page_num = *leaf_node_next_leaf(node);
+        pager_release_snapshot(pager, page_num, version);
+        if (worth_refilling)
+        {
+            if (leaf_node_refill(tree, &page_num, capacity))
+            {
+                vacuum->refilled++;
+                if (!vacuum_step(vacuum, 3))
+                    break;
+            }
+            else
+                pager_release_pages(pager);
+        }
+        else
+            page_num = next_page_num;
+        if (page_num != 0)
+            node = pager_fetch_snapshot(pager, page_num, &snapshot, &version);
+    }
+    pager_close_snapshot(pager, &snapshot);
+    return vacuum->steps < vacuum->budget;
+}
+
+/*
+Appends the nodes of one tree to the plan: its leaves in key order, then its internal nodes level by level
+(the root left out when it has to stay). prev_leaf is filled in and the next_leaf chain is checked against
+the tree on the way.
+*/
+static void vacuum_plan_tree(Vacuum *vacuum, uint32_t root_page_num, bool place_root)
+{
+    Pager *pager = vacuum->table->pager;
+    Snapshot snapshot;
+    pager_open_snapshot(pager, &snapshot);
+
+    // Breadth first, every leaf is on the last level, so the leaves come last and in key order
+    uint32_t capacity = 64;
+    uint32_t *queue = malloc(sizeof(uint32_t) * capacity);
+    uint32_t queue_length = 1;
+    uint32_t first_leaf = UINT32_MAX;
+    queue[0] = root_page_num;
+    for (uint32_t i = 0; i < queue_length; i++)
+    {
+        PageVersion *version;
+        void *node = pager_fetch_snapshot(pager, queue[i], &snapshot, &version);
+        if (get_node_type(node) == INTERNAL_NODE)
+        {
+            uint32_t num_keys = *internal_node_num_keys(node);
+            if (queue_length + num_keys + 1 > capacity)
+            {
+                while (queue_length + num_keys + 1 > capacity)
+                    capacity *= 2;
+                queue = realloc(queue, sizeof(uint32_t) * capacity);
+            }
+            for (uint32_t child = 0; child <= num_keys; child++)
+                queue[queue_length++] = *internal_node_child(node, child);
+        }
+        else
+        {
+            if (first_leaf == UINT32_MAX)
+                first_leaf = i;
+            uint32_t expected = i + 1 < queue_length ? queue[i + 1] : 0;
+            if (*leaf_node_next_leaf(node) != expected)
+            {
+                printf("Leaf %u does not link to the next leaf of its tree\n", queue[i]);
+                exit(EXIT_FAILURE);
+            }
+            vacuum->prev_leaf[queue[i]] = i > first_leaf ? queue[i - 1] : 0;
+        }
+        pager_release_snapshot(pager, queue[i], version);
+    }
+    pager_close_snapshot(pager, &snapshot);
+
+    vacuum->nodes = realloc(vacuum->nodes, sizeof(uint32_t) * (vacuum->num_nodes + queue_length));
+    for (uint32_t n = 0; n < queue_length; n++)
+    {
+        // Leaves first, internal nodes after them
+        uint32_t i = n < queue_length - first_leaf ? first_leaf + n : n - (queue_length - first_leaf);
+        if (queue[i] == root_page_num && !place_root)
+            continue;
+        if (vacuum->owner[queue[i]] != VACUUM_NO_NODE)
+        {
+            printf("Page %u belongs to two nodes\n", queue[i]);
+            exit(EXIT_FAILURE);
+        }
+        vacuum->owner[queue[i]] = vacuum->num_nodes;
+        vacuum->nodes[vacuum->num_nodes++] = queue[i];
+    }
+    free(queue);
+}
+
+// Page node i of the plan is placed at.
+static uint32_t vacuum_target(Vacuum *vacuum, uint32_t i)
+{
+    uint32_t page_num = i + 1;
+    return page_num >= vacuum->table->root_page_num ? page_num + 1 : page_num;
+}
+
+// An unused page after the region being placed, a new one at the end of the file when there is none.
+static uint32_t vacuum_spare(Vacuum *vacuum)
+{
+    if (vacuum->num_spare > 0)
+        return vacuum->spare[--vacuum->num_spare];
+    uint32_t page_num = vacuum->table->pager->num_pages;
+    if (page_num >= vacuum->num_pages)
+    {
+        printf("Vacuum ran out of spare pages\n");
+        exit(EXIT_FAILURE);
+    }
+    return page_num;
+}
+
+/*
+Moves the node in page `from` to the unused page `to` and points everything that referenced it there.
+Returns the number of pages changed.
+*/
+static uint32_t vacuum_move(Vacuum *vacuum, uint32_t from, uint32_t to)
+{
+    Table *table = vacuum->table;
+    Pager *pager = table->pager;
+    void *source = get_page(pager, from);
+    void *destination = get_page(pager, to);
+    memcpy(destination, source, PAGE_SIZE);
+    pager_mark_dirty(pager, to);
+    uint32_t pages = 3; // both pages and the parent or header
+
+    if (is_root_node(destination))
+    {
+        // Only index roots move, readers find them in the header as of their snapshot
+        void *header = get_page(pager, HEADER_PAGE_NUM);
+        for (uint32_t column = 0; column < INDEX_NONE; column++)
+        {
+            if (table->index_roots[column] != from)
+                continue;
+            header_index_roots(header)[column] = to;
+            pager_mark_dirty_range(pager, HEADER_PAGE_NUM, HEADER_INDEX_ROOTS_OFFSET + column * sizeof(uint32_t),
+                                   sizeof(uint32_t));
+            table->index_roots[column] = to;
+        }
+    }
+    else
+    {
+        uint32_t parent_page_num = *node_parent(destination);
+        void *parent = get_page(pager, parent_page_num);
+        uint32_t *child = internal_node_child(parent, internal_node_child_index(parent, from));
+        *child = to;
+        pager_mark_dirty_range(pager, parent_page_num, (uint32_t)((char *)child - (char *)parent), sizeof(uint32_t));
+    }
+
+    if (get_node_type(destination) == INTERNAL_NODE)
+    {
+        for (uint32_t i = 0; i <= *internal_node_num_keys(destination); i++)
+        {
+            uint32_t child_page_num = *internal_node_child(destination, i);
+            *node_parent(get_page(pager, child_page_num)) = to;
+            pager_mark_dirty_range(pager, child_page_num, PARENT_POINTER_OFFSET, PARENT_POINTER_SIZE);
+            pages++;
+        }
+    }
+    else
+    {
+        uint32_t prev_page_num = vacuum->prev_leaf[from];
+        if (prev_page_num != 0)
+        {
+            *leaf_node_next_leaf(get_page(pager, prev_page_num)) = to;
+            pager_mark_dirty_range(pager, prev_page_num, LEAF_NODE_NEXT_LEAF_OFFSET, LEAF_NODE_NEXT_LEAF_SIZE);
+            pages++;
+        }
+        uint32_t next_page_num = *leaf_node_next_leaf(destination);
+        if (next_page_num != 0)
+            vacuum->prev_leaf[next_page_num] = to;
+        vacuum->prev_leaf[to] = prev_page_num;
+    }
+
+    // Snapshots that still see the node at its old page read the version preserved here
+    memset(source, 0, PAGE_SIZE);
+    set_node_type(source, FREE_NODE);
+    pager_mark_dirty(pager, from);
+    pager_new_page_epoch(pager);
+
+    uint32_t node = vacuum->owner[from];
+    vacuum->nodes[node] = to;
+    vacuum->owner[to] = node;
+    vacuum->owner[from] = VACUUM_NO_NODE;
+    if (from >= vacuum->region_end)
+        vacuum->spare[vacuum->num_spare++] = from;
+    vacuum->moved++;
+    return pages;
+}
+
+// Places every node of the plan at its page, false when the budget ran out.
+static bool vacuum_place(Vacuum *vacuum)
+{
+    Pager *pager = vacuum->table->pager;
+    // Moves overwrite free pages, the freelist is rebuilt by vacuum_finish()
+    void *header = get_page(pager, HEADER_PAGE_NUM);
+    if (*header_freelist_head(header) != 0)
+    {
+        *header_freelist_head(header) = 0;
+        *header_freelist_count(header) = 0;
+        pager_mark_dirty_range(pager, HEADER_PAGE_NUM, HEADER_FREELIST_HEAD_OFFSET, 2 * sizeof(uint32_t));
+    }
+    for (uint32_t i = 0; i < vacuum->num_nodes; i++)
+    {
+        uint32_t target = vacuum_target(vacuum, i);
+        if (vacuum->nodes[i] == target)
+            continue;
+        uint32_t pages = 0;
+        if (vacuum->owner[target] != VACUUM_NO_NODE)
+            pages += vacuum_move(vacuum, target, vacuum_spare(vacuum));
+        pages += vacuum_move(vacuum, vacuum->nodes[i], target);
+        if (!vacuum_step(vacuum, pages))
+            return false;
+    }
+    pager_release_pages(pager);
+    return true;
+}
+
+/*
+Cuts the file back after the last page in use and puts the unused pages below it on the freelist, the
+lowest one first so new nodes fill the gaps from the front.
+*/
+static void vacuum_finish(Vacuum *vacuum)
+{
+    Table *table = vacuum->table;
+    Pager *pager = table->pager;
+    uint32_t end = table->root_page_num + 1;
+    for (uint32_t i = 0; i < vacuum->num_nodes; i++)
+        if (vacuum->nodes[i] + 1 > end)
+            end = vacuum->nodes[i] + 1;
+    wal_commit(pager);
+    if (!pager_truncate(pager, end))
+        end = pager->num_pages; // a reader holds a page past the end, next time
+
+    for (uint32_t page_num = end - 1; page_num > HEADER_PAGE_NUM; page_num--)
+    {
+        if (page_num == table->root_page_num || (page_num < vacuum->num_pages && vacuum->owner[page_num] != VACUUM_NO_NODE))
+            continue;
+        free_page(pager, page_num);
+        vacuum_changed(vacuum, 1);
+    }
+    wal_commit(pager);
+}
+
+/**
+ * @brief Implements the `.vacuum [steps]` meta command, see the comment at the top of vacuum.c.
+ *
+ * @param table The open table, outside of a transaction.
+ * @param argument "" or the most refills and moves to make, a later .vacuum continues.
+ *
+ * @return META_COMMAND_SUCCESS, META_COMMAND_UNRECOGNIZED_COMMAND for a malformed argument.
+ */
+MetaCommandResult vacuum_command(Table *table, const char *argument)
+{
+    Pager *pager = table->pager;
+    Vacuum vacuum = {0};
+    vacuum.table = table;
+    vacuum.budget = UINT32_MAX;
+    if (strcmp(argument, "") != 0)
+    {
+        char *end;
+        unsigned long budget = strtoul(argument, &end, 10);
+        if (*end != '\0' || budget == 0 || budget >= UINT32_MAX)
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        vacuum.budget = (uint32_t)budget;
+    }
+    if (pager->in_transaction)
+    {
+        printf("Vacuum can not run inside a transaction.\n");
+        return META_COMMAND_SUCCESS;
+    }
+    if (backup_running(table))
+    {
+        printf("Vacuum can not run while a backup is copying.\n");
+        return META_COMMAND_SUCCESS;
+    }
+    uint32_t pages_before = pager->num_pages;
+
+    Table trees[INDEX_NONE + 1];
+    uint32_t num_trees = 0;
+    trees[num_trees++] = *table;
+    for (uint32_t column = 0; column < INDEX_NONE; column++)
+    {
+        if (table->index_roots[column] != 0)
+        {
+            Table tree = {.pager = pager, .root_page_num = table->index_roots[column]};
+            trees[num_trees++] = tree;
+        }
+    }
+    bool done = true;
+    for (uint32_t i = 0; i < num_trees && done; i++)
+        done = vacuum_refill_tree(&vacuum, &trees[i]);
+    wal_commit(pager);
+
+    if (done)
+    {
+        vacuum.num_pages = pager->num_pages;
+        vacuum.owner = malloc(sizeof(uint32_t) * vacuum.num_pages);
+        vacuum.prev_leaf = calloc(vacuum.num_pages, sizeof(uint32_t));
+        for (uint32_t i = 0; i < vacuum.num_pages; i++)
+            vacuum.owner[i] = VACUUM_NO_NODE;
+        vacuum_plan_tree(&vacuum, table->root_page_num, false);
+        for (uint32_t column = 0; column < INDEX_NONE; column++)
+            if (table->index_roots[column] != 0)
+                vacuum_plan_tree(&vacuum, table->index_roots[column], true);
+        // Every node is pushed out of the way at most once, so the file grows by at most that many pages
+        uint32_t num_nodes = vacuum.num_nodes;
+        vacuum.num_pages += num_nodes + 1;
+        vacuum.owner = realloc(vacuum.owner, sizeof(uint32_t) * vacuum.num_pages);
+        vacuum.prev_leaf = realloc(vacuum.prev_leaf, sizeof(uint32_t) * vacuum.num_pages);
+        for (uint32_t i = pager->num_pages; i < vacuum.num_pages; i++)
+        {
+            vacuum.owner[i] = VACUUM_NO_NODE;
+            vacuum.prev_leaf[i] = 0;
+        }
+
+        vacuum.region_end = num_nodes > 0 ? vacuum_target(&vacuum, num_nodes - 1) + 1 : 1;
+        vacuum.spare = malloc(sizeof(uint32_t) * (vacuum.num_pages + 1));
+        for (uint32_t page_num = pager->num_pages; page_num-- > vacuum.region_end;)
+            if (vacuum.owner[page_num] == VACUUM_NO_NODE && page_num != table->root_page_num)
+                vacuum.spare[vacuum.num_spare++] = page_num;
+        done = vacuum_place(&vacuum);
+        vacuum_finish(&vacuum);
+        free(vacuum.nodes);
+        free(vacuum.owner);
+        free(vacuum.prev_leaf);
+        free(vacuum.spare);
+    }
+    // A remembered leaf may have moved or been merged away
+    table->rightmost_leaf_page_num = 0;
+    table->rightmost_max_key = 0;
+
+    if (done)
+        printf("Vacuumed: %u leaves refilled, %u pages moved, %u pages before, %u after.\n", vacuum.refilled,
+               vacuum.moved, pages_before, pager->num_pages);
+    else
+        printf("Vacuum paused after %u steps (%u leaves refilled, %u pages moved), run it again to continue.\n",
+               vacuum.steps, vacuum.refilled, vacuum.moved);
+    return META_COMMAND_SUCCESS;
+}
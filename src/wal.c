@@ -0,0 +1,370 @@
+#include "constants.h"
+
+// Milliseconds from a monotonic clock, only differences between two calls are meaningful.
+static long long wal_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// FNV-1a over a block of bytes, continuing from a previous hash value (start with WAL_CHECKSUM_SEED).
+uint32_t wal_checksum(uint32_t hash, const void *data, uint32_t length)
+{
+    const uint8_t *bytes = data;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Appends raw bytes to the in-memory record buffer, growing it when needed.
+static void wal_buffer_append(Wal *wal, const void *data, uint32_t length)
+{
+    if (wal->buffer_length + length > wal->buffer_capacity)
+    {
+        while (wal->buffer_length + length > wal->buffer_capacity)
+            wal->buffer_capacity *= 2;
+        wal->buffer = realloc(wal->buffer, wal->buffer_capacity);
+    }
+    memcpy(wal->buffer + wal->buffer_length, data, length);
+    wal->buffer_length += length;
+}
+
+// Appends one record (header + payload) and folds it into the checksum of the running statement.
+static void wal_append_record(Wal *wal, WalRecordHeader *header, const void *payload)
+{
+    wal_buffer_append(wal, header, sizeof(WalRecordHeader));
+    wal->checksum = wal_checksum(wal->checksum, header, sizeof(WalRecordHeader));
+    if (header->type == WAL_RECORD_PAGE_RANGE)
+    {
+        wal_buffer_append(wal, payload, header->length);
+        wal->checksum = wal_checksum(wal->checksum, payload, header->length);
+    }
+}
+
+/*
+Applies the log to the database pages. Records are grouped by statement, a statement is only replayed once
+its commit record has been read and its checksum matches, so a torn tail left by a crash is ignored.
+The replayed pages are written to the database file by the checkpoint that follows in wal_open().
+*/
+static void wal_replay(Pager *pager, Wal *wal)
+{
+    off_t log_length = lseek(wal->file_descriptor, 0, SEEK_END);
+    if (log_length <= 0)
+        return;
+
+    char *log = malloc(log_length);
+    lseek(wal->file_descriptor, 0, SEEK_SET);
+    ssize_t bytes_read = read(wal->file_descriptor, log, log_length);
+    if (bytes_read != log_length)
+    {
+        printf("Error reading write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    off_t statement_start = 0; // first record of the statement being read
+    off_t position = 0;
+    uint32_t checksum = WAL_CHECKSUM_SEED;
+    uint32_t replayed = 0;
+    while (position + (off_t)sizeof(WalRecordHeader) <= log_length)
+    {
+        WalRecordHeader header;
+        memcpy(&header, log + position, sizeof(WalRecordHeader));
+
+        if (header.type == WAL_RECORD_COMMIT)
+        {
+            if (header.length != checksum)
+                break; // torn or corrupt statement, nothing after it can be trusted
+
+            checksum = WAL_CHECKSUM_SEED;
+            off_t record = statement_start;
+            // Statement is complete, copy its after-images into the pages
+            while (record < position)
+            {
+                WalRecordHeader range;
+                memcpy(&range, log + record, sizeof(WalRecordHeader));
+                void *page = get_page(pager, range.page_num);
+                memcpy(page + range.offset, log + record + sizeof(WalRecordHeader), range.length);
+                pager_mark_dirty(pager, range.page_num);
+                record += sizeof(WalRecordHeader) + range.length;
+            }
+            pager_release_pages(pager);
+            position += sizeof(WalRecordHeader);
+            statement_start = position;
+            replayed++;
+            continue;
+        }
+
+        if (header.type != WAL_RECORD_PAGE_RANGE || header.offset + header.length > PAGE_SIZE ||
+            position + (off_t)sizeof(WalRecordHeader) + header.length > log_length)
+            break;
+        checksum = wal_checksum(checksum, &header, sizeof(WalRecordHeader));
+        checksum = wal_checksum(checksum, log + position + sizeof(WalRecordHeader), header.length);
+        position += sizeof(WalRecordHeader) + header.length;
+    }
+    free(log);
+
+    if (replayed > 0)
+        printf("Recovered %u commits from the write-ahead log.\n", replayed);
+}
+
+/**
+ * @brief Opens (or creates) the write-ahead log that belongs to a database file.
+ *
+ * The log lives next to the database as "<db_filename>-wal". If it still holds
+ * records from a previous session that did not close cleanly they are replayed
+ * into the pager and folded into the database file with a checkpoint.
+ *
+ * @param pager The pager of the database the log belongs to, pager->wal is set here.
+ * @param db_filename Name of the database file.
+ *
+ * @return The opened Wal.
+ */
+Wal *wal_open(Pager *pager, const char *db_filename)
+{
+    char *filename = malloc(strlen(db_filename) + 5);
+    sprintf(filename, "%s-wal", db_filename);
+    int fd = open(filename, O_RDWR | O_CREAT | O_BINARY, S_IWUSR | S_IRUSR);
+    free(filename);
+    if (fd == -1)
+    {
+        printf("Unable to open the write-ahead log \n");
+        exit(EXIT_FAILURE);
+    }
+
+    Wal *wal = malloc(sizeof(Wal));
+    wal->file_descriptor = fd;
+    wal->buffer_capacity = 2 * PAGE_SIZE;
+    wal->buffer = malloc(wal->buffer_capacity);
+    wal->buffer_length = 0;
+    wal->pending_capacity = 16;
+    wal->pending_pages = malloc(sizeof(uint32_t) * wal->pending_capacity);
+    wal->num_pending = 0;
+    wal->checksum = WAL_CHECKSUM_SEED;
+    wal->file_length = 0;
+    wal->synced_length = 0;
+    wal->last_sync_ms = wal_now_ms();
+
+    // Replay before pager->wal is set, recovery must not log its own writes. The pages it reads may have
+    // been torn by the crash, their checksums are not trusted until the replayed images are written back.
+    pager->recovering = true;
+    wal_replay(pager, wal);
+    pager->recovering = false;
+    pager->wal = wal;
+    wal_checkpoint(pager);
+    return wal;
+}
+
+/**
+ * @brief Logs the new contents of a byte range of a page.
+ *
+ * Used by the hot paths (leaf_node_insert, execute_update, execute_delete) that know
+ * exactly which bytes they changed, so a statement logs a few hundred bytes instead
+ * of a whole page. Must be called after the bytes were written.
+ *
+ * @param pager The pager that owns the page, it must have a write-ahead log.
+ * @param page_num Page that was modified, it must be resident.
+ * @param offset First modified byte within the page.
+ * @param length Number of modified bytes.
+ */
+void wal_log_range(Pager *pager, uint32_t page_num, uint32_t offset, uint32_t length)
+{
+    Wal *wal = pager->wal;
+    Frame *frame = pager_frame(pager, page_num);
+    WalRecordHeader header = {WAL_RECORD_PAGE_RANGE, page_num, offset, length};
+    wal_append_record(wal, &header, frame->data + offset);
+    frame->wal_lsn = wal->file_length + wal->buffer_length;
+}
+
+/*
+Remembers that a page was modified in a way that is not described by a range record (splits, new roots,
+internal nodes). Its full image is logged by wal_capture_pending() once the operation is done with it.
+*/
+void wal_note_page(Pager *pager, uint32_t page_num)
+{
+    Wal *wal = pager->wal;
+    Frame *frame = pager_frame(pager, page_num);
+    if (frame->wal_pending)
+        return;
+    frame->wal_pending = true;
+    if (wal->num_pending == wal->pending_capacity)
+    {
+        wal->pending_capacity *= 2;
+        wal->pending_pages = realloc(wal->pending_pages, sizeof(uint32_t) * wal->pending_capacity);
+    }
+    wal->pending_pages[wal->num_pending++] = page_num;
+}
+
+/*
+Logs a full image of every page noted with wal_note_page(). Called by pager_release_pages() while those
+pages are still protected by the running operation, so they are guaranteed to be resident.
+*/
+void wal_capture_pending(Pager *pager)
+{
+    Wal *wal = pager->wal;
+    for (uint32_t i = 0; i < wal->num_pending; i++)
+    {
+        uint32_t page_num = wal->pending_pages[i];
+        Frame *frame = pager_frame(pager, page_num);
+        WalRecordHeader header = {WAL_RECORD_PAGE_RANGE, page_num, 0, PAGE_SIZE};
+        wal_append_record(wal, &header, frame->data);
+        frame->wal_pending = false;
+        frame->wal_lsn = wal->file_length + wal->buffer_length;
+    }
+    wal->num_pending = 0;
+}
+
+/**
+ * @brief Makes the log durable up to a given offset.
+ *
+ * The writer syncs its commits without the pager mutex while readers may sync under it to evict a
+ * dirty page, so the synced length only ever moves forward, atomically.
+ *
+ * @param wal The write-ahead log.
+ * @param lsn Log offset that must be on disk, nothing happens if it already is.
+ */
+void wal_sync(Wal *wal, off_t lsn)
+{
+    if (lsn <= __atomic_load_n(&wal->synced_length, __ATOMIC_ACQUIRE))
+        return;
+    off_t length = wal->file_length; // everything written before the fdatasync is durable after it
+    if (fdatasync(wal->file_descriptor) == -1)
+    {
+        printf("Error syncing write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    off_t synced = __atomic_load_n(&wal->synced_length, __ATOMIC_ACQUIRE);
+    while (synced < length &&
+           !__atomic_compare_exchange_n(&wal->synced_length, &synced, length, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        ;
+    __atomic_store_n(&wal->last_sync_ms, wal_now_ms(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&db_stats.wal_syncs, 1, __ATOMIC_RELAXED);
+}
+
+/*
+Syncs the log once no commit did for a group commit window, so the last commits of a burst do not wait for
+the next one to become durable. The background write-back calls it with the pager mutex held (that keeps
+checkpoints out) before it writes pages, which have to wait for the sync of their records.
+*/
+void wal_sync_lagging(Wal *wal)
+{
+    // The writer's commits move synced_length forward without the mutex (wal_sync()), the log length only
+    // changes under it
+    off_t length = __atomic_load_n(&wal->file_length, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&wal->synced_length, __ATOMIC_ACQUIRE) < length &&
+        wal_now_ms() - __atomic_load_n(&wal->last_sync_ms, __ATOMIC_RELAXED) >= db_config.wal_group_commit_ms)
+        wal_sync(wal, length);
+}
+
+/**
+ * @brief Ends the running statement in the write-ahead log.
+ *
+ * Appends a commit record and writes the statement's records to the log with one
+ * sequential write. The write survives a crash of the process, the fdatasync that
+ * also protects against power loss is shared by every commit inside the group commit
+ * window (db_config.wal_group_commit_ms). Once the log has grown past
+ * db_config.wal_checkpoint_bytes it is folded back into the database file.
+ *
+ * @param pager The pager of the database, nothing happens without a log or records.
+ */
+void wal_commit(Pager *pager)
+{
+    Wal *wal = pager->wal;
+    if (wal == NULL || pager->in_transaction)
+        return; // an open transaction is committed as a whole by transaction_commit()
+    // Evictions by reader threads read the log length and sync the log
+    pager_lock(pager);
+    wal_capture_pending(pager);
+    if (wal->buffer_length == 0)
+    {
+        pager_unlock(pager);
+        return; // read only statement
+    }
+
+    WalRecordHeader commit = {WAL_RECORD_COMMIT, 0, 0, wal->checksum};
+    wal_buffer_append(wal, &commit, sizeof(WalRecordHeader));
+
+    ssize_t byte_written = pwrite(wal->file_descriptor, wal->buffer, wal->buffer_length, wal->file_length);
+    if (byte_written != (ssize_t)wal->buffer_length)
+    {
+        printf("Error writing write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    wal->file_length += wal->buffer_length;
+    db_stats.wal_commits++;
+    db_stats.wal_bytes_written += wal->buffer_length;
+    wal->buffer_length = 0;
+    wal->checksum = WAL_CHECKSUM_SEED;
+    off_t length = wal->file_length;
+    pager_unlock(pager);
+
+    // Readers keep fetching pages during the fdatasync, only the writer changes the log length
+    if (wal_now_ms() - __atomic_load_n(&wal->last_sync_ms, __ATOMIC_RELAXED) >= db_config.wal_group_commit_ms)
+        wal_sync(wal, length);
+
+    if (length >= db_config.wal_checkpoint_bytes)
+    {
+        pager_lock(pager);
+        wal_checkpoint(pager);
+        pager_unlock(pager);
+    }
+}
+
+// Forgets the records of the running transaction, nothing of it has been written to the log yet.
+void wal_rollback(Wal *wal)
+{
+    wal->buffer_length = 0;
+    wal->checksum = WAL_CHECKSUM_SEED;
+    wal->num_pending = 0;
+}
+
+/**
+ * @brief Folds the write-ahead log back into the database file.
+ *
+ * Syncs the log, writes every dirty page to the database file, syncs the database
+ * file and only then empties the log. A crash at any point leaves either the old
+ * log (replayed again on the next open) or a database file that already holds
+ * everything the log described.
+ *
+ * @param pager The pager of the database.
+ */
+void wal_checkpoint(Pager *pager)
+{
+    Wal *wal = pager->wal;
+    db_stats.checkpoints++;
+    wal_sync(wal, wal->file_length);
+    pager_flush_dirty(pager);
+    if (fdatasync(pager->file_descriptor) == -1)
+    {
+        printf("Error syncing database: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(wal->file_descriptor, 0) == -1)
+    {
+        printf("Error truncating write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    wal->file_length = 0;
+    __atomic_store_n(&wal->synced_length, 0, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < pager->num_frames; i++)
+        pager->frames[i].wal_lsn = 0;
+}
+
+/*
+Checkpoints one last time so the next open has nothing to replay, then closes the log and frees it.
+Called by pager_close() before the pager flushes and frees its frames.
+*/
+void wal_close(Pager *pager)
+{
+    Wal *wal = pager->wal;
+    wal_commit(pager);
+    wal_checkpoint(pager);
+    close(wal->file_descriptor);
+    free(wal->buffer);
+    free(wal->pending_pages);
+    free(wal);
+    pager->wal = NULL;
+}
@@ -0,0 +1,146 @@
+#include "constants.h"
+
+/*
+The warm list (--warm-cache). A database opened cold misses on every page its first statements touch, one
+read at a time. With the option db_close() writes the numbers of the pages resident in the buffer pool to
+"<db_filename>-warm", the pages that were referenced since CLOCK last passed them first, and db_open()
+loads them again on a thread of its own while the first statements already run. The thread announces the
+whole list to the OS at once with posix_fadvise(POSIX_FADV_WILLNEED), runs of consecutive pages with one
+call, so the reads happen in parallel, then fetches each page into the pool the way a reader does (see
+pager_fetch_snapshot()), which by then mostly copies from the OS cache. With direct I/O there is nothing to
+announce and the pages are read one after another.
+
+The list is only a hint: it is not synced, pages past the end of the file are skipped and a list from
+another page size or a damaged one is ignored. No more pages than the pool holds are loaded.
+
+File layout: magic (WARM_CACHE_MAGIC), page size, number of pages, then the page numbers, all 32 bit.
+*/
+
+static int warm_cache_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void *warm_cache_main(void *argument)
+{
+    WarmCache *warm_cache = argument;
+    Pager *pager = warm_cache->pager;
+    qsort(warm_cache->pages, warm_cache->num_pages, sizeof(uint32_t), warm_cache_compare);
+#ifdef POSIX_FADV_WILLNEED
+    for (uint32_t i = 0; i < warm_cache->num_pages && !pager->direct_io;)
+    {
+        uint32_t run = 1;
+        while (i + run < warm_cache->num_pages && warm_cache->pages[i + run] == warm_cache->pages[i] + run)
+            run++;
+        posix_fadvise(pager->file_descriptor, (off_t)warm_cache->pages[i] * PAGE_SIZE, (off_t)run * PAGE_SIZE,
+                      POSIX_FADV_WILLNEED);
+        i += run;
+    }
+#endif
+    Snapshot snapshot;
+    pager_open_snapshot(pager, &snapshot);
+    for (uint32_t i = 0; i < warm_cache->num_pages && !__atomic_load_n(&warm_cache->stop, __ATOMIC_RELAXED); i++)
+    {
+        PageVersion *version;
+        pager_fetch_snapshot(pager, warm_cache->pages[i], &snapshot, &version);
+        pager_release_snapshot(pager, warm_cache->pages[i], version);
+        __atomic_add_fetch(&db_stats.pages_warmed, 1, __ATOMIC_RELAXED);
+    }
+    pager_close_snapshot(pager, &snapshot);
+    return NULL;
+}
+
+// Reads the warm list, false when there is none or it does not fit the file.
+static bool warm_cache_read(WarmCache *warm_cache)
+{
+    Pager *pager = warm_cache->pager;
+    FILE *file = fopen(warm_cache->path, "rb");
+    if (file == NULL)
+        return false;
+    uint32_t header[3];
+    bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == WARM_CACHE_MAGIC &&
+              header[1] == PAGE_SIZE && header[2] <= UINT32_MAX / sizeof(uint32_t);
+    if (ok)
+    {
+        uint32_t wanted = header[2] < pager->num_frames ? header[2] : pager->num_frames;
+        warm_cache->pages = malloc(sizeof(uint32_t) * (wanted > 0 ? wanted : 1));
+        ok = fread(warm_cache->pages, sizeof(uint32_t), wanted, file) == wanted;
+        for (uint32_t i = 0; ok && i < wanted; i++)
+        {
+            if (warm_cache->pages[i] < pager->num_pages)
+                warm_cache->pages[warm_cache->num_pages++] = warm_cache->pages[i];
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+/**
+ * @brief Starts loading the pages of the warm list left by the last close, called by db_open().
+ *
+ * @param pager The pager of the opened database, the write-ahead log is already replayed.
+ * @param db_filename The database file, the list lives next to it as "<db_filename>-warm".
+ *
+ * @return The warm list, give it to warm_cache_close() before the pager closes.
+ */
+WarmCache *warm_cache_open(Pager *pager, const char *db_filename)
+{
+    WarmCache *warm_cache = calloc(1, sizeof(WarmCache));
+    warm_cache->pager = pager;
+    warm_cache->path = malloc(strlen(db_filename) + strlen("-warm") + 1);
+    sprintf(warm_cache->path, "%s-warm", db_filename);
+    if (warm_cache_read(warm_cache) && warm_cache->num_pages > 0)
+    {
+        if (pthread_create(&warm_cache->thread, NULL, warm_cache_main, warm_cache) != 0)
+        {
+            printf("Unable to start the warm cache thread\n");
+            exit(EXIT_FAILURE);
+        }
+        warm_cache->started = true;
+    }
+    return warm_cache;
+}
+
+/*
+Stops the loading thread if it still runs, then writes the pages resident now as the next warm list and
+frees the WarmCache. Called by db_close() while the buffer pool is still open.
+*/
+void warm_cache_close(WarmCache *warm_cache)
+{
+    Pager *pager = warm_cache->pager;
+    if (warm_cache->started)
+    {
+        __atomic_store_n(&warm_cache->stop, true, __ATOMIC_RELAXED);
+        pthread_join(warm_cache->thread, NULL);
+    }
+
+    pager_lock(pager);
+    uint32_t *pages = malloc(sizeof(uint32_t) * (3 + pager->num_frames));
+    uint32_t num_pages = 0;
+    for (int referenced = 1; referenced >= 0; referenced--)
+    {
+        for (uint32_t i = 0; i < pager->num_frames; i++)
+        {
+            Frame *frame = &pager->frames[i];
+            if (frame->page_num != INVALID_PAGE_NUM && frame->page_num < pager->num_pages &&
+                frame->referenced == (referenced == 1))
+                pages[3 + num_pages++] = frame->page_num;
+        }
+    }
+    pager_unlock(pager);
+    pages[0] = WARM_CACHE_MAGIC;
+    pages[1] = PAGE_SIZE;
+    pages[2] = num_pages;
+
+    FILE *file = fopen(warm_cache->path, "wb");
+    if (file != NULL)
+    {
+        fwrite(pages, sizeof(uint32_t), 3 + num_pages, file);
+        fclose(file);
+    }
+    free(pages);
+    free(warm_cache->pages);
+    free(warm_cache->path);
+    free(warm_cache);
+}
@@ -1,12 +1,18 @@
+import os
+import shutil
 import subprocess
+import tempfile
 
 def run_script(commands):
     """Runs the database program with given commands and captures output."""
     output = []
+
+    # Every script starts from an empty database of its own, the log and warm list land next to it
+    directory = tempfile.mkdtemp()
     
     # Start the database program
     process = subprocess.Popen(
-        ["program.exe", "test"],  # No `./` on Windows
+        ["program.exe", os.path.join(directory, "test")],  # No `./` on Windows
         stdin=subprocess.PIPE,
         stdout=subprocess.PIPE,
         stderr=subprocess.PIPE,
@@ -21,6 +27,8 @@ def run_script(commands):
     # Read output lines
     output = process.stdout.readlines()
     process.stdout.close()
+    process.wait()
+    shutil.rmtree(directory, ignore_errors=True)
     
     return [line.strip() for line in output]
 
@@ -101,5 +109,81 @@ def test_duplicate_id():
     assert result == expected_output, f"Test Failed! Got: {result}"
     print("✅ Test Passed: Duplicate ID correctly detected!")
 
+def freed_leaves_script(first_deleted):
+    """Inserts ids 1..40 with rows large enough to fill several leaves, then deletes first_deleted..40 so leaves are freed."""
+    email = "e" * 200
+    script = ["insert %d user%d %s" % (i, i, email) for i in range(1, 41)]
+    script += ["delete where id=%d" % i for i in range(first_deleted, 41)]
+    return script
+
+def test_append_after_freed_rightmost_leaf():
+    """An append after the right-most leaf was freed and reused by an index must not go into the index page."""
+    script = freed_leaves_script(36)
+    script += [
+    "create index on username",
+    "insert 2147483000 n14 x@y",
+    "select count(*)",
+    "select id where id >= 30",
+    ".exit"
+    ]
+
+    result = run_script(script)
+
+    # Output of the statements after the deletes
+    tail = result[result.index("crypto> (36)"):]
+    expected_output = [
+        "crypto> (36)",
+        "Statement executed.",
+        "crypto> (30)",
+        "(31)",
+        "(32)",
+        "(33)",
+        "(34)",
+        "(35)",
+        "(2147483000)",
+        "Statement executed.",
+        "crypto>",
+    ]
+
+    assert tail == expected_output, f"Test Failed! Got: {tail}"
+    print("✅ Test Passed: Append after a freed right-most leaf stays in the table!")
+
+def test_index_on_freed_pages():
+    """An index built after deletes freed leaves takes those pages, the table and the index must both stay intact."""
+    script = freed_leaves_script(10)
+    script += [
+    "create index on username",
+    "insert 41 user41 x@y",
+    "insert 42 user42 z@y",
+    "select count(*)",
+    "select where username = user41",
+    "select where username = user20",
+    "select id where id >= 8",
+    ".exit"
+    ]
+
+    result = run_script(script)
+
+    # Output of the statements after the deletes
+    tail = result[result.index("crypto> (11)"):]
+    expected_output = [
+        "crypto> (11)",
+        "Statement executed.",
+        "crypto> (41, user41, x@y)",
+        "Statement executed.",
+        "crypto> Statement executed.",
+        "crypto> (8)",
+        "(9)",
+        "(41)",
+        "(42)",
+        "Statement executed.",
+        "crypto>",
+    ]
+
+    assert tail == expected_output, f"Test Failed! Got: {tail}"
+    print("✅ Test Passed: Index built on freed pages finds new rows!")
+
 if __name__ == "__main__":
     test_duplicate_id()
+    test_append_after_freed_rightmost_leaf()
+    test_index_on_freed_pages()